@@ -256,4 +256,20 @@ static inline int cnd_wait(cnd_t *cnd, mtx_t *mtx)
 	return thrd_success;
 }
 
+
+struct pt_once {
+	pthread_once_t once;
+};
+typedef struct pt_once once_flag;
+
+#define ONCE_FLAG_INIT { PTHREAD_ONCE_INIT }
+
+static inline void call_once(once_flag *flag, void (*func)(void))
+{
+	if (!flag || !func)
+		return;
+
+	(void) pthread_once(&flag->once, func);
+}
+
 #endif /* __THREADS_H__ */
@@ -57,7 +57,7 @@ struct thrd_args {
 	void *arg;
 };
 
-static DWORD WINAPI thrd_routine(void *arg)
+static inline DWORD WINAPI thrd_routine(void *arg)
 {
 	struct thrd_args *args;
 	int result;
@@ -236,4 +236,38 @@ static inline int cnd_wait(cnd_t *cnd, mtx_t *mtx)
 	return thrd_success;
 }
 
+
+struct pt_once {
+	INIT_ONCE once;
+};
+typedef struct pt_once once_flag;
+
+#define ONCE_FLAG_INIT { INIT_ONCE_STATIC_INIT }
+
+static inline BOOL CALLBACK call_once_routine(PINIT_ONCE once, PVOID arg,
+					      PVOID *context)
+{
+	void (**func)(void);
+
+	(void) once;
+	(void) context;
+
+	func = (void (**)(void)) arg;
+	if (!func || !*func)
+		return FALSE;
+
+	(*func)();
+
+	return TRUE;
+}
+
+static inline void call_once(once_flag *flag, void (*func)(void))
+{
+	if (!flag || !func)
+		return;
+
+	(void) InitOnceExecuteOnce(&flag->once, call_once_routine,
+				   (PVOID) &func, NULL);
+}
+
 #endif /* __THREADS_H__ */
@@ -43,17 +43,23 @@
  * - Errors
  * - Configuration
  * - Packet encoder / decoder
+ * - PSB index
  * - Query decoder
  * - Traced image
  * - Instruction flow decoder
+ * - Block decoder
+ * - Merge decoder
  */
 
 
 
 struct pt_encoder;
 struct pt_packet_decoder;
+struct pt_psb_index;
 struct pt_query_decoder;
 struct pt_insn_decoder;
+struct pt_block_decoder;
+struct pt_merge_decoder;
 
 
 
@@ -460,7 +466,10 @@ enum pt_error_code {
 	pte_bad_lock,
 
 	/* The requested feature is not supported. */
-	pte_not_supported
+	pte_not_supported,
+
+	/* A file can't be read or written or has a bad format. */
+	pte_bad_file
 };
 
 
@@ -531,6 +540,20 @@ struct pt_errata {
 /** An unknown packet. */
 struct pt_packet_unknown;
 
+/** A segment of a trace that is split into several buffers.
+ *
+ * For example, the trace in a ring buffer that has wrapped around is given by
+ * two segments: the older trace from the current write position to the end of
+ * the buffer followed by the newer trace from the beginning of the buffer.
+ */
+struct pt_segment {
+	/** The segment's begin address. */
+	uint8_t *begin;
+
+	/** The segment's end address. */
+	uint8_t *end;
+};
+
 /** An Intel PT decoder configuration.
  */
 struct pt_config {
@@ -595,6 +618,73 @@ struct pt_config {
 	 * packets.
 	 */
 	uint8_t nom_freq;
+
+	/* Suspend decoding at the end of the trace buffer.
+	 *
+	 * This is meant for decoding trace while it is being collected
+	 * and the trace buffer is extended as new trace arrives.
+	 *
+	 * If not zero, the instruction flow and block decoders do not
+	 * decode instructions beyond the end of the trace.  They return
+	 * -pte_eos, instead, since the missing trace may contain events
+	 * that bind to the next instruction.
+	 */
+	uint8_t live;
+
+	/* An optional list of trace segments.
+	 *
+	 * If not NULL, the trace is given by the concatenation of the
+	 * \@nsegments segments in \@segments without copying it, and \@begin
+	 * and \@end are ignored.  The segments must remain valid for the
+	 * lifetime of the decoder.
+	 *
+	 * Offsets and synchronization refer to the concatenated trace.
+	 * The configuration returned by a decoder gives the part of the
+	 * trace it is currently looking at in \@begin and \@end.
+	 */
+	const struct pt_segment *segments;
+
+	/* The number of segments in \@segments. */
+	uint32_t nsegments;
+
+	/* An optional callback for reading the trace on demand.
+	 *
+	 * If \@read is not NULL, the trace is read in windows of at most
+	 * \@window bytes as decoding proceeds, and \@begin, \@end, and
+	 * \@segments are ignored.  This bounds the memory a decoder needs
+	 * for traces that are too big to be kept in memory.
+	 *
+	 * Offsets and synchronization refer to the trace as read by the
+	 * callback.  The configuration returned by a decoder gives its
+	 * current window in \@begin and \@end.
+	 */
+	struct {
+		/* The callback function.
+		 *
+		 * It shall read up to \@size bytes of trace starting at
+		 * \@offset into \@buffer.
+		 * It shall return the number of bytes read upon success.
+		 * It shall return a negative pt_error_code otherwise.
+		 * The below context is passed as \@context.
+		 *
+		 * It may be called concurrently for different decoders.
+		 */
+		int (*read)(uint8_t *buffer, size_t size, uint64_t offset,
+			    void *context);
+
+		/* The user-defined context for this configuration. */
+		void *context;
+
+		/* The size of the trace in bytes. */
+		uint64_t size;
+
+		/* The size of a window in bytes.
+		 *
+		 * If zero, a default of one megabyte is used.  It must not be
+		 * smaller than 128 bytes, otherwise.
+		 */
+		uint32_t window;
+	} source;
 };
 
 
@@ -997,6 +1087,25 @@ extern pt_export int pt_pkt_sync_backward(struct pt_packet_decoder *decoder);
 extern pt_export int pt_pkt_sync_set(struct pt_packet_decoder *decoder,
 				     uint64_t offset);
 
+/** Extend the trace buffer of an Intel PT packet decoder.
+ *
+ * Moves the end of \@decoder's trace buffer to \@end.  The trace buffer
+ * must have been filled up to \@end and remain valid for the lifetime of the
+ * decoder.  The contents before the previous end must not change.
+ *
+ * This allows decoding trace while it is being collected.  A packet that is
+ * cut off at the end of the trace buffer is reported as -pte_eos without
+ * changing \@decoder's position.  It is decoded once the trace buffer has
+ * been extended.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_invalid if \@decoder or \@end is NULL.
+ * Returns -pte_invalid if \@end lies before the end of the trace buffer.
+ */
+extern pt_export int pt_pkt_extend(struct pt_packet_decoder *decoder,
+				   uint8_t *end);
+
 /** Get the current decoder position.
  *
  * Fills the current \@decoder position into \@offset.
@@ -1053,6 +1162,164 @@ extern pt_export int pt_pkt_next(struct pt_packet_decoder *decoder,
 
 
 
+/* PSB index. */
+
+
+
+/** A PSB index entry.
+ *
+ * Describes the decoder state at a PSB packet as given by its PSB+ header.
+ * The timing information includes packets preceding the PSB.
+ */
+struct pt_psb_index_entry {
+	/** The offset of the PSB packet in the trace buffer. */
+	uint64_t offset;
+
+	/** The last TSC value - valid if \@has_tsc is set. */
+	uint64_t tsc;
+
+	/** The IP given by the FUP packet in PSB+ - valid if \@has_ip is set.
+	 *
+	 * There is no IP if tracing was disabled.
+	 */
+	uint64_t ip;
+
+	/** The CR3 value given by the PIP packet in PSB+ - valid if \@has_cr3
+	 * is set.
+	 */
+	uint64_t cr3;
+
+	/** The last TMA values - valid if \@has_tma is set. */
+	uint16_t ctc;
+	uint16_t fc;
+
+	/** The last core/bus ratio - valid if \@has_cbr is set. */
+	uint8_t cbr;
+
+	/** The execution mode given by the MODE.EXEC packet in PSB+ or
+	 * ptem_unknown.
+	 */
+	enum pt_exec_mode mode;
+
+	/** A collection of flags saying which of the above fields are valid:
+	 *
+	 * - the TSC is known.
+	 */
+	uint32_t has_tsc:1;
+
+	/** - the TMA values are known. */
+	uint32_t has_tma:1;
+
+	/** - the core/bus ratio is known. */
+	uint32_t has_cbr:1;
+
+	/** - the IP is known. */
+	uint32_t has_ip:1;
+
+	/** - the CR3 value is known. */
+	uint32_t has_cr3:1;
+};
+
+/** Allocate an empty PSB index.
+ *
+ * Returns a new PSB index on success, NULL otherwise.
+ */
+extern pt_export struct pt_psb_index *pt_psb_index_alloc(void);
+
+/** Free a PSB index. */
+extern pt_export void pt_psb_index_free(struct pt_psb_index *index);
+
+/** Index the PSB packets in a trace.
+ *
+ * Reads \@config's trace buffer once from beginning to end and replaces the
+ * content of \@index with one entry for each complete PSB+ header.
+ * Corrupted parts of the trace are skipped.
+ *
+ * The entries' offsets can be used with the decoders' sync_set functions to
+ * start decoding at a given position or time without scanning the trace.
+ *
+ * Returns the number of entries on success, a negative error code otherwise.
+ *
+ * Returns -pte_invalid if \@index or \@config is NULL.
+ * Returns -pte_nomem if there is not enough memory.
+ */
+extern pt_export int pt_psb_index_build(struct pt_psb_index *index,
+					const struct pt_config *config);
+
+/** Save a PSB index.
+ *
+ * Writes \@index to \@filename, typically next to the trace file.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_invalid if \@index or \@filename is NULL.
+ * Returns -pte_bad_file if \@filename can't be written.
+ * Returns -pte_nomem if there is not enough memory.
+ */
+extern pt_export int pt_psb_index_save(const struct pt_psb_index *index,
+				       const char *filename);
+
+/** Load a PSB index.
+ *
+ * Replaces the content of \@index with the index read from \@filename.  If
+ * \@config is not NULL, the index must have been built for a trace buffer of
+ * the same size.
+ *
+ * Returns the number of entries on success, a negative error code otherwise.
+ *
+ * Returns -pte_invalid if \@index or \@filename is NULL.
+ * Returns -pte_bad_file if \@filename can't be read, is not a valid PSB
+ * index, or does not match \@config.
+ * Returns -pte_nomem if there is not enough memory.
+ */
+extern pt_export int pt_psb_index_load(struct pt_psb_index *index,
+				       const char *filename,
+				       const struct pt_config *config);
+
+/** Get a PSB index entry.
+ *
+ * Provides the \@idx'th entry of \@index in \@entry.  Entries are ordered
+ * by their offset.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_invalid if \@index or \@entry is NULL.
+ * Returns -pte_eos if \@idx is out of bounds.
+ */
+extern pt_export int pt_psb_index_get(const struct pt_psb_index *index,
+				      uint32_t idx,
+				      struct pt_psb_index_entry *entry);
+
+/** Find the last PSB at or before a trace offset.
+ *
+ * Provides the last entry in \@index whose offset is smaller than or equal
+ * to \@offset in \@entry.
+ *
+ * Returns the index of that entry on success, a negative error code
+ * otherwise.
+ *
+ * Returns -pte_invalid if \@index or \@entry is NULL.
+ * Returns -pte_nosync if there is no PSB at or before \@offset.
+ */
+extern pt_export int pt_psb_index_find_offset(const struct pt_psb_index *index,
+					      uint64_t offset,
+					      struct pt_psb_index_entry *entry);
+
+/** Find the last PSB at or before a point in time.
+ *
+ * Provides the last entry in \@index with a TSC smaller than or equal to
+ * \@tsc in \@entry.  The TSC is assumed to be monotonically increasing.
+ *
+ * Returns the index of that entry on success, a negative error code
+ * otherwise.
+ *
+ * Returns -pte_invalid if \@index or \@entry is NULL.
+ * Returns -pte_no_time if there is no PSB at or before \@tsc.
+ */
+extern pt_export int pt_psb_index_find_time(const struct pt_psb_index *index,
+					    uint64_t tsc,
+					    struct pt_psb_index_entry *entry);
+
 /* Query decoder. */
 
 
@@ -1357,6 +1624,47 @@ extern pt_export int pt_qry_sync_backward(struct pt_query_decoder *decoder,
 extern pt_export int pt_qry_sync_set(struct pt_query_decoder *decoder,
 				     uint64_t *ip, uint64_t offset);
 
+/** Synchronize an Intel PT query decoder at a point in time.
+ *
+ * Synchronize \@decoder on the last syncpoint whose PSB+ header gives a time
+ * smaller than or equal to \@tsc or on the first syncpoint if there is none.
+ *
+ * The syncpoint is found by a binary search over the trace buffer assuming
+ * that the time is monotonically increasing.  This requires TSC packets in
+ * PSB+.
+ *
+ * If \@ip is not NULL, set it to last ip.
+ *
+ * Returns a non-negative pt_status_flag bit-vector on success, a negative error
+ * code otherwise.
+ *
+ * Returns -pte_bad_opc if an unknown packet is encountered.
+ * Returns -pte_bad_packet if an unknown packet payload is encountered.
+ * Returns -pte_eos if \@decoder reaches the end of its trace buffer.
+ * Returns -pte_invalid if \@decoder is NULL.
+ * Returns -pte_no_time if no PSB+ header contains a TSC packet.
+ */
+extern pt_export int pt_qry_sync_time(struct pt_query_decoder *decoder,
+				      uint64_t *ip, uint64_t tsc);
+
+/** Extend the trace buffer of an Intel PT query decoder.
+ *
+ * This is pt_pkt_extend() for a query decoder.
+ *
+ * A query that runs out of trace returns -pte_eos and leaves \@decoder in
+ * the state before the packet that was cut off.  This includes a PSB+ header
+ * that was cut off.  After extending the trace buffer, the query can be
+ * repeated.
+ *
+ * Returns a non-negative pt_status_flag bit-vector on success, a negative error
+ * code otherwise.
+ *
+ * Returns -pte_invalid if \@decoder or \@end is NULL.
+ * Returns -pte_invalid if \@end lies before the end of the trace buffer.
+ */
+extern pt_export int pt_qry_extend(struct pt_query_decoder *decoder,
+				   uint8_t *end);
+
 /** Get the current decoder position.
  *
  * Fills the current \@decoder position into \@offset.
@@ -1385,6 +1693,42 @@ extern pt_export int pt_qry_get_offset(struct pt_query_decoder *decoder,
 extern pt_export int pt_qry_get_sync_offset(struct pt_query_decoder *decoder,
 					    uint64_t *offset);
 
+/** Save the query decoder's state.
+ *
+ * Writes a checkpoint of \@decoder's decoding state into \@buffer of \@size
+ * bytes.  The checkpoint can be restored into a decoder for the same trace
+ * using pt_qry_restore() - also in a different process.
+ *
+ * The checkpoint does not contain the trace.
+ *
+ * If \@buffer is NULL, only determines the size of the checkpoint.
+ *
+ * Returns the size of the checkpoint in bytes on success, a negative error
+ * code otherwise.
+ *
+ * Returns -pte_invalid if \@decoder is NULL.
+ * Returns -pte_invalid if the checkpoint does not fit into \@size bytes.
+ * Returns -pte_nosync if \@decoder is out of sync.
+ */
+extern pt_export int pt_qry_save(const struct pt_query_decoder *decoder,
+				 uint8_t *buffer, size_t size);
+
+/** Restore the query decoder's state.
+ *
+ * Restores the decoding state in the checkpoint in \@buffer of \@size bytes
+ * that had been written by pt_qry_save() into \@decoder.  Decoding continues
+ * at the checkpoint's position.
+ *
+ * Returns a non-negative pt_status_flag bit-vector on success, a negative error
+ * code otherwise.
+ *
+ * Returns -pte_bad_file if \@buffer does not contain a valid checkpoint.
+ * Returns -pte_invalid if \@decoder or \@buffer is NULL.
+ * Returns -pte_invalid if the checkpoint lies outside of \@decoder's trace.
+ */
+extern pt_export int pt_qry_restore(struct pt_query_decoder *decoder,
+				    const uint8_t *buffer, size_t size);
+
 /* Return a pointer to \@decoder's configuration.
  *
  * Returns a non-null pointer on success, NULL if \@decoder is NULL.
@@ -1577,11 +1921,48 @@ extern pt_export int pt_image_add_file(struct pt_image *image,
 				       const struct pt_asid *asid,
 				       uint64_t vaddr);
 
+/** Add a new memory buffer section to the traced memory image.
+ *
+ * Adds \@size bytes of memory starting at \@buffer.  The section is loaded at
+ * the virtual address \@vaddr in the address space \@asid.
+ *
+ * Use this for code that is not available in a file, e.g. for JIT-compiled
+ * code or for code taken from a memory dump.
+ *
+ * If \@copy is non-zero, the image keeps its own copy of \@buffer and the
+ * user's buffer may be freed or reused after this function returns.
+ *
+ * If \@copy is zero, the image uses \@buffer directly.  The memory must remain
+ * valid and must not change until the section has been removed from all
+ * images it has been added or copied to and until all decoders using those
+ * images have been freed or have been given a different image.
+ *
+ * The \@asid may be NULL or (partially) invalid.  In that case only the valid
+ * fields are considered when comparing with other address-spaces.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_bad_image if sections would overlap.
+ * Returns -pte_invalid if \@image or \@buffer is NULL.
+ * Returns -pte_invalid if \@size is zero or too big.
+ * Returns -pte_nomem if the section can't be allocated.
+ */
+extern pt_export int pt_image_add_buffer(struct pt_image *image,
+					 const uint8_t *buffer, uint64_t size,
+					 int copy,
+					 const struct pt_asid *asid,
+					 uint64_t vaddr);
+
 /** Copy an image.
  *
  * Adds all sections from \@src to \@image.  Sections that would overlap with
  * existing sections will be ignored.
  *
+ * Address spaces in \@src that do not match any address space in \@image are
+ * shared copy-on-write between the two images.  Copying an image into an
+ * empty image is therefore cheap independent of the number of sections.
+ * Use this to derive per-process images from a common base image.
+ *
  * Returns the number of ignored images on success, a negative error code
  * otherwise.
  *
@@ -1590,6 +1971,76 @@ extern pt_export int pt_image_add_file(struct pt_image *image,
 extern pt_export int pt_image_copy(struct pt_image *image,
 				   const struct pt_image *src);
 
+/** Save an image manifest.
+ *
+ * Writes a compact, binary description of the file sections in \@image to
+ * \@filename.  The manifest records each section's file name, offset, size,
+ * virtual address, and address space.  It further records the size and the
+ * modification time of each file so changes to the files can be detected.
+ *
+ * Memory buffer sections and the read memory callback are not saved.
+ *
+ * Use pt_image_load() to add the saved sections to an image.
+ *
+ * Returns the number of sections that were not saved on success, a negative
+ * error code otherwise.
+ *
+ * Returns -pte_invalid if \@image or \@filename is NULL.
+ * Returns -pte_bad_file if \@filename can't be written.
+ * Returns -pte_nomem if the manifest can't be allocated.
+ */
+extern pt_export int pt_image_save(const struct pt_image *image,
+				   const char *filename);
+
+/** Load an image manifest.
+ *
+ * Reads a manifest written by pt_image_save() from \@filename and adds the
+ * sections it describes to \@image.  Sections that would overlap with
+ * existing sections will be ignored as in pt_image_copy().
+ *
+ * The manifest is validated before any section is added.  Each file is
+ * checked once against the size and modification time recorded in the
+ * manifest.
+ *
+ * Returns the number of ignored sections on success, a negative error code
+ * otherwise.
+ *
+ * Returns -pte_invalid if \@image or \@filename is NULL.
+ * Returns -pte_bad_file if \@filename can't be read or is not a valid image
+ * manifest.
+ * Returns -pte_bad_image if a file changed since the manifest was saved.
+ * Returns -pte_nomem if the sections can't be allocated.
+ */
+extern pt_export int pt_image_load(struct pt_image *image,
+				   const char *filename);
+
+/** Pre-decode the sections in an image.
+ *
+ * Decodes each section in \@image once linearly in execution mode \@mode and
+ * remembers where its instructions begin and which of them may change the
+ * flow of execution.  Instruction flow and block decoders use this map to
+ * walk over instructions that do not branch without decoding each of them.
+ * Only pt_blk_next() and pt_blk_next_branch() benefit from this.
+ *
+ * The map is kept with the section and shared by all images that contain
+ * the same section.  A section is only pre-decoded once.
+ *
+ * If \@cachedir is not NULL, it names an existing directory in which the
+ * maps for file sections are stored.  They are keyed by the file's name,
+ * size, and modification time, and by the section's offset and size.  A
+ * matching map is read instead of decoding the section again.  Failing to
+ * read or write a cache file is not an error.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_invalid if \@image is NULL.
+ * Returns -pte_bad_insn if \@mode is not a valid execution mode.
+ * Returns -pte_nomem if a map can't be allocated.
+ */
+extern pt_export int pt_image_predecode(struct pt_image *image,
+					enum pt_exec_mode mode,
+					const char *cachedir);
+
 /** Remove all sections loaded from a file.
  *
  * Removes all sections loaded from \@filename from the address space \@asid.
@@ -1644,6 +2095,132 @@ extern pt_export int pt_image_set_callback(struct pt_image *image,
 					   read_memory_callback_t *callback,
 					   void *context);
 
+/** Callback cache statistics. */
+struct pt_callback_cache_stats {
+	/** The size of a cached page in bytes - zero if disabled. */
+	uint32_t granule;
+
+	/** The number of cached pages - zero if disabled. */
+	uint32_t npages;
+
+	/** The number of reads served from cached pages. */
+	uint64_t hits;
+
+	/** The number of pages requested from the callback. */
+	uint64_t misses;
+
+	/** The number of cached pages that were invalidated. */
+	uint64_t invalidations;
+};
+
+/** Cache memory read via the read memory callback.
+ *
+ * By default, the read memory callback is called for every read that is not
+ * served by one of the image's sections.  If the callback is expensive, e.g.
+ * because it reads from a core dump or from another process, enable the
+ * callback cache.
+ *
+ * The cache requests naturally aligned pages of \@granule bytes from the
+ * callback and serves subsequent reads in those pages from memory.  It holds
+ * at most \@npages pages.  If the callback can't provide an entire page, the
+ * read is passed on to the callback.
+ *
+ * Cached pages are not updated when the memory the callback reads from
+ * changes.  Use pt_image_invalidate_callback_cache() in that case.  Setting a
+ * new callback discards all cached pages.
+ *
+ * Re-configuring the cache discards all cached pages and resets the
+ * statistics.  Set \@granule or \@npages to zero to disable the cache.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_invalid if \@image is NULL.
+ * Returns -pte_invalid if \@granule is not a power of two.
+ * Returns -pte_nomem if the cache can't be allocated.
+ */
+extern pt_export int pt_image_set_callback_cache(struct pt_image *image,
+						 uint32_t granule,
+						 uint32_t npages);
+
+/** Invalidate cached callback memory.
+ *
+ * Discards all pages cached for address spaces matching \@asid that overlap
+ * with \@size bytes starting at \@vaddr.  Use 0 for \@vaddr and UINT64_MAX
+ * for \@size to discard all pages cached for \@asid.
+ *
+ * The \@asid may be NULL or (partially) invalid.  In that case only the valid
+ * fields are considered when matching address-spaces.
+ *
+ * Returns the number of discarded pages on success, a negative error code
+ * otherwise.
+ *
+ * Returns -pte_invalid if \@image is NULL.
+ */
+extern pt_export int
+pt_image_invalidate_callback_cache(struct pt_image *image,
+				   const struct pt_asid *asid,
+				   uint64_t vaddr, uint64_t size);
+
+/** Get the callback cache statistics.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_invalid if \@image or \@stats is NULL.
+ */
+extern pt_export int
+pt_image_get_callback_cache_stats(const struct pt_image *image,
+				  struct pt_callback_cache_stats *stats);
+
+
+/** Section cache statistics. */
+struct pt_section_cache_stats {
+	/** The memory budget in bytes. */
+	uint64_t limit;
+
+	/** The total size of all cached sections in bytes. */
+	uint64_t size;
+
+	/** The number of section map requests served by the cache. */
+	uint64_t hits;
+
+	/** The number of section map requests not served by the cache. */
+	uint64_t misses;
+
+	/** The number of sections evicted to stay within the budget. */
+	uint64_t evictions;
+
+	/** The number of cached sections. */
+	uint32_t nsections;
+};
+
+/** Set the section cache memory budget.
+ *
+ * File sections are shared between all traced memory images and decoders in
+ * the process.  Recently used sections are kept mapped in a process-wide
+ * cache.  The least recently used sections are unmapped to keep the total
+ * size of cached sections within \@limit bytes.
+ *
+ * A \@limit of zero disables caching.  Sections are unmapped as soon as they
+ * are no longer used.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_bad_lock on any locking error.
+ */
+extern pt_export int pt_section_cache_set_limit(uint64_t limit);
+
+/** Get section cache statistics.
+ *
+ * Provides a snapshot of the section cache statistics in \@stats.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_invalid if \@stats is NULL.
+ * Returns -pte_bad_lock on any locking error.
+ */
+extern pt_export int
+pt_section_cache_get_stats(struct pt_section_cache_stats *stats);
+
 
 
 /* Instruction flow decoder. */
@@ -1801,23 +2378,63 @@ extern pt_export int pt_insn_sync_backward(struct pt_insn_decoder *decoder);
 extern pt_export int pt_insn_sync_set(struct pt_insn_decoder *decoder,
 				      uint64_t offset);
 
-/** Get the current decoder position.
+/** Synchronize an Intel PT instruction flow decoder at a point in time.
  *
- * Fills the current \@decoder position into \@offset.
+ * Synchronize \@decoder on the syncpoint found by pt_qry_sync_time() for
+ * \@tsc and proceed to the first instruction that is not known to have been
+ * executed before \@tsc.
  *
- * This is useful for reporting errors.
+ * The time is only known at timing packets, so the next instruction may have
+ * been executed somewhat before \@tsc.
  *
- * Returns zero on success, a negative error code otherwise.
+ * Returns zero or a positive value on success, a negative error code otherwise.
  *
- * Returns -pte_invalid if \@decoder or \@offset is NULL.
- * Returns -pte_nosync if \@decoder is out of sync.
+ * Returns -pte_bad_opc if an unknown packet is encountered.
+ * Returns -pte_bad_packet if an unknown packet payload is encountered.
+ * Returns -pte_eos if \@decoder reaches the end of its trace buffer.
+ * Returns -pte_invalid if \@decoder is NULL.
+ * Returns -pte_no_time if no PSB+ header contains a TSC packet.
  */
-extern pt_export int pt_insn_get_offset(struct pt_insn_decoder *decoder,
-					uint64_t *offset);
+extern pt_export int pt_insn_sync_time(struct pt_insn_decoder *decoder,
+				       uint64_t tsc);
 
-/** Get the position of the last synchronization point.
+/** Extend the trace buffer of an Intel PT instruction flow decoder.
  *
- * Fills the last synchronization position into \@offset.
+ * This is pt_pkt_extend() for an instruction flow decoder.
+ *
+ * If \@decoder ran out of trace, decoding continues where it stopped, and
+ * pt_insn_next() provides the next instruction.  If it ran out of trace
+ * determining the instruction following the last provided one, events
+ * indicated after that instruction can't be given in its flags anymore.
+ *
+ * Set the live field in \@decoder's configuration to have it wait for more
+ * trace instead of decoding instructions beyond the end of the trace.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_invalid if \@decoder or \@end is NULL.
+ * Returns -pte_invalid if \@end lies before the end of the trace buffer.
+ */
+extern pt_export int pt_insn_extend(struct pt_insn_decoder *decoder,
+				    uint8_t *end);
+
+/** Get the current decoder position.
+ *
+ * Fills the current \@decoder position into \@offset.
+ *
+ * This is useful for reporting errors.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_invalid if \@decoder or \@offset is NULL.
+ * Returns -pte_nosync if \@decoder is out of sync.
+ */
+extern pt_export int pt_insn_get_offset(struct pt_insn_decoder *decoder,
+					uint64_t *offset);
+
+/** Get the position of the last synchronization point.
+ *
+ * Fills the last synchronization position into \@offset.
  *
  * Returns zero on success, a negative error code otherwise.
  *
@@ -1827,6 +2444,42 @@ extern pt_export int pt_insn_get_offset(struct pt_insn_decoder *decoder,
 extern pt_export int pt_insn_get_sync_offset(struct pt_insn_decoder *decoder,
 					     uint64_t *offset);
 
+/** Save the instruction flow decoder's state.
+ *
+ * Writes a checkpoint of \@decoder's decoding state into \@buffer of \@size
+ * bytes.  The checkpoint can be restored into a decoder for the same trace
+ * and the same traced image using pt_insn_restore() - also in a different
+ * process.
+ *
+ * The checkpoint contains neither the trace nor the image.
+ *
+ * If \@buffer is NULL, only determines the size of the checkpoint.
+ *
+ * Returns the size of the checkpoint in bytes on success, a negative error
+ * code otherwise.
+ *
+ * Returns -pte_invalid if \@decoder is NULL.
+ * Returns -pte_invalid if the checkpoint does not fit into \@size bytes.
+ * Returns -pte_nosync if \@decoder is out of sync.
+ */
+extern pt_export int pt_insn_save(const struct pt_insn_decoder *decoder,
+				  uint8_t *buffer, size_t size);
+
+/** Restore the instruction flow decoder's state.
+ *
+ * Restores the decoding state in the checkpoint in \@buffer of \@size bytes
+ * that had been written by pt_insn_save() into \@decoder.  Decoding continues
+ * at the checkpoint's position.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_bad_file if \@buffer does not contain a valid checkpoint.
+ * Returns -pte_invalid if \@decoder or \@buffer is NULL.
+ * Returns -pte_invalid if the checkpoint lies outside of \@decoder's trace.
+ */
+extern pt_export int pt_insn_restore(struct pt_insn_decoder *decoder,
+				     const uint8_t *buffer, size_t size);
+
 /** Get the traced image.
  *
  * The returned image may be modified as long as no decoder that uses this
@@ -1927,4 +2580,498 @@ extern pt_export int pt_insn_core_bus_ratio(struct pt_insn_decoder *decoder,
 extern pt_export int pt_insn_next(struct pt_insn_decoder *decoder,
 				  struct pt_insn *insn, size_t size);
 
+/** Determine the next instructions.
+ *
+ * On success, provides up to \@n next instructions in execution order in the
+ * array \@insn and their number in \@count.  This is equivalent to calling
+ * pt_insn_next() up to \@n times but avoids the per-call overhead.
+ *
+ * The batch ends early at events.  Only the first instruction may be marked
+ * as enabled, resumed, or resynced.  Only the last instruction may be marked
+ * as disabled, interrupted, aborted, committed, or stopped.
+ *
+ * The \@size argument must be set to sizeof(struct pt_insn).
+ *
+ * Returns a non-negative pt_status_flag bit-vector for the last instruction
+ * on success, a negative error code otherwise.
+ *
+ * Errors encountered after the first instruction end the batch and are
+ * reported on the next call.  An error is only returned if not a single
+ * instruction could be determined.  In this case, \@insn[0] contains the
+ * incomplete instruction as in pt_insn_next().
+ *
+ * Returns -pte_invalid if \@decoder, \@insn, or \@count is NULL or if
+ * \@size is zero.
+ * Returns the errors of pt_insn_next() otherwise.
+ */
+extern pt_export int pt_insn_next_batch(struct pt_insn_decoder *decoder,
+					struct pt_insn *insn, size_t n,
+					size_t size, size_t *count);
+
+
+
+
+/* Block decoder. */
+
+
+
+/** A block of sequential instructions.
+ *
+ * The instructions in a block are sequential in the sense that no trace is
+ * required for reconstructing them.  Only the last instruction may be a
+ * branch.  The IP of the first instruction is given in \@ip and the IP of
+ * every other instruction is the IP of the preceding instruction plus its
+ * size.
+ *
+ * Events that would be indicated in the middle of a block end the block.
+ */
+struct pt_block {
+	/** The IP of the first instruction in this block. */
+	uint64_t ip;
+
+	/** The IP of the last instruction in this block.
+	 *
+	 * This can be used for error-detection.
+	 */
+	uint64_t end_ip;
+
+	/** The execution mode for all instructions in this block. */
+	enum pt_exec_mode mode;
+
+	/** The instruction class of the last instruction in this block.
+	 *
+	 * This is ptic_other unless the block ends with a branch.
+	 */
+	enum pt_insn_class iclass;
+
+	/** The number of instructions in this block. */
+	uint32_t ninsn;
+
+	/** A collection of flags giving additional information:
+	 *
+	 * - all instructions in this block were executed speculatively.
+	 */
+	uint32_t speculative:1;
+
+	/** - speculative execution was aborted after this block. */
+	uint32_t aborted:1;
+
+	/** - speculative execution was committed after this block. */
+	uint32_t committed:1;
+
+	/** - tracing was disabled after this block. */
+	uint32_t disabled:1;
+
+	/** - tracing was enabled at this block. */
+	uint32_t enabled:1;
+
+	/** - tracing was resumed at this block.
+	 *
+	 *    In addition to tracing being enabled, it continues from the IP
+	 *    at which tracing had been disabled before.
+	 */
+	uint32_t resumed:1;
+
+	/** - normal execution flow was interrupted after this block. */
+	uint32_t interrupted:1;
+
+	/** - tracing resumed at this block after an overflow. */
+	uint32_t resynced:1;
+
+	/** - tracing was stopped after this block. */
+	uint32_t stopped:1;
+};
+
+/** Allocate an Intel PT block decoder.
+ *
+ * The decoder will work on the buffer defined in \@config, it shall contain
+ * raw trace data and remain valid for the lifetime of the decoder.
+ *
+ * The decoder needs to be synchronized before it can be used.
+ */
+extern pt_export struct pt_block_decoder *
+pt_blk_alloc_decoder(const struct pt_config *config);
+
+/** Free an Intel PT block decoder.
+ *
+ * This will destroy the decoder's default image.
+ *
+ * The \@decoder must not be used after a successful return.
+ */
+extern pt_export void pt_blk_free_decoder(struct pt_block_decoder *decoder);
+
+/** Synchronize an Intel PT block decoder.
+ *
+ * This is pt_insn_sync_forward() and pt_insn_sync_backward(), respectively,
+ * for a block decoder.
+ */
+extern pt_export int pt_blk_sync_forward(struct pt_block_decoder *decoder);
+extern pt_export int pt_blk_sync_backward(struct pt_block_decoder *decoder);
+
+/** Manually synchronize an Intel PT block decoder.
+ *
+ * This is pt_insn_sync_set() for a block decoder.
+ */
+extern pt_export int pt_blk_sync_set(struct pt_block_decoder *decoder,
+				     uint64_t offset);
+
+/** Synchronize an Intel PT block decoder at a point in time.
+ *
+ * This is pt_insn_sync_time() for a block decoder.
+ */
+extern pt_export int pt_blk_sync_time(struct pt_block_decoder *decoder,
+				      uint64_t tsc);
+
+/** Extend the trace buffer of an Intel PT block decoder.
+ *
+ * This is pt_insn_extend() for a block decoder.
+ */
+extern pt_export int pt_blk_extend(struct pt_block_decoder *decoder,
+				   uint8_t *end);
+
+/** Get the current decoder position.
+ *
+ * This is pt_insn_get_offset() for a block decoder.
+ */
+extern pt_export int pt_blk_get_offset(struct pt_block_decoder *decoder,
+				       uint64_t *offset);
+
+/** Get the position of the last synchronization point.
+ *
+ * This is pt_insn_get_sync_offset() for a block decoder.
+ */
+extern pt_export int pt_blk_get_sync_offset(struct pt_block_decoder *decoder,
+					    uint64_t *offset);
+
+/** Save the block decoder's state.
+ *
+ * This is pt_insn_save() for a block decoder.
+ */
+extern pt_export int pt_blk_save(const struct pt_block_decoder *decoder,
+				 uint8_t *buffer, size_t size);
+
+/** Restore the block decoder's state.
+ *
+ * This is pt_insn_restore() for a block decoder.
+ */
+extern pt_export int pt_blk_restore(struct pt_block_decoder *decoder,
+				    const uint8_t *buffer, size_t size);
+
+/** Get the traced image.
+ *
+ * This is pt_insn_get_image() for a block decoder.
+ */
+extern pt_export struct pt_image *
+pt_blk_get_image(struct pt_block_decoder *decoder);
+
+/** Set the traced image.
+ *
+ * This is pt_insn_set_image() for a block decoder.
+ */
+extern pt_export int pt_blk_set_image(struct pt_block_decoder *decoder,
+				      struct pt_image *image);
+
+/* Return a pointer to \@decoder's configuration.
+ *
+ * Returns a non-null pointer on success, NULL if \@decoder is NULL.
+ */
+extern pt_export const struct pt_config *
+pt_blk_get_config(const struct pt_block_decoder *decoder);
+
+/** Return the current time.
+ *
+ * This is pt_insn_time() for a block decoder.
+ */
+extern pt_export int pt_blk_time(struct pt_block_decoder *decoder,
+				 uint64_t *time, uint32_t *lost_mtc,
+				 uint32_t *lost_cyc);
+
+/** Return the current core bus ratio.
+ *
+ * This is pt_insn_core_bus_ratio() for a block decoder.
+ */
+extern pt_export int pt_blk_core_bus_ratio(struct pt_block_decoder *decoder,
+					   uint32_t *cbr);
+
+/** Determine the next block of instructions.
+ *
+ * On success, provides the next block of instructions in execution order in
+ * \@block.  The trace is only consulted at the end of a block, i.e. for the
+ * block's last instruction.
+ *
+ * The \@size argument must be set to sizeof(struct pt_block).
+ *
+ * Returns a non-negative pt_status_flag bit-vector on success, a negative error
+ * code otherwise.
+ *
+ * Returns pts_eos to indicate the end of the trace stream.  Subsequent calls
+ * to pt_blk_next() will continue to return pts_eos until trace is required
+ * to determine the next block.
+ *
+ * Returns -pte_bad_context if the decoder encountered an unexpected packet.
+ * Returns -pte_bad_opc if the decoder encountered unknown packets.
+ * Returns -pte_bad_packet if the decoder encountered unknown packet payloads.
+ * Returns -pte_bad_query if the decoder got out of sync.
+ * Returns -pte_eos if decoding reached the end of the Intel PT buffer.
+ * Returns -pte_invalid if \@decoder or \@block is NULL.
+ * Returns -pte_nomap if the memory at the block's first instruction address
+ * can't be read.
+ * Returns -pte_nosync if \@decoder is out of sync.
+ */
+extern pt_export int pt_blk_next(struct pt_block_decoder *decoder,
+				 struct pt_block *block, size_t size);
+
+/** A branch record.
+ *
+ * A branch record describes a range of sequential instructions that ends with
+ * a taken branch or with an event, similar to a Last Branch Record (LBR).
+ * Not-taken conditional branches do not end the range.
+ */
+struct pt_branch {
+	/** The IP of the first instruction in the range. */
+	uint64_t start;
+
+	/** The IP of the last instruction in the range.
+	 *
+	 * If \@taken is set, this is the IP of the branch instruction.
+	 */
+	uint64_t from;
+
+	/** The IP of the branch target.
+	 *
+	 * This is only valid if \@taken is set.
+	 */
+	uint64_t to;
+
+	/** The execution mode for all instructions in the range. */
+	enum pt_exec_mode mode;
+
+	/** The instruction class of the last instruction in the range. */
+	enum pt_insn_class iclass;
+
+	/** The number of instructions in the range. */
+	uint32_t ninsn;
+
+	/** A collection of flags giving additional information:
+	 *
+	 * - the range ends with a taken branch to \@to.
+	 */
+	uint32_t taken:1;
+
+	/** - all instructions in the range were executed speculatively. */
+	uint32_t speculative:1;
+
+	/** - speculative execution was aborted after the range. */
+	uint32_t aborted:1;
+
+	/** - speculative execution was committed after the range. */
+	uint32_t committed:1;
+
+	/** - tracing was disabled after the range. */
+	uint32_t disabled:1;
+
+	/** - tracing was enabled at the start of the range. */
+	uint32_t enabled:1;
+
+	/** - tracing was resumed at the start of the range. */
+	uint32_t resumed:1;
+
+	/** - normal execution flow was interrupted after the range. */
+	uint32_t interrupted:1;
+
+	/** - tracing resumed at the start of the range after an overflow. */
+	uint32_t resynced:1;
+
+	/** - tracing was stopped after the range. */
+	uint32_t stopped:1;
+};
+
+/** Determine the next branch record.
+ *
+ * On success, provides the next range of instructions in execution order
+ * together with the taken branch that ends it in \@branch.
+ *
+ * Instructions inside the range are only walked over, they are not provided
+ * individually.  This is considerably faster than pt_blk_next() or
+ * pt_insn_next() if only the control-flow edges are of interest, for example
+ * for collecting profiles for feedback-directed optimization.
+ *
+ * The \@size argument must be set to sizeof(struct pt_branch).
+ *
+ * Returns a non-negative pt_status_flag bit-vector on success, a negative error
+ * code otherwise.
+ *
+ * This returns the same errors as pt_blk_next().
+ * Returns -pte_invalid if \@decoder or \@branch is NULL.
+ */
+extern pt_export int pt_blk_next_branch(struct pt_block_decoder *decoder,
+					struct pt_branch *branch, size_t size);
+
+/** Skip blocks.
+ *
+ * Proceeds over the blocks that pt_blk_next() would provide next without
+ * providing them.  Only blocks that end in a conditional branch whose outcome
+ * is already known to \@decoder and that do not indicate events are skipped.
+ * The remaining blocks are left to pt_blk_next().
+ *
+ * The decoder remembers the blocks it skipped together with the outcomes of
+ * their conditional branches.  When the same code is executed again with the
+ * same outcomes, it proceeds over all of them in one step.  This makes
+ * alternating calls of pt_blk_skip() and pt_blk_next() considerably faster
+ * than calling pt_blk_next() alone if only the number of executed instructions
+ * is of interest.
+ *
+ * On success, provides the number of skipped instructions in \@ninsn and the
+ * number of skipped blocks in \@nblocks.  Both may be zero.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_invalid if \@decoder, \@ninsn, or \@nblocks is NULL.
+ */
+extern pt_export int pt_blk_skip(struct pt_block_decoder *decoder,
+				 uint64_t *ninsn, uint64_t *nblocks);
+
+/** A block callback.
+ *
+ * This is called by pt_blk_decode_parallel() for each block in trace order
+ * with the block in \@block and the pt_blk_next() status in \@status.
+ *
+ * A negative \@status indicates a decode error.  The block is incomplete and
+ * describes the instructions up to the error.
+ *
+ * Returns zero on success, a negative error code to stop decoding.
+ */
+typedef int (pt_blk_callback_t)(const struct pt_block *block, int status,
+				void *context);
+
+/** Decode a trace in parallel.
+ *
+ * Splits \@config's trace buffer at synchronization points into chunks and
+ * decodes the chunks concurrently using up to \@nthreads threads, each with
+ * its own block decoder for \@image.  Zero threads means one thread.
+ *
+ * The resulting blocks are provided in trace order to \@callback together
+ * with \@context from the calling thread.  They correspond to what
+ * pt_blk_next() provides when decoding the trace serially, resynchronizing
+ * with pt_blk_sync_forward() after each error other than -pte_eos.
+ *
+ * If a chunk can't be decoded on its own, for example because a return
+ * compression requires the return stack built up by the preceding chunk, it
+ * is decoded again continuing the decoder of the preceding chunk.  This
+ * preserves the return stack and the execution mode across chunks.
+ *
+ * \@image must not be modified during decode.
+ *
+ * Without threading support, the chunks are decoded one after another.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns the first negative error code returned by \@callback.
+ * Returns -pte_invalid if \@config, \@image, or \@callback is NULL.
+ * Returns -pte_nomem if there is not enough memory.
+ */
+extern pt_export int pt_blk_decode_parallel(const struct pt_config *config,
+					    struct pt_image *image,
+					    uint32_t nthreads,
+					    pt_blk_callback_t *callback,
+					    void *context);
+
+
+
+/* Merge decoder. */
+
+
+
+/** Allocate an Intel PT merge decoder.
+ *
+ * A merge decoder combines the traces of \@ncpus cpus into a single timeline.
+ * Each cpu's trace is decoded by its own instruction flow decoder working on
+ * the buffer defined in the respective element of the \@config array.  The
+ * buffers shall contain raw trace data and remain valid for the lifetime of
+ * the decoder.
+ *
+ * The decoder needs to be synchronized before it can be used.
+ *
+ * Returns a new merge decoder on success, NULL otherwise.
+ */
+extern pt_export struct pt_merge_decoder *
+pt_merge_alloc_decoder(const struct pt_config *config, uint32_t ncpus);
+
+/** Free an Intel PT merge decoder.
+ *
+ * This will free the per-cpu instruction flow decoders.
+ *
+ * The \@decoder must not be used after a successful return.
+ */
+extern pt_export void pt_merge_free_decoder(struct pt_merge_decoder *decoder);
+
+/** Synchronize an Intel PT merge decoder.
+ *
+ * Synchronizes each cpu's instruction flow decoder at its next
+ * synchronization point using pt_insn_sync_forward().  Cpus without further
+ * synchronization points are ignored.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_eos if none of the cpus could be synchronized.
+ * Returns -pte_invalid if \@decoder is NULL.
+ */
+extern pt_export int pt_merge_sync_forward(struct pt_merge_decoder *decoder);
+
+/** Set the traced image.
+ *
+ * Sets the image that all cpus use for reading memory to \@image.  If
+ * \@image is NULL, each cpu uses its instruction flow decoder's default
+ * image.  The address spaces of different processes are distinguished by
+ * their CR3 in \@image.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_invalid if \@decoder is NULL.
+ */
+extern pt_export int pt_merge_set_image(struct pt_merge_decoder *decoder,
+					struct pt_image *image);
+
+/** Determine the next instruction in time order.
+ *
+ * On success, provides the next instruction in \@insn and the index of the
+ * cpu that executed it in \@cpu.
+ *
+ * The instructions of all cpus are merged in the order of the time provided
+ * by pt_insn_time() after decoding each instruction.  Instructions at the
+ * same time are ordered by cpu.  Since the time is only updated by timing
+ * packets, this provides runs of instructions per cpu.  If TSC is not enabled,
+ * the time is relative to each cpu's last synchronization.
+ *
+ * Only one instruction is kept per cpu.
+ *
+ * The \@size argument must be set to sizeof(struct pt_insn).
+ *
+ * Returns a non-negative pt_status_flag bit-vector on success, a negative error
+ * code otherwise.
+ *
+ * Errors are reported in time order together with the cpu that encountered
+ * the error and the incomplete instruction as in pt_insn_next().  That cpu is
+ * resynchronized using pt_insn_sync_forward() and decoding continues with the
+ * next call.  Cpus that reach the end of their trace are removed.
+ *
+ * Returns -pte_eos if all cpus reached the end of their trace.
+ * Returns -pte_invalid if \@decoder, \@insn, or \@cpu is NULL.
+ * Returns the errors of pt_insn_next() otherwise.
+ */
+extern pt_export int pt_merge_next(struct pt_merge_decoder *decoder,
+				   struct pt_insn *insn, size_t size,
+				   uint32_t *cpu);
+
+/** Return the current time.
+ *
+ * On success, provides the time of the instruction most recently provided by
+ * pt_merge_next() in \@time.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ *
+ * Returns -pte_invalid if \@decoder or \@time is NULL.
+ */
+extern pt_export int pt_merge_time(const struct pt_merge_decoder *decoder,
+				   uint64_t *time);
+
 #endif /* __INTEL_PT_H__ */
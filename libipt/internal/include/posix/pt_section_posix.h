@@ -56,7 +56,7 @@ struct pt_sec_posix_mapping {
 
 /* Map a section.
  *
- * On success, sets @section's mapping, unmap, and read pointers.
+ * On success, sets @section's mapping, unmap, read, and fetch pointers.
  *
  * Returns zero on success, a negative error code otherwise.
  * Returns -pte_internal if @section or @file are NULL.
@@ -66,7 +66,8 @@ extern int pt_sec_posix_map(struct pt_section *section, int fd);
 
 /* Unmap a section.
  *
- * On success, clears @section's mapping, unmap, and read pointers.
+ * On success, clears @section's mapping, unmap, read, and fetch
+ * pointers.
  *
  * Returns zero on success, a negative error code otherwise.
  * Returns -pte_internal if @section is NULL.
@@ -85,4 +86,19 @@ extern int pt_sec_posix_unmap(struct pt_section *section);
 extern int pt_sec_posix_read(const struct pt_section *section, uint8_t *buffer,
 			     uint16_t size, uint64_t offset);
 
+/* Fetch memory from an mmaped section without copying.
+ *
+ * Provides a pointer to @section's memory at @offset in @pbegin.  At most
+ * @size bytes starting at *@pbegin may be accessed.
+ *
+ * Returns the number of accessible bytes on success, a negative error code
+ * otherwise.
+ * Returns -pte_internal if @section or @pbegin are NULL.
+ * Returns -pte_internal if @section has not been mapped.
+ * Returns -pte_nomap if @offset is beyond the end of the section.
+ */
+extern int pt_sec_posix_fetch(const struct pt_section *section,
+			      const uint8_t **pbegin, uint16_t size,
+			      uint64_t offset);
+
 #endif /* __PT_SECTION_POSIX_H__ */
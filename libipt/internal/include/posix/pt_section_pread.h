@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PT_SECTION_PREAD_H__
+#define __PT_SECTION_PREAD_H__
+
+#include <stdint.h>
+
+#if defined(FEATURE_THREADS)
+#  include <threads.h>
+#endif /* defined(FEATURE_THREADS) */
+
+struct pt_section;
+
+
+enum {
+	/* The granularity of the page cache in bytes - a power of two. */
+	pt_sec_pread_page_size		= 0x1000,
+
+	/* The number of pages in a section's page cache - zero disables
+	 * the page cache.
+	 */
+	pt_sec_pread_cache_pages	= 16
+};
+
+/* A cached page of a pread-based section. */
+struct pt_sec_pread_page {
+	/* The file offset of the page. */
+	uint64_t offset;
+
+	/* The number of valid bytes in @data - zero if the page is empty. */
+	uint32_t size;
+
+	/* The file content. */
+	uint8_t data[pt_sec_pread_page_size];
+};
+
+/* Pread-based section mapping information.
+ *
+ * Reads from the file do not need a lock since pread() does not use the file
+ * position.  Only the optional page cache is protected by a lock.
+ */
+struct pt_sec_pread_mapping {
+	/* The file descriptor. */
+	int fd;
+
+	/* The begin and end of the section as offset into @fd. */
+	uint64_t begin, end;
+
+	/* A direct-mapped cache of pt_sec_pread_cache_pages pages - NULL if
+	 * we do not cache.
+	 */
+	struct pt_sec_pread_page *cache;
+
+#if defined(FEATURE_THREADS)
+	/* A lock protecting @cache.
+	 *
+	 * The lock is only held while accessing @cache, not while reading
+	 * from the file.
+	 */
+	mtx_t lock;
+#endif /* defined(FEATURE_THREADS) */
+};
+
+
+/* Map a section based on pread().
+ *
+ * The caller has already opened the file for reading.  On success, the
+ * section takes ownership of @fd.  It will be closed on unmap.
+ *
+ * On success, sets @section's mapping, unmap, and read pointers.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @section is NULL.
+ * Returns -pte_bad_image if @section does not fit into the file.
+ * Returns -pte_nomem if the mapping can't be allocated.
+ */
+extern int pt_sec_pread_map(struct pt_section *section, int fd);
+
+/* Unmap a pread-based section.
+ *
+ * On success, clears @section's mapping, unmap, and read pointers.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @section is NULL.
+ * Returns -pte_internal if @section has not been mapped.
+ */
+extern int pt_sec_pread_unmap(struct pt_section *section);
+
+/* Read memory from a pread-based section.
+ *
+ * Reads at most @size bytes from @section at @offset into @buffer.
+ *
+ * Returns the number of bytes read on success, a negative error code otherwise.
+ * Returns -pte_invalid if @section or @buffer are NULL.
+ * Returns -pte_nomap if @offset is beyond the end of the section.
+ */
+extern int pt_sec_pread_read(const struct pt_section *section, uint8_t *buffer,
+			     uint16_t size, uint64_t offset);
+
+#endif /* __PT_SECTION_PREAD_H__ */
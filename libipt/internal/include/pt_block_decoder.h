@@ -25,27 +25,48 @@
  * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  * POSSIBILITY OF SUCH DAMAGE.
  */
+#ifndef __PT_BLOCK_DECODER_H__
+#define __PT_BLOCK_DECODER_H__
 
-#include "pti-ild.h"
+#include "pt_insn_decoder.h"
+#include "pt_sblock_cache.h"
 
-#include <windows.h>
+#include "intel-pt.h"
 
 
-BOOLEAN WINAPI DllMain(HINSTANCE handle, DWORD reason, LPVOID reserved)
-{
-	(void) handle;
-	(void) reserved;
+/* An Intel PT block decoder.
+ *
+ * The block decoder groups the instructions determined by an instruction
+ * flow decoder into blocks of sequential instructions.  It bypasses event
+ * processing inside a block.
+ */
+struct pt_block_decoder {
+	/* The Intel(R) Processor Trace instruction flow decoder. */
+	struct pt_insn_decoder insn;
+
+	/* The superblocks skipped by pt_blk_skip(). */
+	struct pt_sblock_cache sbcache;
+
+	/* The trace offset at which the first instruction of the most recent
+	 * block was decoded or, if the block started on cached TNT bits, at
+	 * which the block that fetched them was decoded.
+	 *
+	 * This tells whether the block started before or after a given PSB.
+	 */
+	uint64_t start_offset;
+};
 
-	switch (reason) {
-	case DLL_PROCESS_ATTACH:
-		/* Initialize the Intel(R) Processor Trace instruction
-		   decoder. */
-		pti_ild_init();
-		break;
 
-	default:
-		break;
-	}
+/* Initialize a block decoder.
+ *
+ * Returns zero on success; a negative error code otherwise.
+ * Returns -pte_internal, if @decoder is NULL.
+ * Returns -pte_invalid, if @config is NULL.
+ */
+extern int pt_blk_decoder_init(struct pt_block_decoder *decoder,
+			       const struct pt_config *config);
+
+/* Finalize a block decoder. */
+extern void pt_blk_decoder_fini(struct pt_block_decoder *decoder);
 
-	return TRUE;
-}
+#endif /* __PT_BLOCK_DECODER_H__ */
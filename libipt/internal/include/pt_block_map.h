@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PT_BLOCK_MAP_H__
+#define __PT_BLOCK_MAP_H__
+
+#include "intel-pt.h"
+
+#include <stdint.h>
+
+struct pt_section;
+
+
+/* A map of the instructions in a section.
+ *
+ * The map is computed once by decoding the section linearly from its
+ * beginning.  It tells for each byte offset whether an instruction begins
+ * there and whether a run of instructions that can be walked over without
+ * consulting the trace ends there.
+ *
+ * Instruction decode is deterministic.  If the flow reconstruction reaches
+ * an offset at which an instruction begins in the map, the map describes
+ * the instructions that follow exactly as they would be decoded one by one
+ * until the end of the run.  Offsets at which no instruction begins in the
+ * map, e.g. because the linear decode got misaligned by data in the section,
+ * are not covered and need to be decoded one instruction at a time.
+ */
+struct pt_block_map {
+	/* The bit-vectors - one bit per byte - giving the offsets at which:
+	 *
+	 * - an instruction begins.
+	 */
+	uint64_t *insn;
+
+	/* - a run ends.
+	 *
+	 *   This is set for instructions that may change the flow of execution
+	 *   or that may bind to an event, for offsets at which the linear
+	 *   decode failed, and for an instruction that crosses the end of the
+	 *   section.
+	 */
+	uint64_t *stop;
+
+	/* The size of the section in bytes. */
+	uint64_t size;
+
+	/* The execution mode in which the section had been decoded. */
+	enum pt_exec_mode mode;
+};
+
+/* Allocate a block map.
+ *
+ * Returns a new, empty map for @size bytes on success, NULL otherwise.
+ */
+extern struct pt_block_map *pt_bmap_alloc(uint64_t size,
+					  enum pt_exec_mode mode);
+
+/* Free a block map. */
+extern void pt_bmap_free(struct pt_block_map *bmap);
+
+/* Decode @code into @bmap.
+ *
+ * Decodes @bmap->size bytes of @code linearly in @bmap->mode.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @bmap or @code is NULL.
+ * Returns -pte_bad_insn if @bmap->mode is not a valid execution mode.
+ */
+extern int pt_bmap_build(struct pt_block_map *bmap, const uint8_t *code);
+
+/* Walk over a run of instructions.
+ *
+ * Walks over the instructions beginning at *@offset until the end of their
+ * run.  The run neither includes the instruction that ends it nor any
+ * instruction after it.
+ *
+ * On success, provides the offset of the last instruction in the run in
+ * @last, its number of instructions in @ninsn, and the offset at which the
+ * run ends in @offset.
+ *
+ * Returns a positive number on success.
+ * Returns zero if @offset is not covered by @bmap or if the run is empty or
+ * longer than @max instructions.
+ * Returns -pte_internal if @bmap, @offset, @last, or @ninsn is NULL.
+ */
+extern int pt_bmap_skip(const struct pt_block_map *bmap, uint64_t *offset,
+			uint64_t *last, uint32_t *ninsn, uint32_t max);
+
+/* Provide a block map for a section.
+ *
+ * Decodes @section in @mode and attaches the resulting map to @section
+ * unless it already has one.
+ *
+ * If @cachedir is not NULL and @section is loaded from a file, the map is
+ * read from a cache file in @cachedir that is keyed by the identity of the
+ * file, if one exists.  Otherwise, the map is computed and stored in a new
+ * cache file.  Failing to read or write the cache file is not an error.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @section is NULL.
+ * Returns -pte_bad_insn if @mode is not a valid execution mode.
+ */
+extern int pt_bmap_section(struct pt_section *section, enum pt_exec_mode mode,
+			   const char *cachedir);
+
+/* Return the name of the cache file for @section.
+ *
+ * Returns the malloc()'ed name of the file in @cachedir that holds the map
+ * for @section in @mode on success, NULL if @section is not loaded from a
+ * file or on errors.
+ */
+extern char *pt_bmap_cache_file(const struct pt_section *section,
+				enum pt_exec_mode mode, const char *cachedir);
+
+#endif /* __PT_BLOCK_MAP_H__ */
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __PT_CALLBACK_CACHE_H__
+#define __PT_CALLBACK_CACHE_H__
+
+#include "intel-pt.h"
+
+#include <stdint.h>
+
+#if defined(FEATURE_THREADS)
+#  include <threads.h>
+#endif /* defined(FEATURE_THREADS) */
+
+
+/* A page of memory read via the read memory callback. */
+struct pt_callback_page {
+	/* The address space in which the page had been read. */
+	struct pt_asid asid;
+
+	/* The virtual address of the page. */
+	uint64_t vaddr;
+
+	/* The number of valid bytes - zero if the page is empty. */
+	uint32_t size;
+};
+
+/* A cache for memory read via the read memory callback.
+ *
+ * Rather than calling the callback for each read, the cache requests memory
+ * in naturally aligned pages of @granule bytes and serves subsequent reads in
+ * those pages from memory.
+ *
+ * The cache is direct-mapped.  Pages are indexed by their virtual address and
+ * their address space's cr3.
+ *
+ * The cache is disabled if @npages is zero.
+ *
+ * If FEATURE_THREADS is defined, the cache is protected by a lock so decoders
+ * in different threads may share it.  The lock is not held while the
+ * callback runs.
+ */
+struct pt_callback_cache {
+	/* The page descriptors - NULL if the cache is disabled. */
+	struct pt_callback_page *pages;
+
+	/* The page contents - @granule bytes for each page. */
+	uint8_t *data;
+
+	/* The size of a page in bytes - zero or a power of two. */
+	uint32_t granule;
+
+	/* The base two logarithm of @granule. */
+	uint8_t shift;
+
+	/* The number of pages. */
+	uint32_t npages;
+
+	/* The number of reads served from the cache. */
+	uint64_t hits;
+
+	/* The number of pages requested from the callback. */
+	uint64_t misses;
+
+	/* The number of pages that were invalidated. */
+	uint64_t invalidations;
+
+	/* A counter that is incremented whenever pages are discarded.
+	 *
+	 * A page read from the callback is only installed if the cache has not
+	 * been modified while the callback ran.
+	 */
+	uint64_t generation;
+
+#if defined(FEATURE_THREADS)
+	/* A lock protecting the cache. */
+	mtx_t lock;
+
+	/* The result of initializing @lock. */
+	int lock_status;
+#endif /* defined(FEATURE_THREADS) */
+};
+
+/* Initialize a disabled callback cache. */
+extern void pt_callback_cache_init(struct pt_callback_cache *cache);
+
+/* Finalize a callback cache.
+ *
+ * This frees all pages.
+ */
+extern void pt_callback_cache_fini(struct pt_callback_cache *cache);
+
+/* Configure a callback cache.
+ *
+ * Discards all cached pages and resets the statistics.  If @granule and
+ * @npages are both non-zero, the cache holds @npages pages of @granule bytes.
+ * Otherwise, the cache is disabled.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @cache is NULL.
+ * Returns -pte_invalid if @granule is not a power of two.
+ * Returns -pte_nomem if the pages can't be allocated.  The cache is disabled
+ * in this case.
+ */
+extern int pt_callback_cache_configure(struct pt_callback_cache *cache,
+				       uint32_t granule, uint32_t npages);
+
+/* Discard all cached pages. */
+extern void pt_callback_cache_clear(struct pt_callback_cache *cache);
+
+/* Invalidate cached pages.
+ *
+ * Discards all cached pages in address spaces matching @asid that overlap
+ * with @size bytes starting at @vaddr.
+ *
+ * Returns the number of discarded pages on success, a negative error code
+ * otherwise.
+ * Returns -pte_internal if @cache or @asid is NULL.
+ */
+extern int pt_callback_cache_invalidate(struct pt_callback_cache *cache,
+					const struct pt_asid *asid,
+					uint64_t vaddr, uint64_t size);
+
+/* Get a callback cache's statistics.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @cache or @stats is NULL.
+ * Returns -pte_bad_lock if the cache can't be locked.
+ */
+extern int pt_callback_cache_get_stats(const struct pt_callback_cache *cache,
+				       struct pt_callback_cache_stats *stats);
+
+/* Read memory using a callback cache.
+ *
+ * Reads at most @size bytes at @addr in @asid into @buffer.  Serves the
+ * read from cached pages if possible and requests missing pages from
+ * @callback otherwise.
+ *
+ * If @callback can't provide a page, the read is passed on to @callback
+ * directly.  This is also done if @cache is disabled.
+ *
+ * @callback is called without holding @cache's lock.  It may read from
+ * @cache itself.
+ *
+ * Returns the number of bytes read on success, a negative error code otherwise.
+ * Returns -pte_internal if @cache, @callback, @buffer, or @asid is NULL.
+ * Returns -pte_bad_lock if the cache can't be locked.
+ * Returns -pte_nomem if a page can't be allocated.
+ * Returns the error returned by @callback if no bytes could be read.
+ */
+extern int pt_callback_cache_read(struct pt_callback_cache *cache,
+				  read_memory_callback_t *callback,
+				  void *context, uint8_t *buffer,
+				  uint16_t size, const struct pt_asid *asid,
+				  uint64_t addr);
+
+#endif /* __PT_CALLBACK_CACHE_H__ */
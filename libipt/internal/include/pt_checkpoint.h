@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PT_CHECKPOINT_H__
+#define __PT_CHECKPOINT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct pt_last_ip;
+struct pt_tnt_cache;
+struct pt_time;
+struct pt_time_cal;
+struct pt_event_queue;
+struct pt_event;
+struct pt_retstack;
+struct pt_asid;
+struct pt_qry_state;
+struct pt_insn_state;
+
+
+/* The kinds of decoder checkpoints. */
+enum pt_ckpt_kind {
+	pck_query,
+	pck_insn
+};
+
+/* A decoder checkpoint in a user-provided buffer.
+ *
+ * A checkpoint is written and read field by field in little-endian byte
+ * order.  Errors are recorded and diagnosed once at the end.
+ */
+struct pt_checkpoint {
+	/* The buffer we're writing to - NULL when reading. */
+	uint8_t *out;
+
+	/* The buffer we're reading from - NULL when writing. */
+	const uint8_t *in;
+
+	/* The size of the buffer in bytes. */
+	size_t capacity;
+
+	/* The number of bytes written or read so far.
+	 *
+	 * When writing, this may exceed @capacity.
+	 */
+	size_t size;
+
+	/* A flag indicating that we read beyond @capacity or that we read an
+	 * invalid value.
+	 */
+	uint32_t bad:1;
+};
+
+
+/* Start writing a checkpoint into @buffer of @size bytes.
+ *
+ * If @buffer is NULL, we only determine the size of the checkpoint.
+ */
+extern void pt_ckpt_init_write(struct pt_checkpoint *ckpt, uint8_t *buffer,
+			       size_t size);
+
+/* Start reading a checkpoint from @buffer of @size bytes. */
+extern void pt_ckpt_init_read(struct pt_checkpoint *ckpt,
+			      const uint8_t *buffer, size_t size);
+
+/* Finish writing a checkpoint.
+ *
+ * Returns the size of the checkpoint in bytes on success, a negative error
+ * code otherwise.
+ * Returns -pte_invalid if the checkpoint does not fit into the buffer.
+ */
+extern int pt_ckpt_end_write(const struct pt_checkpoint *ckpt);
+
+/* Finish reading a checkpoint.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_bad_file if the checkpoint is truncated or invalid.
+ */
+extern int pt_ckpt_end_read(const struct pt_checkpoint *ckpt);
+
+/* Write and read a checkpoint header for a checkpoint of kind @kind.
+ *
+ * Reading a header of a different kind or version marks @ckpt bad.
+ */
+extern void pt_ckpt_put_header(struct pt_checkpoint *ckpt,
+			       enum pt_ckpt_kind kind);
+extern void pt_ckpt_get_header(struct pt_checkpoint *ckpt,
+			       enum pt_ckpt_kind kind);
+
+/* Write and read integers. */
+extern void pt_ckpt_put32(struct pt_checkpoint *ckpt, uint32_t value);
+extern void pt_ckpt_put64(struct pt_checkpoint *ckpt, uint64_t value);
+extern uint32_t pt_ckpt_get32(struct pt_checkpoint *ckpt);
+extern uint64_t pt_ckpt_get64(struct pt_checkpoint *ckpt);
+
+/* Write and read decoder state.
+ *
+ * Reading a value that is not valid marks @ckpt bad.
+ */
+extern void pt_ckpt_put_last_ip(struct pt_checkpoint *ckpt,
+				const struct pt_last_ip *last_ip);
+extern void pt_ckpt_get_last_ip(struct pt_checkpoint *ckpt,
+				struct pt_last_ip *last_ip);
+extern void pt_ckpt_put_tnt_cache(struct pt_checkpoint *ckpt,
+				  const struct pt_tnt_cache *tnt);
+extern void pt_ckpt_get_tnt_cache(struct pt_checkpoint *ckpt,
+				  struct pt_tnt_cache *tnt);
+extern void pt_ckpt_put_time(struct pt_checkpoint *ckpt,
+			     const struct pt_time *time);
+extern void pt_ckpt_get_time(struct pt_checkpoint *ckpt,
+			     struct pt_time *time);
+extern void pt_ckpt_put_time_cal(struct pt_checkpoint *ckpt,
+				 const struct pt_time_cal *tcal);
+extern void pt_ckpt_get_time_cal(struct pt_checkpoint *ckpt,
+				 struct pt_time_cal *tcal);
+extern void pt_ckpt_put_event(struct pt_checkpoint *ckpt,
+			      const struct pt_event *event);
+extern void pt_ckpt_get_event(struct pt_checkpoint *ckpt,
+			      struct pt_event *event);
+extern void pt_ckpt_put_evq(struct pt_checkpoint *ckpt,
+			    const struct pt_event_queue *evq);
+extern void pt_ckpt_get_evq(struct pt_checkpoint *ckpt,
+			    struct pt_event_queue *evq);
+extern void pt_ckpt_put_retstack(struct pt_checkpoint *ckpt,
+				 const struct pt_retstack *retstack);
+extern void pt_ckpt_get_retstack(struct pt_checkpoint *ckpt,
+				 struct pt_retstack *retstack);
+extern void pt_ckpt_put_asid(struct pt_checkpoint *ckpt,
+			     const struct pt_asid *asid);
+extern void pt_ckpt_get_asid(struct pt_checkpoint *ckpt,
+			     struct pt_asid *asid);
+extern void pt_ckpt_put_qry_state(struct pt_checkpoint *ckpt,
+				  const struct pt_qry_state *state);
+extern void pt_ckpt_get_qry_state(struct pt_checkpoint *ckpt,
+				  struct pt_qry_state *state);
+extern void pt_ckpt_put_insn_state(struct pt_checkpoint *ckpt,
+				   const struct pt_insn_state *state);
+extern void pt_ckpt_get_insn_state(struct pt_checkpoint *ckpt,
+				   struct pt_insn_state *state);
+
+#endif /* __PT_CHECKPOINT_H__ */
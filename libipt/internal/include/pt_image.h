@@ -30,22 +30,60 @@
 #define __PT_IMAGE_H__
 
 #include "pt_mapped_section.h"
+#include "pt_callback_cache.h"
 
 #include "intel-pt.h"
 
 #include <stdint.h>
 
 
-/* A list of sections. */
-struct pt_section_list {
-	/* The next list element. */
-	struct pt_section_list *next;
-
+/* A section in an image. */
+struct pt_image_entry {
 	/* The mapped section. */
 	struct pt_mapped_section section;
 
-	/* A flag saying whether @section is already mapped. */
-	uint32_t mapped:1;
+	/* The virtual address one byte past the end of @section. */
+	uint64_t end;
+};
+
+/* The sections of one address space.
+ *
+ * All sections share the same asid.  They do not overlap and are sorted by
+ * their virtual address.  This allows finding the section containing a given
+ * address in logarithmic time.
+ *
+ * An index may be shared by address spaces for the same asid in different
+ * images, e.g. after pt_image_copy().  A shared index is immutable.  It is
+ * copied before it is modified.
+ */
+struct pt_image_index {
+	/* The sorted array of sections. */
+	struct pt_image_entry *entries;
+
+	/* The number of used entries. */
+	uint32_t nentries;
+
+	/* The number of allocated entries. */
+	uint32_t capacity;
+
+	/* The number of address spaces using this index.
+	 *
+	 * This field is protected by a global lock since the address spaces
+	 * may belong to images used by different threads.
+	 */
+	uint32_t ucount;
+};
+
+/* An address space in an image. */
+struct pt_image_space {
+	/* The next address space in the same hash bucket. */
+	struct pt_image_space *next;
+
+	/* The address space. */
+	struct pt_asid asid;
+
+	/* The sections in this address space. */
+	struct pt_image_index *index;
 };
 
 /* A traced image consisting of a collection of sections. */
@@ -53,8 +91,32 @@ struct pt_image {
 	/* The optional image name. */
 	char *name;
 
-	/* The list of sections. */
-	struct pt_section_list *sections;
+	/* The address spaces hashed by their cr3.
+	 *
+	 * Address spaces that only differ in their vmcs share a bucket.
+	 * Sections that were added for any cr3 are kept in the bucket for
+	 * pt_asid_no_cr3.
+	 */
+	struct pt_image_space **spaces;
+
+	/* The number of hash buckets - zero or a power of two. */
+	uint32_t nbuckets;
+
+	/* The number of address spaces. */
+	uint32_t nspaces;
+
+	/* The generation of @spaces.
+	 *
+	 * This is incremented whenever address spaces are added or removed.
+	 */
+	uint32_t generation;
+
+	/* The generation of the memory provided by the image.
+	 *
+	 * This is incremented whenever sections are added or removed and
+	 * whenever the read memory callback or its cache is changed.
+	 */
+	uint32_t mgeneration;
 
 	/* An optional read memory callback. */
 	struct {
@@ -63,13 +125,58 @@ struct pt_image {
 
 		/* The callback context. */
 		void *context;
+
+		/* An optional cache for memory read via @callback. */
+		struct pt_callback_cache cache;
 	} readmem;
+};
+
+enum {
+	/* The maximal number of address spaces in an image view. */
+	pt_image_view_size	= 8
+};
+
+/* A view on the address spaces of an image that match an asid.
+ *
+ * Resolving the address spaces that match an asid requires a hash lookup.
+ * Readers keep a view to do this once per asid change rather than on every
+ * read.  The view is re-resolved automatically when the image changes.
+ *
+ * The view further keeps the most recently read section mapped so
+ * consecutive reads from the same section do not need to consult the
+ * section cache.
+ */
+struct pt_image_view {
+	/* The most recently read section - NULL if none.
+	 *
+	 * The view holds a user and a mapper reference on @section.
+	 */
+	struct pt_section *section;
+
+	/* The image for which the view had been resolved. */
+	const struct pt_image *image;
+
+	/* The generation of @image at which the view had been resolved. */
+	uint32_t generation;
+
+	/* The asid for which the view had been resolved. */
+	struct pt_asid asid;
 
-	/* The cache size as number of to-keep-mapped sections. */
-	uint16_t cache;
+	/* The matching address spaces. */
+	struct pt_image_space *space[pt_image_view_size];
 
-	/* The number of permanently mapped sections. */
-	uint16_t mapped;
+	/* The number of valid entries in @space. */
+	uint8_t nspaces;
+
+	/* A flag saying that @space is incomplete and all address spaces
+	 * must be searched.
+	 */
+	uint8_t all:1;
+
+	/* A flag saying that the most recent access had been served by the
+	 * image's read memory callback.
+	 */
+	uint8_t callback:1;
 };
 
 /* Initialize an image with an optional @name. */
@@ -90,6 +197,7 @@ extern void pt_image_fini(struct pt_image *image);
  * Returns zero on success.
  * Returns -pte_internal if @image, @section, or @asid is NULL.
  * Returns -pte_bad_image if @section overlaps with a section in @image.
+ * Returns -pte_nomem if @image can't be grown.
  */
 extern int pt_image_add(struct pt_image *image, struct pt_section *section,
 			const struct pt_asid *asid, uint64_t vaddr);
@@ -117,4 +225,78 @@ extern int pt_image_read(struct pt_image *image, uint8_t *buffer,
 			 uint16_t size, const struct pt_asid *asid,
 			 uint64_t addr);
 
+/* Initialize an image view.
+ *
+ * The view will be resolved on its first use.
+ */
+extern void pt_image_view_init(struct pt_image_view *view);
+
+/* Finalize an image view.
+ *
+ * This releases the section held by @view.  The view may be used again
+ * after finalizing it.
+ */
+extern void pt_image_view_fini(struct pt_image_view *view);
+
+/* Read memory from an image using a view.
+ *
+ * This is similar to pt_image_read() but looks up address spaces using
+ * @view.  If @view has been resolved for a different @image or @asid, or if
+ * @image changed, @view is updated.
+ *
+ * The section containing @addr is held by @view until the next read or
+ * until @view is finalized.
+ *
+ * Returns the number of bytes read on success, a negative error code otherwise.
+ * Returns -pte_internal if @view, @image, @buffer, or @asid is NULL.
+ * Returns -pte_nomap if the section does not contain @addr.
+ */
+extern int pt_image_read_view(struct pt_image_view *view,
+			      struct pt_image *image, uint8_t *buffer,
+			      uint16_t size, const struct pt_asid *asid,
+			      uint64_t addr);
+
+/* Fetch memory from an image using a view.
+ *
+ * This is similar to pt_image_read_view() but avoids copying the memory if
+ * possible.
+ *
+ * On success, provides a pointer to the memory at @addr in @asid in @pbegin.
+ * At most the returned number of bytes starting at *@pbegin may be accessed.
+ *
+ * If the containing section supports direct memory access, *@pbegin points
+ * into the section's mapping.  The pointer remains valid until the next read
+ * using @view or until @view is finalized.
+ *
+ * Otherwise, at most @size bytes are copied into @buffer and *@pbegin points
+ * to @buffer.
+ *
+ * Returns the number of accessible bytes on success, a negative error code
+ * otherwise.
+ * Returns -pte_internal if @view, @image, @pbegin, @buffer, or @asid is NULL.
+ * Returns -pte_nomap if the section does not contain @addr.
+ */
+extern int pt_image_fetch_view(struct pt_image_view *view,
+			       struct pt_image *image, const uint8_t **pbegin,
+			       uint8_t *buffer, uint16_t size,
+			       const struct pt_asid *asid, uint64_t addr);
+
+/* Find the section containing an address using a view.
+ *
+ * This is similar to pt_image_read_view() but does not access the memory at
+ * @addr.  Memory provided by @image's read memory callback is not
+ * considered.
+ *
+ * On success, provides the mapped section containing @addr in @asid in
+ * @pmsec.  The pointer remains valid until the sections in @image change.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @view, @image, @pmsec, or @asid is NULL.
+ * Returns -pte_nomap if no section in @image contains @addr.
+ */
+extern int pt_image_find_view(struct pt_image_view *view,
+			      struct pt_image *image,
+			      const struct pt_mapped_section **pmsec,
+			      const struct pt_asid *asid, uint64_t addr);
+
 #endif /* __PT_IMAGE_H__ */
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __PT_INSN_CACHE_H__
+#define __PT_INSN_CACHE_H__
+
+#include "pti-ild.h"
+
+#include "intel-pt.h"
+
+#include <stdint.h>
+
+struct pt_image;
+
+
+enum {
+	/* The number of entries in an instruction cache - a power of two. */
+	pt_insn_cache_size	= 0x400
+};
+
+/* A decoded instruction. */
+struct pt_insn_cache_entry {
+	/* The address space in which the instruction had been decoded. */
+	struct pt_asid asid;
+
+	/* The instruction's decode information.
+	 *
+	 * The @ild.itext pointer is not valid.  The instruction's address is
+	 * given by @ild.runtime_address.
+	 */
+	pti_ild_t ild;
+
+	/* The generation of the image's memory at which the instruction had
+	 * been decoded.
+	 */
+	uint32_t generation;
+
+	/* The execution mode in which the instruction had been decoded. */
+	uint8_t mode;
+
+	/* A flag saying that the entry is valid. */
+	uint8_t valid:1;
+
+	/* A flag saying that the instruction is relevant for flow
+	 * reconstruction, i.e. that pti_instruction_decode() returned true.
+	 */
+	uint8_t relevant:1;
+
+	/* The instruction's bytes - @ild.length bytes are valid. */
+	uint8_t raw[pt_max_insn_size];
+};
+
+/* A cache of decoded instructions.
+ *
+ * Rather than fetching and decoding an instruction each time it is executed,
+ * an instruction flow decoder remembers the decode information for the most
+ * recently decoded instructions.
+ *
+ * The cache is direct-mapped.  Instructions are indexed by their address and
+ * their address space's cr3.
+ *
+ * Entries are valid for one image and one generation of its memory.  They
+ * become invalid when sections are added to or removed from the image, or
+ * when the image's read memory callback changes.
+ */
+struct pt_insn_cache {
+	/* The entries - NULL until the first instruction is added. */
+	struct pt_insn_cache_entry *entries;
+
+	/* The image for which the entries are valid. */
+	const struct pt_image *image;
+
+	/* The number of instructions served from the cache. */
+	uint64_t hits;
+
+	/* The number of instructions that were not found in the cache. */
+	uint64_t misses;
+};
+
+/* Initialize an empty instruction cache. */
+extern void pt_insn_cache_init(struct pt_insn_cache *cache);
+
+/* Finalize an instruction cache.
+ *
+ * This frees all entries.
+ */
+extern void pt_insn_cache_fini(struct pt_insn_cache *cache);
+
+/* Discard all cached instructions. */
+extern void pt_insn_cache_clear(struct pt_insn_cache *cache);
+
+/* Look up an instruction.
+ *
+ * Searches @cache for the instruction at @ip in @asid decoded in @mode from
+ * the current generation of @image.
+ *
+ * Returns a pointer to the cache entry if found, NULL otherwise.
+ */
+extern const struct pt_insn_cache_entry *
+pt_insn_cache_lookup(struct pt_insn_cache *cache,
+		     const struct pt_image *image,
+		     const struct pt_asid *asid, enum pt_exec_mode mode,
+		     uint64_t ip);
+
+/* Add an instruction.
+ *
+ * Adds the instruction described by @ild that had been decoded in @mode at
+ * @ild->runtime_address in @asid from the current generation of @image to
+ * @cache.  Copies @ild->length bytes of @ild->itext.  The @relevant argument
+ * gives the result of pti_instruction_decode() for @ild.
+ *
+ * Replaces any instruction that maps to the same entry.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @cache, @image, @asid, or @ild is NULL.
+ * Returns -pte_internal if @ild->length is too big.
+ * Returns -pte_nomem if the cache entries can't be allocated.
+ */
+extern int pt_insn_cache_add(struct pt_insn_cache *cache,
+			     const struct pt_image *image,
+			     const struct pt_asid *asid,
+			     enum pt_exec_mode mode, const pti_ild_t *ild,
+			     int relevant);
+
+#endif /* __PT_INSN_CACHE_H__ */
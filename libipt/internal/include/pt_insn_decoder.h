@@ -32,10 +32,13 @@
 #include "pt_query_decoder.h"
 #include "pt_image.h"
 #include "pt_retstack.h"
+#include "pt_insn_cache.h"
 #include "pti-ild.h"
 
 #include <inttypes.h>
 
+struct pt_sblock_cache_entry;
+
 
 struct pt_insn_decoder {
 	/* The Intel(R) Processor Trace query decoder. */
@@ -47,6 +50,9 @@ struct pt_insn_decoder {
 	/* The image. */
 	struct pt_image *image;
 
+	/* The view on @image for the current address space. */
+	struct pt_image_view view;
+
 	/* The current address space. */
 	struct pt_asid asid;
 
@@ -59,6 +65,30 @@ struct pt_insn_decoder {
 	/* The Intel(R) Processor Trace instruction (length) decoder. */
 	pti_ild_t ild;
 
+	/* The most recently decoded instructions. */
+	struct pt_insn_cache icache;
+
+	/* The section containing the most recently skipped instructions.
+	 *
+	 * This is used for walking over instructions using the section's
+	 * block map.  It is valid if @image is the decoder's image and the
+	 * image's sections did not change.
+	 */
+	struct {
+		/* The image and its memory generation. */
+		const struct pt_image *image;
+		uint32_t mgeneration;
+
+		/* The address space. */
+		struct pt_asid asid;
+
+		/* The virtual address range [@begin; @end[ of the section. */
+		uint64_t begin, end;
+
+		/* The section's block map - NULL if it does not have one. */
+		const struct pt_block_map *bmap;
+	} run;
+
 	/* The current IP. */
 	uint64_t ip;
 
@@ -95,6 +125,45 @@ struct pt_insn_decoder {
 
 	/* - a vmcs event has been bound to the current instruction. */
 	uint32_t vmcs_event_bound:1;
+
+	/* - we ran out of trace after the current instruction. */
+	uint32_t resume_proceed:1;
+
+	/* - we ran out of trace processing events for the next instruction. */
+	uint32_t resume_peek:1;
+};
+
+/* The decoding state of an instruction flow decoder as stored in a
+ * checkpoint.
+ */
+struct pt_insn_state {
+	/* The query decoder's state. */
+	struct pt_qry_state query;
+
+	/* The current address space, event, and return stack. */
+	struct pt_asid asid;
+	struct pt_event event;
+	struct pt_retstack retstack;
+
+	/* The current IP and the IP of the last disable. */
+	uint64_t ip;
+	uint64_t last_disable_ip;
+
+	/* The current execution mode. */
+	enum pt_exec_mode mode;
+
+	/* The status of the last decoder query. */
+	int status;
+
+	/* The decoder's flags. */
+	uint32_t enabled:1;
+	uint32_t process_event:1;
+	uint32_t event_may_change_ip:1;
+	uint32_t speculative:1;
+	uint32_t paging_event_bound:1;
+	uint32_t vmcs_event_bound:1;
+	uint32_t resume_proceed:1;
+	uint32_t resume_peek:1;
 };
 
 
@@ -110,4 +179,69 @@ extern int pt_insn_decoder_init(struct pt_insn_decoder *decoder,
 /* Finalize an instruction flow decoder. */
 extern void pt_insn_decoder_fini(struct pt_insn_decoder *decoder);
 
+/* Check whether events need to be processed for the next instruction.
+ *
+ * Returns zero if the next instruction can be decoded without event
+ * processing, a positive number otherwise.  This includes the case where
+ * tracing is disabled or where @decoder encountered an error.
+ */
+extern int pt_insn_needs_events(const struct pt_insn_decoder *decoder);
+
+/* Determine the next instruction.
+ *
+ * This is pt_insn_next() for a struct pt_insn of the current size.  It skips
+ * event processing if pt_insn_needs_events() says that it is not needed.
+ *
+ * Returns a non-negative pt_status_flag bit-vector on success, a negative error
+ * code otherwise.
+ * Returns -pte_internal if @decoder or @insn is NULL.
+ */
+extern int pt_insn_step(struct pt_insn_decoder *decoder, struct pt_insn *insn);
+
+/* Skip instructions.
+ *
+ * Proceeds over instructions without providing a struct pt_insn for them as
+ * long as they can neither change the flow of execution nor bind to an event
+ * and as long as no events need to be processed.
+ *
+ * If the section containing the current IP has a block map, walks over up to
+ * @max instructions using the map.  Otherwise, skips at most one instruction.
+ *
+ * On success, provides the IP of the last skipped instruction in @ip and the
+ * number of skipped instructions in @ninsn.
+ *
+ * Returns a positive number if at least one instruction has been skipped.
+ * Returns zero if the instruction needs to be decoded using pt_insn_step().
+ * Returns a negative error code otherwise.  The error is logged in @decoder
+ * and reported by the next pt_insn_step().
+ * Returns -pte_internal if @decoder, @ip, or @ninsn is NULL.
+ */
+extern int pt_insn_skip(struct pt_insn_decoder *decoder, uint64_t *ip,
+			uint32_t *ninsn, uint32_t max);
+
+/* Follow conditional branches.
+ *
+ * Walks from @sblock->ip over blocks of instructions that each end in a direct
+ * conditional branch.  The @sblock->ntnt outcomes given in @sblock->tnt,
+ * starting with the most significant one, determine where each block
+ * continues.
+ *
+ * This does not consult the trace and does not change @decoder's state other
+ * than its caches.  It decodes in @decoder's execution mode and address space.
+ *
+ * Stops after @sblock->ntnt blocks or before a block that contains another
+ * relevant instruction or that can not be decoded.  That block is left to
+ * pt_insn_step().
+ *
+ * On success, sets @sblock->next_ip, @sblock->ninsn, @sblock->nblocks, and
+ * @sblock->nused.  The remaining fields of @sblock are not modified.
+ *
+ * Returns zero on success.
+ * Returns a positive number on success if the result depends on memory that
+ * may change, i.e. on memory provided by an uncached read memory callback.
+ * Returns -pte_internal if @decoder or @sblock is NULL.
+ */
+extern int pt_insn_follow_tnt(struct pt_insn_decoder *decoder,
+			      struct pt_sblock_cache_entry *sblock);
+
 #endif /* __PT_INSN_DECODER_H__ */
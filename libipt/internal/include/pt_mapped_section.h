@@ -103,4 +103,20 @@ extern int pt_msec_read_mapped(const struct pt_mapped_section *msec,
 			       uint8_t *buffer, uint16_t size,
 			       const struct pt_asid *asid, uint64_t addr);
 
+/* Fetch memory from a mapped section without copying.
+ *
+ * Provides a pointer to the memory of @msec at @addr in @asid in @pbegin.  At
+ * most @size bytes starting at *@pbegin may be accessed.  The caller must map
+ * @msec.  The pointer remains valid until @msec is unmapped.
+ *
+ * Returns the number of accessible bytes on success, a negative error code
+ * otherwise.
+ * Returns -pte_internal, if @msec, @pbegin, or @asid are NULL.
+ * Returns -pte_nomap, if the mapped section does not contain @addr in @asid.
+ * Returns -pte_not_supported, if @msec does not support direct access.
+ */
+extern int pt_msec_fetch_mapped(const struct pt_mapped_section *msec,
+				const uint8_t **pbegin, uint16_t size,
+				const struct pt_asid *asid, uint64_t addr);
+
 #endif /* __PT_MAPPED_SECTION_H__ */
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PT_MERGE_DECODER_H__
+#define __PT_MERGE_DECODER_H__
+
+#include "intel-pt.h"
+
+#include <stdint.h>
+
+
+/* The per-cpu state of a merge decoder. */
+struct pt_merge_cpu {
+	/* The instruction flow decoder for this cpu's trace. */
+	struct pt_insn_decoder *decoder;
+
+	/* The next instruction. */
+	struct pt_insn insn;
+
+	/* The time at @insn. */
+	uint64_t time;
+
+	/* The pt_insn_next() status for @insn. */
+	int status;
+};
+
+/* A merge decoder. */
+struct pt_merge_decoder {
+	/* The per-cpu state. */
+	struct pt_merge_cpu *cpu;
+
+	/* The number of cpus. */
+	uint32_t ncpus;
+
+	/* A min-heap of indices into @cpu ordered by time.
+	 *
+	 * It contains the cpus that have an instruction pending.
+	 */
+	uint32_t *heap;
+
+	/* The number of cpus in @heap. */
+	uint32_t nheap;
+
+	/* The time at the last instruction. */
+	uint64_t time;
+};
+
+
+/* Initialize a merge decoder for @ncpus traces given in @config.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @decoder is NULL.
+ * Returns -pte_invalid if @config is NULL or @ncpus is zero.
+ * Returns -pte_nomem if there is not enough memory.
+ */
+extern int pt_merge_decoder_init(struct pt_merge_decoder *decoder,
+				 const struct pt_config *config,
+				 uint32_t ncpus);
+
+/* Finalize a merge decoder. */
+extern void pt_merge_decoder_fini(struct pt_merge_decoder *decoder);
+
+#endif /* __PT_MERGE_DECODER_H__ */
@@ -29,6 +29,8 @@
 #ifndef __PT_PACKET_DECODER_H__
 #define __PT_PACKET_DECODER_H__
 
+#include "pt_window.h"
+
 #include "intel-pt.h"
 
 
@@ -37,11 +39,17 @@ struct pt_packet_decoder {
 	/* The decoder configuration. */
 	struct pt_config config;
 
-	/* The current position in the trace buffer. */
+	/* The window into the trace. */
+	struct pt_window win;
+
+	/* The current position in the trace buffer.
+	 *
+	 * This is NULL if the decoder is not synchronized.
+	 */
 	const uint8_t *pos;
 
-	/* The position of the last PSB packet. */
-	const uint8_t *sync;
+	/* The offset of the last PSB packet. */
+	uint64_t sync;
 };
 
 
@@ -26,11 +26,43 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include "pti-ild.h"
+#ifndef __PT_PSB_INDEX_H__
+#define __PT_PSB_INDEX_H__
 
+#include "intel-pt.h"
 
-static void __attribute__((constructor)) init(void)
-{
-	/* Initialize the Intel(R) Processor Trace instruction decoder. */
-	pti_ild_init();
-}
+#include <stdint.h>
+
+
+/* An index of the PSB packets in a trace. */
+struct pt_psb_index {
+	/* The entries sorted by their offset. */
+	struct pt_psb_index_entry *entries;
+
+	/* The number of entries and the capacity of @entries. */
+	uint32_t nentries;
+	uint32_t capacity;
+
+	/* The size of the indexed trace buffer in bytes. */
+	uint64_t size;
+};
+
+/* Initialize an empty PSB index. */
+extern void pt_psb_index_init(struct pt_psb_index *index);
+
+/* Finalize a PSB index. */
+extern void pt_psb_index_fini(struct pt_psb_index *index);
+
+/* Add @entry to @index.
+ *
+ * The offset of @entry must be bigger than the offset of the last entry.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @index or @entry is NULL or if @entry is out of
+ * order.
+ * Returns -pte_nomem if @index can't be enlarged.
+ */
+extern int pt_psb_index_add(struct pt_psb_index *index,
+			    const struct pt_psb_index_entry *entry);
+
+#endif /* __PT_PSB_INDEX_H__ */
@@ -33,6 +33,7 @@
 #include "pt_tnt_cache.h"
 #include "pt_time.h"
 #include "pt_event_queue.h"
+#include "pt_window.h"
 
 #include "intel-pt.h"
 
@@ -44,11 +45,19 @@ struct pt_query_decoder {
 	/* The decoder configuration. */
 	struct pt_config config;
 
-	/* The current position in the trace buffer. */
+	/* The window into the trace that @config.begin and @config.end
+	 * describe.
+	 */
+	struct pt_window win;
+
+	/* The current position in the trace buffer.
+	 *
+	 * This is NULL if the decoder is not synchronized.
+	 */
 	const uint8_t *pos;
 
-	/* The position of the last PSB packet. */
-	const uint8_t *sync;
+	/* The trace offset of the last PSB packet. */
+	uint64_t sync;
 
 	/* The decoding function for the next packet. */
 	const struct pt_decoder_function *next;
@@ -91,6 +100,79 @@ extern int pt_qry_decoder_init(struct pt_query_decoder *,
 /* Finalize the query decoder. */
 extern void pt_qry_decoder_fini(struct pt_query_decoder *);
 
+/* The decoding state of a query decoder as stored in a checkpoint. */
+struct pt_qry_state {
+	/* The trace offsets of the current position and of the last PSB. */
+	uint64_t offset;
+	uint64_t sync;
+
+	/* The last-ip. */
+	struct pt_last_ip ip;
+
+	/* The cached tnt indicators. */
+	struct pt_tnt_cache tnt;
+
+	/* Timing information and calibration. */
+	struct pt_time time;
+	struct pt_time_cal tcal;
+
+	/* Pending (incomplete) events. */
+	struct pt_event_queue evq;
+
+	/* The decoder's flags. */
+	uint32_t enabled:1;
+	uint32_t consume_packet:1;
+
+	/* A flag indicating that the decoder fetched the next packet. */
+	uint32_t has_next:1;
+};
+
+/* Get the decoding state of a query decoder.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_nosync if @decoder is not synchronized.
+ */
+extern int pt_qry_get_state(const struct pt_query_decoder *decoder,
+			    struct pt_qry_state *state);
+
+/* Set the decoding state of a query decoder.
+ *
+ * Moves @decoder to @state's position in its trace.  On failure, @decoder is
+ * not synchronized.
+ *
+ * Returns a non-negative pt_status_flag bit-vector on success, a negative error
+ * code otherwise.
+ * Returns -pte_invalid if @state's position lies outside of @decoder's trace.
+ */
+extern int pt_qry_set_state(struct pt_query_decoder *decoder,
+			    const struct pt_qry_state *state);
+
+/* Peek at the cached conditional branch outcomes.
+ *
+ * Provides the outcomes of the next conditional branches that are already
+ * cached in @decoder in the low bits of @tnt, with the next outcome in the most
+ * significant of those bits.  A set bit indicates a taken branch.
+ *
+ * This does not fetch new packets and does not consume the outcomes.
+ *
+ * Returns the number of cached outcomes on success, a negative error code
+ * otherwise.
+ */
+extern int pt_qry_peek_tnt(const struct pt_query_decoder *decoder,
+			   uint64_t *tnt);
+
+/* Skip cached conditional branch outcomes.
+ *
+ * Consumes the next @count cached outcomes as if pt_qry_cond_branch() had been
+ * called @count times.
+ *
+ * Returns a non-negative pt_status_flag bit-vector on success, a negative error
+ * code otherwise.
+ *
+ * Returns -pte_bad_query if there are less than @count outcomes cached.
+ */
+extern int pt_qry_skip_tnt(struct pt_query_decoder *decoder, uint8_t count);
+
 /* Decoder functions (tracing context). */
 extern int pt_qry_decode_unknown(struct pt_query_decoder *);
 extern int pt_qry_decode_pad(struct pt_query_decoder *);
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PT_SBLOCK_CACHE_H__
+#define __PT_SBLOCK_CACHE_H__
+
+#include "intel-pt.h"
+
+#include <stdint.h>
+
+struct pt_image;
+
+
+enum {
+	/* The number of entries in a superblock cache - a power of two. */
+	pt_sblock_cache_size	= 0x100
+};
+
+/* A superblock.
+ *
+ * A sequence of blocks that each end in a conditional branch.  Which blocks
+ * are part of the superblock is determined by the outcome of those
+ * conditional branches.
+ */
+struct pt_sblock_cache_entry {
+	/* The address space in which the superblock had been decoded. */
+	struct pt_asid asid;
+
+	/* The IP of the first instruction in the superblock. */
+	uint64_t ip;
+
+	/* The outcome of the conditional branches in the low @ntnt bits with
+	 * the first outcome in the most significant of those bits.
+	 */
+	uint64_t tnt;
+
+	/* The IP of the first instruction after the superblock. */
+	uint64_t next_ip;
+
+	/* The number of instructions in the superblock. */
+	uint64_t ninsn;
+
+	/* The number of blocks in the superblock. */
+	uint32_t nblocks;
+
+	/* The generation of the image's memory at which the superblock had
+	 * been decoded.
+	 */
+	uint32_t generation;
+
+	/* The number of outcomes in @tnt. */
+	uint8_t ntnt;
+
+	/* The number of outcomes used by the superblock.
+	 *
+	 * This is less than @ntnt if the superblock ended before a block that
+	 * does not end in a conditional branch.
+	 */
+	uint8_t nused;
+
+	/* The execution mode in which the superblock had been decoded. */
+	uint8_t mode;
+
+	/* A flag saying that the entry is valid. */
+	uint8_t valid:1;
+};
+
+/* A cache of superblocks.
+ *
+ * A block decoder remembers how far a sequence of conditional branch outcomes
+ * took it from a given IP.  This allows it to proceed over all the blocks
+ * covered by a tnt packet in one step the next time the same code is executed
+ * with the same outcomes.
+ *
+ * The cache is direct-mapped.  Superblocks are indexed by their start address,
+ * the outcomes of their conditional branches, and their address space's cr3.
+ *
+ * Entries are valid for one image and one generation of its memory.  They
+ * become invalid when sections are added to or removed from the image, or
+ * when the image's read memory callback changes.
+ */
+struct pt_sblock_cache {
+	/* The entries - NULL until the first superblock is added. */
+	struct pt_sblock_cache_entry *entries;
+
+	/* The image for which the entries are valid. */
+	const struct pt_image *image;
+
+	/* The number of superblocks served from the cache. */
+	uint64_t hits;
+
+	/* The number of superblocks that were not found in the cache. */
+	uint64_t misses;
+};
+
+/* Initialize an empty superblock cache. */
+extern void pt_sblock_cache_init(struct pt_sblock_cache *cache);
+
+/* Finalize a superblock cache.
+ *
+ * This frees all entries.
+ */
+extern void pt_sblock_cache_fini(struct pt_sblock_cache *cache);
+
+/* Discard all cached superblocks. */
+extern void pt_sblock_cache_clear(struct pt_sblock_cache *cache);
+
+/* Look up a superblock.
+ *
+ * Searches @cache for the superblock starting at @ip in @asid in @mode for the
+ * @ntnt conditional branch outcomes given in @tnt that had been decoded from
+ * the current generation of @image.
+ *
+ * Returns a pointer to the cache entry if found, NULL otherwise.
+ */
+extern const struct pt_sblock_cache_entry *
+pt_sblock_cache_lookup(struct pt_sblock_cache *cache,
+		       const struct pt_image *image,
+		       const struct pt_asid *asid, enum pt_exec_mode mode,
+		       uint64_t ip, uint64_t tnt, uint8_t ntnt);
+
+/* Add a superblock.
+ *
+ * Adds @sblock that had been decoded in @sblock->mode in @sblock->asid from the
+ * current generation of @image to @cache.  The @sblock->generation and
+ * @sblock->valid fields are ignored.
+ *
+ * Replaces any superblock that maps to the same entry.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @cache, @image, or @sblock is NULL.
+ * Returns -pte_internal if @sblock->nused is bigger than @sblock->ntnt.
+ * Returns -pte_nomem if the cache entries can't be allocated.
+ */
+extern int pt_sblock_cache_add(struct pt_sblock_cache *cache,
+			       const struct pt_image *image,
+			       const struct pt_sblock_cache_entry *sblock);
+
+#endif /* __PT_SBLOCK_CACHE_H__ */
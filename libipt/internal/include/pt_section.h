@@ -35,10 +35,12 @@
 #  include <threads.h>
 #endif /* defined(FEATURE_THREADS) */
 
+struct pt_block_map;
 
-/* A section of contiguous memory loaded from a file. */
+
+/* A section of contiguous memory loaded from a file or from a memory buffer. */
 struct pt_section {
-	/* The name of the file. */
+	/* The name of the file - NULL for memory buffer sections. */
 	char *filename;
 
 	/* The offset into the file. */
@@ -54,6 +56,8 @@ struct pt_section {
 	 * The status is initialized on first pt_section_map() and will be
 	 * left in the section until the section is destroyed.  This field
 	 * is owned by the OS-specific mmap-based section implementation.
+	 *
+	 * For memory buffer sections, this points to the buffer status.
 	 */
 	void *status;
 
@@ -82,6 +86,24 @@ struct pt_section {
 	int (*read)(const struct pt_section *sec, uint8_t *buffer,
 		    uint16_t size, uint64_t offset);
 
+	/* A pointer to the fetch function - NULL if the section is currently
+	 * not mapped or if the mapping does not provide direct access to the
+	 * section's memory.
+	 *
+	 * This field is set in pt_section_map() and owned by the mapping
+	 * implementation.
+	 */
+	int (*fetch)(const struct pt_section *sec, const uint8_t **pbegin,
+		     uint16_t size, uint64_t offset);
+
+	/* An optional map of the section's instructions - NULL if the section
+	 * has not been pre-decoded.
+	 *
+	 * The map is attached once and owned by the section.  It remains
+	 * valid until the section is destroyed.
+	 */
+	struct pt_block_map *bmap;
+
 #if defined(FEATURE_THREADS)
 	/* A lock protecting this section.
 	 *
@@ -91,11 +113,43 @@ struct pt_section {
 	mtx_t lock;
 #endif /* defined(FEATURE_THREADS) */
 
-	/* The number of current users.  The last user destroys the section. */
-	uint16_t ucount;
+	/* The section cache's LRU list links - NULL if the section is not
+	 * cached or at the respective end of the list.
+	 *
+	 * These fields are owned by the section cache and protected by its
+	 * lock.
+	 */
+	struct pt_section *lru_prev, *lru_next;
+
+	/* The next section in the same section registry hash bucket.
+	 *
+	 * This field is owned by the section registry and protected by its
+	 * lock.
+	 */
+	struct pt_section *reg_next;
+
+	/* The number of current users.  The last user destroys the section.
+	 *
+	 * Registered sections are shared by all images in the process, so
+	 * this may get big.
+	 */
+	uint32_t ucount;
 
 	/* The number of current mappers.  The last unmaps the section. */
 	uint16_t mcount;
+
+	/* A flag saying whether the section is in the section cache.
+	 *
+	 * This field is owned by the section cache and protected by its lock.
+	 */
+	uint8_t cached;
+
+	/* A flag saying whether the section is in the section registry.
+	 *
+	 * This field is owned by the section registry.  It is set before the
+	 * section is shared and cleared by the last user.
+	 */
+	uint8_t registered;
 };
 
 /* Create a section.
@@ -115,6 +169,20 @@ struct pt_section {
 extern struct pt_section *pt_mk_section(const char *file, uint64_t offset,
 					uint64_t size);
 
+/* Create a section for a file with known status.
+ *
+ * This is similar to pt_mk_section() but uses a copy of @status and the file
+ * size @fsize instead of querying @file's status.  Use this if the status of
+ * @file is already known, e.g. because several sections are created for the
+ * same file.
+ *
+ * Returns a new section on success, NULL otherwise.
+ */
+extern struct pt_section *pt_mk_section_status(const char *file,
+					       uint64_t offset, uint64_t size,
+					       const void *status,
+					       uint64_t fsize);
+
 /* Lock a section.
  *
  * Locks @section.  The section must not be locked.
@@ -162,6 +230,24 @@ extern const char *pt_section_filename(const struct pt_section *section);
 /* Return the size of the section in bytes. */
 extern uint64_t pt_section_size(const struct pt_section *section);
 
+/* Return the block map of @section - NULL if there is none. */
+extern const struct pt_block_map *
+pt_section_bmap(struct pt_section *section);
+
+/* Attach a block map to a section.
+ *
+ * Attaches @bmap to @section unless @section already has a map.  On
+ * success, @section takes ownership of @bmap.
+ *
+ * Returns zero if @bmap has been attached.
+ * Returns a positive number if @section already has a map.  The caller
+ * retains ownership of @bmap in this case.
+ * Returns -pte_internal if @section or @bmap is NULL.
+ * Returns -pte_bad_lock on any locking error.
+ */
+extern int pt_section_attach_bmap(struct pt_section *section,
+				  struct pt_block_map *bmap);
+
 /* Create the OS-specific file status.
  *
  * On success, allocates a status object, provides a pointer to it in @pstatus
@@ -179,6 +265,48 @@ extern uint64_t pt_section_size(const struct pt_section *section);
 extern int pt_section_mk_status(void **pstatus, uint64_t *psize,
 				const char *filename);
 
+/* Check whether two file status objects describe the same file.
+ *
+ * Compares the OS-specific file status objects @lhs and @rhs created by
+ * pt_section_mk_status() for the same file name.  They match if they refer to
+ * the same version of the same file.
+ *
+ * This function is implemented in the OS-specific section implementation.
+ *
+ * Returns a positive number if @lhs and @rhs match.
+ * Returns zero if they do not match.
+ * Returns -pte_internal if @lhs or @rhs is NULL.
+ */
+extern int pt_section_match_status(const void *lhs, const void *rhs);
+
+/* Copy a file status object.
+ *
+ * On success, allocates a copy of @status and provides a pointer to it in
+ * @pcopy.
+ *
+ * This function is implemented in the OS-specific section implementation.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @pcopy or @status is NULL.
+ * Returns -pte_nomem if the copy can't be allocated.
+ */
+extern int pt_section_dup_status(void **pcopy, const void *status);
+
+/* Describe the identity of a file.
+ *
+ * Provides the size and the modification time of the file described by the
+ * file status object @status in @psize and @pmtime, respectively.  Unlike the
+ * status object, they may be stored for later comparison, e.g. in an image
+ * manifest.
+ *
+ * This function is implemented in the OS-specific section implementation.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @psize, @pmtime, or @status is NULL.
+ */
+extern int pt_section_status_identity(uint64_t *psize, uint64_t *pmtime,
+				      const void *status);
+
 /* Map a section.
  *
  * Maps @section into memory.  Mappings are use-counted.  The number of
@@ -218,4 +346,23 @@ extern int pt_section_unmap(struct pt_section *section);
 extern int pt_section_read(const struct pt_section *section, uint8_t *buffer,
 			   uint16_t size, uint64_t offset);
 
+/* Fetch memory from a section without copying.
+ *
+ * Provides a pointer to the memory of @section at @offset in @pbegin.  At most
+ * @size bytes starting at *@pbegin may be accessed.  @section must be mapped.
+ *
+ * The pointer remains valid until @section is unmapped.
+ *
+ * Returns the number of accessible bytes on success, a negative error code
+ * otherwise.
+ * Returns -pte_internal if @section or @pbegin is NULL.
+ * Returns -pte_nomap if @section is not mapped.
+ * Returns -pte_nomap if @offset is beyond the end of the section.
+ * Returns -pte_not_supported if @section's mapping does not support direct
+ * memory access.  Use pt_section_read() in this case.
+ */
+extern int pt_section_fetch(const struct pt_section *section,
+			    const uint8_t **pbegin, uint16_t size,
+			    uint64_t offset);
+
 #endif /* __PT_SECTION_H__ */
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __PT_SECTION_BUFFER_H__
+#define __PT_SECTION_BUFFER_H__
+
+#include <stdint.h>
+
+struct pt_section;
+
+
+/* The status of a memory buffer section.
+ *
+ * Buffer sections are not backed by a file.  They use this object instead of
+ * the OS-specific file status.  It is free()'ed when its section is.
+ */
+struct pt_sec_buffer_status {
+	/* The beginning of the section's memory.
+	 *
+	 * This either points to the user's buffer or to a copy of it that is
+	 * allocated together with this object.
+	 */
+	const uint8_t *begin;
+};
+
+/* Create a memory buffer section.
+ *
+ * The returned section describes @size bytes of memory starting at @buffer.
+ * It has no filename.
+ *
+ * If @copy is non-zero, the section keeps its own copy of @buffer.
+ * Otherwise, @buffer must remain valid and must not change for the lifetime
+ * of the section.
+ *
+ * The returned section is not mapped and starts with a user count of one.
+ *
+ * Returns a new section on success, NULL otherwise.
+ */
+extern struct pt_section *pt_mk_section_buffer(const uint8_t *buffer,
+					       uint64_t size, int copy);
+
+/* Map a memory buffer section.
+ *
+ * On success, sets @section's mapping, unmap, read, and fetch pointers.
+ *
+ * Mapping a buffer section does not require any resources.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @section is NULL or not a buffer section.
+ * Returns -pte_internal if @section is already mapped.
+ */
+extern int pt_sec_buffer_map(struct pt_section *section);
+
+/* Unmap a memory buffer section.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @section is NULL or not mapped.
+ */
+extern int pt_sec_buffer_unmap(struct pt_section *section);
+
+/* Read memory from a memory buffer section.
+ *
+ * Reads at most @size bytes from @section at @offset into @buffer.
+ *
+ * Returns the number of bytes read on success, a negative error code otherwise.
+ * Returns -pte_invalid if @section or @buffer are NULL.
+ * Returns -pte_nomap if @offset is beyond the end of the section.
+ */
+extern int pt_sec_buffer_read(const struct pt_section *section,
+			      uint8_t *buffer, uint16_t size,
+			      uint64_t offset);
+
+/* Fetch memory from a memory buffer section without copying.
+ *
+ * Provides a pointer to @section's memory at @offset in @pbegin.
+ *
+ * Returns the number of accessible bytes on success, a negative error code
+ * otherwise.
+ * Returns -pte_internal if @section or @pbegin are NULL.
+ * Returns -pte_nomap if @offset is beyond the end of the section.
+ */
+extern int pt_sec_buffer_fetch(const struct pt_section *section,
+			       const uint8_t **pbegin, uint16_t size,
+			       uint64_t offset);
+
+#endif /* __PT_SECTION_BUFFER_H__ */
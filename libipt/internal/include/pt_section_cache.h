@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PT_SECTION_CACHE_H__
+#define __PT_SECTION_CACHE_H__
+
+#include <stdint.h>
+
+#if defined(FEATURE_THREADS)
+#  include <threads.h>
+#endif /* defined(FEATURE_THREADS) */
+
+struct pt_section;
+
+
+enum {
+	/* The default section cache memory budget in bytes. */
+	pt_section_cache_default_limit = 256 << 20
+};
+
+/* A process-wide cache of mapped sections.
+ *
+ * The cache keeps recently used sections mapped so they need not be mapped
+ * again by the next image or decoder that uses them.  It holds one user and
+ * one mapper reference on each cached section.
+ *
+ * Sections are kept in a doubly-linked list in least recently used order
+ * using links in struct pt_section.  The least recently used sections are
+ * evicted to keep the total size of cached sections within the cache's
+ * memory budget.
+ */
+struct pt_section_cache {
+	/* The most and least recently used sections - NULL if empty. */
+	struct pt_section *head, *tail;
+
+	/* The memory budget in bytes. */
+	uint64_t limit;
+
+	/* The total size of all cached sections in bytes. */
+	uint64_t size;
+
+	/* The number of pt_section_cache_map() calls served by a cached
+	 * mapping and the number of those that weren't.
+	 */
+	uint64_t hits, misses;
+
+	/* The number of sections that were evicted to stay within @limit. */
+	uint64_t evictions;
+
+	/* The number of cached sections. */
+	uint32_t nsections;
+
+#if defined(FEATURE_THREADS)
+	/* A lock protecting the cache and the LRU links of cached sections.
+	 *
+	 * The cache lock may be taken before a section's lock but not the
+	 * other way around.
+	 */
+	mtx_t lock;
+#endif /* defined(FEATURE_THREADS) */
+};
+
+/* Map a section using the section cache.
+ *
+ * Maps @section like pt_section_map() and adds it to the section cache, or
+ * marks it as most recently used if it is already cached.  If @section is
+ * bigger than the cache's memory budget, it is mapped but not cached.
+ *
+ * Adding @section may evict other sections.
+ *
+ * The caller must unmap @section with pt_section_unmap().
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @section is NULL.
+ * Returns -pte_bad_lock on any locking error.
+ */
+extern int pt_section_cache_map(struct pt_section *section);
+
+#endif /* __PT_SECTION_CACHE_H__ */
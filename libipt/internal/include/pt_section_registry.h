@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PT_SECTION_REGISTRY_H__
+#define __PT_SECTION_REGISTRY_H__
+
+#include <stdint.h>
+
+#if defined(FEATURE_THREADS)
+#  include <threads.h>
+#endif /* defined(FEATURE_THREADS) */
+
+struct pt_section;
+
+
+/* A process-wide registry of file sections.
+ *
+ * The registry allows sections for the same part of the same file to be
+ * shared by all images in the process.  It is keyed by file name, offset,
+ * size, and the OS-specific file status that identifies the file version.
+ *
+ * The registry does not hold references to its sections.  Sections remove
+ * themselves when their last user puts them.
+ */
+struct pt_section_registry {
+	/* The sections hashed by file name, offset, and size.
+	 *
+	 * Sections in a bucket are chained via their @reg_next field.
+	 */
+	struct pt_section **buckets;
+
+	/* The number of hash buckets - zero or a power of two. */
+	uint32_t nbuckets;
+
+	/* The number of registered sections. */
+	uint32_t nsections;
+
+#if defined(FEATURE_THREADS)
+	/* A lock protecting the registry and the @reg_next links of
+	 * registered sections.
+	 *
+	 * The registry lock may be taken before a section's lock but not the
+	 * other way around.
+	 */
+	mtx_t lock;
+#endif /* defined(FEATURE_THREADS) */
+};
+
+/* Get a shared section.
+ *
+ * This is similar to pt_mk_section() but returns an existing section for the
+ * same version of @filename at @offset with @size, if there is one.
+ * Otherwise, a new section is created and registered.
+ *
+ * The caller gets a new user reference on the returned section that it must
+ * release with pt_section_put().
+ *
+ * Returns a section on success, NULL otherwise.
+ */
+extern struct pt_section *pt_section_registry_get(const char *filename,
+						  uint64_t offset,
+						  uint64_t size);
+
+/* Get a shared section for a file with known status.
+ *
+ * This is similar to pt_section_registry_get() but uses pt_mk_section_status()
+ * with @status and @fsize instead of querying @filename's status.
+ *
+ * Returns a section on success, NULL otherwise.
+ */
+extern struct pt_section *
+pt_section_registry_get_status(const char *filename, uint64_t offset,
+			       uint64_t size, const void *status,
+			       uint64_t fsize);
+
+/* Remove a section from the registry.
+ *
+ * This is called by pt_section_put() when the last user of a registered
+ * section is gone.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @section is NULL or not registered.
+ * Returns -pte_bad_lock on any locking error.
+ */
+extern int pt_section_registry_remove(struct pt_section *section);
+
+#endif /* __PT_SECTION_REGISTRY_H__ */
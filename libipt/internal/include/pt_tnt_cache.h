@@ -72,6 +72,27 @@ extern int pt_tnt_cache_is_empty(const struct pt_tnt_cache *cache);
  */
 extern int pt_tnt_cache_query(struct pt_tnt_cache *cache);
 
+/* Peek at the cached tnt indicators.
+ *
+ * Provides the cached tnt indicators in the low bits of @tnt with the next
+ * indicator in the most significant of those bits.  The indicators remain in
+ * the cache.
+ *
+ * Returns the number of cached tnt indicators on success.
+ * Returns -pte_invalid if @cache or @tnt is NULL.
+ */
+extern int pt_tnt_cache_peek(const struct pt_tnt_cache *cache, uint64_t *tnt);
+
+/* Skip tnt indicators.
+ *
+ * This consumes the next @count tnt indicators in the cache.
+ *
+ * Returns zero on success.
+ * Returns -pte_invalid if @cache is NULL.
+ * Returns -pte_bad_query if there are less than @count tnt indicators cached.
+ */
+extern int pt_tnt_cache_skip(struct pt_tnt_cache *cache, uint8_t count);
+
 /* Update the tnt cache based on Intel PT packets.
  *
  * Updates @cache based on @packet and, if non-null, @config.
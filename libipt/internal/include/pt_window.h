@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PT_WINDOW_H__
+#define __PT_WINDOW_H__
+
+#include <stdint.h>
+
+struct pt_config;
+
+
+enum {
+	/* The number of bytes we keep in the window ahead of the current
+	 * position.  This must be big enough to hold any packet.
+	 */
+	pt_win_lookahead	= 64,
+
+	/* The size of the bounce buffer. */
+	pt_win_bounce_size	= 2 * pt_win_lookahead,
+
+	/* The default window size for a trace that is read on demand. */
+	pt_win_source_size	= 1024 * 1024
+};
+
+/* A window into a trace that is split into several segments or that is read
+ * on demand.
+ *
+ * Decoders read the trace from their configuration's begin and end.  If the
+ * trace is given by a list of segments or by a read callback, begin and end
+ * describe a window into the trace that is moved as decoding proceeds.
+ *
+ * For segments, the window is either one of the segments or, close to the end
+ * of a segment, a copy of the trace around the current position in a small
+ * bounce buffer.
+ *
+ * For a read callback, the window is a buffer that is refilled from the
+ * current position when it runs out of trace.
+ *
+ * Positions are pointers into the window.  Offsets are given in the
+ * concatenated trace.
+ */
+struct pt_window {
+	/* The offset of the window's begin in the trace. */
+	uint64_t base;
+
+	/* The buffer for a trace that is read on demand - NULL otherwise. */
+	uint8_t *buffer;
+
+	/* The size of @buffer in bytes. */
+	uint32_t capacity;
+
+	/* The bounce buffer for windows that span segments. */
+	uint8_t bounce[pt_win_bounce_size];
+};
+
+
+/* Initialize a window for @config.
+ *
+ * Sets @config's begin and end to the first window if the trace is given by
+ * a list of segments or by a read callback.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @win or @config is NULL.
+ * Returns -pte_nomem if the window buffer can't be allocated.
+ */
+extern int pt_win_init(struct pt_window *win, struct pt_config *config);
+
+/* Finalize a window. */
+extern void pt_win_fini(struct pt_window *win);
+
+/* Determine the size of @config's trace.
+ *
+ * This works for a library user's configuration as well as for a decoder's
+ * configuration with a window.
+ *
+ * Returns the size of the trace in bytes.
+ */
+extern uint64_t pt_win_size(const struct pt_config *config);
+
+/* Determine the offset of @pos in the trace.
+ *
+ * Returns the offset of @pos inside @config's current window.
+ */
+extern uint64_t pt_win_offset(const struct pt_window *win,
+			      const struct pt_config *config,
+			      const uint8_t *pos);
+
+/* Move the window to @offset.
+ *
+ * Moves @config's window so it contains the trace at @offset followed by at
+ * least pt_win_lookahead bytes or the rest of the trace and stores a pointer
+ * to @offset in @pos.
+ *
+ * If the trace is read on demand, errors from reading the trace are passed
+ * on.  The window's content is undefined in that case.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @win, @config, or @pos is NULL.
+ * Returns -pte_invalid if @offset lies beyond the end of the trace.
+ */
+extern int pt_win_map(struct pt_window *win, struct pt_config *config,
+		      uint64_t offset, const uint8_t **pos);
+
+/* Make sure the window contains the packet at @pos.
+ *
+ * Moves @config's window if less than pt_win_lookahead bytes follow @pos in
+ * the current window and updates @pos.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @win, @config, or @pos is NULL.
+ */
+extern int pt_win_ensure(struct pt_window *win, struct pt_config *config,
+			 const uint8_t **pos);
+
+/* Synchronize onto the trace.
+ *
+ * This is pt_sync_forward(), pt_sync_backward(), and pt_sync_set() for a
+ * trace that may be split into several segments.  The search starts at
+ * @offset, moving @config's window as necessary.
+ *
+ * On success, stores a pointer into the current window in @sync.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @win, @config, or @sync is NULL.
+ * Returns -pte_invalid if @offset lies beyond the end of the trace.
+ * Returns -pte_eos if no further synchronization point is found.
+ */
+extern int pt_win_sync_forward(struct pt_window *win, struct pt_config *config,
+			       const uint8_t **sync, uint64_t offset);
+extern int pt_win_sync_backward(struct pt_window *win,
+				struct pt_config *config,
+				const uint8_t **sync, uint64_t offset);
+extern int pt_win_sync_set(struct pt_window *win, struct pt_config *config,
+			   const uint8_t **sync, uint64_t offset);
+
+/* Extend the trace to @end.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_internal if @win or @config is NULL.
+ * Returns -pte_invalid if @end is NULL or lies before @config's end.
+ * Returns -pte_invalid if the trace is given by a list of segments or by a
+ * read callback.
+ */
+extern int pt_win_extend(struct pt_window *win, struct pt_config *config,
+			 uint8_t *end);
+
+#endif /* __PT_WINDOW_H__ */
@@ -200,11 +200,8 @@ pti_get_modrm_rm (pti_ild_t * ild)
 
 /* MAIN ENTRANCE POINTS */
 
-/* one time call. not thread safe init. call when single threaded. */
-void pti_ild_init (void);
-
-
-/* all decoding is multithread safe. */
+/* all decoding is multithread safe.  there is no global state and no
+   initialization is required. */
 
 /* returns 1 on success, 0 on failure.
    Failures come from not having enough bytes
@@ -62,7 +62,7 @@ struct pt_sec_windows_mapping {
  *
  * The caller has already opened the file for reading.
  *
- * On success, sets @section's mapping, unmap, and read pointers.
+ * On success, sets @section's mapping, unmap, read, and fetch pointers.
  *
  * Returns zero on success, a negative error code otherwise.
  * Returns -pte_internal if @section is NULL.
@@ -72,7 +72,8 @@ extern int pt_sec_windows_map(struct pt_section *section, int fd);
 
 /* Unmap a section.
  *
- * On success, clears @section's mapping, unmap, and read pointers.
+ * On success, clears @section's mapping, unmap, read, and fetch
+ * pointers.
  *
  * This function should not be called directly; call @section->unmap() instead.
  *
@@ -96,4 +97,22 @@ extern int pt_sec_windows_read(const struct pt_section *section,
 			       uint8_t *buffer, uint16_t size,
 			       uint64_t offset);
 
+/* Fetch memory from an mmaped section without copying.
+ *
+ * Provides a pointer to @section's memory at @offset in @pbegin.  At most
+ * @size bytes starting at *@pbegin may be accessed.
+ *
+ * This function should not be called directly; call @section->fetch()
+ * instead.
+ *
+ * Returns the number of accessible bytes on success, a negative error code
+ * otherwise.
+ * Returns -pte_internal if @section or @pbegin are NULL.
+ * Returns -pte_internal if @section has not been mapped.
+ * Returns -pte_nomap if @offset is beyond the end of the section.
+ */
+extern int pt_sec_windows_fetch(const struct pt_section *section,
+				const uint8_t **pbegin, uint16_t size,
+				uint64_t offset);
+
 #endif /* __PT_SECTION_WINDOWS_H__ */
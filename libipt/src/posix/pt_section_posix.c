@@ -31,7 +31,8 @@
 
 #include "pt_section.h"
 #include "pt_section_posix.h"
-#include "pt_section_file.h"
+#include "pt_section_pread.h"
+#include "pt_section_buffer.h"
 
 #include "intel-pt.h"
 
@@ -73,6 +74,63 @@ int pt_section_mk_status(void **pstatus, uint64_t *psize, const char *filename)
 	return 0;
 }
 
+int pt_section_match_status(const void *lhs, const void *rhs)
+{
+	const struct pt_sec_posix_status *lstatus, *rstatus;
+
+	lstatus = (const struct pt_sec_posix_status *) lhs;
+	rstatus = (const struct pt_sec_posix_status *) rhs;
+
+	if (!lstatus || !rstatus)
+		return -pte_internal;
+
+	if (lstatus->stat.st_dev != rstatus->stat.st_dev)
+		return 0;
+
+	if (lstatus->stat.st_ino != rstatus->stat.st_ino)
+		return 0;
+
+	if (lstatus->stat.st_size != rstatus->stat.st_size)
+		return 0;
+
+	if (lstatus->stat.st_mtime != rstatus->stat.st_mtime)
+		return 0;
+
+	return 1;
+}
+
+int pt_section_dup_status(void **pcopy, const void *status)
+{
+	struct pt_sec_posix_status *copy;
+
+	if (!pcopy || !status)
+		return -pte_internal;
+
+	copy = malloc(sizeof(*copy));
+	if (!copy)
+		return -pte_nomem;
+
+	*copy = *(const struct pt_sec_posix_status *) status;
+	*pcopy = copy;
+
+	return 0;
+}
+
+int pt_section_status_identity(uint64_t *psize, uint64_t *pmtime,
+			       const void *status)
+{
+	const struct pt_sec_posix_status *fstatus;
+
+	fstatus = (const struct pt_sec_posix_status *) status;
+	if (!psize || !pmtime || !fstatus)
+		return -pte_internal;
+
+	*psize = (uint64_t) fstatus->stat.st_size;
+	*pmtime = (uint64_t) fstatus->stat.st_mtime;
+
+	return 0;
+}
+
 static int check_file_status(struct pt_section *section, int fd)
 {
 	struct pt_sec_posix_status *status;
@@ -138,6 +196,7 @@ int pt_sec_posix_map(struct pt_section *section, int fd)
 	section->mapping = mapping;
 	section->unmap = pt_sec_posix_unmap;
 	section->read = pt_sec_posix_read;
+	section->fetch = pt_sec_posix_fetch;
 
 	return 0;
 
@@ -150,7 +209,6 @@ int pt_section_map(struct pt_section *section)
 {
 	const char *filename;
 	uint16_t mcount;
-	FILE *file;
 	int fd, errcode;
 
 	if (!section)
@@ -173,9 +231,16 @@ int pt_section_map(struct pt_section *section)
 	if (section->mapping)
 		goto out_unlock;
 
+	/* Sections without a file are backed by a memory buffer. */
 	filename = section->filename;
-	if (!filename)
-		goto out_unlock;
+	if (!filename) {
+		errcode = pt_sec_buffer_map(section);
+		if (errcode < 0)
+			goto out_unlock;
+
+		section->mcount = 1;
+		return pt_section_unlock(section);
+	}
 
 	errcode = -pte_bad_image;
 	fd = open(filename, O_RDONLY);
@@ -194,25 +259,15 @@ int pt_section_map(struct pt_section *section)
 		return pt_section_unlock(section);
 	}
 
-	/* Fall back to file based sections - report the original error
-	 * if we fail to convert the file descriptor.
+	/* Fall back to pread-based sections.  They take ownership of @fd
+	 * on success.  It will be closed when the section is unmapped.
 	 */
-	file = fdopen(fd, "rb");
-	if (!file)
-		goto out_fd;
-
-	/* We need to keep the file open on success.  It will be closed when
-	 * the section is unmapped.
-	 */
-	errcode = pt_sec_file_map(section, file);
+	errcode = pt_sec_pread_map(section, fd);
 	if (!errcode) {
 		section->mcount = 1;
 		return pt_section_unlock(section);
 	}
 
-	fclose(file);
-	goto out_unlock;
-
 out_fd:
 	close(fd);
 
@@ -235,6 +290,7 @@ int pt_sec_posix_unmap(struct pt_section *section)
 	section->mapping = NULL;
 	section->unmap = NULL;
 	section->read = NULL;
+	section->fetch = NULL;
 
 	munmap(mapping->base, mapping->size);
 	free(mapping);
@@ -245,13 +301,29 @@ int pt_sec_posix_unmap(struct pt_section *section)
 int pt_sec_posix_read(const struct pt_section *section, uint8_t *buffer,
 		      uint16_t size, uint64_t offset)
 {
-	struct pt_sec_posix_mapping *mapping;
-	const uint8_t *begin, *end;
+	const uint8_t *begin;
 	int bytes;
 
 	if (!buffer || !section)
 		return -pte_invalid;
 
+	bytes = pt_sec_posix_fetch(section, &begin, size, offset);
+	if (bytes < 0)
+		return bytes;
+
+	memcpy(buffer, begin, bytes);
+	return bytes;
+}
+
+int pt_sec_posix_fetch(const struct pt_section *section,
+		       const uint8_t **pbegin, uint16_t size, uint64_t offset)
+{
+	struct pt_sec_posix_mapping *mapping;
+	const uint8_t *begin, *end;
+
+	if (!pbegin || !section)
+		return -pte_internal;
+
 	mapping = section->mapping;
 	if (!mapping)
 		return -pte_internal;
@@ -271,8 +343,6 @@ int pt_sec_posix_read(const struct pt_section *section, uint8_t *buffer,
 	if (mapping->end < end)
 		end = mapping->end;
 
-	bytes = (int) (end - begin);
-
-	memcpy(buffer, begin, bytes);
-	return bytes;
+	*pbegin = begin;
+	return (int) (end - begin);
 }
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _XOPEN_SOURCE 500
+
+#include "pt_section.h"
+#include "pt_section_pread.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static int pread_lock(struct pt_sec_pread_mapping *mapping)
+{
+	if (!mapping)
+		return -pte_internal;
+
+#if defined(FEATURE_THREADS)
+	{
+		int errcode;
+
+		errcode = mtx_lock(&mapping->lock);
+		if (errcode != thrd_success)
+			return -pte_bad_lock;
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	return 0;
+}
+
+static int pread_unlock(struct pt_sec_pread_mapping *mapping)
+{
+	if (!mapping)
+		return -pte_internal;
+
+#if defined(FEATURE_THREADS)
+	{
+		int errcode;
+
+		errcode = mtx_unlock(&mapping->lock);
+		if (errcode != thrd_success)
+			return -pte_bad_lock;
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	return 0;
+}
+
+/* Read at most @size bytes from @fd at @offset into @buffer.
+ *
+ * Retries on interrupts and short reads.
+ *
+ * Returns the number of bytes read on success, a negative error code otherwise.
+ */
+static int pread_all(int fd, uint8_t *buffer, uint32_t size, uint64_t offset)
+{
+	uint32_t done;
+
+	for (done = 0; done < size;) {
+		ssize_t bytes;
+
+		bytes = pread(fd, buffer + done, size - done,
+			      (off_t) (offset + done));
+		if (bytes < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -pte_nomap;
+		}
+
+		if (!bytes)
+			break;
+
+		done += (uint32_t) bytes;
+	}
+
+	return (int) done;
+}
+
+int pt_sec_pread_map(struct pt_section *section, int fd)
+{
+	struct pt_sec_pread_mapping *mapping;
+	uint64_t offset, size;
+	struct stat buffer;
+	int errcode;
+
+	if (!section)
+		return -pte_internal;
+
+	if (section->mapping)
+		return -pte_internal;
+
+	offset = section->offset;
+	size = section->size;
+
+	if ((offset + size) < offset)
+		return -pte_bad_image;
+
+	/* The off_t argument to pread() may be signed and smaller. */
+	if ((uint64_t) (off_t) (offset + size) != (offset + size))
+		return -pte_bad_image;
+
+	/* Validate that the section lies within the file. */
+	errcode = fstat(fd, &buffer);
+	if (errcode)
+		return -pte_bad_image;
+
+	if ((buffer.st_size < 0) || ((uint64_t) buffer.st_size < offset + size))
+		return -pte_bad_image;
+
+	mapping = malloc(sizeof(*mapping));
+	if (!mapping)
+		return -pte_nomem;
+
+	memset(mapping, 0, sizeof(*mapping));
+
+#if defined(FEATURE_THREADS)
+
+	errcode = mtx_init(&mapping->lock, mtx_plain);
+	if (errcode != thrd_success) {
+		free(mapping);
+		return -pte_bad_lock;
+	}
+
+#endif /* defined(FEATURE_THREADS) */
+
+	mapping->fd = fd;
+	mapping->begin = offset;
+	mapping->end = offset + size;
+
+	/* The page cache is optional.  We read directly from the file if we
+	 * can't allocate it.
+	 */
+	if (pt_sec_pread_cache_pages)
+		mapping->cache = calloc(pt_sec_pread_cache_pages,
+					sizeof(*mapping->cache));
+
+	section->mapping = mapping;
+	section->unmap = pt_sec_pread_unmap;
+	section->read = pt_sec_pread_read;
+
+	return 0;
+}
+
+int pt_sec_pread_unmap(struct pt_section *section)
+{
+	struct pt_sec_pread_mapping *mapping;
+
+	if (!section)
+		return -pte_internal;
+
+	mapping = section->mapping;
+	if (!mapping || !section->unmap || !section->read)
+		return -pte_internal;
+
+	section->mapping = NULL;
+	section->unmap = NULL;
+	section->read = NULL;
+
+#if defined(FEATURE_THREADS)
+
+	mtx_destroy(&mapping->lock);
+
+#endif /* defined(FEATURE_THREADS) */
+
+	close(mapping->fd);
+	free(mapping->cache);
+	free(mapping);
+
+	return 0;
+}
+
+/* Read from the page containing @offset using @mapping's page cache.
+ *
+ * Reads at most @size bytes from the file at @offset into @buffer but not
+ * beyond the end of the page.  Fills the page cache on a miss.
+ *
+ * Returns the number of bytes read on success, a negative error code otherwise.
+ */
+static int pread_cached(struct pt_sec_pread_mapping *mapping, uint8_t *buffer,
+			uint16_t size, uint64_t offset)
+{
+	struct pt_sec_pread_page *slot;
+	uint8_t data[pt_sec_pread_page_size];
+	uint64_t page, begin;
+	uint32_t psize;
+	int status, errcode;
+
+	page = offset & ~((uint64_t) pt_sec_pread_page_size - 1);
+	begin = offset - page;
+
+	slot = &mapping->cache[(page / pt_sec_pread_page_size) %
+			       pt_sec_pread_cache_pages];
+
+	errcode = pread_lock(mapping);
+	if (errcode < 0)
+		return errcode;
+
+	psize = slot->size;
+	if (psize && (slot->offset == page)) {
+		status = 0;
+		if (begin < psize) {
+			if ((psize - begin) < size)
+				size = (uint16_t) (psize - begin);
+
+			memcpy(buffer, &slot->data[begin], size);
+			status = size;
+		}
+
+		errcode = pread_unlock(mapping);
+		if (errcode < 0)
+			return errcode;
+
+		return status;
+	}
+
+	errcode = pread_unlock(mapping);
+	if (errcode < 0)
+		return errcode;
+
+	/* We read the page without holding the lock.  Another thread may
+	 * fill the same slot in the meantime; the last one wins.
+	 */
+	status = pread_all(mapping->fd, data, pt_sec_pread_page_size, page);
+	if (status < 0)
+		return status;
+
+	psize = (uint32_t) status;
+
+	errcode = pread_lock(mapping);
+	if (errcode < 0)
+		return errcode;
+
+	memcpy(slot->data, data, psize);
+	slot->offset = page;
+	slot->size = psize;
+
+	errcode = pread_unlock(mapping);
+	if (errcode < 0)
+		return errcode;
+
+	if (psize <= begin)
+		return 0;
+
+	if ((psize - begin) < size)
+		size = (uint16_t) (psize - begin);
+
+	memcpy(buffer, &data[begin], size);
+	return size;
+}
+
+int pt_sec_pread_read(const struct pt_section *section, uint8_t *buffer,
+		      uint16_t size, uint64_t offset)
+{
+	struct pt_sec_pread_mapping *mapping;
+	uint64_t begin, end;
+	uint16_t done;
+
+	if (!buffer || !section)
+		return -pte_invalid;
+
+	mapping = section->mapping;
+	if (!mapping)
+		return -pte_internal;
+
+	begin = mapping->begin + offset;
+	if (begin < mapping->begin)
+		return -pte_nomap;
+
+	if (mapping->end <= begin)
+		return -pte_nomap;
+
+	end = begin + size;
+	if ((end < begin) || (mapping->end < end))
+		end = mapping->end;
+
+	size = (uint16_t) (end - begin);
+
+	if (!mapping->cache)
+		return pread_all(mapping->fd, buffer, size, begin);
+
+	/* The request may span two pages. */
+	for (done = 0; done < size;) {
+		int status;
+
+		status = pread_cached(mapping, buffer + done, size - done,
+				      begin + done);
+		if (status < 0)
+			return done ? done : status;
+
+		if (!status)
+			break;
+
+		done += (uint16_t) status;
+	}
+
+	return done;
+}
@@ -0,0 +1,648 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "pt_block_decoder.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+int pt_blk_decoder_init(struct pt_block_decoder *decoder,
+			const struct pt_config *config)
+{
+	if (!decoder)
+		return -pte_internal;
+
+	pt_sblock_cache_init(&decoder->sbcache);
+	decoder->start_offset = 0ull;
+
+	return pt_insn_decoder_init(&decoder->insn, config);
+}
+
+void pt_blk_decoder_fini(struct pt_block_decoder *decoder)
+{
+	if (!decoder)
+		return;
+
+	pt_sblock_cache_fini(&decoder->sbcache);
+	pt_insn_decoder_fini(&decoder->insn);
+}
+
+struct pt_block_decoder *pt_blk_alloc_decoder(const struct pt_config *config)
+{
+	struct pt_block_decoder *decoder;
+	int errcode;
+
+	decoder = malloc(sizeof(*decoder));
+	if (!decoder)
+		return NULL;
+
+	errcode = pt_blk_decoder_init(decoder, config);
+	if (errcode < 0) {
+		free(decoder);
+		return NULL;
+	}
+
+	return decoder;
+}
+
+void pt_blk_free_decoder(struct pt_block_decoder *decoder)
+{
+	if (!decoder)
+		return;
+
+	pt_blk_decoder_fini(decoder);
+	free(decoder);
+}
+
+int pt_blk_sync_forward(struct pt_block_decoder *decoder)
+{
+	if (!decoder)
+		return -pte_invalid;
+
+	return pt_insn_sync_forward(&decoder->insn);
+}
+
+int pt_blk_sync_backward(struct pt_block_decoder *decoder)
+{
+	if (!decoder)
+		return -pte_invalid;
+
+	return pt_insn_sync_backward(&decoder->insn);
+}
+
+int pt_blk_sync_set(struct pt_block_decoder *decoder, uint64_t offset)
+{
+	if (!decoder)
+		return -pte_invalid;
+
+	return pt_insn_sync_set(&decoder->insn, offset);
+}
+
+int pt_blk_sync_time(struct pt_block_decoder *decoder, uint64_t tsc)
+{
+	if (!decoder)
+		return -pte_invalid;
+
+	return pt_insn_sync_time(&decoder->insn, tsc);
+}
+
+int pt_blk_extend(struct pt_block_decoder *decoder, uint8_t *end)
+{
+	if (!decoder)
+		return -pte_invalid;
+
+	return pt_insn_extend(&decoder->insn, end);
+}
+
+int pt_blk_get_offset(struct pt_block_decoder *decoder, uint64_t *offset)
+{
+	if (!decoder)
+		return -pte_invalid;
+
+	return pt_insn_get_offset(&decoder->insn, offset);
+}
+
+int pt_blk_get_sync_offset(struct pt_block_decoder *decoder, uint64_t *offset)
+{
+	if (!decoder)
+		return -pte_invalid;
+
+	return pt_insn_get_sync_offset(&decoder->insn, offset);
+}
+
+struct pt_image *pt_blk_get_image(struct pt_block_decoder *decoder)
+{
+	if (!decoder)
+		return NULL;
+
+	return pt_insn_get_image(&decoder->insn);
+}
+
+int pt_blk_set_image(struct pt_block_decoder *decoder, struct pt_image *image)
+{
+	if (!decoder)
+		return -pte_invalid;
+
+	pt_sblock_cache_clear(&decoder->sbcache);
+
+	return pt_insn_set_image(&decoder->insn, image);
+}
+
+const struct pt_config *
+pt_blk_get_config(const struct pt_block_decoder *decoder)
+{
+	if (!decoder)
+		return NULL;
+
+	return pt_insn_get_config(&decoder->insn);
+}
+
+int pt_blk_save(const struct pt_block_decoder *decoder, uint8_t *buffer,
+		size_t size)
+{
+	if (!decoder)
+		return -pte_invalid;
+
+	return pt_insn_save(&decoder->insn, buffer, size);
+}
+
+int pt_blk_restore(struct pt_block_decoder *decoder, const uint8_t *buffer,
+		   size_t size)
+{
+	if (!decoder)
+		return -pte_invalid;
+
+	decoder->start_offset = 0ull;
+
+	return pt_insn_restore(&decoder->insn, buffer, size);
+}
+
+int pt_blk_time(struct pt_block_decoder *decoder, uint64_t *time,
+		uint32_t *lost_mtc, uint32_t *lost_cyc)
+{
+	if (!decoder || !time)
+		return -pte_invalid;
+
+	return pt_insn_time(&decoder->insn, time, lost_mtc, lost_cyc);
+}
+
+int pt_blk_core_bus_ratio(struct pt_block_decoder *decoder, uint32_t *cbr)
+{
+	if (!decoder || !cbr)
+		return -pte_invalid;
+
+	return pt_insn_core_bus_ratio(&decoder->insn, cbr);
+}
+
+/* Check whether @insn ends a block.
+ *
+ * Returns non-zero if it does, zero otherwise.
+ */
+static int pt_blk_ends_with(const struct pt_insn *insn)
+{
+	if (!insn)
+		return 1;
+
+	/* Branches may change the IP. */
+	if (insn->iclass != ptic_other)
+		return 1;
+
+	/* Events that are indicated after an instruction end the block. */
+	return insn->aborted || insn->committed || insn->disabled ||
+		insn->interrupted || insn->stopped;
+}
+
+/* Decode instructions into @block.
+ *
+ * Adds instructions to @block until a block-ending instruction or an event
+ * is reached.
+ *
+ * Returns a non-negative pt_status_flag bit-vector on success, a negative error
+ * code otherwise.
+ */
+static int pt_blk_proceed(struct pt_block_decoder *decoder,
+			  struct pt_block *block)
+{
+	struct pt_insn_decoder *insn_decoder;
+	struct pt_insn insn;
+	int status, cached;
+
+	if (!decoder || !block)
+		return -pte_internal;
+
+	insn_decoder = &decoder->insn;
+
+	/* The query decoder reads ahead after fetching a TNT packet, possibly
+	 * beyond the next PSB.  A block that starts on TNT bits that are still
+	 * cached belongs to the packet that provided them.
+	 */
+	cached = !pt_tnt_cache_is_empty(&insn_decoder->query.tnt);
+
+	/* The first instruction is decoded with event processing, if
+	 * necessary.  Its flags give the block's start flags.
+	 */
+	status = pt_insn_step(insn_decoder, &insn);
+
+	if (!cached && pt_qry_get_offset(&insn_decoder->query,
+					 &decoder->start_offset) < 0)
+		decoder->start_offset = 0ull;
+
+	if (status < 0) {
+		/* Provide the IP for diagnostics. */
+		block->ip = insn.ip;
+		block->mode = insn.mode;
+
+		return status;
+	}
+
+	block->ip = insn.ip;
+	block->mode = insn.mode;
+	block->speculative = insn.speculative;
+	block->enabled = insn.enabled;
+	block->resumed = insn.resumed;
+	block->resynced = insn.resynced;
+
+	block->end_ip = insn.ip;
+	block->iclass = insn.iclass;
+	block->ninsn = 1;
+
+	/* Events may change the IP, the execution mode, or the speculative
+	 * state.  We end the block and process them at the beginning of the
+	 * next block.
+	 */
+	if (!pt_blk_ends_with(&insn) && !pt_insn_needs_events(insn_decoder)) {
+		while (block->ninsn < UINT32_MAX) {
+			uint64_t ip;
+			uint32_t ninsn;
+			int errcode;
+
+			/* Walk over instructions that neither branch nor bind
+			 * to events without materializing them.
+			 *
+			 * Errors are logged in @insn_decoder and reported
+			 * when decoding the next block.
+			 */
+			errcode = pt_insn_skip(insn_decoder, &ip, &ninsn,
+					       UINT32_MAX - block->ninsn);
+			if (errcode < 0)
+				break;
+
+			if (errcode) {
+				block->end_ip = ip;
+				block->iclass = ptic_other;
+				block->ninsn += ninsn;
+				continue;
+			}
+
+			errcode = pt_insn_step(insn_decoder, &insn);
+			if (errcode < 0)
+				break;
+
+			status = errcode;
+
+			block->end_ip = insn.ip;
+			block->iclass = insn.iclass;
+			block->ninsn += 1;
+
+			if (pt_blk_ends_with(&insn))
+				break;
+
+			if (pt_insn_needs_events(insn_decoder))
+				break;
+		}
+	}
+
+	/* Skipped instructions do not have flags.  The flags of the last
+	 * decoded instruction are only set if it ended the block.
+	 */
+	block->aborted = insn.aborted;
+	block->committed = insn.committed;
+	block->disabled = insn.disabled;
+	block->interrupted = insn.interrupted;
+	block->stopped = insn.stopped;
+
+	return status;
+}
+
+static inline int block_to_user(struct pt_block *ublock, size_t size,
+				const struct pt_block *block)
+{
+	if (!ublock || !block)
+		return -pte_internal;
+
+	if (ublock == block)
+		return 0;
+
+	/* Zero out any unknown bytes. */
+	if (sizeof(*block) < size) {
+		memset((uint8_t *) ublock + sizeof(*block), 0,
+		       size - sizeof(*block));
+
+		size = sizeof(*block);
+	}
+
+	memcpy(ublock, block, size);
+
+	return 0;
+}
+
+int pt_blk_next(struct pt_block_decoder *decoder, struct pt_block *ublock,
+		size_t size)
+{
+	struct pt_block block, *pblock;
+	int errcode, status;
+
+	if (!decoder || !ublock)
+		return -pte_invalid;
+
+	pblock = size == sizeof(block) ? ublock : &block;
+
+	/* Zero-initialize the block in case of error returns. */
+	memset(pblock, 0, sizeof(*pblock));
+
+	status = pt_blk_proceed(decoder, pblock);
+
+	/* We provide the (incomplete) block also in case of errors. */
+	errcode = block_to_user(ublock, size, pblock);
+	if (status < 0)
+		return status;
+
+	return (errcode < 0) ? errcode : status;
+}
+
+/* Check whether @insn ends a branch record.
+ *
+ * Sets @branch->taken and @branch->to if @insn is a taken branch.
+ *
+ * Returns non-zero if it does, zero otherwise.
+ */
+static int pt_blk_ends_branch(struct pt_block_decoder *decoder,
+			      struct pt_branch *branch,
+			      const struct pt_insn *insn)
+{
+	struct pt_insn_decoder *insn_decoder;
+
+	if (!decoder || !branch || !insn)
+		return 1;
+
+	insn_decoder = &decoder->insn;
+
+	/* Events that are indicated after an instruction end the range. */
+	if (insn->aborted || insn->committed || insn->disabled ||
+	    insn->interrupted || insn->stopped)
+		return 1;
+
+	if (insn->iclass == ptic_other)
+		return 0;
+
+	/* If we failed to determine the next IP, the error will be reported
+	 * on the next call.
+	 */
+	if (insn_decoder->status < 0)
+		return 1;
+
+	/* Not-taken conditional branches continue the range. */
+	if (insn->iclass == ptic_cond_jump &&
+	    insn_decoder->ip == insn->ip + insn->size)
+		return 0;
+
+	branch->taken = 1;
+	branch->to = insn_decoder->ip;
+
+	return 1;
+}
+
+/* Decode instructions into @branch.
+ *
+ * Walks over instructions until a taken branch or an event is reached.
+ * Instructions that neither branch nor bind to events are skipped without
+ * consulting the trace or materializing a struct pt_insn.
+ *
+ * Returns a non-negative pt_status_flag bit-vector on success, a negative error
+ * code otherwise.
+ */
+static int pt_blk_proceed_branch(struct pt_block_decoder *decoder,
+				 struct pt_branch *branch)
+{
+	struct pt_insn_decoder *insn_decoder;
+	struct pt_insn insn;
+	int status;
+
+	if (!decoder || !branch)
+		return -pte_internal;
+
+	insn_decoder = &decoder->insn;
+
+	/* The first instruction is decoded with event processing, if
+	 * necessary.  Its flags give the range's start flags.
+	 */
+	status = pt_insn_step(insn_decoder, &insn);
+	if (status < 0) {
+		/* Provide the IP for diagnostics. */
+		branch->start = insn.ip;
+		branch->from = insn.ip;
+		branch->mode = insn.mode;
+
+		return status;
+	}
+
+	branch->start = insn.ip;
+	branch->mode = insn.mode;
+	branch->speculative = insn.speculative;
+	branch->enabled = insn.enabled;
+	branch->resumed = insn.resumed;
+	branch->resynced = insn.resynced;
+
+	branch->from = insn.ip;
+	branch->iclass = insn.iclass;
+	branch->ninsn = 1;
+
+	if (!pt_blk_ends_branch(decoder, branch, &insn) &&
+	    !pt_insn_needs_events(insn_decoder)) {
+		while (branch->ninsn < UINT32_MAX) {
+			uint64_t ip;
+			uint32_t ninsn;
+			int errcode;
+
+			/* Errors are logged in @insn_decoder and reported
+			 * when decoding the next range.
+			 */
+			errcode = pt_insn_skip(insn_decoder, &ip, &ninsn,
+					       UINT32_MAX - branch->ninsn);
+			if (errcode < 0)
+				break;
+
+			if (errcode) {
+				branch->from = ip;
+				branch->iclass = ptic_other;
+				branch->ninsn += ninsn;
+				continue;
+			}
+
+			errcode = pt_insn_step(insn_decoder, &insn);
+			if (errcode < 0)
+				break;
+
+			status = errcode;
+
+			branch->from = insn.ip;
+			branch->iclass = insn.iclass;
+			branch->ninsn += 1;
+
+			if (pt_blk_ends_branch(decoder, branch, &insn))
+				break;
+
+			/* Events may change the IP, the execution mode, or
+			 * the speculative state.  We end the range and
+			 * process them at the beginning of the next range.
+			 */
+			if (pt_insn_needs_events(insn_decoder))
+				break;
+		}
+	}
+
+	/* Skipped instructions do not have flags.  The flags of the last
+	 * decoded instruction are only set if it ended the range.
+	 */
+	branch->aborted = insn.aborted;
+	branch->committed = insn.committed;
+	branch->disabled = insn.disabled;
+	branch->interrupted = insn.interrupted;
+	branch->stopped = insn.stopped;
+
+	return status;
+}
+
+static inline int branch_to_user(struct pt_branch *ubranch, size_t size,
+				 const struct pt_branch *branch)
+{
+	if (!ubranch || !branch)
+		return -pte_internal;
+
+	if (ubranch == branch)
+		return 0;
+
+	/* Zero out any unknown bytes. */
+	if (sizeof(*branch) < size) {
+		memset((uint8_t *) ubranch + sizeof(*branch), 0,
+		       size - sizeof(*branch));
+
+		size = sizeof(*branch);
+	}
+
+	memcpy(ubranch, branch, size);
+
+	return 0;
+}
+
+int pt_blk_next_branch(struct pt_block_decoder *decoder,
+		       struct pt_branch *ubranch, size_t size)
+{
+	struct pt_branch branch, *pbranch;
+	int errcode, status;
+
+	if (!decoder || !ubranch)
+		return -pte_invalid;
+
+	pbranch = size == sizeof(branch) ? ubranch : &branch;
+
+	/* Zero-initialize the branch in case of error returns. */
+	memset(pbranch, 0, sizeof(*pbranch));
+
+	status = pt_blk_proceed_branch(decoder, pbranch);
+
+	/* We provide the (incomplete) branch also in case of errors. */
+	errcode = branch_to_user(ubranch, size, pbranch);
+	if (status < 0)
+		return status;
+
+	return (errcode < 0) ? errcode : status;
+}
+
+int pt_blk_skip(struct pt_block_decoder *decoder, uint64_t *ninsn,
+		uint64_t *nblocks)
+{
+	struct pt_insn_decoder *insn_decoder;
+
+	if (!decoder || !ninsn || !nblocks)
+		return -pte_invalid;
+
+	insn_decoder = &decoder->insn;
+
+	*ninsn = 0ull;
+	*nblocks = 0ull;
+
+	while (!pt_insn_needs_events(insn_decoder)) {
+		const struct pt_sblock_cache_entry *sblock;
+		struct pt_sblock_cache_entry entry;
+		uint64_t tnt;
+		int ntnt, status;
+
+		ntnt = pt_qry_peek_tnt(&insn_decoder->query, &tnt);
+		if (ntnt < 0)
+			return ntnt;
+
+		/* We leave the last cached outcome to pt_blk_next().
+		 *
+		 * Using it up may reveal events that are indicated on the
+		 * branch's block.
+		 */
+		if (ntnt <= 1)
+			break;
+
+		ntnt -= 1;
+		tnt >>= 1;
+
+		sblock = pt_sblock_cache_lookup(&decoder->sbcache,
+						insn_decoder->image,
+						&insn_decoder->asid,
+						insn_decoder->mode,
+						insn_decoder->ip, tnt,
+						(uint8_t) ntnt);
+		if (!sblock) {
+			memset(&entry, 0, sizeof(entry));
+			entry.asid = insn_decoder->asid;
+			entry.ip = insn_decoder->ip;
+			entry.tnt = tnt;
+			entry.ntnt = (uint8_t) ntnt;
+			entry.mode = (uint8_t) insn_decoder->mode;
+
+			status = pt_insn_follow_tnt(insn_decoder, &entry);
+			if (status < 0)
+				return status;
+
+			/* Failing to cache the superblock is not an error. */
+			if (!status)
+				(void) pt_sblock_cache_add(&decoder->sbcache,
+							   insn_decoder->image,
+							   &entry);
+
+			sblock = &entry;
+		}
+
+		if (!sblock->nused)
+			break;
+
+		status = pt_qry_skip_tnt(&insn_decoder->query, sblock->nused);
+		if (status < 0)
+			return status;
+
+		insn_decoder->status = status;
+		insn_decoder->ip = sblock->next_ip;
+
+		*ninsn += sblock->ninsn;
+		*nblocks += sblock->nblocks;
+
+		if (sblock->nused < ntnt)
+			break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pt_block_map.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+
+
+/* Return the number of u64 words required for @size bits. */
+static uint64_t pt_bmap_nwords(uint64_t size)
+{
+	return (size + 63ull) >> 6;
+}
+
+static int pt_bmap_test(const uint64_t *bits, uint64_t offset)
+{
+	return (bits[offset >> 6] >> (offset & 63ull)) & 1ull;
+}
+
+static uint32_t pt_bmap_popcount(uint64_t word)
+{
+	word = word - ((word >> 1) & 0x5555555555555555ull);
+	word = (word & 0x3333333333333333ull) +
+		((word >> 2) & 0x3333333333333333ull);
+	word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+
+	return (uint32_t) ((word * 0x0101010101010101ull) >> 56);
+}
+
+/* Find the first set bit in @bits at or after @begin and before @end.
+ *
+ * Returns the offset of the bit, @end if there is none.
+ */
+static uint64_t pt_bmap_find(const uint64_t *bits, uint64_t begin,
+			     uint64_t end)
+{
+	uint64_t word;
+
+	if (end <= begin)
+		return end;
+
+	word = bits[begin >> 6] & (~0ull << (begin & 63ull));
+	begin &= ~63ull;
+
+	while (!word) {
+		begin += 64ull;
+		if (end <= begin)
+			return end;
+
+		word = bits[begin >> 6];
+	}
+
+	while (!(word & 1ull)) {
+		word >>= 1;
+		begin += 1ull;
+	}
+
+	return begin < end ? begin : end;
+}
+
+/* Count the set bits in @bits at or after @begin and before @end. */
+static uint64_t pt_bmap_count(const uint64_t *bits, uint64_t begin,
+			      uint64_t end)
+{
+	uint64_t count, first, last;
+
+	if (end <= begin)
+		return 0ull;
+
+	first = begin >> 6;
+	last = (end - 1ull) >> 6;
+
+	if (first == last) {
+		uint64_t word;
+
+		word = bits[first] >> (begin & 63ull);
+		word &= ~0ull >> (63ull - ((end - 1ull - begin) & 63ull));
+
+		return pt_bmap_popcount(word);
+	}
+
+	count = pt_bmap_popcount(bits[first] >> (begin & 63ull));
+	for (first += 1; first < last; ++first)
+		count += pt_bmap_popcount(bits[first]);
+
+	count += pt_bmap_popcount(bits[last] &
+				  (~0ull >> (63ull - ((end - 1ull) & 63ull))));
+
+	return count;
+}
+
+struct pt_block_map *pt_bmap_alloc(uint64_t size, enum pt_exec_mode mode)
+{
+	struct pt_block_map *bmap;
+	uint64_t nwords;
+
+	nwords = pt_bmap_nwords(size);
+	if ((SIZE_MAX / sizeof(uint64_t)) < nwords)
+		return NULL;
+
+	bmap = malloc(sizeof(*bmap));
+	if (!bmap)
+		return NULL;
+
+	/* Allocate at least one word so we can tell success from failure. */
+	if (!nwords)
+		nwords = 1ull;
+
+	bmap->insn = calloc((size_t) nwords, sizeof(uint64_t));
+	bmap->stop = calloc((size_t) nwords, sizeof(uint64_t));
+	bmap->size = size;
+	bmap->mode = mode;
+
+	if (!bmap->insn || !bmap->stop) {
+		pt_bmap_free(bmap);
+		return NULL;
+	}
+
+	return bmap;
+}
+
+void pt_bmap_free(struct pt_block_map *bmap)
+{
+	if (!bmap)
+		return;
+
+	free(bmap->insn);
+	free(bmap->stop);
+	free(bmap);
+}
+
+int pt_bmap_skip(const struct pt_block_map *bmap, uint64_t *offset,
+		 uint64_t *last, uint32_t *ninsn, uint32_t max)
+{
+	uint64_t begin, end, count;
+
+	if (!bmap || !offset || !last || !ninsn)
+		return -pte_internal;
+
+	begin = *offset;
+	if (bmap->size <= begin)
+		return 0;
+
+	if (!pt_bmap_test(bmap->insn, begin) ||
+	    pt_bmap_test(bmap->stop, begin))
+		return 0;
+
+	/* Without a stop, the run ends with the last instruction in the
+	 * section, which ends at the end of the section.
+	 */
+	end = pt_bmap_find(bmap->stop, begin + 1ull, bmap->size);
+
+	count = pt_bmap_count(bmap->insn, begin, end);
+	if (max < count)
+		return 0;
+
+	*offset = end;
+	*ninsn = (uint32_t) count;
+
+	/* Instructions are at most pt_max_insn_size bytes long, so we do not
+	 * need to search far.
+	 */
+	for (end -= 1ull; !pt_bmap_test(bmap->insn, end); --end)
+		;
+
+	*last = end;
+
+	return 1;
+}
@@ -0,0 +1,686 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pt_block_decoder.h"
+#include "pt_window.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(FEATURE_THREADS)
+#  include <threads.h>
+#endif /* defined(FEATURE_THREADS) */
+
+
+enum {
+	/* The maximal number of threads we use. */
+	pt_par_threads_max	= 64,
+
+	/* The number of chunks we aim for per thread. */
+	pt_par_chunks_per_thread	= 4,
+
+	/* The maximal size of a chunk in bytes. */
+	pt_par_chunk_max	= 0x40000,
+
+	/* The maximal number of blocks we keep per chunk.
+	 *
+	 * This bounds the memory we use independent of the trace's density.
+	 */
+	pt_par_blocks_max	= 0x4000
+};
+
+/* A block and the status with which it had been decoded. */
+struct pt_par_block {
+	/* The block. */
+	struct pt_block block;
+
+	/* The pt_blk_next() status or a negative pt_error_code enumeration
+	 * constant.
+	 */
+	int status;
+};
+
+/* A contiguous part of the trace that is decoded by one block decoder.
+ *
+ * A chunk starts at a PSB and ends at the PSB at which the next chunk starts
+ * or at the end of the trace.  It contains all blocks that start in between.
+ */
+struct pt_par_chunk {
+	/* The trace configuration. */
+	const struct pt_config *config;
+
+	/* The traced memory image. */
+	struct pt_image *image;
+
+	/* The begin and end offset of the chunk in the trace buffer. */
+	uint64_t begin;
+	uint64_t end;
+
+	/* The decoded blocks. */
+	struct pt_par_block *blocks;
+
+	/* The number of decoded blocks and the capacity of @blocks. */
+	size_t nblocks;
+	size_t capacity;
+
+	/* The trace offset at which the first block had been decoded. */
+	uint64_t offset;
+
+	/* A flag saying whether @blocks contains decode errors. */
+	uint32_t failed:1;
+
+	/* A flag saying that decoding stopped at pt_par_blocks_max blocks
+	 * before reaching @end.
+	 */
+	uint32_t partial:1;
+
+	/* The decoder that reached @end, if decoding reached @end without
+	 * resynchronizing; NULL otherwise.
+	 *
+	 * It has already decoded @next, the first block of the next chunk.
+	 *
+	 * If @partial is set, it is the decoder that stopped inside the chunk
+	 * and @next is the next block of this chunk.
+	 */
+	struct pt_block_decoder *decoder;
+	struct pt_par_block next;
+
+	/* An error preventing us from decoding the chunk. */
+	int errcode;
+};
+
+/* Add @block with @status to @chunk.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_par_add(struct pt_par_chunk *chunk,
+		      const struct pt_block *block, int status)
+{
+	struct pt_par_block *blocks;
+	size_t capacity;
+
+	if (!chunk || !block)
+		return -pte_internal;
+
+	blocks = chunk->blocks;
+	capacity = chunk->capacity;
+	if (capacity <= chunk->nblocks) {
+		capacity = capacity ? (capacity * 2) : 0x40;
+
+		blocks = realloc(blocks, capacity * sizeof(*blocks));
+		if (!blocks)
+			return -pte_nomem;
+
+		chunk->blocks = blocks;
+		chunk->capacity = capacity;
+	}
+
+	blocks += chunk->nblocks++;
+	blocks->block = *block;
+	blocks->status = status;
+
+	return 0;
+}
+
+/* Decode the blocks of @chunk using @decoder.
+ *
+ * If @first is not NULL, it is the first block that @decoder already
+ * decoded.
+ *
+ * If @decoder reaches the end of @chunk, it is stored in @chunk together with
+ * the first block of the next chunk.  If @chunk is full, @decoder is stored in
+ * @chunk together with the next block and @chunk is marked partial.
+ * Otherwise, @decoder is freed.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_par_proceed(struct pt_par_chunk *chunk,
+			  struct pt_block_decoder *decoder,
+			  const struct pt_par_block *first)
+{
+	struct pt_par_block next;
+	uint64_t offset;
+	int status;
+
+	if (!chunk || !decoder)
+		return -pte_internal;
+
+	status = 0;
+	if (first)
+		next = *first;
+	else
+		next.status = pt_blk_next(decoder, &next.block,
+					  sizeof(next.block));
+
+	for (;;) {
+		if (next.status == -pte_eos)
+			break;
+
+		/* The block started after reading the next chunk's PSB. */
+		if (chunk->end < decoder->start_offset) {
+			chunk->decoder = decoder;
+			chunk->next = next;
+
+			return 0;
+		}
+
+		/* We continue once the blocks have been delivered. */
+		if (pt_par_blocks_max <= chunk->nblocks) {
+			chunk->decoder = decoder;
+			chunk->next = next;
+			chunk->partial = 1;
+
+			return 0;
+		}
+
+		if (!chunk->nblocks)
+			chunk->offset = decoder->start_offset;
+
+		status = pt_par_add(chunk, &next.block, next.status);
+		if (status < 0)
+			break;
+
+		if (next.status < 0) {
+			chunk->failed = 1;
+
+			status = pt_blk_sync_forward(decoder);
+			if (status < 0) {
+				if (status == -pte_eos)
+					status = 0;
+				break;
+			}
+
+			/* We resynchronized onto the next chunk, which is
+			 * decoded independently.
+			 */
+			status = pt_blk_get_sync_offset(decoder, &offset);
+			if (status < 0 || chunk->end <= offset)
+				break;
+		}
+
+		next.status = pt_blk_next(decoder, &next.block,
+					  sizeof(next.block));
+	}
+
+	pt_blk_free_decoder(decoder);
+
+	return (next.status == -pte_eos) ? 0 : status;
+}
+
+/* Decode @arg, a struct pt_par_chunk, using a new block decoder.
+ *
+ * Errors are stored in the chunk.
+ *
+ * Returns zero.
+ */
+static int pt_par_decode(void *arg)
+{
+	struct pt_block_decoder *decoder;
+	struct pt_par_chunk *chunk;
+	int errcode;
+
+	chunk = (struct pt_par_chunk *) arg;
+	if (!chunk)
+		return 0;
+
+	decoder = pt_blk_alloc_decoder(chunk->config);
+	if (!decoder) {
+		chunk->errcode = -pte_nomem;
+		return 0;
+	}
+
+	errcode = pt_blk_set_image(decoder, chunk->image);
+	if (errcode >= 0)
+		errcode = pt_blk_sync_set(decoder, chunk->begin);
+
+	if (errcode < 0) {
+		pt_blk_free_decoder(decoder);
+		chunk->errcode = errcode;
+		return 0;
+	}
+
+	errcode = pt_par_proceed(chunk, decoder, NULL);
+	if (errcode < 0)
+		chunk->errcode = errcode;
+
+	return 0;
+}
+
+/* Decode @chunks[0..@nchunks) concurrently.
+ *
+ * The first chunk is decoded by the calling thread.  If we fail to create a
+ * thread, the calling thread decodes that chunk, as well.
+ */
+static void pt_par_decode_all(struct pt_par_chunk *chunks, uint32_t nchunks)
+{
+	uint32_t idx;
+
+#if defined(FEATURE_THREADS)
+	thrd_t threads[pt_par_threads_max];
+	int created[pt_par_threads_max];
+
+	for (idx = 1; idx < nchunks; ++idx) {
+		int errcode;
+
+		errcode = thrd_create(&threads[idx], pt_par_decode,
+				      &chunks[idx]);
+		created[idx] = (errcode == thrd_success);
+	}
+
+	(void) pt_par_decode(&chunks[0]);
+
+	for (idx = 1; idx < nchunks; ++idx) {
+		if (created[idx])
+			(void) thrd_join(&threads[idx], NULL);
+		else
+			(void) pt_par_decode(&chunks[idx]);
+	}
+#else /* defined(FEATURE_THREADS) */
+	for (idx = 0; idx < nchunks; ++idx)
+		(void) pt_par_decode(&chunks[idx]);
+#endif /* defined(FEATURE_THREADS) */
+}
+
+/* Free the blocks and the decoder of @chunk. */
+static void pt_par_chunk_fini(struct pt_par_chunk *chunk)
+{
+	if (!chunk)
+		return;
+
+	pt_blk_free_decoder(chunk->decoder);
+	free(chunk->blocks);
+
+	chunk->decoder = NULL;
+	chunk->blocks = NULL;
+	chunk->nblocks = 0;
+	chunk->capacity = 0;
+	chunk->partial = 0;
+}
+
+/* Split the next chunk starting at trace offset @*pos off @config's trace.
+ *
+ * Initializes @chunk and moves @*pos to the beginning of the next chunk or
+ * to the end of the trace if @chunk extends to the end of the trace.
+ *
+ * Searches for the next chunk's PSB using @win and @wconfig, a copy of
+ * @config.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_par_split(struct pt_par_chunk *chunk, uint64_t *pos,
+			const struct pt_config *config, struct pt_image *image,
+			uint64_t size, struct pt_window *win,
+			struct pt_config *wconfig)
+{
+	const uint8_t *next;
+	uint64_t begin, end;
+	int errcode;
+
+	if (!chunk || !pos || !config)
+		return -pte_internal;
+
+	begin = *pos;
+	end = pt_win_size(config);
+	if (end <= begin)
+		return -pte_internal;
+
+	memset(chunk, 0, sizeof(*chunk));
+	chunk->config = config;
+	chunk->image = image;
+	chunk->begin = begin;
+	chunk->end = end;
+
+	*pos = end;
+
+	if (size < ptps_psb)
+		size = ptps_psb;
+
+	if ((end - begin) <= size)
+		return 0;
+
+	errcode = pt_win_sync_forward(win, wconfig, &next, begin + size);
+	if (errcode < 0)
+		return (errcode == -pte_eos) ? 0 : errcode;
+
+	chunk->end = pt_win_offset(win, wconfig, next);
+	*pos = chunk->end;
+
+	return 0;
+}
+
+/* Provide the blocks of @chunk to @callback.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_par_deliver(const struct pt_par_chunk *chunk,
+			  pt_blk_callback_t *callback, void *context)
+{
+	size_t idx;
+
+	if (!chunk || !callback)
+		return -pte_internal;
+
+	for (idx = 0; idx < chunk->nblocks; ++idx) {
+		const struct pt_par_block *block;
+		int errcode;
+
+		block = &chunk->blocks[idx];
+
+		errcode = callback(&block->block, block->status, context);
+		if (errcode < 0)
+			return errcode;
+	}
+
+	return 0;
+}
+
+/* Continue decoding the partial @chunk and provide its blocks to @callback.
+ *
+ * Decodes at most pt_par_blocks_max blocks at a time until the end of @chunk.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_par_resume(struct pt_par_chunk *chunk,
+			 pt_blk_callback_t *callback, void *context)
+{
+	if (!chunk)
+		return -pte_internal;
+
+	while (chunk->partial) {
+		struct pt_block_decoder *decoder;
+		struct pt_par_block next;
+		int errcode;
+
+		decoder = chunk->decoder;
+		next = chunk->next;
+
+		chunk->decoder = NULL;
+		chunk->nblocks = 0;
+		chunk->partial = 0;
+
+		errcode = pt_par_proceed(chunk, decoder, &next);
+		if (errcode < 0)
+			return errcode;
+
+		errcode = pt_par_deliver(chunk, callback, context);
+		if (errcode < 0)
+			return errcode;
+	}
+
+	return 0;
+}
+
+/* Bridge the gap between @chunk and @decoder, which reached @chunk with
+ * @first as its next block.
+ *
+ * When @decoder reads @chunk's PSB, it may not yet have reached the IP at
+ * which @chunk's own decoder starts.  Add the blocks @decoder provides until
+ * it gets there in front of @chunk's blocks.
+ *
+ * The first block of @chunk is replaced with @decoder's version of it, which
+ * has not been decoded from a synchronization point.
+ *
+ * If @decoder does not reach @chunk's first block before it reads beyond it,
+ * @chunk is left unchanged.
+ *
+ * Frees @decoder.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_par_bridge(struct pt_par_chunk *chunk,
+			 struct pt_block_decoder *decoder,
+			 const struct pt_par_block *first)
+{
+	struct pt_par_chunk bridge;
+	struct pt_par_block next;
+	int errcode;
+
+	if (!chunk || !decoder || !first)
+		return -pte_internal;
+
+	memset(&bridge, 0, sizeof(bridge));
+	next = *first;
+	errcode = 0;
+
+	while (chunk->nblocks && (0 <= next.status) &&
+	       (decoder->start_offset <= chunk->offset)) {
+		if (next.block.ip == chunk->blocks[0].block.ip) {
+			struct pt_par_block *blocks;
+			size_t nblocks;
+
+			chunk->blocks[0] = next;
+
+			nblocks = bridge.nblocks;
+			if (!nblocks)
+				break;
+
+			errcode = -pte_nomem;
+			blocks = realloc(bridge.blocks,
+					 (nblocks + chunk->nblocks) *
+					 sizeof(*blocks));
+			if (!blocks)
+				break;
+
+			memcpy(&blocks[nblocks], chunk->blocks,
+			       chunk->nblocks * sizeof(*blocks));
+
+			free(chunk->blocks);
+			chunk->blocks = blocks;
+			chunk->nblocks += nblocks;
+			chunk->capacity = chunk->nblocks;
+
+			bridge.blocks = NULL;
+			errcode = 0;
+			break;
+		}
+
+		errcode = pt_par_add(&bridge, &next.block, next.status);
+		if (errcode < 0)
+			break;
+
+		next.status = pt_blk_next(decoder, &next.block,
+					  sizeof(next.block));
+	}
+
+	free(bridge.blocks);
+	pt_blk_free_decoder(decoder);
+
+	return errcode;
+}
+
+/* Stitch @chunk to its predecessor's decoder @*carry.
+ *
+ * If @chunk could not be decoded without errors on its own and the previous
+ * chunk's decoder reached @chunk without resynchronizing, @chunk is decoded
+ * again by continuing that decoder.  This preserves the return stack and
+ * execution mode at the chunk boundary.
+ *
+ * Otherwise, the gap between the two decoders is bridged.
+ *
+ * Takes ownership of @*carry and sets it to NULL.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_par_stitch(struct pt_par_chunk *chunk,
+			 struct pt_block_decoder **carry,
+			 const struct pt_par_block *next)
+{
+	struct pt_block_decoder *decoder;
+	int errcode;
+
+	if (!chunk || !carry || !next)
+		return -pte_internal;
+
+	decoder = *carry;
+	*carry = NULL;
+
+	if (decoder && (chunk->failed || chunk->errcode)) {
+		pt_par_chunk_fini(chunk);
+
+		chunk->failed = 0;
+		chunk->errcode = 0;
+
+		errcode = pt_par_proceed(chunk, decoder, next);
+		if (errcode < 0)
+			chunk->errcode = errcode;
+	} else if (decoder) {
+		errcode = pt_par_bridge(chunk, decoder, next);
+		if (errcode < 0)
+			chunk->errcode = errcode;
+	}
+
+	return chunk->errcode;
+}
+
+int pt_blk_decode_parallel(const struct pt_config *config,
+			   struct pt_image *image, uint32_t nthreads,
+			   pt_blk_callback_t *callback, void *context)
+{
+	struct pt_par_chunk *chunks;
+	struct pt_block_decoder *carry;
+	struct pt_par_block next;
+	struct pt_config wconfig;
+	struct pt_window win;
+	const uint8_t *psb;
+	uint64_t pos, size, max_size, tsize;
+	int errcode;
+
+	if (!config || !image || !callback)
+		return -pte_invalid;
+
+	if (!config->source.read && !config->segments &&
+	    (!config->begin || !config->end || config->end < config->begin))
+		return -pte_invalid;
+
+	if (!nthreads)
+		nthreads = 1;
+	else if (pt_par_threads_max < nthreads)
+		nthreads = pt_par_threads_max;
+
+	wconfig = *config;
+	errcode = pt_win_init(&win, &wconfig);
+	if (errcode < 0)
+		return errcode;
+
+	errcode = pt_win_sync_forward(&win, &wconfig, &psb, 0ull);
+	if (errcode < 0) {
+		pt_win_fini(&win);
+		return (errcode == -pte_eos) ? 0 : errcode;
+	}
+
+	pos = pt_win_offset(&win, &wconfig, psb);
+	tsize = pt_win_size(config);
+
+	size = tsize;
+	size /= (uint64_t) nthreads * pt_par_chunks_per_thread;
+	if (pt_par_chunk_max < size)
+		size = pt_par_chunk_max;
+
+	max_size = size;
+
+	chunks = calloc(nthreads, sizeof(*chunks));
+	if (!chunks) {
+		pt_win_fini(&win);
+		return -pte_nomem;
+	}
+
+	memset(&next, 0, sizeof(next));
+	carry = NULL;
+
+	/* We decode the trace in waves of @nthreads chunks and stitch them
+	 * together in the calling thread.
+	 *
+	 * Chunks that are too dense to be decoded in one go are finished in the
+	 * calling thread.  We adjust the chunk size to the trace's density so
+	 * this remains the exception.
+	 */
+	while (pos < tsize) {
+		uint32_t idx, nchunks;
+		int dense, sparse;
+
+		for (nchunks = 0; pos < tsize && nchunks < nthreads;
+		     ++nchunks) {
+			errcode = pt_par_split(&chunks[nchunks], &pos, config,
+					       image, size, &win, &wconfig);
+			if (errcode < 0)
+				break;
+		}
+
+		pt_par_decode_all(chunks, nchunks);
+
+		dense = 0;
+		sparse = 1;
+		for (idx = 0; idx < nchunks; ++idx) {
+			struct pt_par_chunk *chunk;
+
+			chunk = &chunks[idx];
+
+			if (chunk->partial)
+				dense = 1;
+
+			if ((pt_par_blocks_max / 4) <= chunk->nblocks)
+				sparse = 0;
+
+			if (errcode >= 0)
+				errcode = pt_par_stitch(chunk, &carry, &next);
+
+			if (errcode >= 0)
+				errcode = pt_par_deliver(chunk, callback,
+							 context);
+
+			if (errcode >= 0)
+				errcode = pt_par_resume(chunk, callback,
+							context);
+
+			/* On errors, @chunk's decoder is freed below. */
+			if (errcode >= 0) {
+				carry = chunk->decoder;
+				chunk->decoder = NULL;
+			}
+
+			next = chunk->next;
+			pt_par_chunk_fini(chunk);
+		}
+
+		if (errcode < 0)
+			break;
+
+		if (dense && (ptps_psb < size))
+			size /= 2;
+		else if (sparse && (size < max_size))
+			size *= 2;
+	}
+
+	pt_blk_free_decoder(carry);
+	pt_win_fini(&win);
+	free(chunks);
+
+	return (errcode < 0) ? errcode : 0;
+}
@@ -0,0 +1,460 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "pt_callback_cache.h"
+#include "pt_asid.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+static int pt_ccache_lock(struct pt_callback_cache *cache)
+{
+	if (!cache)
+		return -pte_internal;
+
+#if defined(FEATURE_THREADS)
+	{
+		int errcode;
+
+		if (cache->lock_status != thrd_success)
+			return -pte_bad_lock;
+
+		errcode = mtx_lock(&cache->lock);
+		if (errcode != thrd_success)
+			return -pte_bad_lock;
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	return 0;
+}
+
+static int pt_ccache_unlock(struct pt_callback_cache *cache)
+{
+	if (!cache)
+		return -pte_internal;
+
+#if defined(FEATURE_THREADS)
+	{
+		int errcode;
+
+		errcode = mtx_unlock(&cache->lock);
+		if (errcode != thrd_success)
+			return -pte_bad_lock;
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	return 0;
+}
+
+void pt_callback_cache_init(struct pt_callback_cache *cache)
+{
+	if (!cache)
+		return;
+
+	memset(cache, 0, sizeof(*cache));
+
+#if defined(FEATURE_THREADS)
+
+	cache->lock_status = mtx_init(&cache->lock, mtx_plain);
+
+#endif /* defined(FEATURE_THREADS) */
+}
+
+void pt_callback_cache_fini(struct pt_callback_cache *cache)
+{
+	if (!cache)
+		return;
+
+	free(cache->pages);
+	free(cache->data);
+
+#if defined(FEATURE_THREADS)
+
+	if (cache->lock_status == thrd_success)
+		mtx_destroy(&cache->lock);
+
+#endif /* defined(FEATURE_THREADS) */
+
+	memset(cache, 0, sizeof(*cache));
+}
+
+/* Discard @cache's pages and disable it.
+ *
+ * The caller must hold @cache's lock.
+ */
+static void pt_ccache_disable(struct pt_callback_cache *cache)
+{
+	free(cache->pages);
+	free(cache->data);
+
+	cache->pages = NULL;
+	cache->data = NULL;
+	cache->granule = 0;
+	cache->shift = 0;
+	cache->npages = 0;
+	cache->hits = 0ull;
+	cache->misses = 0ull;
+	cache->invalidations = 0ull;
+	cache->generation += 1;
+}
+
+int pt_callback_cache_configure(struct pt_callback_cache *cache,
+				uint32_t granule, uint32_t npages)
+{
+	struct pt_callback_page *pages;
+	uint8_t *data;
+	uint64_t size;
+	uint8_t shift;
+	int errcode;
+
+	if (!cache)
+		return -pte_internal;
+
+	if (granule & (granule - 1))
+		return -pte_invalid;
+
+	pages = NULL;
+	data = NULL;
+	shift = 0;
+
+	if (granule && npages) {
+		size = (uint64_t) granule * npages;
+		if ((uint64_t) (size_t) size != size)
+			return -pte_nomem;
+
+		pages = calloc(npages, sizeof(*pages));
+		if (!pages)
+			return -pte_nomem;
+
+		data = malloc((size_t) size);
+		if (!data) {
+			free(pages);
+			return -pte_nomem;
+		}
+
+		for (; (1u << shift) < granule; ++shift)
+			;
+	}
+
+	errcode = pt_ccache_lock(cache);
+	if (errcode < 0) {
+		free(data);
+		free(pages);
+		return errcode;
+	}
+
+	pt_ccache_disable(cache);
+
+	if (pages) {
+		cache->pages = pages;
+		cache->data = data;
+		cache->granule = granule;
+		cache->shift = shift;
+		cache->npages = npages;
+	}
+
+	return pt_ccache_unlock(cache);
+}
+
+void pt_callback_cache_clear(struct pt_callback_cache *cache)
+{
+	uint32_t idx;
+
+	if (pt_ccache_lock(cache) < 0)
+		return;
+
+	for (idx = 0; idx < cache->npages; ++idx)
+		cache->pages[idx].size = 0;
+
+	cache->generation += 1;
+
+	(void) pt_ccache_unlock(cache);
+}
+
+int pt_callback_cache_invalidate(struct pt_callback_cache *cache,
+				 const struct pt_asid *asid, uint64_t vaddr,
+				 uint64_t size)
+{
+	uint64_t last;
+	uint32_t idx;
+	int discarded, errcode;
+
+	if (!cache || !asid)
+		return -pte_internal;
+
+	if (!size)
+		return 0;
+
+	/* We use inclusive bounds so we can cover the entire address range. */
+	last = vaddr + size - 1;
+	if (last < vaddr)
+		last = UINT64_MAX;
+
+	errcode = pt_ccache_lock(cache);
+	if (errcode < 0)
+		return errcode;
+
+	discarded = 0;
+	for (idx = 0; idx < cache->npages; ++idx) {
+		struct pt_callback_page *page;
+		uint64_t plast;
+
+		page = &cache->pages[idx];
+		if (!page->size)
+			continue;
+
+		plast = page->vaddr + (cache->granule - 1);
+		if ((last < page->vaddr) || (plast < vaddr))
+			continue;
+
+		if (pt_asid_match(&page->asid, asid) <= 0)
+			continue;
+
+		page->size = 0;
+		discarded += 1;
+	}
+
+	cache->invalidations += (uint64_t) discarded;
+
+	/* A page that is being read right now may be affected, as well. */
+	cache->generation += 1;
+
+	errcode = pt_ccache_unlock(cache);
+	if (errcode < 0)
+		return errcode;
+
+	return discarded;
+}
+
+int pt_callback_cache_get_stats(const struct pt_callback_cache *ccache,
+				struct pt_callback_cache_stats *stats)
+{
+	struct pt_callback_cache *cache;
+	int errcode;
+
+	if (!ccache || !stats)
+		return -pte_internal;
+
+	/* Reading the statistics does not modify @ccache - locking does. */
+	cache = (struct pt_callback_cache *) ccache;
+
+	errcode = pt_ccache_lock(cache);
+	if (errcode < 0)
+		return errcode;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->granule = cache->granule;
+	stats->npages = cache->npages;
+	stats->hits = cache->hits;
+	stats->misses = cache->misses;
+	stats->invalidations = cache->invalidations;
+
+	return pt_ccache_unlock(cache);
+}
+
+/* Copy at most @size bytes at offset @begin of a page of @psize bytes at
+ * @data into @buffer.
+ *
+ * Returns the number of bytes copied on success, a negative error code
+ * otherwise.
+ * Returns -pte_nomap if @begin lies outside of the page.
+ */
+static int pt_ccache_copy(uint8_t *buffer, uint16_t size, const uint8_t *data,
+			  uint32_t psize, uint64_t begin)
+{
+	if (psize <= begin)
+		return -pte_nomap;
+
+	if ((psize - begin) < size)
+		size = (uint16_t) (psize - begin);
+
+	memcpy(buffer, &data[begin], size);
+	return (int) size;
+}
+
+/* Read memory from the page containing @addr.
+ *
+ * Reads at most @size bytes from @addr in @asid into @buffer but not beyond
+ * the end of the page.  Requests the page from @callback on a miss.
+ *
+ * The lock is not held while @callback runs so @callback may use the cache
+ * itself.  The page is only installed if the cache has not been modified in
+ * the meantime.
+ *
+ * Returns the number of bytes read on success, a negative error code otherwise.
+ * Returns -pte_nomap if the page can't be provided by @callback.
+ */
+static int pt_callback_cache_read_page(struct pt_callback_cache *cache,
+				       read_memory_callback_t *callback,
+				       void *context, uint8_t *buffer,
+				       uint16_t size,
+				       const struct pt_asid *asid,
+				       uint64_t addr)
+{
+	struct pt_callback_page *page;
+	uint64_t vaddr, begin, generation;
+	uint32_t granule, idx, psize;
+	uint8_t *data;
+	int status, errcode;
+
+	errcode = pt_ccache_lock(cache);
+	if (errcode < 0)
+		return errcode;
+
+	/* The cache may have been disabled since we last checked. */
+	granule = cache->granule;
+	if (!cache->npages) {
+		errcode = pt_ccache_unlock(cache);
+		return (errcode < 0) ? errcode : -pte_nomap;
+	}
+
+	vaddr = addr & ~((uint64_t) granule - 1);
+	begin = addr - vaddr;
+
+	idx = (uint32_t) (((vaddr >> cache->shift) ^ (asid->cr3 >> 12)) %
+			  cache->npages);
+
+	page = &cache->pages[idx];
+	data = &cache->data[(size_t) idx * granule];
+
+	if (page->size && (page->vaddr == vaddr) &&
+	    (page->asid.cr3 == asid->cr3) && (page->asid.vmcs == asid->vmcs)) {
+		cache->hits += 1;
+
+		status = pt_ccache_copy(buffer, size, data, page->size, begin);
+
+		errcode = pt_ccache_unlock(cache);
+		if (errcode < 0)
+			return errcode;
+
+		return status;
+	}
+
+	cache->misses += 1;
+	generation = cache->generation;
+
+	errcode = pt_ccache_unlock(cache);
+	if (errcode < 0)
+		return errcode;
+
+	data = malloc(granule);
+	if (!data)
+		return -pte_nomem;
+
+	status = callback(data, granule, asid, vaddr, context);
+	if (status <= 0) {
+		free(data);
+		return -pte_nomap;
+	}
+
+	psize = (uint32_t) status;
+	if (granule < psize)
+		psize = granule;
+
+	errcode = pt_ccache_lock(cache);
+	if (errcode < 0) {
+		free(data);
+		return errcode;
+	}
+
+	/* Another thread may have installed a page into our slot in the
+	 * meantime.  We replace it.
+	 */
+	if (cache->generation == generation) {
+		page = &cache->pages[idx];
+
+		memcpy(&cache->data[(size_t) idx * granule], data, psize);
+
+		page->asid = *asid;
+		page->vaddr = vaddr;
+		page->size = psize;
+	}
+
+	errcode = pt_ccache_unlock(cache);
+	if (errcode < 0) {
+		free(data);
+		return errcode;
+	}
+
+	status = pt_ccache_copy(buffer, size, data, psize, begin);
+	free(data);
+
+	return status;
+}
+
+int pt_callback_cache_read(struct pt_callback_cache *cache,
+			   read_memory_callback_t *callback, void *context,
+			   uint8_t *buffer, uint16_t size,
+			   const struct pt_asid *asid, uint64_t addr)
+{
+	uint16_t done;
+
+	if (!cache || !callback || !buffer || !asid)
+		return -pte_internal;
+
+	/* The read may span two or more pages.
+	 *
+	 * If @cache is disabled, the first page is not available and the
+	 * entire read is passed on to @callback.
+	 */
+	for (done = 0; done < size;) {
+		uint64_t vaddr;
+		int status;
+
+		vaddr = addr + done;
+		if (vaddr < addr)
+			break;
+
+		status = pt_callback_cache_read_page(cache, callback, context,
+						     buffer + done,
+						     size - done, asid,
+						     vaddr);
+		if (status == -pte_bad_lock || status == -pte_nomem)
+			return status;
+
+		if (status < 0) {
+			/* Let the callback try on its own if the page as a
+			 * whole isn't available.
+			 */
+			status = callback(buffer + done, size - done, asid,
+					  vaddr, context);
+			if (status <= 0) {
+				if (done)
+					break;
+
+				return status;
+			}
+		}
+
+		done += (uint16_t) status;
+	}
+
+	return (int) done;
+}
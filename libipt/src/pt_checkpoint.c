@@ -0,0 +1,716 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pt_checkpoint.h"
+#include "pt_query_decoder.h"
+#include "pt_insn_decoder.h"
+#include "pt_last_ip.h"
+#include "pt_tnt_cache.h"
+#include "pt_time.h"
+#include "pt_event_queue.h"
+#include "pt_retstack.h"
+
+#include "intel-pt.h"
+
+#include <string.h>
+
+
+/* The decoder checkpoint format.
+ *
+ * All integers are stored in little-endian byte order.  Flags are stored as
+ * a u32 bit-vector in the order in which they are declared.
+ *
+ *   header:    magic[8], version (u32)
+ *
+ *   query:     offset (u64), sync (u64), flags (u32), last-ip, tnt-cache,
+ *              time, time-cal, event-queue
+ *
+ *   insn:      query, asid, return-stack, ip (u64), last_disable_ip (u64),
+ *              mode (u32), status (u32), flags (u32), followed by the event
+ *              if the process_event flag is set
+ *
+ *   last-ip:   ip (u64), flags (u32)
+ *   tnt-cache: tnt (u64), index (u64)
+ *   time:      tsc (u64), base (u64), fc (u64), mtc_offset (u32), ctc (u32),
+ *              ctc_cyc (u32), lost_mtc (u32), lost_cyc (u32), cbr (u32),
+ *              flags (u32)
+ *   time-cal:  fcr (u64), min_fcr (u64), max_fcr (u64), tsc (u64),
+ *              cyc_tsc (u64), cyc_mtc (u64), ctc (u32), lost_mtc (u32),
+ *              flags (u32)
+ *   event:     type (u32), flags (u32), tsc (u64), lost_mtc (u32),
+ *              lost_cyc (u32), followed by the type's variant fields
+ *   event-queue:  for each binding: nevents (u32), nevents * event
+ *   return-stack: nentries (u32), nentries * ip (u64) from bottom to top
+ *   asid:      cr3 (u64), vmcs (u64)
+ *
+ * The query decoder's position is stored as offset into the trace.  The
+ * trace itself is not part of the checkpoint.
+ */
+static const char pt_ckpt_magic[][8] = {
+	/* pck_query */	{ 'p', 't', 'q', 'r', 'y', 'c', 'k', 'p' },
+	/* pck_insn */	{ 'p', 't', 'i', 'n', 's', 'c', 'k', 'p' }
+};
+
+enum {
+	pt_ckpt_version		= 1
+};
+
+void pt_ckpt_init_write(struct pt_checkpoint *ckpt, uint8_t *buffer,
+			size_t size)
+{
+	if (!ckpt)
+		return;
+
+	memset(ckpt, 0, sizeof(*ckpt));
+
+	ckpt->out = buffer;
+	ckpt->capacity = buffer ? size : 0;
+}
+
+void pt_ckpt_init_read(struct pt_checkpoint *ckpt, const uint8_t *buffer,
+		       size_t size)
+{
+	if (!ckpt)
+		return;
+
+	memset(ckpt, 0, sizeof(*ckpt));
+
+	ckpt->in = buffer;
+	ckpt->capacity = buffer ? size : 0;
+}
+
+int pt_ckpt_end_write(const struct pt_checkpoint *ckpt)
+{
+	if (!ckpt)
+		return -pte_internal;
+
+	if (ckpt->out && (ckpt->capacity < ckpt->size))
+		return -pte_invalid;
+
+	return (int) ckpt->size;
+}
+
+int pt_ckpt_end_read(const struct pt_checkpoint *ckpt)
+{
+	if (!ckpt)
+		return -pte_internal;
+
+	if (ckpt->bad)
+		return -pte_bad_file;
+
+	return 0;
+}
+
+static void pt_ckpt_put(struct pt_checkpoint *ckpt, uint64_t value,
+			size_t size)
+{
+	size_t idx;
+
+	if (ckpt->out && (ckpt->size + size <= ckpt->capacity)) {
+		for (idx = 0; idx < size; ++idx)
+			ckpt->out[ckpt->size + idx] =
+				(uint8_t) (value >> (idx * 8));
+	}
+
+	ckpt->size += size;
+}
+
+static uint64_t pt_ckpt_get(struct pt_checkpoint *ckpt, size_t size)
+{
+	uint64_t value;
+	size_t idx;
+
+	if (!ckpt->in || (ckpt->capacity < ckpt->size + size)) {
+		ckpt->bad = 1;
+		return 0ull;
+	}
+
+	value = 0ull;
+	for (idx = 0; idx < size; ++idx)
+		value |= (uint64_t) ckpt->in[ckpt->size + idx] << (idx * 8);
+
+	ckpt->size += size;
+
+	return value;
+}
+
+void pt_ckpt_put32(struct pt_checkpoint *ckpt, uint32_t value)
+{
+	pt_ckpt_put(ckpt, value, 4);
+}
+
+void pt_ckpt_put64(struct pt_checkpoint *ckpt, uint64_t value)
+{
+	pt_ckpt_put(ckpt, value, 8);
+}
+
+uint32_t pt_ckpt_get32(struct pt_checkpoint *ckpt)
+{
+	return (uint32_t) pt_ckpt_get(ckpt, 4);
+}
+
+uint64_t pt_ckpt_get64(struct pt_checkpoint *ckpt)
+{
+	return pt_ckpt_get(ckpt, 8);
+}
+
+void pt_ckpt_put_header(struct pt_checkpoint *ckpt, enum pt_ckpt_kind kind)
+{
+	size_t idx;
+
+	for (idx = 0; idx < sizeof(pt_ckpt_magic[kind]); ++idx)
+		pt_ckpt_put(ckpt, (uint8_t) pt_ckpt_magic[kind][idx], 1);
+
+	pt_ckpt_put32(ckpt, pt_ckpt_version);
+}
+
+void pt_ckpt_get_header(struct pt_checkpoint *ckpt, enum pt_ckpt_kind kind)
+{
+	size_t idx;
+
+	for (idx = 0; idx < sizeof(pt_ckpt_magic[kind]); ++idx) {
+		if (pt_ckpt_get(ckpt, 1) != (uint8_t) pt_ckpt_magic[kind][idx])
+			ckpt->bad = 1;
+	}
+
+	if (pt_ckpt_get32(ckpt) != pt_ckpt_version)
+		ckpt->bad = 1;
+}
+
+void pt_ckpt_put_last_ip(struct pt_checkpoint *ckpt,
+			 const struct pt_last_ip *last_ip)
+{
+	uint32_t flags;
+
+	flags = 0;
+	if (last_ip->have_ip)
+		flags |= 1 << 0;
+	if (last_ip->suppressed)
+		flags |= 1 << 1;
+
+	pt_ckpt_put64(ckpt, last_ip->ip);
+	pt_ckpt_put32(ckpt, flags);
+}
+
+void pt_ckpt_get_last_ip(struct pt_checkpoint *ckpt,
+			 struct pt_last_ip *last_ip)
+{
+	uint32_t flags;
+
+	pt_last_ip_init(last_ip);
+
+	last_ip->ip = pt_ckpt_get64(ckpt);
+
+	flags = pt_ckpt_get32(ckpt);
+	last_ip->have_ip = (flags >> 0) & 1;
+	last_ip->suppressed = (flags >> 1) & 1;
+}
+
+void pt_ckpt_put_tnt_cache(struct pt_checkpoint *ckpt,
+			   const struct pt_tnt_cache *tnt)
+{
+	pt_ckpt_put64(ckpt, tnt->tnt);
+	pt_ckpt_put64(ckpt, tnt->index);
+}
+
+void pt_ckpt_get_tnt_cache(struct pt_checkpoint *ckpt,
+			   struct pt_tnt_cache *tnt)
+{
+	pt_tnt_cache_init(tnt);
+
+	tnt->tnt = pt_ckpt_get64(ckpt);
+	tnt->index = pt_ckpt_get64(ckpt);
+
+	/* The index selects a single bit. */
+	if (tnt->index & (tnt->index - 1))
+		ckpt->bad = 1;
+}
+
+void pt_ckpt_put_time(struct pt_checkpoint *ckpt, const struct pt_time *time)
+{
+	uint32_t flags;
+
+	flags = 0;
+	if (time->have_tsc)
+		flags |= 1 << 0;
+	if (time->have_cbr)
+		flags |= 1 << 1;
+	if (time->have_tma)
+		flags |= 1 << 2;
+	if (time->have_mtc)
+		flags |= 1 << 3;
+
+	pt_ckpt_put64(ckpt, time->tsc);
+	pt_ckpt_put64(ckpt, time->base);
+	pt_ckpt_put64(ckpt, time->fc);
+	pt_ckpt_put32(ckpt, time->mtc_offset);
+	pt_ckpt_put32(ckpt, time->ctc);
+	pt_ckpt_put32(ckpt, time->ctc_cyc);
+	pt_ckpt_put32(ckpt, time->lost_mtc);
+	pt_ckpt_put32(ckpt, time->lost_cyc);
+	pt_ckpt_put32(ckpt, time->cbr);
+	pt_ckpt_put32(ckpt, flags);
+}
+
+void pt_ckpt_get_time(struct pt_checkpoint *ckpt, struct pt_time *time)
+{
+	uint32_t flags;
+
+	pt_time_init(time);
+
+	time->tsc = pt_ckpt_get64(ckpt);
+	time->base = pt_ckpt_get64(ckpt);
+	time->fc = pt_ckpt_get64(ckpt);
+	time->mtc_offset = pt_ckpt_get32(ckpt);
+	time->ctc = pt_ckpt_get32(ckpt);
+	time->ctc_cyc = pt_ckpt_get32(ckpt);
+	time->lost_mtc = pt_ckpt_get32(ckpt);
+	time->lost_cyc = pt_ckpt_get32(ckpt);
+	time->cbr = (uint8_t) pt_ckpt_get32(ckpt);
+
+	flags = pt_ckpt_get32(ckpt);
+	time->have_tsc = (flags >> 0) & 1;
+	time->have_cbr = (flags >> 1) & 1;
+	time->have_tma = (flags >> 2) & 1;
+	time->have_mtc = (flags >> 3) & 1;
+}
+
+void pt_ckpt_put_time_cal(struct pt_checkpoint *ckpt,
+			  const struct pt_time_cal *tcal)
+{
+	pt_ckpt_put64(ckpt, tcal->fcr);
+	pt_ckpt_put64(ckpt, tcal->min_fcr);
+	pt_ckpt_put64(ckpt, tcal->max_fcr);
+	pt_ckpt_put64(ckpt, tcal->tsc);
+	pt_ckpt_put64(ckpt, tcal->cyc_tsc);
+	pt_ckpt_put64(ckpt, tcal->cyc_mtc);
+	pt_ckpt_put32(ckpt, tcal->ctc);
+	pt_ckpt_put32(ckpt, tcal->lost_mtc);
+	pt_ckpt_put32(ckpt, tcal->have_mtc ? 1 : 0);
+}
+
+void pt_ckpt_get_time_cal(struct pt_checkpoint *ckpt,
+			  struct pt_time_cal *tcal)
+{
+	pt_tcal_init(tcal);
+
+	tcal->fcr = pt_ckpt_get64(ckpt);
+	tcal->min_fcr = pt_ckpt_get64(ckpt);
+	tcal->max_fcr = pt_ckpt_get64(ckpt);
+	tcal->tsc = pt_ckpt_get64(ckpt);
+	tcal->cyc_tsc = pt_ckpt_get64(ckpt);
+	tcal->cyc_mtc = pt_ckpt_get64(ckpt);
+	tcal->ctc = pt_ckpt_get32(ckpt);
+	tcal->lost_mtc = pt_ckpt_get32(ckpt);
+	tcal->have_mtc = pt_ckpt_get32(ckpt) & 1;
+}
+
+void pt_ckpt_put_event(struct pt_checkpoint *ckpt,
+		       const struct pt_event *event)
+{
+	uint32_t flags;
+
+	flags = 0;
+	if (event->ip_suppressed)
+		flags |= 1 << 0;
+	if (event->status_update)
+		flags |= 1 << 1;
+	if (event->has_tsc)
+		flags |= 1 << 2;
+
+	pt_ckpt_put32(ckpt, (uint32_t) event->type);
+	pt_ckpt_put32(ckpt, flags);
+	pt_ckpt_put64(ckpt, event->tsc);
+	pt_ckpt_put32(ckpt, event->lost_mtc);
+	pt_ckpt_put32(ckpt, event->lost_cyc);
+
+	switch (event->type) {
+	case ptev_enabled:
+		pt_ckpt_put64(ckpt, event->variant.enabled.ip);
+		break;
+
+	case ptev_disabled:
+		pt_ckpt_put64(ckpt, event->variant.disabled.ip);
+		break;
+
+	case ptev_async_disabled:
+		pt_ckpt_put64(ckpt, event->variant.async_disabled.at);
+		pt_ckpt_put64(ckpt, event->variant.async_disabled.ip);
+		break;
+
+	case ptev_async_branch:
+		pt_ckpt_put64(ckpt, event->variant.async_branch.from);
+		pt_ckpt_put64(ckpt, event->variant.async_branch.to);
+		break;
+
+	case ptev_paging:
+		pt_ckpt_put64(ckpt, event->variant.paging.cr3);
+		pt_ckpt_put32(ckpt, event->variant.paging.non_root);
+		break;
+
+	case ptev_async_paging:
+		pt_ckpt_put64(ckpt, event->variant.async_paging.cr3);
+		pt_ckpt_put32(ckpt, event->variant.async_paging.non_root);
+		pt_ckpt_put64(ckpt, event->variant.async_paging.ip);
+		break;
+
+	case ptev_overflow:
+		pt_ckpt_put64(ckpt, event->variant.overflow.ip);
+		break;
+
+	case ptev_exec_mode:
+		pt_ckpt_put32(ckpt, (uint32_t) event->variant.exec_mode.mode);
+		pt_ckpt_put64(ckpt, event->variant.exec_mode.ip);
+		break;
+
+	case ptev_tsx:
+		flags = 0;
+		if (event->variant.tsx.speculative)
+			flags |= 1 << 0;
+		if (event->variant.tsx.aborted)
+			flags |= 1 << 1;
+
+		pt_ckpt_put64(ckpt, event->variant.tsx.ip);
+		pt_ckpt_put32(ckpt, flags);
+		break;
+
+	case ptev_stop:
+		break;
+
+	case ptev_vmcs:
+		pt_ckpt_put64(ckpt, event->variant.vmcs.base);
+		break;
+
+	case ptev_async_vmcs:
+		pt_ckpt_put64(ckpt, event->variant.async_vmcs.base);
+		pt_ckpt_put64(ckpt, event->variant.async_vmcs.ip);
+		break;
+	}
+}
+
+void pt_ckpt_get_event(struct pt_checkpoint *ckpt, struct pt_event *event)
+{
+	uint32_t flags;
+
+	memset(event, 0, sizeof(*event));
+
+	event->type = (enum pt_event_type) pt_ckpt_get32(ckpt);
+
+	flags = pt_ckpt_get32(ckpt);
+	event->ip_suppressed = (flags >> 0) & 1;
+	event->status_update = (flags >> 1) & 1;
+	event->has_tsc = (flags >> 2) & 1;
+
+	event->tsc = pt_ckpt_get64(ckpt);
+	event->lost_mtc = pt_ckpt_get32(ckpt);
+	event->lost_cyc = pt_ckpt_get32(ckpt);
+
+	switch (event->type) {
+	case ptev_enabled:
+		event->variant.enabled.ip = pt_ckpt_get64(ckpt);
+		return;
+
+	case ptev_disabled:
+		event->variant.disabled.ip = pt_ckpt_get64(ckpt);
+		return;
+
+	case ptev_async_disabled:
+		event->variant.async_disabled.at = pt_ckpt_get64(ckpt);
+		event->variant.async_disabled.ip = pt_ckpt_get64(ckpt);
+		return;
+
+	case ptev_async_branch:
+		event->variant.async_branch.from = pt_ckpt_get64(ckpt);
+		event->variant.async_branch.to = pt_ckpt_get64(ckpt);
+		return;
+
+	case ptev_paging:
+		event->variant.paging.cr3 = pt_ckpt_get64(ckpt);
+		event->variant.paging.non_root = pt_ckpt_get32(ckpt) & 1;
+		return;
+
+	case ptev_async_paging:
+		event->variant.async_paging.cr3 = pt_ckpt_get64(ckpt);
+		event->variant.async_paging.non_root = pt_ckpt_get32(ckpt) & 1;
+		event->variant.async_paging.ip = pt_ckpt_get64(ckpt);
+		return;
+
+	case ptev_overflow:
+		event->variant.overflow.ip = pt_ckpt_get64(ckpt);
+		return;
+
+	case ptev_exec_mode:
+		event->variant.exec_mode.mode =
+			(enum pt_exec_mode) pt_ckpt_get32(ckpt);
+		event->variant.exec_mode.ip = pt_ckpt_get64(ckpt);
+		return;
+
+	case ptev_tsx:
+		event->variant.tsx.ip = pt_ckpt_get64(ckpt);
+
+		flags = pt_ckpt_get32(ckpt);
+		event->variant.tsx.speculative = (flags >> 0) & 1;
+		event->variant.tsx.aborted = (flags >> 1) & 1;
+		return;
+
+	case ptev_stop:
+		return;
+
+	case ptev_vmcs:
+		event->variant.vmcs.base = pt_ckpt_get64(ckpt);
+		return;
+
+	case ptev_async_vmcs:
+		event->variant.async_vmcs.base = pt_ckpt_get64(ckpt);
+		event->variant.async_vmcs.ip = pt_ckpt_get64(ckpt);
+		return;
+	}
+
+	/* We don't know this event type. */
+	ckpt->bad = 1;
+}
+
+void pt_ckpt_put_evq(struct pt_checkpoint *ckpt,
+		     const struct pt_event_queue *evq)
+{
+	int evb;
+
+	for (evb = 0; evb < evb_max; ++evb) {
+		uint8_t begin, end, idx;
+
+		begin = evq->begin[evb];
+		end = evq->end[evb];
+
+		pt_ckpt_put32(ckpt, (uint32_t) ((end + evq_max - begin) %
+						evq_max));
+
+		for (idx = begin; idx != end; idx = (idx + 1) % evq_max)
+			pt_ckpt_put_event(ckpt, &evq->queue[evb][idx]);
+	}
+}
+
+void pt_ckpt_get_evq(struct pt_checkpoint *ckpt, struct pt_event_queue *evq)
+{
+	int evb;
+
+	pt_evq_init(evq);
+
+	for (evb = 0; evb < evb_max; ++evb) {
+		enum pt_event_binding binding;
+		uint32_t nevents;
+
+		binding = (enum pt_event_binding) evb;
+
+		nevents = pt_ckpt_get32(ckpt);
+		if (evq_max <= nevents) {
+			ckpt->bad = 1;
+			return;
+		}
+
+		for (; nevents; --nevents) {
+			struct pt_event *event;
+
+			event = pt_evq_enqueue(evq, binding);
+			if (!event) {
+				ckpt->bad = 1;
+				return;
+			}
+
+			pt_ckpt_get_event(ckpt, event);
+		}
+	}
+}
+
+void pt_ckpt_put_retstack(struct pt_checkpoint *ckpt,
+			  const struct pt_retstack *retstack)
+{
+	uint8_t bottom, top, idx;
+
+	bottom = retstack->bottom;
+	top = retstack->top;
+
+	pt_ckpt_put32(ckpt, (uint32_t) ((top + pt_retstack_size + 1 - bottom) %
+					(pt_retstack_size + 1)));
+
+	for (idx = bottom; idx != top; idx = (idx + 1) % (pt_retstack_size + 1))
+		pt_ckpt_put64(ckpt, retstack->stack[idx]);
+}
+
+void pt_ckpt_get_retstack(struct pt_checkpoint *ckpt,
+			  struct pt_retstack *retstack)
+{
+	uint32_t nentries;
+
+	pt_retstack_init(retstack);
+
+	nentries = pt_ckpt_get32(ckpt);
+	if (pt_retstack_size < nentries) {
+		ckpt->bad = 1;
+		return;
+	}
+
+	for (; nentries; --nentries)
+		(void) pt_retstack_push(retstack, pt_ckpt_get64(ckpt));
+}
+
+void pt_ckpt_put_asid(struct pt_checkpoint *ckpt, const struct pt_asid *asid)
+{
+	pt_ckpt_put64(ckpt, asid->cr3);
+	pt_ckpt_put64(ckpt, asid->vmcs);
+}
+
+void pt_ckpt_get_asid(struct pt_checkpoint *ckpt, struct pt_asid *asid)
+{
+	pt_asid_init(asid);
+
+	asid->cr3 = pt_ckpt_get64(ckpt);
+	asid->vmcs = pt_ckpt_get64(ckpt);
+}
+
+void pt_ckpt_put_qry_state(struct pt_checkpoint *ckpt,
+			   const struct pt_qry_state *state)
+{
+	uint32_t flags;
+
+	flags = 0;
+	if (state->enabled)
+		flags |= 1 << 0;
+	if (state->consume_packet)
+		flags |= 1 << 1;
+	if (state->has_next)
+		flags |= 1 << 2;
+
+	pt_ckpt_put64(ckpt, state->offset);
+	pt_ckpt_put64(ckpt, state->sync);
+	pt_ckpt_put32(ckpt, flags);
+	pt_ckpt_put_last_ip(ckpt, &state->ip);
+	pt_ckpt_put_tnt_cache(ckpt, &state->tnt);
+	pt_ckpt_put_time(ckpt, &state->time);
+	pt_ckpt_put_time_cal(ckpt, &state->tcal);
+	pt_ckpt_put_evq(ckpt, &state->evq);
+}
+
+void pt_ckpt_get_qry_state(struct pt_checkpoint *ckpt,
+			   struct pt_qry_state *state)
+{
+	uint32_t flags;
+
+	memset(state, 0, sizeof(*state));
+
+	state->offset = pt_ckpt_get64(ckpt);
+	state->sync = pt_ckpt_get64(ckpt);
+
+	flags = pt_ckpt_get32(ckpt);
+	state->enabled = (flags >> 0) & 1;
+	state->consume_packet = (flags >> 1) & 1;
+	state->has_next = (flags >> 2) & 1;
+
+	pt_ckpt_get_last_ip(ckpt, &state->ip);
+	pt_ckpt_get_tnt_cache(ckpt, &state->tnt);
+	pt_ckpt_get_time(ckpt, &state->time);
+	pt_ckpt_get_time_cal(ckpt, &state->tcal);
+	pt_ckpt_get_evq(ckpt, &state->evq);
+}
+
+void pt_ckpt_put_insn_state(struct pt_checkpoint *ckpt,
+			    const struct pt_insn_state *state)
+{
+	uint32_t flags;
+
+	flags = 0;
+	if (state->enabled)
+		flags |= 1 << 0;
+	if (state->process_event)
+		flags |= 1 << 1;
+	if (state->event_may_change_ip)
+		flags |= 1 << 2;
+	if (state->speculative)
+		flags |= 1 << 3;
+	if (state->paging_event_bound)
+		flags |= 1 << 4;
+	if (state->vmcs_event_bound)
+		flags |= 1 << 5;
+	if (state->resume_proceed)
+		flags |= 1 << 6;
+	if (state->resume_peek)
+		flags |= 1 << 7;
+
+	pt_ckpt_put_qry_state(ckpt, &state->query);
+	pt_ckpt_put_asid(ckpt, &state->asid);
+	pt_ckpt_put_retstack(ckpt, &state->retstack);
+	pt_ckpt_put64(ckpt, state->ip);
+	pt_ckpt_put64(ckpt, state->last_disable_ip);
+	pt_ckpt_put32(ckpt, (uint32_t) state->mode);
+	pt_ckpt_put32(ckpt, (uint32_t) state->status);
+	pt_ckpt_put32(ckpt, flags);
+
+	/* The event is only meaningful while we're processing it. */
+	if (state->process_event)
+		pt_ckpt_put_event(ckpt, &state->event);
+}
+
+void pt_ckpt_get_insn_state(struct pt_checkpoint *ckpt,
+			    struct pt_insn_state *state)
+{
+	uint32_t flags;
+
+	memset(state, 0, sizeof(*state));
+
+	pt_ckpt_get_qry_state(ckpt, &state->query);
+	pt_ckpt_get_asid(ckpt, &state->asid);
+	pt_ckpt_get_retstack(ckpt, &state->retstack);
+	state->ip = pt_ckpt_get64(ckpt);
+	state->last_disable_ip = pt_ckpt_get64(ckpt);
+	state->mode = (enum pt_exec_mode) pt_ckpt_get32(ckpt);
+	state->status = (int) pt_ckpt_get32(ckpt);
+
+	flags = pt_ckpt_get32(ckpt);
+	state->enabled = (flags >> 0) & 1;
+	state->process_event = (flags >> 1) & 1;
+	state->event_may_change_ip = (flags >> 2) & 1;
+	state->speculative = (flags >> 3) & 1;
+	state->paging_event_bound = (flags >> 4) & 1;
+	state->vmcs_event_bound = (flags >> 5) & 1;
+	state->resume_proceed = (flags >> 6) & 1;
+	state->resume_peek = (flags >> 7) & 1;
+
+	if (state->process_event)
+		pt_ckpt_get_event(ckpt, &state->event);
+
+	switch (state->mode) {
+	case ptem_unknown:
+	case ptem_16bit:
+	case ptem_32bit:
+	case ptem_64bit:
+		break;
+
+	default:
+		ckpt->bad = 1;
+		break;
+	}
+}
@@ -26,6 +26,8 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "pt_window.h"
+
 #include "intel-pt.h"
 
 #include <string.h>
@@ -73,12 +75,6 @@ int pt_config_from_user(struct pt_config *config,
 	if (size < offsetof(struct pt_config, decode))
 		return -pte_bad_config;
 
-	begin = uconfig->begin;
-	end = uconfig->end;
-
-	if (!begin || !end || end < begin)
-		return -pte_bad_config;
-
 	/* Ignore fields in the user's configuration we don't know; zero out
 	 * fields the user didn't know about.
 	 */
@@ -93,5 +89,40 @@ int pt_config_from_user(struct pt_config *config,
 	/* We copied user's size - fix it. */
 	config->size = size;
 
+	/* The trace is given by a read callback, by a list of segments, or
+	 * by a single buffer.
+	 */
+	if (config->source.read) {
+		uint32_t window;
+
+		window = config->source.window;
+		if (window && (window < pt_win_bounce_size))
+			return -pte_bad_config;
+
+		return 0;
+	}
+
+	if (config->segments) {
+		const struct pt_segment *segment;
+		uint32_t idx;
+
+		segment = config->segments;
+		for (idx = 0; idx < config->nsegments; ++idx) {
+			begin = segment[idx].begin;
+			end = segment[idx].end;
+
+			if (!begin || !end || end < begin)
+				return -pte_bad_config;
+		}
+
+		return 0;
+	}
+
+	begin = config->begin;
+	end = config->end;
+
+	if (!begin || !end || end < begin)
+		return -pte_bad_config;
+
 	return 0;
 }
@@ -45,6 +45,10 @@ int pt_encoder_init(struct pt_encoder *encoder, const struct pt_config *config)
 	if (errcode < 0)
 		return errcode;
 
+	/* We encode into a single trace buffer. */
+	if (encoder->config.segments || encoder->config.source.read)
+		return -pte_bad_config;
+
 	encoder->pos = encoder->config.begin;
 
 	return 0;
@@ -91,6 +91,9 @@ const char *pt_errstr(enum pt_error_code errcode)
 
 	case pte_not_supported:
 		return "not supported";
+
+	case pte_bad_file:
+		return "bad file";
 	}
 
 	/* Should not reach here. */
@@ -43,90 +43,62 @@ pti_abort ()
   exit(1);
 }
 
-/* SET UP 3 TABLES */
-
-static pti_uint8_t has_disp_regular[3][4][8];
-
-static void
-init_has_disp_regular_table (void)
-{
-  pti_uint8_t eamode;
-  pti_uint8_t rm;
-  pti_uint8_t mod;
-
-  /* zero whole table */
-  for (eamode = 0; eamode < 3; eamode++)
-    for (mod = 0; mod < 4; mod++)
-      for (rm = 0; rm < 8; rm++)
-        has_disp_regular[eamode][mod][rm] = 0;
-
-  /*fill the eamode16 */
-  has_disp_regular[0][0][6] = 2;
-  for (rm = 0; rm < 8; rm++)
-    {
-      for (mod = 1; mod <= 2; mod++)
-        has_disp_regular[0][mod][rm] = mod;
-    }
-
-  /*fill eamode32/64 */
-  for (eamode = 1; eamode <= 2; eamode++)
-    {
-      for (rm = 0; rm < 8; rm++)
-        {
-          has_disp_regular[eamode][1][rm] = 1;
-          has_disp_regular[eamode][2][rm] = 4;
-        };
-      has_disp_regular[eamode][0][5] = 4;
-    }
-}
-
-
-
-static pti_uint8_t eamode_table[2][PTI_MODE_LAST];
-
-static void
-init_eamode_table (void)
-{
-  pti_uint8_t mode;
-  pti_uint8_t asz;
-
-  /* zero out the table. */
-  for (asz = 0; asz < 2; asz++)
-    for (mode = 0; mode < PTI_MODE_LAST; mode++)
-      eamode_table[asz][mode] = 0;
-
-  for (mode = PTI_MODE_16; mode <= PTI_MODE_64; mode++)
-    eamode_table[0][mode] = mode;
-
-  eamode_table[1][PTI_MODE_16] = PTI_MODE_32;
-  eamode_table[1][PTI_MODE_32] = PTI_MODE_16;
-  eamode_table[1][PTI_MODE_64] = PTI_MODE_32;
-}
-
-static pti_uint8_t has_sib_table[3][4][8];
-
-static void
-init_has_sib_table (void)
-{
-  pti_uint8_t eamode;
-  pti_uint8_t mod;
-  pti_uint8_t rm;
-
-  /* zero whole table */
-  for (eamode = 0; eamode < 3; eamode++)
-    for (mod = 0; mod < 4; mod++)
-      for (rm = 0; rm < 8; rm++)
-        has_sib_table[eamode][mod][rm] = 0;
-
-  /*for eamode32/64 there is sib byte for mod!=3 and rm==4 */
-  for (eamode = 1; eamode <= 2; eamode++)
-    {
-      for (mod = 0; mod <= 2; mod++)
-        {
-          has_sib_table[eamode][mod][4] = 1;
-        }
-    }
-}
+/* THE 3 TABLES - indexed by eamode, mod, and rm */
+
+static const pti_uint8_t has_disp_regular[3][4][8] = {
+  /* eamode16 */
+  {
+    { 0, 0, 0, 0, 0, 0, 2, 0 },
+    { 1, 1, 1, 1, 1, 1, 1, 1 },
+    { 2, 2, 2, 2, 2, 2, 2, 2 },
+    { 0, 0, 0, 0, 0, 0, 0, 0 }
+  },
+  /* eamode32 */
+  {
+    { 0, 0, 0, 0, 0, 4, 0, 0 },
+    { 1, 1, 1, 1, 1, 1, 1, 1 },
+    { 4, 4, 4, 4, 4, 4, 4, 4 },
+    { 0, 0, 0, 0, 0, 0, 0, 0 }
+  },
+  /* eamode64 */
+  {
+    { 0, 0, 0, 0, 0, 4, 0, 0 },
+    { 1, 1, 1, 1, 1, 1, 1, 1 },
+    { 4, 4, 4, 4, 4, 4, 4, 4 },
+    { 0, 0, 0, 0, 0, 0, 0, 0 }
+  }
+};
+
+/* indexed by asz and mode */
+static const pti_uint8_t eamode_table[2][PTI_MODE_LAST] = {
+  { PTI_MODE_16, PTI_MODE_32, PTI_MODE_64 },
+  { PTI_MODE_32, PTI_MODE_16, PTI_MODE_32 }
+};
+
+/* for eamode32/64 there is sib byte for mod!=3 and rm==4 */
+static const pti_uint8_t has_sib_table[3][4][8] = {
+  /* eamode16 */
+  {
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0 }
+  },
+  /* eamode32 */
+  {
+    { 0, 0, 0, 0, 1, 0, 0, 0 },
+    { 0, 0, 0, 0, 1, 0, 0, 0 },
+    { 0, 0, 0, 0, 1, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0 }
+  },
+  /* eamode64 */
+  {
+    { 0, 0, 0, 0, 1, 0, 0, 0 },
+    { 0, 0, 0, 0, 1, 0, 0, 0 },
+    { 0, 0, 0, 0, 1, 0, 0, 0 },
+    { 0, 0, 0, 0, 0, 0, 0, 0 }
+  }
+};
 
 /* SOME ACCESSORS */
 
@@ -904,14 +876,6 @@ set_branch_target (pti_ild_t * ild)
 
 /*  MAIN ENTRY POINTS */
 
-PTI_DLL_EXPORT void
-pti_ild_init (void)
-{                               /* initialization */
-  init_has_disp_regular_table ();
-  init_has_sib_table ();
-  init_eamode_table ();
-}
-
 PTI_DLL_EXPORT pti_bool_t
 pti_instruction_length_decode (pti_ild_t * ild)
 {
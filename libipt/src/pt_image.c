@@ -28,11 +28,18 @@
 
 #include "pt_image.h"
 #include "pt_section.h"
+#include "pt_section_cache.h"
+#include "pt_section_registry.h"
+#include "pt_section_buffer.h"
 #include "pt_asid.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(FEATURE_THREADS)
+#  include <threads.h>
+#endif /* defined(FEATURE_THREADS) */
+
 
 static char *dupstr(const char *str)
 {
@@ -50,42 +57,744 @@ static char *dupstr(const char *str)
 	return strcpy(dup, str);
 }
 
-static struct pt_section_list *pt_mk_section_list(struct pt_section *section,
-						  const struct pt_asid *asid,
-						  uint64_t vaddr)
+#if defined(FEATURE_THREADS)
+
+/* A lock protecting the user counts of all image indices.
+ *
+ * Indices may be shared by images that are used by different threads.
+ */
+static mtx_t pt_image_index_lock;
+static once_flag pt_image_index_once = ONCE_FLAG_INIT;
+static int pt_image_index_lock_status;
+
+static void pt_image_index_init_lock(void)
 {
-	struct pt_section_list *list;
-	int errcode;
+	pt_image_index_lock_status = mtx_init(&pt_image_index_lock,
+					      mtx_plain);
+}
+
+#endif /* defined(FEATURE_THREADS) */
+
+static int pt_image_lock_indices(void)
+{
+#if defined(FEATURE_THREADS)
+	{
+		int errcode;
+
+		call_once(&pt_image_index_once, pt_image_index_init_lock);
+		if (pt_image_index_lock_status != thrd_success)
+			return -pte_bad_lock;
+
+		errcode = mtx_lock(&pt_image_index_lock);
+		if (errcode != thrd_success)
+			return -pte_bad_lock;
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	return 0;
+}
+
+static int pt_image_unlock_indices(void)
+{
+#if defined(FEATURE_THREADS)
+	{
+		int errcode;
+
+		errcode = mtx_unlock(&pt_image_index_lock);
+		if (errcode != thrd_success)
+			return -pte_bad_lock;
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	return 0;
+}
+
+/* Check whether two asids are identical.
+ *
+ * In contrast to pt_asid_match(), default values are not treated as
+ * wildcards.
+ */
+static int pt_image_same_asid(const struct pt_asid *lhs,
+			      const struct pt_asid *rhs)
+{
+	if (!lhs || !rhs)
+		return 0;
+
+	return (lhs->cr3 == rhs->cr3) && (lhs->vmcs == rhs->vmcs);
+}
+
+/* Find the position of a section in an address space.
+ *
+ * Sections are sorted by @vaddr and then by @end, so empty sections come
+ * before a non-empty section at the same virtual address.
+ *
+ * Returns the number of sections in @space that sort before (@vaddr, @end).
+ */
+static uint32_t pt_image_space_lower(const struct pt_image_space *space,
+				     uint64_t vaddr, uint64_t end)
+{
+	uint32_t lo, hi;
+
+	lo = 0;
+	hi = space->index->nentries;
+	while (lo < hi) {
+		const struct pt_image_entry *entry;
+		uint32_t mid;
+
+		mid = lo + ((hi - lo) / 2);
+		entry = &space->index->entries[mid];
+
+		if ((entry->section.vaddr < vaddr) ||
+		    ((entry->section.vaddr == vaddr) && (entry->end < end)))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Find the section containing @addr in @space.
+ *
+ * Returns a pointer to the section entry on success, NULL otherwise.
+ */
+static struct pt_image_entry *
+pt_image_space_lookup(const struct pt_image_space *space, uint64_t addr)
+{
+	struct pt_image_entry *entry;
+	uint32_t lo, hi;
+
+	/* Find the number of sections starting at or below @addr. */
+	lo = 0;
+	hi = space->index->nentries;
+	while (lo < hi) {
+		uint32_t mid;
+
+		mid = lo + ((hi - lo) / 2);
+		if (space->index->entries[mid].section.vaddr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* Since sections don't overlap, only the last of those sections may
+	 * contain @addr.  Empty sections sort before non-empty sections at
+	 * the same address.
+	 */
+	if (!lo)
+		return NULL;
+
+	entry = &space->index->entries[lo - 1];
+	if (entry->end <= addr)
+		return NULL;
+
+	return entry;
+}
+
+/* Check whether [@begin; @end[ overlaps with a section in @space.
+ *
+ * On success, provides the insertion position in @pos if @pos is not NULL.
+ *
+ * Returns a positive number if there is an overlap, zero otherwise.
+ */
+static int pt_image_space_overlaps(const struct pt_image_space *space,
+				   uint64_t begin, uint64_t end,
+				   uint32_t *pos)
+{
+	uint32_t idx, lower;
+
+	lower = pt_image_space_lower(space, begin, end);
+	if (pos)
+		*pos = lower;
+
+	/* Sections don't overlap so their end addresses are sorted, as well.
+	 *
+	 * We only need to look at preceding sections that end after @begin.
+	 */
+	for (idx = lower; idx; --idx) {
+		const struct pt_image_entry *entry;
+
+		entry = &space->index->entries[idx - 1];
+		if (entry->end <= begin)
+			break;
+
+		if (end <= entry->section.vaddr)
+			continue;
+
+		return 1;
+	}
+
+	/* And at succeeding sections that start before @end. */
+	for (idx = lower; idx < space->index->nentries; ++idx) {
+		const struct pt_image_entry *entry;
 
-	list = malloc(sizeof(*list));
-	if (!list)
+		entry = &space->index->entries[idx];
+		if (end <= entry->section.vaddr)
+			break;
+
+		if (entry->end <= begin)
+			continue;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static void pt_image_entry_fini(struct pt_image *image,
+				struct pt_image_entry *entry)
+{
+	if (!image || !entry)
+		return;
+
+	(void) pt_section_put(entry->section.section);
+	pt_msec_fini(&entry->section);
+}
+
+/* Allocate an empty index with a user count of one.
+ *
+ * Returns a pointer to the new index on success, NULL otherwise.
+ */
+static struct pt_image_index *pt_image_index_alloc(void)
+{
+	struct pt_image_index *index;
+
+	index = malloc(sizeof(*index));
+	if (!index)
 		return NULL;
 
-	memset(list, 0, sizeof(*list));
+	memset(index, 0, sizeof(*index));
+	index->ucount = 1;
+
+	return index;
+}
+
+/* Add another user to @index.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_image_index_get(struct pt_image_index *index)
+{
+	uint32_t ucount;
+	int errcode;
+
+	errcode = pt_image_lock_indices();
+	if (errcode < 0)
+		return errcode;
+
+	ucount = index->ucount + 1;
+	if (ucount)
+		index->ucount = ucount;
+
+	errcode = pt_image_unlock_indices();
+	if (errcode < 0)
+		return errcode;
+
+	return ucount ? 0 : -pte_internal;
+}
+
+/* Remove a user from @index.
+ *
+ * The last user frees @index and puts its sections.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_image_index_put(struct pt_image *image,
+			      struct pt_image_index *index)
+{
+	uint32_t ucount, idx;
+	int errcode;
+
+	errcode = pt_image_lock_indices();
+	if (errcode < 0)
+		return errcode;
+
+	ucount = index->ucount;
+	if (ucount)
+		index->ucount = ucount - 1;
+
+	errcode = pt_image_unlock_indices();
+	if (errcode < 0)
+		return errcode;
+
+	if (!ucount)
+		return -pte_internal;
+
+	if (ucount > 1)
+		return 0;
+
+	for (idx = 0; idx < index->nentries; ++idx)
+		pt_image_entry_fini(image, &index->entries[idx]);
+
+	free(index->entries);
+	free(index);
+
+	return 0;
+}
+
+/* Make sure @space does not share its index.
+ *
+ * A shared index must not be modified.  Replaces @space's index with a copy
+ * if it is shared.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_image_space_own(struct pt_image *image,
+			      struct pt_image_space *space)
+{
+	struct pt_image_index *index, *copy;
+	uint32_t ucount, idx;
+	int errcode;
+
+	index = space->index;
+
+	errcode = pt_image_lock_indices();
+	if (errcode < 0)
+		return errcode;
+
+	ucount = index->ucount;
+
+	errcode = pt_image_unlock_indices();
+	if (errcode < 0)
+		return errcode;
+
+	/* Nobody else can start sharing @index while we're using it. */
+	if (ucount <= 1)
+		return 0;
+
+	copy = pt_image_index_alloc();
+	if (!copy)
+		return -pte_nomem;
+
+	if (index->nentries) {
+		copy->entries = malloc(index->nentries *
+				       sizeof(*copy->entries));
+		if (!copy->entries) {
+			free(copy);
+			return -pte_nomem;
+		}
+
+		copy->capacity = index->nentries;
+	}
+
+	for (idx = 0; idx < index->nentries; ++idx) {
+		struct pt_image_entry *entry;
+
+		entry = &index->entries[idx];
+
+		errcode = pt_section_get(entry->section.section);
+		if (errcode < 0) {
+			(void) pt_image_index_put(image, copy);
+			return errcode;
+		}
+
+		copy->entries[idx] = *entry;
+		copy->nentries = idx + 1;
+	}
+
+	space->index = copy;
+
+	return pt_image_index_put(image, index);
+}
+
+static int pt_image_space_insert(struct pt_image *image,
+				 struct pt_image_space *space, uint32_t pos,
+				 struct pt_section *section,
+				 const struct pt_asid *asid, uint64_t vaddr)
+{
+	struct pt_image_index *index;
+	struct pt_image_entry *entry;
+	uint32_t nentries;
+	int errcode;
+
+	errcode = pt_image_space_own(image, space);
+	if (errcode < 0)
+		return errcode;
+
+	index = space->index;
+
+	nentries = index->nentries;
+	if (index->capacity <= nentries) {
+		struct pt_image_entry *entries;
+		uint32_t capacity;
+
+		capacity = index->capacity ? index->capacity * 2 : 8;
+		if (capacity <= nentries)
+			return -pte_nomem;
+
+		entries = realloc(index->entries, capacity * sizeof(*entries));
+		if (!entries)
+			return -pte_nomem;
+
+		index->entries = entries;
+		index->capacity = capacity;
+	}
 
 	errcode = pt_section_get(section);
 	if (errcode < 0)
-		goto out_mem;
+		return errcode;
+
+	entry = &index->entries[pos];
+	memmove(entry + 1, entry, (nentries - pos) * sizeof(*entry));
+	memset(entry, 0, sizeof(*entry));
+
+	pt_msec_init(&entry->section, section, asid, vaddr);
+	entry->end = vaddr + pt_section_size(section);
+
+	index->nentries = nentries + 1;
+
+	image->mgeneration += 1;
+
+	return 0;
+}
+
+/* Remove the section at @pos from @space.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_image_space_erase(struct pt_image *image,
+				struct pt_image_space *space, uint32_t pos)
+{
+	struct pt_image_entry *entry;
+	uint32_t nentries;
+	int errcode;
+
+	nentries = space->index->nentries;
+	if (nentries <= pos)
+		return -pte_internal;
+
+	errcode = pt_image_space_own(image, space);
+	if (errcode < 0)
+		return errcode;
+
+	entry = &space->index->entries[pos];
+	pt_image_entry_fini(image, entry);
+
+	nentries -= 1;
+	memmove(entry, entry + 1, (nentries - pos) * sizeof(*entry));
+
+	space->index->nentries = nentries;
+
+	image->mgeneration += 1;
+
+	return 0;
+}
+
+static void pt_image_space_free(struct pt_image *image,
+				struct pt_image_space *space)
+{
+	if (!space)
+		return;
+
+	(void) pt_image_index_put(image, space->index);
+	free(space);
+}
+
+static uint32_t pt_image_bucket(const struct pt_image *image, uint64_t cr3)
+{
+	uint64_t hash;
+
+	/* Cr3 values are page-aligned.  Mix the page number into the upper
+	 * half and use that.
+	 */
+	hash = cr3 * 0x9e3779b97f4a7c15ull;
+
+	return ((uint32_t) (hash >> 32)) & (image->nbuckets - 1);
+}
+
+/* Grow the address space hash table of @image.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_image_grow(struct pt_image *image)
+{
+	struct pt_image_space **spaces, **old;
+	uint32_t nbuckets, obuckets, bucket;
+
+	obuckets = image->nbuckets;
+	nbuckets = obuckets ? obuckets * 2 : 16;
+	if (nbuckets <= obuckets)
+		return -pte_nomem;
+
+	spaces = calloc(nbuckets, sizeof(*spaces));
+	if (!spaces)
+		return -pte_nomem;
+
+	old = image->spaces;
+
+	image->spaces = spaces;
+	image->nbuckets = nbuckets;
 
-	pt_msec_init(&list->section, section, asid, vaddr);
+	for (bucket = 0; bucket < obuckets; ++bucket) {
+		struct pt_image_space *space;
+
+		for (space = old[bucket]; space;) {
+			struct pt_image_space *next;
+			uint32_t idx;
+
+			next = space->next;
+
+			idx = pt_image_bucket(image, space->asid.cr3);
+			space->next = spaces[idx];
+			spaces[idx] = space;
+
+			space = next;
+		}
+	}
 
-	return list;
+	free(old);
+
+	return 0;
+}
+
+/* Find the address space for @asid.
+ *
+ * Returns a pointer to the address space on success, NULL otherwise.
+ */
+static struct pt_image_space *pt_image_find_space(const struct pt_image *image,
+						  const struct pt_asid *asid)
+{
+	struct pt_image_space *space;
+
+	if (!image->nbuckets)
+		return NULL;
+
+	space = image->spaces[pt_image_bucket(image, asid->cr3)];
+	for (; space; space = space->next) {
+		if (pt_image_same_asid(&space->asid, asid))
+			return space;
+	}
 
-out_mem:
-	free(list);
 	return NULL;
 }
 
-static void pt_section_list_free(struct pt_section_list *list)
+/* Create a new address space for @asid using @index.
+ *
+ * The new address space takes over the caller's reference to @index on
+ * success.
+ *
+ * Returns a pointer to the address space on success, NULL otherwise.
+ */
+static struct pt_image_space *pt_image_new_space(struct pt_image *image,
+						 const struct pt_asid *asid,
+						 struct pt_image_index *index)
 {
-	if (!list)
+	struct pt_image_space *space;
+	uint32_t idx;
+
+	if (image->nbuckets <= image->nspaces) {
+		int errcode;
+
+		errcode = pt_image_grow(image);
+		if (errcode < 0)
+			return NULL;
+	}
+
+	space = malloc(sizeof(*space));
+	if (!space)
+		return NULL;
+
+	memset(space, 0, sizeof(*space));
+
+	pt_asid_init(&space->asid);
+	space->asid.cr3 = asid->cr3;
+	space->asid.vmcs = asid->vmcs;
+	space->index = index;
+
+	idx = pt_image_bucket(image, asid->cr3);
+	space->next = image->spaces[idx];
+	image->spaces[idx] = space;
+
+	image->nspaces += 1;
+	image->generation += 1;
+	image->mgeneration += 1;
+
+	return space;
+}
+
+/* Find or create the address space for @asid.
+ *
+ * Returns a pointer to the address space on success, NULL otherwise.
+ */
+static struct pt_image_space *pt_image_get_space(struct pt_image *image,
+						 const struct pt_asid *asid)
+{
+	struct pt_image_index *index;
+	struct pt_image_space *space;
+
+	space = pt_image_find_space(image, asid);
+	if (space)
+		return space;
+
+	index = pt_image_index_alloc();
+	if (!index)
+		return NULL;
+
+	space = pt_image_new_space(image, asid, index);
+	if (!space)
+		free(index);
+
+	return space;
+}
+
+/* Remove @space from @image if it is empty. */
+static void pt_image_prune_space(struct pt_image *image,
+				 struct pt_image_space *space)
+{
+	struct pt_image_space **pspace;
+
+	if (!image || !space || space->index->nentries)
 		return;
 
-	if (list->mapped)
-		pt_section_unmap(list->section.section);
-	pt_section_put(list->section.section);
-	pt_msec_fini(&list->section);
-	free(list);
+	pspace = &image->spaces[pt_image_bucket(image, space->asid.cr3)];
+	for (; *pspace; pspace = &(*pspace)->next) {
+		if (*pspace != space)
+			continue;
+
+		*pspace = space->next;
+
+		pt_image_space_free(image, space);
+
+		image->nspaces -= 1;
+		image->generation += 1;
+		image->mgeneration += 1;
+		return;
+	}
+}
+
+/* Add the address spaces in bucket @cr3 that match @asid to @view.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_nomem if @view is full.
+ */
+static int pt_image_view_probe(struct pt_image_view *view, uint64_t cr3,
+			       const struct pt_asid *asid)
+{
+	const struct pt_image *image;
+	struct pt_image_space *space;
+	uint8_t nspaces;
+
+	image = view->image;
+	nspaces = view->nspaces;
+
+	space = image->spaces[pt_image_bucket(image, cr3)];
+	for (; space; space = space->next) {
+		if (space->asid.cr3 != cr3)
+			continue;
+
+		if (pt_asid_match(&space->asid, asid) <= 0)
+			continue;
+
+		if (pt_image_view_size <= nspaces)
+			return -pte_nomem;
+
+		view->space[nspaces++] = space;
+	}
+
+	view->nspaces = nspaces;
+
+	return 0;
+}
+
+/* Resolve the address spaces in @image that match @asid into @view. */
+static void pt_image_view_resolve(struct pt_image_view *view,
+				  const struct pt_image *image,
+				  const struct pt_asid *asid)
+{
+	int errcode;
+
+	view->image = image;
+	view->generation = image->generation;
+	view->asid = *asid;
+	view->nspaces = 0;
+	view->all = 0;
+
+	if (!image->nbuckets)
+		return;
+
+	/* Without a cr3, @asid matches address spaces in every bucket. */
+	if (asid->cr3 == pt_asid_no_cr3) {
+		view->all = 1;
+		return;
+	}
+
+	errcode = pt_image_view_probe(view, asid->cr3, asid);
+	if (errcode >= 0)
+		errcode = pt_image_view_probe(view, pt_asid_no_cr3, asid);
+
+	if (errcode < 0)
+		view->all = 1;
+}
+
+void pt_image_view_init(struct pt_image_view *view)
+{
+	if (!view)
+		return;
+
+	memset(view, 0, sizeof(*view));
+}
+
+/* Release the section held by @view.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_image_view_release(struct pt_image_view *view)
+{
+	struct pt_section *section;
+	int errcode;
+
+	if (!view)
+		return -pte_internal;
+
+	section = view->section;
+	if (!section)
+		return 0;
+
+	view->section = NULL;
+
+	errcode = pt_section_unmap(section);
+	if (errcode < 0) {
+		(void) pt_section_put(section);
+		return errcode;
+	}
+
+	return pt_section_put(section);
+}
+
+/* Make @view hold @section.
+ *
+ * Maps @section using the section cache and releases the previously held
+ * section.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_image_view_hold(struct pt_image_view *view,
+			      struct pt_section *section)
+{
+	int errcode;
+
+	if (!view)
+		return -pte_internal;
+
+	errcode = pt_section_get(section);
+	if (errcode < 0)
+		return errcode;
+
+	errcode = pt_section_cache_map(section);
+	if (errcode < 0) {
+		(void) pt_section_put(section);
+		return errcode;
+	}
+
+	errcode = pt_image_view_release(view);
+	view->section = section;
+
+	return errcode;
+}
+
+void pt_image_view_fini(struct pt_image_view *view)
+{
+	(void) pt_image_view_release(view);
 }
 
 void pt_image_init(struct pt_image *image, const char *name)
@@ -96,25 +805,33 @@ void pt_image_init(struct pt_image *image, const char *name)
 	memset(image, 0, sizeof(*image));
 
 	image->name = dupstr(name);
-	image->cache = 10;
+
+	pt_callback_cache_init(&image->readmem.cache);
 }
 
 void pt_image_fini(struct pt_image *image)
 {
-	struct pt_section_list *list;
+	uint32_t bucket;
 
 	if (!image)
 		return;
 
-	for (list = image->sections; list; ) {
-		struct pt_section_list *trash;
+	for (bucket = 0; bucket < image->nbuckets; ++bucket) {
+		struct pt_image_space *space;
+
+		for (space = image->spaces[bucket]; space;) {
+			struct pt_image_space *trash;
 
-		trash = list;
-		list = list->next;
+			trash = space;
+			space = space->next;
 
-		pt_section_list_free(trash);
+			pt_image_space_free(image, trash);
+		}
 	}
 
+	pt_callback_cache_fini(&image->readmem.cache);
+
+	free(image->spaces);
 	free(image->name);
 
 	memset(image, 0, sizeof(*image));
@@ -142,83 +859,270 @@ const char *pt_image_name(const struct pt_image *image)
 	if (!image)
 		return NULL;
 
-	return image->name;
-}
+	return image->name;
+}
+
+/* Check whether [@begin; @end[ in @asid overlaps with a section in @image.
+ *
+ * Returns a positive number if there is an overlap, zero otherwise.
+ */
+static int pt_image_overlaps(const struct pt_image *image,
+			     const struct pt_asid *asid, uint64_t begin,
+			     uint64_t end)
+{
+	struct pt_image_view view;
+	uint32_t bucket;
+	uint8_t idx;
+
+	pt_image_view_resolve(&view, image, asid);
+
+	for (idx = 0; idx < view.nspaces; ++idx) {
+		if (pt_image_space_overlaps(view.space[idx], begin, end, NULL))
+			return 1;
+	}
+
+	if (!view.all)
+		return 0;
+
+	for (bucket = 0; bucket < image->nbuckets; ++bucket) {
+		const struct pt_image_space *space;
+
+		space = image->spaces[bucket];
+		for (; space; space = space->next) {
+			if (pt_asid_match(&space->asid, asid) <= 0)
+				continue;
+
+			if (pt_image_space_overlaps(space, begin, end, NULL))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+int pt_image_add(struct pt_image *image, struct pt_section *section,
+		 const struct pt_asid *asid, uint64_t vaddr)
+{
+	struct pt_image_space *space;
+	uint64_t begin, end;
+	uint32_t pos;
+	int errcode;
+
+	if (!image || !section || !asid)
+		return -pte_internal;
+
+	begin = vaddr;
+	end = begin + pt_section_size(section);
+
+	if (pt_image_overlaps(image, asid, begin, end))
+		return -pte_bad_image;
+
+	space = pt_image_get_space(image, asid);
+	if (!space)
+		return -pte_nomem;
+
+	(void) pt_image_space_overlaps(space, begin, end, &pos);
+
+	errcode = pt_image_space_insert(image, space, pos, section, asid,
+					vaddr);
+	if (errcode < 0) {
+		pt_image_prune_space(image, space);
+		return errcode;
+	}
+
+	return 0;
+}
+
+/* Remove sections from @space.
+ *
+ * Removes all sections if @filename is NULL and all sections loaded from
+ * @filename otherwise.
+ *
+ * Returns the number of removed sections on success, a negative error code
+ * otherwise.
+ */
+static int pt_image_space_remove(struct pt_image *image,
+				 struct pt_image_space *space,
+				 const char *filename)
+{
+	uint32_t idx;
+	int removed, errcode;
+
+	/* There's no need to copy a shared index if we remove everything. */
+	if (!filename) {
+		struct pt_image_index *index;
+
+		index = pt_image_index_alloc();
+		if (!index)
+			return -pte_nomem;
+
+		removed = (int) space->index->nentries;
+
+		errcode = pt_image_index_put(image, space->index);
+		space->index = index;
+
+		/* The removed sections may still be remembered. */
+		if (removed)
+			image->mgeneration += 1;
+
+		if (errcode < 0)
+			return errcode;
+
+		return removed;
+	}
+
+	removed = 0;
+	for (idx = 0; idx < space->index->nentries;) {
+		const char *tname;
+
+		tname = pt_section_filename(space->index->entries[idx]
+					    .section.section);
+
+		if (!tname || (strcmp(tname, filename) != 0)) {
+			idx += 1;
+			continue;
+		}
+
+		errcode = pt_image_space_erase(image, space, idx);
+		if (errcode < 0)
+			return errcode;
+
+		removed += 1;
+	}
+
+	return removed;
+}
+
+/* Remove sections from all address spaces matching @asid.
+ *
+ * Removes all sections if @filename is NULL and all sections loaded from
+ * @filename otherwise.
+ *
+ * Returns the number of removed sections on success, a negative error code
+ * otherwise.
+ */
+static int pt_image_remove_matching(struct pt_image *image,
+				    const struct pt_asid *asid,
+				    const char *filename)
+{
+	struct pt_image_view view;
+	uint32_t bucket;
+	uint8_t idx;
+	int removed, status;
+
+	pt_image_view_resolve(&view, image, asid);
+
+	removed = 0;
+	if (!view.all) {
+		for (idx = 0; idx < view.nspaces; ++idx) {
+			struct pt_image_space *space;
+
+			space = view.space[idx];
+
+			status = pt_image_space_remove(image, space, filename);
+			if (status < 0)
+				return status;
+
+			removed += status;
+			pt_image_prune_space(image, space);
+		}
+
+		return removed;
+	}
+
+	for (bucket = 0; bucket < image->nbuckets; ++bucket) {
+		struct pt_image_space *space;
 
-int pt_image_add(struct pt_image *image, struct pt_section *section,
-		 const struct pt_asid *asid, uint64_t vaddr)
-{
-	struct pt_section_list **list, *next;
-	uint64_t begin, end;
-	int errcode;
+		for (space = image->spaces[bucket]; space;) {
+			struct pt_image_space *next;
 
-	if (!image || !section)
-		return -pte_internal;
+			next = space->next;
 
-	begin = vaddr;
-	end = begin + pt_section_size(section);
+			if (pt_asid_match(&space->asid, asid) > 0) {
+				status = pt_image_space_remove(image, space,
+							       filename);
+				if (status < 0)
+					return status;
 
-	/* Check for overlaps while we move to the end of the list. */
-	for (list = &(image->sections); *list; list = &((*list)->next)) {
-		const struct pt_mapped_section *msec;
-		uint64_t lbegin, lend;
+				removed += status;
+				pt_image_prune_space(image, space);
+			}
 
-		msec = &(*list)->section;
+			space = next;
+		}
+	}
 
-		errcode = pt_msec_matches_asid(msec, asid);
-		if (errcode < 0)
-			return errcode;
+	return removed;
+}
 
-		if (!errcode)
-			continue;
+/* Remove @section at @vaddr from @space.
+ *
+ * Returns a positive number if @section had been removed, zero if @space
+ * does not contain @section at @vaddr, a negative error code otherwise.
+ */
+static int pt_image_space_remove_section(struct pt_image *image,
+					 struct pt_image_space *space,
+					 const struct pt_section *section,
+					 uint64_t vaddr)
+{
+	struct pt_image_entry *entry;
+	uint32_t pos;
+	int errcode;
 
-		lbegin = pt_msec_begin(msec);
-		lend = pt_msec_end(msec);
+	entry = pt_image_space_lookup(space, vaddr);
+	if (!entry || entry->section.vaddr != vaddr)
+		return 0;
 
-		if (end <= lbegin)
-			continue;
-		if (lend <= begin)
-			continue;
+	if (entry->section.section != section)
+		return 0;
 
-		return -pte_bad_image;
-	}
+	pos = (uint32_t) (entry - space->index->entries);
 
-	next = pt_mk_section_list(section, asid, vaddr);
-	if (!next)
-		return -pte_nomap;
+	errcode = pt_image_space_erase(image, space, pos);
+	if (errcode < 0)
+		return errcode;
 
-	*list = next;
-	return 0;
+	pt_image_prune_space(image, space);
+
+	return 1;
 }
 
 int pt_image_remove(struct pt_image *image, struct pt_section *section,
 		    const struct pt_asid *asid, uint64_t vaddr)
 {
-	struct pt_section_list **list;
+	struct pt_image_view view;
+	uint32_t bucket;
+	uint8_t idx;
+	int status;
 
-	if (!image || !section)
+	if (!image || !section || !asid)
 		return -pte_internal;
 
-	for (list = &image->sections; *list; list = &((*list)->next)) {
-		struct pt_mapped_section *msec;
-		struct pt_section_list *trash;
-		int errcode;
-
-		trash = *list;
-		msec = &trash->section;
-
-		errcode = pt_msec_matches_asid(msec, asid);
-		if (errcode < 0)
-			return errcode;
-
-		if (!errcode)
-			continue;
+	pt_image_view_resolve(&view, image, asid);
 
-		if (msec->section == section && msec->vaddr == vaddr) {
-			*list = trash->next;
-			pt_section_list_free(trash);
+	for (idx = 0; idx < view.nspaces; ++idx) {
+		status = pt_image_space_remove_section(image, view.space[idx],
+						       section, vaddr);
+		if (status)
+			return (status < 0) ? status : 0;
+	}
 
-			return 0;
+	if (view.all) {
+		for (bucket = 0; bucket < image->nbuckets; ++bucket) {
+			struct pt_image_space *space;
+
+			space = image->spaces[bucket];
+			for (; space; space = space->next) {
+				if (pt_asid_match(&space->asid, asid) <= 0)
+					continue;
+
+				status = pt_image_space_remove_section(image,
+								       space,
+								       section,
+								       vaddr);
+				if (status)
+					return (status < 0) ? status : 0;
+			}
 		}
 	}
 
@@ -240,7 +1144,8 @@ int pt_image_add_file(struct pt_image *image, const char *filename,
 	if (errcode < 0)
 		return errcode;
 
-	section = pt_mk_section(filename, offset, size);
+	/* Sections are shared between images so we map each file only once. */
+	section = pt_section_registry_get(filename, offset, size);
 	if (!section)
 		return -pte_invalid;
 
@@ -258,23 +1163,154 @@ int pt_image_add_file(struct pt_image *image, const char *filename,
 	return 0;
 }
 
+int pt_image_add_buffer(struct pt_image *image, const uint8_t *buffer,
+			uint64_t size, int copy, const struct pt_asid *uasid,
+			uint64_t vaddr)
+{
+	struct pt_section *section;
+	struct pt_asid asid;
+	int errcode;
+
+	if (!image || !buffer || !size)
+		return -pte_invalid;
+
+	if ((uint64_t) (size_t) size != size)
+		return -pte_invalid;
+
+	errcode = pt_asid_from_user(&asid, uasid);
+	if (errcode < 0)
+		return errcode;
+
+	section = pt_mk_section_buffer(buffer, size, copy);
+	if (!section)
+		return -pte_nomem;
+
+	errcode = pt_image_add(image, section, &asid, vaddr);
+	if (errcode < 0) {
+		(void) pt_section_put(section);
+		return errcode;
+	}
+
+	/* The image list got its own reference; let's drop ours. */
+	errcode = pt_section_put(section);
+	if (errcode < 0)
+		return errcode;
+
+	return 0;
+}
+
+/* Check whether @image has an address space matching @asid.
+ *
+ * Returns a positive number if it does, zero otherwise.
+ */
+static int pt_image_has_matching_space(const struct pt_image *image,
+				       const struct pt_asid *asid)
+{
+	struct pt_image_view view;
+	uint32_t bucket;
+
+	pt_image_view_resolve(&view, image, asid);
+
+	if (view.nspaces)
+		return 1;
+
+	if (!view.all)
+		return 0;
+
+	for (bucket = 0; bucket < image->nbuckets; ++bucket) {
+		const struct pt_image_space *space;
+
+		space = image->spaces[bucket];
+		for (; space; space = space->next) {
+			if (pt_asid_match(&space->asid, asid) > 0)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Add @src's sections to @image by sharing @src's index.
+ *
+ * This is only possible if none of @image's address spaces match @src's asid,
+ * since @src's sections can't overlap with any sections in @image then.
+ *
+ * Returns a positive number if @src is shared, zero if it can't be shared, a
+ * negative error code otherwise.
+ */
+static int pt_image_share_space(struct pt_image *image,
+				const struct pt_image_space *src)
+{
+	struct pt_image_space *space;
+	int errcode;
+
+	if (pt_image_has_matching_space(image, &src->asid))
+		return 0;
+
+	errcode = pt_image_index_get(src->index);
+	if (errcode < 0)
+		return errcode;
+
+	space = pt_image_new_space(image, &src->asid, src->index);
+	if (!space) {
+		(void) pt_image_index_put(image, src->index);
+		return -pte_nomem;
+	}
+
+	return 1;
+}
+
 int pt_image_copy(struct pt_image *image, const struct pt_image *src)
 {
-	struct pt_section_list *list;
+	uint32_t bucket;
 	int ignored;
 
 	if (!image || !src)
 		return -pte_invalid;
 
 	ignored = 0;
-	for (list = src->sections; list; list = list->next) {
-		int errcode;
 
-		errcode = pt_image_add(image, list->section.section,
-				       &list->section.asid,
-				       list->section.vaddr);
-		if (errcode < 0)
-			ignored += 1;
+	/* Every section overlaps with itself. */
+	if (image == src) {
+		for (bucket = 0; bucket < src->nbuckets; ++bucket) {
+			const struct pt_image_space *space;
+
+			space = src->spaces[bucket];
+			for (; space; space = space->next)
+				ignored += (int) space->index->nentries;
+		}
+
+		return ignored;
+	}
+
+	for (bucket = 0; bucket < src->nbuckets; ++bucket) {
+		const struct pt_image_space *space;
+
+		space = src->spaces[bucket];
+		for (; space; space = space->next) {
+			uint32_t idx;
+			int status;
+
+			status = pt_image_share_space(image, space);
+			if (status < 0)
+				return status;
+
+			if (status > 0)
+				continue;
+
+			for (idx = 0; idx < space->index->nentries; ++idx) {
+				const struct pt_mapped_section *msec;
+				int errcode;
+
+				msec = &space->index->entries[idx].section;
+
+				errcode = pt_image_add(image, msec->section,
+						       &msec->asid,
+						       msec->vaddr);
+				if (errcode < 0)
+					ignored += 1;
+			}
+		}
 	}
 
 	return ignored;
@@ -283,9 +1319,8 @@ int pt_image_copy(struct pt_image *image, const struct pt_image *src)
 int pt_image_remove_by_filename(struct pt_image *image, const char *filename,
 				const struct pt_asid *uasid)
 {
-	struct pt_section_list **list;
 	struct pt_asid asid;
-	int errcode, removed;
+	int errcode;
 
 	if (!image || !filename)
 		return -pte_invalid;
@@ -294,44 +1329,14 @@ int pt_image_remove_by_filename(struct pt_image *image, const char *filename,
 	if (errcode < 0)
 		return errcode;
 
-	removed = 0;
-	for (list = &image->sections; *list;) {
-		struct pt_mapped_section *msec;
-		struct pt_section_list *trash;
-		const char *tname;
-
-		trash = *list;
-		msec = &trash->section;
-
-		errcode = pt_msec_matches_asid(msec, &asid);
-		if (errcode < 0)
-			return errcode;
-
-		if (!errcode) {
-			list = &trash->next;
-			continue;
-		}
-
-		tname = pt_section_filename(msec->section);
-
-		if (tname && (strcmp(tname, filename) == 0)) {
-			*list = trash->next;
-			pt_section_list_free(trash);
-
-			removed += 1;
-		} else
-			list = &trash->next;
-	}
-
-	return removed;
+	return pt_image_remove_matching(image, &asid, filename);
 }
 
 int pt_image_remove_by_asid(struct pt_image *image,
 			    const struct pt_asid *uasid)
 {
-	struct pt_section_list **list;
 	struct pt_asid asid;
-	int errcode, removed;
+	int errcode;
 
 	if (!image)
 		return -pte_invalid;
@@ -340,30 +1345,7 @@ int pt_image_remove_by_asid(struct pt_image *image,
 	if (errcode < 0)
 		return errcode;
 
-	removed = 0;
-	for (list = &image->sections; *list;) {
-		struct pt_mapped_section *msec;
-		struct pt_section_list *trash;
-
-		trash = *list;
-		msec = &trash->section;
-
-		errcode = pt_msec_matches_asid(msec, &asid);
-		if (errcode < 0)
-			return errcode;
-
-		if (!errcode) {
-			list = &trash->next;
-			continue;
-		}
-
-		*list = trash->next;
-		pt_section_list_free(trash);
-
-		removed += 1;
-	}
-
-	return removed;
+	return pt_image_remove_matching(image, &asid, NULL);
 }
 
 int pt_image_set_callback(struct pt_image *image,
@@ -375,46 +1357,52 @@ int pt_image_set_callback(struct pt_image *image,
 	image->readmem.callback = callback;
 	image->readmem.context = context;
 
+	/* The new callback may provide different memory. */
+	pt_callback_cache_clear(&image->readmem.cache);
+	image->mgeneration += 1;
+
 	return 0;
 }
 
-static int pt_image_prune_cache(struct pt_image *image)
+int pt_image_set_callback_cache(struct pt_image *image, uint32_t granule,
+				uint32_t npages)
 {
-	struct pt_section_list *list;
-	uint16_t cache, mapped;
-	int status;
-
 	if (!image)
-		return -pte_internal;
+		return -pte_invalid;
 
-	cache = image->cache;
-	status = 0;
-	mapped = 0;
-	for (list = image->sections; list; list = list->next) {
-		int errcode;
+	image->mgeneration += 1;
 
-		/* Let's traverse the entire list.  It isn't very long and
-		 * this allows us to fix up any previous unmap errors.
-		 */
-		if (!list->mapped)
-			continue;
+	return pt_callback_cache_configure(&image->readmem.cache, granule,
+					   npages);
+}
 
-		mapped += 1;
-		if (mapped <= cache)
-			continue;
+int pt_image_invalidate_callback_cache(struct pt_image *image,
+				       const struct pt_asid *uasid,
+				       uint64_t vaddr, uint64_t size)
+{
+	struct pt_asid asid;
+	int errcode;
 
-		errcode = pt_section_unmap(list->section.section);
-		if (errcode < 0) {
-			status = errcode;
-			continue;
-		}
+	if (!image)
+		return -pte_invalid;
 
-		list->mapped = 0;
-		mapped -= 1;
-	}
+	errcode = pt_asid_from_user(&asid, uasid);
+	if (errcode < 0)
+		return errcode;
 
-	image->mapped = mapped;
-	return status;
+	image->mgeneration += 1;
+
+	return pt_callback_cache_invalidate(&image->readmem.cache, &asid,
+					    vaddr, size);
+}
+
+int pt_image_get_callback_cache_stats(const struct pt_image *image,
+				      struct pt_callback_cache_stats *stats)
+{
+	if (!image || !stats)
+		return -pte_invalid;
+
+	return pt_callback_cache_get_stats(&image->readmem.cache, stats);
 }
 
 static int pt_image_read_callback(struct pt_image *image, uint8_t *buffer,
@@ -430,123 +1418,235 @@ static int pt_image_read_callback(struct pt_image *image, uint8_t *buffer,
 	if (!callback)
 		return -pte_nomap;
 
-	return callback(buffer, size, asid, addr, image->readmem.context);
+	return pt_callback_cache_read(&image->readmem.cache, callback,
+				      image->readmem.context, buffer, size,
+				      asid, addr);
 }
 
-static int pt_image_read_cold(struct pt_image *image,
-			      struct pt_section_list **list,
-			      uint8_t *buffer, uint16_t size,
-			      const struct pt_asid *asid, uint64_t addr)
+/* Access memory in a mapped entry.
+ *
+ * If @pbegin is not NULL, tries to provide a pointer into @entry's mapping in
+ * @pbegin.  If @entry does not support direct memory access, or if @pbegin is
+ * NULL, copies the memory into @buffer instead.  In the former case, @pbegin
+ * is set to @buffer.
+ *
+ * Returns the number of accessible bytes on success, a negative error code
+ * otherwise.
+ */
+static int pt_image_access_mapped(struct pt_image_entry *entry,
+				  const uint8_t **pbegin, uint8_t *buffer,
+				  uint16_t size, const struct pt_asid *asid,
+				  uint64_t addr)
 {
-	struct pt_section_list **start;
+	int status;
 
-	if (!image || !list)
+	if (!entry)
 		return -pte_internal;
 
-	start = &image->sections;
-	while (*list) {
-		struct pt_mapped_section *msec;
-		struct pt_section_list *elem;
-		struct pt_section *sec;
-		int mapped, errcode, status;
-
-		elem = *list;
-		msec = &elem->section;
-		sec = msec->section;
-
-		mapped = elem->mapped;
-		if (!mapped) {
-			errcode = pt_section_map(sec);
-			if (errcode < 0)
-				return errcode;
-		}
+	if (pbegin) {
+		status = pt_msec_fetch_mapped(&entry->section, pbegin, size,
+					      asid, addr);
+		if (status != -pte_not_supported)
+			return status;
 
-		status = pt_msec_read_mapped(msec, buffer, size, asid, addr);
-		if (status < 0) {
-			if (!mapped) {
-				errcode = pt_section_unmap(sec);
-				if (errcode < 0)
-					return errcode;
-			}
+		*pbegin = buffer;
+	}
 
-			list = &elem->next;
-			continue;
-		}
+	return pt_msec_read_mapped(&entry->section, buffer, size, asid, addr);
+}
 
-		/* Move the section to the front if it isn't already. */
-		if (list != start) {
-			*list = elem->next;
-			elem->next = *start;
-			*start = elem;
-		}
+/* Access memory in a section in an image.
+ *
+ * Makes @view hold @entry's section, if it does not already, so the section
+ * remains mapped until the next access.
+ *
+ * If @pbegin is not NULL, provides a pointer to the memory in @pbegin.  This
+ * points into the section's mapping if the section supports direct memory
+ * access and to @buffer otherwise.
+ *
+ * Returns the number of accessible bytes on success, a negative error code
+ * otherwise.
+ */
+static int pt_image_access_entry(struct pt_image_view *view,
+				 struct pt_image_entry *entry,
+				 const uint8_t **pbegin, uint8_t *buffer,
+				 uint16_t size, const struct pt_asid *asid,
+				 uint64_t addr)
+{
+	struct pt_section *sec;
 
-		/* Keep the section mapped if it isn't already - provided we
-		 * do cache recently used sections.
-		 */
-		if (!mapped) {
-			uint16_t cache, already;
-
-			already = image->mapped;
-			cache = image->cache;
-			if (cache) {
-				elem->mapped = 1;
-
-				already += 1;
-				image->mapped = already;
-
-				if (cache < already) {
-					errcode = pt_image_prune_cache(image);
-					if (errcode < 0)
-						return errcode;
-				}
-			} else {
-				errcode = pt_section_unmap(sec);
-				if (errcode < 0)
-					return errcode;
+	if (!view || !entry)
+		return -pte_internal;
+
+	sec = entry->section.section;
+	if (view->section != sec) {
+		int errcode;
+
+		errcode = pt_image_view_hold(view, sec);
+		if (errcode < 0)
+			return errcode;
+	}
+
+	return pt_image_access_mapped(entry, pbegin, buffer, size, asid, addr);
+}
+
+/* Access memory in the section containing @addr in @space.
+ *
+ * Returns the number of accessible bytes on success, a negative error code
+ * otherwise.
+ * Returns -pte_nomap if @space does not contain @addr.
+ */
+static int pt_image_access_space(struct pt_image_view *view,
+				 struct pt_image_space *space,
+				 const uint8_t **pbegin, uint8_t *buffer,
+				 uint16_t size, const struct pt_asid *asid,
+				 uint64_t addr)
+{
+	struct pt_image_entry *entry;
+
+	entry = pt_image_space_lookup(space, addr);
+	if (!entry)
+		return -pte_nomap;
+
+	return pt_image_access_entry(view, entry, pbegin, buffer, size, asid,
+				     addr);
+}
+
+/* Access memory in an image using a view.
+ *
+ * This implements pt_image_read_view() if @pbegin is NULL and
+ * pt_image_fetch_view() otherwise.
+ */
+static int pt_image_access_view(struct pt_image_view *view,
+				struct pt_image *image, const uint8_t **pbegin,
+				uint8_t *buffer, uint16_t size,
+				const struct pt_asid *asid, uint64_t addr)
+{
+	uint32_t bucket;
+	uint8_t idx;
+	int status;
+
+	if (!view || !image || !asid)
+		return -pte_internal;
+
+	if ((view->image != image) ||
+	    (view->generation != image->generation) ||
+	    !pt_image_same_asid(&view->asid, asid))
+		pt_image_view_resolve(view, image, asid);
+
+	view->callback = 0;
+
+	for (idx = 0; idx < view->nspaces; ++idx) {
+		status = pt_image_access_space(view, view->space[idx], pbegin,
+					       buffer, size, asid, addr);
+		if (status != -pte_nomap)
+			return status;
+	}
+
+	if (view->all) {
+		for (bucket = 0; bucket < image->nbuckets; ++bucket) {
+			struct pt_image_space *space;
+
+			space = image->spaces[bucket];
+			for (; space; space = space->next) {
+				if (pt_asid_match(&space->asid, asid) <= 0)
+					continue;
+
+				status = pt_image_access_space(view, space,
+							       pbegin, buffer,
+							       size, asid,
+							       addr);
+				if (status != -pte_nomap)
+					return status;
 			}
 		}
-
-		return status;
 	}
 
+	if (pbegin)
+		*pbegin = buffer;
+
+	view->callback = 1;
+
 	return pt_image_read_callback(image, buffer, size, asid, addr);
 }
 
-int pt_image_read(struct pt_image *image, uint8_t *buffer, uint16_t size,
-		  const struct pt_asid *asid, uint64_t addr)
+int pt_image_read_view(struct pt_image_view *view, struct pt_image *image,
+		       uint8_t *buffer, uint16_t size,
+		       const struct pt_asid *asid, uint64_t addr)
 {
-	struct pt_section_list **list, **start;
+	return pt_image_access_view(view, image, NULL, buffer, size, asid,
+				    addr);
+}
 
-	if (!image || !asid)
+int pt_image_fetch_view(struct pt_image_view *view, struct pt_image *image,
+			const uint8_t **pbegin, uint8_t *buffer,
+			uint16_t size, const struct pt_asid *asid,
+			uint64_t addr)
+{
+	if (!pbegin || !buffer)
 		return -pte_internal;
 
-	start = &image->sections;
-	for (list = start; *list;) {
-		struct pt_mapped_section *msec;
-		struct pt_section_list *elem;
-		int status;
+	return pt_image_access_view(view, image, pbegin, buffer, size, asid,
+				    addr);
+}
+
+int pt_image_find_view(struct pt_image_view *view, struct pt_image *image,
+		       const struct pt_mapped_section **pmsec,
+		       const struct pt_asid *asid, uint64_t addr)
+{
+	const struct pt_image_entry *entry;
+	uint32_t bucket;
+	uint8_t idx;
 
-		elem = *list;
-		msec = &elem->section;
+	if (!view || !image || !pmsec || !asid)
+		return -pte_internal;
 
-		if (!elem->mapped)
-			break;
+	if ((view->image != image) ||
+	    (view->generation != image->generation) ||
+	    !pt_image_same_asid(&view->asid, asid))
+		pt_image_view_resolve(view, image, asid);
 
-		status = pt_msec_read_mapped(msec, buffer, size, asid, addr);
-		if (status < 0) {
-			list = &elem->next;
-			continue;
+	for (idx = 0; idx < view->nspaces; ++idx) {
+		entry = pt_image_space_lookup(view->space[idx], addr);
+		if (entry) {
+			*pmsec = &entry->section;
+			return 0;
 		}
+	}
 
-		/* Move the section to the front if it isn't already. */
-		if (list != start) {
-			*list = elem->next;
-			elem->next = *start;
-			*start = elem;
-		}
+	if (!view->all)
+		return -pte_nomap;
+
+	for (bucket = 0; bucket < image->nbuckets; ++bucket) {
+		const struct pt_image_space *space;
 
-		return status;
+		space = image->spaces[bucket];
+		for (; space; space = space->next) {
+			if (pt_asid_match(&space->asid, asid) <= 0)
+				continue;
+
+			entry = pt_image_space_lookup(space, addr);
+			if (entry) {
+				*pmsec = &entry->section;
+				return 0;
+			}
+		}
 	}
 
-	return pt_image_read_cold(image, list, buffer, size, asid, addr);
+	return -pte_nomap;
+}
+
+int pt_image_read(struct pt_image *image, uint8_t *buffer, uint16_t size,
+		  const struct pt_asid *asid, uint64_t addr)
+{
+	struct pt_image_view view;
+	int status;
+
+	pt_image_view_init(&view);
+
+	status = pt_image_read_view(&view, image, buffer, size, asid, addr);
+
+	pt_image_view_fini(&view);
+
+	return status;
 }
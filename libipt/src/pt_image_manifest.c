@@ -0,0 +1,745 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "pt_image.h"
+#include "pt_section.h"
+#include "pt_section_registry.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* The image manifest format.
+ *
+ * All integers are stored in little-endian byte order.  File names are
+ * stored without a terminating zero.
+ *
+ *   header:  magic[8], version (u32), nfiles (u32), nspaces (u32)
+ *
+ *   file:    size (u64), mtime (u64), length (u32), name[length]
+ *
+ *   space:   cr3 (u64), vmcs (u64), nsections (u32)
+ *   section: file (u32), offset (u64), size (u64), vaddr (u64)
+ *
+ * The header is followed by @nfiles files and @nspaces spaces.  Each space is
+ * followed by its @nsections sections.  Sections refer to files by their
+ * index in the file table.
+ */
+static const char pt_manifest_magic[8] = "ptimage";
+
+enum {
+	pt_manifest_version	= 1,
+
+	/* The minimal size of a file and of a section, respectively. */
+	pt_manifest_file_size		= 20,
+	pt_manifest_section_size	= 28
+};
+
+/* An encoder writing a manifest into a growing buffer. */
+struct pt_manifest_encoder {
+	/* The encoded manifest. */
+	uint8_t *begin;
+
+	/* The number of used and allocated bytes, respectively. */
+	size_t size, capacity;
+
+	/* A sticky error code - zero if no error occurred. */
+	int errcode;
+};
+
+static void pt_mfe_put(struct pt_manifest_encoder *encoder,
+		       const void *data, size_t size)
+{
+	if (encoder->errcode)
+		return;
+
+	if ((encoder->capacity - encoder->size) < size) {
+		uint8_t *begin;
+		size_t capacity;
+
+		capacity = encoder->capacity ? encoder->capacity : 0x1000;
+		while ((capacity - encoder->size) < size) {
+			if ((capacity << 1) < capacity) {
+				encoder->errcode = -pte_nomem;
+				return;
+			}
+
+			capacity <<= 1;
+		}
+
+		begin = realloc(encoder->begin, capacity);
+		if (!begin) {
+			encoder->errcode = -pte_nomem;
+			return;
+		}
+
+		encoder->begin = begin;
+		encoder->capacity = capacity;
+	}
+
+	memcpy(encoder->begin + encoder->size, data, size);
+	encoder->size += size;
+}
+
+static void pt_mfe_put_u32(struct pt_manifest_encoder *encoder,
+			   uint32_t value)
+{
+	uint8_t bytes[4];
+	int idx;
+
+	for (idx = 0; idx < (int) sizeof(bytes); ++idx)
+		bytes[idx] = (uint8_t) (value >> (idx * 8));
+
+	pt_mfe_put(encoder, bytes, sizeof(bytes));
+}
+
+static void pt_mfe_put_u64(struct pt_manifest_encoder *encoder,
+			   uint64_t value)
+{
+	uint8_t bytes[8];
+	int idx;
+
+	for (idx = 0; idx < (int) sizeof(bytes); ++idx)
+		bytes[idx] = (uint8_t) (value >> (idx * 8));
+
+	pt_mfe_put(encoder, bytes, sizeof(bytes));
+}
+
+/* A decoder reading a manifest from memory. */
+struct pt_manifest_decoder {
+	/* The current position and the end of the manifest. */
+	const uint8_t *pos, *end;
+};
+
+static int pt_mfd_get(struct pt_manifest_decoder *decoder,
+		      const uint8_t **pbegin, size_t size)
+{
+	if ((size_t) (decoder->end - decoder->pos) < size)
+		return -pte_bad_file;
+
+	*pbegin = decoder->pos;
+	decoder->pos += size;
+
+	return 0;
+}
+
+static int pt_mfd_get_u32(struct pt_manifest_decoder *decoder,
+			  uint32_t *value)
+{
+	const uint8_t *bytes;
+	int errcode, idx;
+
+	errcode = pt_mfd_get(decoder, &bytes, 4);
+	if (errcode < 0)
+		return errcode;
+
+	*value = 0;
+	for (idx = 3; idx >= 0; --idx)
+		*value = (*value << 8) | bytes[idx];
+
+	return 0;
+}
+
+static int pt_mfd_get_u64(struct pt_manifest_decoder *decoder,
+			  uint64_t *value)
+{
+	const uint8_t *bytes;
+	int errcode, idx;
+
+	errcode = pt_mfd_get(decoder, &bytes, 8);
+	if (errcode < 0)
+		return errcode;
+
+	*value = 0;
+	for (idx = 7; idx >= 0; --idx)
+		*value = (*value << 8) | bytes[idx];
+
+	return 0;
+}
+
+/* Order file sections by file name and file identity. */
+static int pt_manifest_cmp_file(const void *lhs, const void *rhs)
+{
+	const struct pt_section *lsec, *rsec;
+	uint64_t lsize, lmtime, rsize, rmtime;
+	int errcode, cmp;
+
+	lsec = *(const struct pt_section * const *) lhs;
+	rsec = *(const struct pt_section * const *) rhs;
+
+	cmp = strcmp(lsec->filename, rsec->filename);
+	if (cmp)
+		return cmp;
+
+	/* We checked the status when collecting the sections. */
+	errcode = pt_section_status_identity(&lsize, &lmtime, lsec->status);
+	if (errcode >= 0)
+		errcode = pt_section_status_identity(&rsize, &rmtime,
+						     rsec->status);
+	if (errcode < 0)
+		return 0;
+
+	if (lsize != rsize)
+		return (lsize < rsize) ? -1 : 1;
+
+	if (lmtime != rmtime)
+		return (lmtime < rmtime) ? -1 : 1;
+
+	return 0;
+}
+
+/* Check whether @section can be saved in a manifest.
+ *
+ * Returns a positive number if it can, zero otherwise.
+ */
+static int pt_manifest_saves(const struct pt_section *section)
+{
+	uint64_t size, mtime;
+
+	if (!section || !section->filename)
+		return 0;
+
+	return pt_section_status_identity(&size, &mtime,
+					  section->status) >= 0;
+}
+
+/* Collect the files of all file sections in @image.
+ *
+ * Provides a sorted array of sections with one section per file in @pfiles
+ * and its size in @pnfiles.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_manifest_collect(const struct pt_section ***pfiles,
+			       uint32_t *pnfiles,
+			       const struct pt_image *image)
+{
+	const struct pt_section **files;
+	uint32_t bucket, nfiles, idx, nunique;
+
+	nfiles = 0;
+	for (bucket = 0; bucket < image->nbuckets; ++bucket) {
+		const struct pt_image_space *space;
+
+		space = image->spaces[bucket];
+		for (; space; space = space->next)
+			nfiles += space->index->nentries;
+	}
+
+	files = NULL;
+	if (nfiles) {
+		files = malloc(nfiles * sizeof(*files));
+		if (!files)
+			return -pte_nomem;
+	}
+
+	nfiles = 0;
+	for (bucket = 0; bucket < image->nbuckets; ++bucket) {
+		const struct pt_image_space *space;
+
+		space = image->spaces[bucket];
+		for (; space; space = space->next) {
+			for (idx = 0; idx < space->index->nentries; ++idx) {
+				const struct pt_section *section;
+
+				section = space->index->entries[idx]
+					.section.section;
+				if (!pt_manifest_saves(section))
+					continue;
+
+				files[nfiles++] = section;
+			}
+		}
+	}
+
+	if (nfiles)
+		qsort(files, nfiles, sizeof(*files), pt_manifest_cmp_file);
+
+	nunique = 0;
+	for (idx = 0; idx < nfiles; ++idx) {
+		if (nunique &&
+		    !pt_manifest_cmp_file(&files[nunique - 1], &files[idx]))
+			continue;
+
+		files[nunique++] = files[idx];
+	}
+
+	*pfiles = files;
+	*pnfiles = nunique;
+
+	return 0;
+}
+
+/* Encode the sections of @space that can be saved.
+ *
+ * Returns the number of sections that can't be saved.
+ */
+static int pt_manifest_put_space(struct pt_manifest_encoder *encoder,
+				 const struct pt_image_space *space,
+				 const struct pt_section **files,
+				 uint32_t nfiles)
+{
+	uint32_t idx, nsections;
+	int skipped;
+
+	nsections = 0;
+	for (idx = 0; idx < space->index->nentries; ++idx) {
+		if (pt_manifest_saves(space->index->entries[idx]
+				      .section.section))
+			nsections += 1;
+	}
+
+	skipped = (int) (space->index->nentries - nsections);
+	if (!nsections)
+		return skipped;
+
+	pt_mfe_put_u64(encoder, space->asid.cr3);
+	pt_mfe_put_u64(encoder, space->asid.vmcs);
+	pt_mfe_put_u32(encoder, nsections);
+
+	for (idx = 0; idx < space->index->nentries; ++idx) {
+		const struct pt_mapped_section *msec;
+		const struct pt_section **file;
+
+		msec = &space->index->entries[idx].section;
+		if (!pt_manifest_saves(msec->section))
+			continue;
+
+		file = bsearch(&msec->section, files, nfiles, sizeof(*files),
+			       pt_manifest_cmp_file);
+		if (!file) {
+			encoder->errcode = -pte_internal;
+			break;
+		}
+
+		pt_mfe_put_u32(encoder, (uint32_t) (file - files));
+		pt_mfe_put_u64(encoder, msec->section->offset);
+		pt_mfe_put_u64(encoder, msec->section->size);
+		pt_mfe_put_u64(encoder, msec->vaddr);
+	}
+
+	return skipped;
+}
+
+int pt_image_save(const struct pt_image *image, const char *filename)
+{
+	struct pt_manifest_encoder encoder;
+	const struct pt_section **files;
+	uint32_t bucket, nfiles, nspaces, idx;
+	size_t written;
+	FILE *file;
+	int errcode, skipped;
+
+	if (!image || !filename)
+		return -pte_invalid;
+
+	errcode = pt_manifest_collect(&files, &nfiles, image);
+	if (errcode < 0)
+		return errcode;
+
+	memset(&encoder, 0, sizeof(encoder));
+
+	/* Count the address spaces containing file sections. */
+	nspaces = 0;
+	for (bucket = 0; bucket < image->nbuckets; ++bucket) {
+		const struct pt_image_space *space;
+
+		space = image->spaces[bucket];
+		for (; space; space = space->next) {
+			for (idx = 0; idx < space->index->nentries; ++idx) {
+				if (pt_manifest_saves(space->index->entries[idx]
+						      .section.section))
+					break;
+			}
+
+			if (idx < space->index->nentries)
+				nspaces += 1;
+		}
+	}
+
+	pt_mfe_put(&encoder, pt_manifest_magic, sizeof(pt_manifest_magic));
+	pt_mfe_put_u32(&encoder, pt_manifest_version);
+	pt_mfe_put_u32(&encoder, nfiles);
+	pt_mfe_put_u32(&encoder, nspaces);
+
+	for (idx = 0; idx < nfiles; ++idx) {
+		uint64_t size, mtime;
+		size_t length;
+
+		errcode = pt_section_status_identity(&size, &mtime,
+						     files[idx]->status);
+		if (errcode < 0) {
+			encoder.errcode = errcode;
+			break;
+		}
+
+		length = strlen(files[idx]->filename);
+
+		pt_mfe_put_u64(&encoder, size);
+		pt_mfe_put_u64(&encoder, mtime);
+		pt_mfe_put_u32(&encoder, (uint32_t) length);
+		pt_mfe_put(&encoder, files[idx]->filename, length);
+	}
+
+	skipped = 0;
+	for (bucket = 0; bucket < image->nbuckets; ++bucket) {
+		const struct pt_image_space *space;
+
+		space = image->spaces[bucket];
+		for (; space; space = space->next)
+			skipped += pt_manifest_put_space(&encoder, space, files,
+							 nfiles);
+	}
+
+	free(files);
+
+	errcode = encoder.errcode;
+	if (errcode < 0)
+		goto out;
+
+	errcode = -pte_bad_file;
+	file = fopen(filename, "wb");
+	if (!file)
+		goto out;
+
+	written = fwrite(encoder.begin, 1, encoder.size, file);
+	if (fclose(file) || (written != encoder.size))
+		goto out;
+
+	errcode = skipped;
+
+out:
+	free(encoder.begin);
+	return errcode;
+}
+
+/* Read the contents of @filename.
+ *
+ * On success, provides the malloc()'ed contents in @pbuffer and its size in
+ * @psize.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_manifest_read(uint8_t **pbuffer, size_t *psize,
+			    const char *filename)
+{
+	uint8_t *buffer;
+	size_t size, read;
+	FILE *file;
+	long fsize;
+	int errcode;
+
+	file = fopen(filename, "rb");
+	if (!file)
+		return -pte_bad_file;
+
+	errcode = fseek(file, 0, SEEK_END);
+	if (errcode)
+		goto out_file;
+
+	fsize = ftell(file);
+	if (fsize < 0)
+		goto out_file;
+
+	errcode = fseek(file, 0, SEEK_SET);
+	if (errcode)
+		goto out_file;
+
+	size = (size_t) fsize;
+
+	/* Allocate at least one byte so we can tell success from failure. */
+	buffer = malloc(size ? size : 1);
+	if (!buffer) {
+		fclose(file);
+		return -pte_nomem;
+	}
+
+	read = fread(buffer, 1, size, file);
+	fclose(file);
+
+	if (read != size) {
+		free(buffer);
+		return -pte_bad_file;
+	}
+
+	*pbuffer = buffer;
+	*psize = size;
+
+	return 0;
+
+out_file:
+	fclose(file);
+	return -pte_bad_file;
+}
+
+/* A file in a manifest. */
+struct pt_manifest_file {
+	/* The file name. */
+	char *name;
+
+	/* The file's status and size. */
+	void *status;
+	uint64_t size;
+};
+
+/* Decode and check a file in a manifest.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_bad_image if the file changed.
+ */
+static int pt_manifest_get_file(struct pt_manifest_file *file,
+				struct pt_manifest_decoder *decoder)
+{
+	const uint8_t *name;
+	uint64_t size, mtime, fsize, fmtime;
+	uint32_t length;
+	int errcode;
+
+	errcode = pt_mfd_get_u64(decoder, &size);
+	if (errcode < 0)
+		return errcode;
+
+	errcode = pt_mfd_get_u64(decoder, &mtime);
+	if (errcode < 0)
+		return errcode;
+
+	errcode = pt_mfd_get_u32(decoder, &length);
+	if (errcode < 0)
+		return errcode;
+
+	errcode = pt_mfd_get(decoder, &name, length);
+	if (errcode < 0)
+		return errcode;
+
+	if (!length || memchr(name, 0, length))
+		return -pte_bad_file;
+
+	file->name = malloc((size_t) length + 1);
+	if (!file->name)
+		return -pte_nomem;
+
+	memcpy(file->name, name, length);
+	file->name[length] = 0;
+
+	errcode = pt_section_mk_status(&file->status, &file->size,
+				       file->name);
+	if (errcode < 0) {
+		file->status = NULL;
+		return -pte_bad_image;
+	}
+
+	errcode = pt_section_status_identity(&fsize, &fmtime, file->status);
+	if (errcode < 0)
+		return errcode;
+
+	if ((fsize != size) || (fmtime != mtime))
+		return -pte_bad_image;
+
+	return 0;
+}
+
+/* Decode an address space in a manifest and add its sections to @image.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_manifest_get_space(struct pt_image *image,
+				 struct pt_manifest_decoder *decoder,
+				 const struct pt_manifest_file *files,
+				 uint32_t nfiles)
+{
+	struct pt_asid asid;
+	uint32_t nsections;
+	int errcode;
+
+	pt_asid_init(&asid);
+
+	errcode = pt_mfd_get_u64(decoder, &asid.cr3);
+	if (errcode < 0)
+		return errcode;
+
+	errcode = pt_mfd_get_u64(decoder, &asid.vmcs);
+	if (errcode < 0)
+		return errcode;
+
+	errcode = pt_mfd_get_u32(decoder, &nsections);
+	if (errcode < 0)
+		return errcode;
+
+	if (((size_t) (decoder->end - decoder->pos) /
+	     pt_manifest_section_size) < nsections)
+		return -pte_bad_file;
+
+	for (; nsections; --nsections) {
+		const struct pt_manifest_file *file;
+		struct pt_section *section;
+		uint64_t offset, size, vaddr;
+		uint32_t fidx;
+
+		errcode = pt_mfd_get_u32(decoder, &fidx);
+		if (errcode < 0)
+			return errcode;
+
+		errcode = pt_mfd_get_u64(decoder, &offset);
+		if (errcode < 0)
+			return errcode;
+
+		errcode = pt_mfd_get_u64(decoder, &size);
+		if (errcode < 0)
+			return errcode;
+
+		errcode = pt_mfd_get_u64(decoder, &vaddr);
+		if (errcode < 0)
+			return errcode;
+
+		if (nfiles <= fidx)
+			return -pte_bad_file;
+
+		file = &files[fidx];
+
+		section = pt_section_registry_get_status(file->name, offset,
+							 size, file->status,
+							 file->size);
+		if (!section)
+			return -pte_bad_image;
+
+		errcode = -pte_bad_image;
+		if (pt_section_size(section) == size)
+			errcode = pt_image_add(image, section, &asid, vaddr);
+
+		(void) pt_section_put(section);
+
+		if (errcode < 0)
+			return (errcode == -pte_nomem) ? errcode :
+				-pte_bad_file;
+	}
+
+	return 0;
+}
+
+int pt_image_load(struct pt_image *image, const char *filename)
+{
+	struct pt_manifest_decoder decoder;
+	struct pt_manifest_file *files;
+	struct pt_image loaded;
+	const uint8_t *magic;
+	uint32_t version, nfiles, nspaces, idx;
+	uint8_t *buffer;
+	size_t size;
+	int errcode;
+
+	if (!image || !filename)
+		return -pte_invalid;
+
+	errcode = pt_manifest_read(&buffer, &size, filename);
+	if (errcode < 0)
+		return errcode;
+
+	decoder.pos = buffer;
+	decoder.end = buffer + size;
+
+	files = NULL;
+	nfiles = 0;
+
+	errcode = pt_mfd_get(&decoder, &magic, sizeof(pt_manifest_magic));
+	if (errcode < 0)
+		goto out_buffer;
+
+	errcode = -pte_bad_file;
+	if (memcmp(magic, pt_manifest_magic, sizeof(pt_manifest_magic)) != 0)
+		goto out_buffer;
+
+	errcode = pt_mfd_get_u32(&decoder, &version);
+	if (errcode < 0)
+		goto out_buffer;
+
+	errcode = -pte_bad_file;
+	if (version != pt_manifest_version)
+		goto out_buffer;
+
+	errcode = pt_mfd_get_u32(&decoder, &nfiles);
+	if (errcode < 0)
+		goto out_buffer;
+
+	errcode = pt_mfd_get_u32(&decoder, &nspaces);
+	if (errcode < 0)
+		goto out_buffer;
+
+	errcode = -pte_bad_file;
+	if (((size_t) (decoder.end - decoder.pos) / pt_manifest_file_size) <
+	    nfiles)
+		goto out_buffer;
+
+	if (nfiles) {
+		errcode = -pte_nomem;
+		files = calloc(nfiles, sizeof(*files));
+		if (!files)
+			goto out_buffer;
+	}
+
+	for (idx = 0; idx < nfiles; ++idx) {
+		errcode = pt_manifest_get_file(&files[idx], &decoder);
+		if (errcode < 0)
+			goto out_files;
+	}
+
+	/* We load the manifest into a temporary image so we don't leave
+	 * @image half-populated on errors.  Copying it into @image shares its
+	 * address spaces, so this is cheap.
+	 */
+	pt_image_init(&loaded, NULL);
+
+	for (idx = 0; idx < nspaces; ++idx) {
+		errcode = pt_manifest_get_space(&loaded, &decoder, files,
+						nfiles);
+		if (errcode < 0)
+			goto out_image;
+	}
+
+	errcode = -pte_bad_file;
+	if (decoder.pos != decoder.end)
+		goto out_image;
+
+	errcode = pt_image_copy(image, &loaded);
+
+out_image:
+	pt_image_fini(&loaded);
+
+out_files:
+	for (idx = 0; idx < nfiles; ++idx) {
+		free(files[idx].name);
+		free(files[idx].status);
+	}
+
+	free(files);
+
+out_buffer:
+	free(buffer);
+	return errcode;
+}
@@ -27,6 +27,10 @@
  */
 
 #include "pt_insn_decoder.h"
+#include "pt_block_map.h"
+#include "pt_section.h"
+#include "pt_sblock_cache.h"
+#include "pt_checkpoint.h"
 
 #include "intel-pt.h"
 
@@ -46,6 +50,12 @@ static void pt_insn_reset(struct pt_insn_decoder *decoder)
 	decoder->process_event = 0;
 	decoder->speculative = 0;
 	decoder->event_may_change_ip = 1;
+	decoder->paging_event_bound = 0;
+	decoder->vmcs_event_bound = 0;
+	decoder->resume_proceed = 0;
+	decoder->resume_peek = 0;
+
+	memset(&decoder->event, 0, sizeof(decoder->event));
 
 	pt_retstack_init(&decoder->retstack);
 	pt_asid_init(&decoder->asid);
@@ -66,6 +76,10 @@ int pt_insn_decoder_init(struct pt_insn_decoder *decoder,
 	pt_image_init(&decoder->default_image, NULL);
 	decoder->image = &decoder->default_image;
 
+	pt_image_view_init(&decoder->view);
+	pt_insn_cache_init(&decoder->icache);
+	memset(&decoder->run, 0, sizeof(decoder->run));
+
 	pt_insn_reset(decoder);
 
 	return 0;
@@ -76,6 +90,8 @@ void pt_insn_decoder_fini(struct pt_insn_decoder *decoder)
 	if (!decoder)
 		return;
 
+	pt_insn_cache_fini(&decoder->icache);
+	pt_image_view_fini(&decoder->view);
 	pt_image_fini(&decoder->default_image);
 	pt_qry_decoder_fini(&decoder->query);
 }
@@ -164,6 +180,38 @@ int pt_insn_sync_set(struct pt_insn_decoder *decoder, uint64_t offset)
 	return pt_insn_start(decoder, status);
 }
 
+int pt_insn_sync_time(struct pt_insn_decoder *decoder, uint64_t tsc)
+{
+	int status;
+
+	if (!decoder)
+		return -pte_invalid;
+
+	pt_insn_reset(decoder);
+
+	status = pt_qry_sync_time(&decoder->query, &decoder->ip, tsc);
+
+	status = pt_insn_start(decoder, status);
+	if (status < 0)
+		return status;
+
+	/* Proceed to the first instruction that is not known to have been
+	 * executed before @tsc.
+	 */
+	for (;;) {
+		struct pt_insn insn;
+		uint64_t time;
+
+		status = pt_qry_time(&decoder->query, &time, NULL, NULL);
+		if (status < 0 || tsc <= time)
+			return 0;
+
+		status = pt_insn_next(decoder, &insn, sizeof(insn));
+		if (status < 0)
+			return status;
+	}
+}
+
 int pt_insn_get_offset(struct pt_insn_decoder *decoder, uint64_t *offset)
 {
 	if (!decoder)
@@ -198,6 +246,13 @@ int pt_insn_set_image(struct pt_insn_decoder *decoder,
 		image = &decoder->default_image;
 
 	decoder->image = image;
+
+	pt_image_view_fini(&decoder->view);
+	pt_image_view_init(&decoder->view);
+
+	pt_insn_cache_clear(&decoder->icache);
+	memset(&decoder->run, 0, sizeof(decoder->run));
+
 	return 0;
 }
 
@@ -210,6 +265,117 @@ pt_insn_get_config(const struct pt_insn_decoder *decoder)
 	return pt_qry_get_config(&decoder->query);
 }
 
+static int pt_insn_get_state(const struct pt_insn_decoder *decoder,
+			     struct pt_insn_state *state)
+{
+	int errcode;
+
+	if (!decoder || !state)
+		return -pte_internal;
+
+	memset(state, 0, sizeof(*state));
+
+	errcode = pt_qry_get_state(&decoder->query, &state->query);
+	if (errcode < 0)
+		return errcode;
+
+	state->asid = decoder->asid;
+	state->event = decoder->event;
+	state->retstack = decoder->retstack;
+	state->ip = decoder->ip;
+	state->last_disable_ip = decoder->last_disable_ip;
+	state->mode = decoder->mode;
+	state->status = decoder->status;
+	state->enabled = decoder->enabled;
+	state->process_event = decoder->process_event;
+	state->event_may_change_ip = decoder->event_may_change_ip;
+	state->speculative = decoder->speculative;
+	state->paging_event_bound = decoder->paging_event_bound;
+	state->vmcs_event_bound = decoder->vmcs_event_bound;
+	state->resume_proceed = decoder->resume_proceed;
+	state->resume_peek = decoder->resume_peek;
+
+	return 0;
+}
+
+static int pt_insn_set_state(struct pt_insn_decoder *decoder,
+			     const struct pt_insn_state *state)
+{
+	int status;
+
+	if (!decoder || !state)
+		return -pte_internal;
+
+	pt_insn_reset(decoder);
+
+	/* The cached address space run belongs to the old position. */
+	memset(&decoder->run, 0, sizeof(decoder->run));
+
+	status = pt_qry_set_state(&decoder->query, &state->query);
+	if (status < 0)
+		return status;
+
+	decoder->asid = state->asid;
+	decoder->event = state->event;
+	decoder->retstack = state->retstack;
+	decoder->ip = state->ip;
+	decoder->last_disable_ip = state->last_disable_ip;
+	decoder->mode = state->mode;
+	decoder->status = state->status;
+	decoder->enabled = state->enabled;
+	decoder->process_event = state->process_event;
+	decoder->event_may_change_ip = state->event_may_change_ip;
+	decoder->speculative = state->speculative;
+	decoder->paging_event_bound = state->paging_event_bound;
+	decoder->vmcs_event_bound = state->vmcs_event_bound;
+	decoder->resume_proceed = state->resume_proceed;
+	decoder->resume_peek = state->resume_peek;
+
+	return 0;
+}
+
+int pt_insn_save(const struct pt_insn_decoder *decoder, uint8_t *buffer,
+		 size_t size)
+{
+	struct pt_checkpoint ckpt;
+	struct pt_insn_state state;
+	int errcode;
+
+	if (!decoder)
+		return -pte_invalid;
+
+	errcode = pt_insn_get_state(decoder, &state);
+	if (errcode < 0)
+		return errcode;
+
+	pt_ckpt_init_write(&ckpt, buffer, size);
+	pt_ckpt_put_header(&ckpt, pck_insn);
+	pt_ckpt_put_insn_state(&ckpt, &state);
+
+	return pt_ckpt_end_write(&ckpt);
+}
+
+int pt_insn_restore(struct pt_insn_decoder *decoder, const uint8_t *buffer,
+		    size_t size)
+{
+	struct pt_checkpoint ckpt;
+	struct pt_insn_state state;
+	int errcode;
+
+	if (!decoder || !buffer)
+		return -pte_invalid;
+
+	pt_ckpt_init_read(&ckpt, buffer, size);
+	pt_ckpt_get_header(&ckpt, pck_insn);
+	pt_ckpt_get_insn_state(&ckpt, &state);
+
+	errcode = pt_ckpt_end_read(&ckpt);
+	if (errcode < 0)
+		return errcode;
+
+	return pt_insn_set_state(decoder, &state);
+}
+
 int pt_insn_time(struct pt_insn_decoder *decoder, uint64_t *time,
 		 uint32_t *lost_mtc, uint32_t *lost_cyc)
 {
@@ -382,61 +548,133 @@ static pti_machine_mode_enum_t translate_mode(enum pt_exec_mode mode)
 	return PTI_MODE_LAST;
 }
 
-/* Decode and analyze one instruction.
+/* Fetch and decode the instruction at @ip.
  *
- * Decodes the instructruction at @decoder->ip into @insn and updates
- * @decoder->ip.
+ * Decodes the instruction at @ip in @decoder's current address space and
+ * execution mode into @ild and copies its bytes into @raw, which must
+ * provide room for pt_max_insn_size bytes.  On success, @ild->itext points
+ * to @raw.
+ *
+ * Serves the instruction from @decoder's instruction cache, if possible, and
+ * adds it to the cache otherwise.
  *
  * Returns a negative error code on failure.
  * Returns zero on success if the instruction is not relevant for our purposes.
  * Returns a positive number on success if the instruction is relevant.
- * Returns -pte_bad_insn if the instruction could not be decoded.
+ * Returns -pte_bad_insn if the instruction could not be decoded.  In this
+ * case, @raw contains the bytes that were looked at and @ild->max_bytes gives
+ * their number.
  */
-static int decode_insn(struct pt_insn *insn, struct pt_insn_decoder *decoder)
+static int pt_insn_decode_at(pti_ild_t *ild, uint8_t *raw,
+			     struct pt_insn_decoder *decoder, uint64_t ip)
 {
-	static pti_machine_mode_enum_t mode;
-	pti_ild_t *ild;
+	const struct pt_insn_cache_entry *entry;
+	pti_machine_mode_enum_t mode;
+	const uint8_t *itext;
 	pti_bool_t status, relevant;
 	int size;
 
-	if (!insn || !decoder)
+	if (!ild || !raw || !decoder)
 		return -pte_internal;
 
-	/* Fill in as much as we can as early as we can so we have the
-	 * information available in case of errors.
-	 */
-	if (decoder->speculative)
-		insn->speculative = 1;
-	insn->mode = decoder->mode;
-	insn->ip = decoder->ip;
-
 	/* If we don't know the execution mode, we can't decode. */
 	mode = translate_mode(decoder->mode);
 	if (PTI_MODE_LAST <= mode)
 		return -pte_bad_insn;
 
-	/* Read the memory at the current IP in the current address space. */
-	size = pt_image_read(decoder->image, insn->raw, sizeof(insn->raw),
-			     &decoder->asid, decoder->ip);
+	entry = pt_insn_cache_lookup(&decoder->icache, decoder->image,
+				     &decoder->asid, decoder->mode, ip);
+	if (entry) {
+		*ild = entry->ild;
+		ild->itext = raw;
+
+		memcpy(raw, entry->raw, ild->length);
+
+		return entry->relevant;
+	}
+
+	/* Fetch the memory at @ip in the current address space.
+	 *
+	 * We decode the instruction in place, if possible, and copy only
+	 * its bytes into @raw.
+	 */
+	size = pt_image_fetch_view(&decoder->view, decoder->image, &itext,
+				   raw, pt_max_insn_size, &decoder->asid, ip);
 	if (size < 0)
 		return size;
 
-	/* Decode the instruction. */
-	ild = &decoder->ild;
-	ild->itext = insn->raw;
+	ild->itext = itext;
 	ild->max_bytes = size;
 	ild->mode = mode;
-	ild->runtime_address = decoder->ip;
+	ild->runtime_address = ip;
 
 	status = pti_instruction_length_decode(ild);
-	if (!status)
-		return -pte_bad_insn;
+	if (!status) {
+		/* Provide all the bytes we looked at for diagnostics. */
+		if (itext != raw)
+			memcpy(raw, itext, size);
 
-	insn->size = (uint8_t) ild->length;
+		ild->itext = raw;
+		return -pte_bad_insn;
+	}
 
 	relevant = pti_instruction_decode(ild);
+
+	/* The fetched memory may not remain valid - do not keep pointers
+	 * into it.
+	 */
+	if (itext != raw)
+		memcpy(raw, itext, ild->length);
+
+	ild->itext = raw;
+
+	/* Memory provided by an uncached read memory callback may change at
+	 * any time.  We do not cache instructions decoded from it.
+	 *
+	 * Failing to cache the instruction is not an error.
+	 */
+	if (!decoder->view.callback || decoder->image->readmem.cache.npages)
+		(void) pt_insn_cache_add(&decoder->icache, decoder->image,
+					 &decoder->asid, decoder->mode, ild,
+					 relevant);
+
+	return relevant;
+}
+
+/* Decode and analyze one instruction.
+ *
+ * Decodes the instructruction at @decoder->ip into @insn and updates
+ * @decoder->ip.
+ *
+ * Returns a negative error code on failure.
+ * Returns zero on success if the instruction is not relevant for our purposes.
+ * Returns a positive number on success if the instruction is relevant.
+ * Returns -pte_bad_insn if the instruction could not be decoded.
+ */
+static int decode_insn(struct pt_insn *insn, struct pt_insn_decoder *decoder)
+{
+	int relevant;
+
+	if (!insn || !decoder)
+		return -pte_internal;
+
+	/* Fill in as much as we can as early as we can so we have the
+	 * information available in case of errors.
+	 */
+	if (decoder->speculative)
+		insn->speculative = 1;
+	insn->mode = decoder->mode;
+	insn->ip = decoder->ip;
+
+	relevant = pt_insn_decode_at(&decoder->ild, insn->raw, decoder,
+				     decoder->ip);
+	if (relevant < 0)
+		return relevant;
+
+	insn->size = (uint8_t) decoder->ild.length;
+
 	if (relevant)
-		insn->iclass = pt_insn_classify(ild);
+		insn->iclass = pt_insn_classify(&decoder->ild);
 	else
 		insn->iclass = ptic_other;
 
@@ -448,30 +686,27 @@ static int decode_insn(struct pt_insn *insn, struct pt_insn_decoder *decoder)
  * Tries to reach @ip from @decoder->ip in @decoder->mode without Intel PT for
  * at most @steps steps.
  *
- * Does not update @decoder except for its image LRU cache.
+ * Does not update @decoder except for its image view.
  *
  * Returns non-zero if @ip can be reached, zero otherwise.
  */
 static int pt_ip_is_ahead(struct pt_insn_decoder *decoder, uint64_t ip,
 			  size_t steps)
 {
-	pti_machine_mode_enum_t mode;
 	uint64_t at;
 
 	if (!decoder)
 		return 0;
 
 	/* We do not expect execution mode changes. */
-	mode = translate_mode(decoder->mode);
-	if (PTI_MODE_LAST <= mode)
+	if (PTI_MODE_LAST <= translate_mode(decoder->mode))
 		return -pte_bad_insn;
 
 	at = decoder->ip;
 	while (at != ip) {
-		pti_bool_t status;
 		pti_ild_t ild;
 		uint8_t raw[pt_max_insn_size];
-		int size, errcode;
+		int status, errcode;
 
 		if (!steps--)
 			return 0;
@@ -479,22 +714,10 @@ static int pt_ip_is_ahead(struct pt_insn_decoder *decoder, uint64_t ip,
 		/* If we can't read the memory for the instruction, we can't
 		 * reach it.
 		 */
-		size = pt_image_read(decoder->image, raw, sizeof(raw),
-				     &decoder->asid, at);
-		if (size < 0)
-			return 0;
-
-		ild.itext = raw;
-		ild.max_bytes = size;
-		ild.mode = mode;
-		ild.runtime_address = at;
-
-		status = pti_instruction_length_decode(&ild);
-		if (!status)
+		status = pt_insn_decode_at(&ild, raw, decoder, at);
+		if (status < 0)
 			return 0;
 
-		(void) pti_instruction_decode(&ild);
-
 		errcode = pt_insn_next_ip(&at, &ild);
 		if (errcode < 0)
 			return 0;
@@ -1173,6 +1396,7 @@ static int process_events_peek(struct pt_insn_decoder *decoder,
 static int proceed(struct pt_insn_decoder *decoder)
 {
 	const pti_ild_t *ild;
+	uint64_t ip;
 
 	if (!decoder)
 		return -pte_internal;
@@ -1201,11 +1425,6 @@ static int proceed(struct pt_insn_decoder *decoder)
 		}
 
 		/* Fall through to process the taken branch. */
-	} else if (ild->u.s.call && !ild->u.s.branch_far) {
-		/* Log the call for return compression. */
-		pt_retstack_push(&decoder->retstack, decoder->ip + ild->length);
-
-		/* Fall through to process the call. */
 	} else if (ild->u.s.ret && !ild->u.s.branch_far) {
 		int taken, status;
 
@@ -1235,12 +1454,11 @@ static int proceed(struct pt_insn_decoder *decoder)
 
 	/* Process the actual branch. */
 	if (ild->u.s.branch_direct)
-		decoder->ip = ild->direct_target;
+		ip = ild->direct_target;
 	else {
 		int status;
 
-		status = pt_qry_indirect_branch(&decoder->query,
-						&decoder->ip);
+		status = pt_qry_indirect_branch(&decoder->query, &ip);
 
 		if (status < 0)
 			return status;
@@ -1252,6 +1470,16 @@ static int proceed(struct pt_insn_decoder *decoder)
 		decoder->status = status;
 	}
 
+	/* Log the call for return compression.
+	 *
+	 * We do this after querying the branch destination so we may proceed
+	 * again if we ran out of trace.
+	 */
+	if (ild->u.s.call && !ild->u.s.branch_far)
+		pt_retstack_push(&decoder->retstack, decoder->ip + ild->length);
+
+	decoder->ip = ip;
+
 	return 0;
 }
 
@@ -1259,17 +1487,25 @@ static int pt_insn_peek(struct pt_insn_decoder *decoder, struct pt_insn *insn)
 {
 	int errcode;
 
-	/* Determine the next IP. */
+	/* Determine the next IP.
+	 *
+	 * If we run out of trace, we remember where we stopped so we can
+	 * continue in pt_insn_extend().
+	 */
 	errcode = proceed(decoder);
-	if (errcode < 0)
+	if (errcode < 0) {
+		decoder->resume_proceed = (errcode == -pte_eos);
 		return errcode;
+	}
 
 	/* Peek event processing is based on the next instruction's
 	 * IP and is therefore independent of the relevance of @insn.
 	 */
 	errcode = process_events_peek(decoder, insn);
-	if (errcode < 0)
+	if (errcode < 0) {
+		decoder->resume_peek = (errcode == -pte_eos);
 		return errcode;
+	}
 
 	return 0;
 }
@@ -1309,7 +1545,8 @@ static inline int insn_to_user(struct pt_insn *uinsn, size_t size,
 
 	/* Zero out any unknown bytes. */
 	if (sizeof(*insn) < size) {
-		memset(uinsn + sizeof(*insn), 0, size - sizeof(*insn));
+		memset((uint8_t *) uinsn + sizeof(*insn), 0,
+		       size - sizeof(*insn));
 
 		size = sizeof(*insn);
 	}
@@ -1319,19 +1556,20 @@ static inline int insn_to_user(struct pt_insn *uinsn, size_t size,
 	return 0;
 }
 
-int pt_insn_next(struct pt_insn_decoder *decoder, struct pt_insn *uinsn,
-		 size_t size)
+/* Determine the next instruction with full event processing.
+ *
+ * This implements pt_insn_step() if events need to be processed.
+ */
+static int pt_insn_next_events(struct pt_insn_decoder *decoder,
+			       struct pt_insn *insn)
 {
-	struct pt_insn insn, *pinsn;
 	int errcode, status;
 
-	if (!uinsn || !decoder)
-		return -pte_invalid;
-
-	pinsn = size == sizeof(insn) ? uinsn : &insn;
+	if (!decoder || !insn)
+		return -pte_internal;
 
 	/* Zero-initialize the instruction in case of error returns. */
-	memset(pinsn, 0, sizeof(*pinsn));
+	memset(insn, 0, sizeof(*insn));
 
 	/* Report any errors we encountered. */
 	if (decoder->status < 0)
@@ -1347,7 +1585,7 @@ int pt_insn_next(struct pt_insn_decoder *decoder, struct pt_insn *uinsn,
 	 *
 	 * This is necessary to attribute events to the correct instruction.
 	 */
-	errcode = process_events_before(decoder, pinsn);
+	errcode = process_events_before(decoder, insn);
 	if (errcode < 0)
 		goto err;
 
@@ -1366,7 +1604,19 @@ int pt_insn_next(struct pt_insn_decoder *decoder, struct pt_insn *uinsn,
 		goto err;
 	}
 
-	errcode = decode_insn(pinsn, decoder);
+	/* When decoding live trace, we wait for more trace before we
+	 * decode the next instruction.
+	 *
+	 * Any further trace would only follow a pending event, so we may
+	 * proceed to the instruction that event binds to.
+	 */
+	if (decoder->query.config.live && (decoder->status & pts_eos) &&
+	    !decoder->process_event) {
+		errcode = -pte_eos;
+		goto err;
+	}
+
+	errcode = decode_insn(insn, decoder);
 	if (errcode < 0)
 		goto err;
 
@@ -1376,9 +1626,20 @@ int pt_insn_next(struct pt_insn_decoder *decoder, struct pt_insn *uinsn,
 	 */
 	decoder->event_may_change_ip = 0;
 
-	errcode = process_events_after(decoder, pinsn);
-	if (errcode < 0)
-		goto err;
+	errcode = process_events_after(decoder, insn);
+	if (errcode < 0) {
+		if (errcode != -pte_eos)
+			goto err;
+
+		/* If we ran out of trace, we provide the instruction and
+		 * continue in pt_insn_extend().
+		 */
+		decoder->resume_proceed = 1;
+		decoder->status = errcode;
+		decoder->event_may_change_ip = 1;
+
+		return 0;
+	}
 
 	/* We return the decoder status for this instruction. */
 	status = pt_insn_status(decoder);
@@ -1392,15 +1653,11 @@ int pt_insn_next(struct pt_insn_decoder *decoder, struct pt_insn *uinsn,
 	 * will be logged for the next iteration.
 	 */
 	if (decoder->enabled) {
-		errcode = pt_insn_peek(decoder, pinsn);
+		errcode = pt_insn_peek(decoder, insn);
 		if (errcode < 0)
 			decoder->status = errcode;
 	}
 
-	errcode = insn_to_user(uinsn, size, pinsn);
-	if (errcode < 0)
-		goto err_log;
-
 	/* We're done with this instruction.  Now we may change the IP again. */
 	decoder->event_may_change_ip = 1;
 
@@ -1412,9 +1669,369 @@ err:
 	 * For decode or post-decode event-processing errors, the IP or
 	 * other fields are already valid and may help diagnose the error.
 	 */
-	(void) insn_to_user(uinsn, size, pinsn);
-
-err_log:
 	decoder->status = errcode;
 	return errcode;
 }
+
+int pt_insn_needs_events(const struct pt_insn_decoder *decoder)
+{
+	if (!decoder)
+		return 1;
+
+	/* Errors are reported via event processing. */
+	if (decoder->status < 0)
+		return 1;
+
+	if (!decoder->enabled || decoder->process_event)
+		return 1;
+
+	/* We suspend decoding live trace in pt_insn_next_events(). */
+	if (decoder->query.config.live && (decoder->status & pts_eos))
+		return 1;
+
+	return (decoder->status & pts_event_pending) != 0;
+}
+
+int pt_insn_step(struct pt_insn_decoder *decoder, struct pt_insn *insn)
+{
+	int errcode, status;
+
+	if (!decoder || !insn)
+		return -pte_internal;
+
+	if (pt_insn_needs_events(decoder))
+		return pt_insn_next_events(decoder, insn);
+
+	/* Without pending events, event processing before and after the
+	 * instruction would not do anything.
+	 */
+	memset(insn, 0, sizeof(*insn));
+
+	errcode = decode_insn(insn, decoder);
+	if (errcode < 0) {
+		decoder->status = errcode;
+		return errcode;
+	}
+
+	status = pt_insn_status(decoder);
+
+	errcode = pt_insn_peek(decoder, insn);
+	if (errcode < 0)
+		decoder->status = errcode;
+
+	return status;
+}
+
+int pt_insn_extend(struct pt_insn_decoder *decoder, uint8_t *end)
+{
+	struct pt_insn insn;
+	uint64_t offset;
+	int status, errcode;
+
+	if (!decoder)
+		return -pte_invalid;
+
+	status = pt_qry_extend(&decoder->query, end);
+	if (status < 0)
+		return status;
+
+	/* There is nothing more to do if we're not synchronized, yet. */
+	errcode = pt_qry_get_sync_offset(&decoder->query, &offset);
+	if (errcode < 0)
+		return 0;
+
+	/* Other errors are still reported by the next instruction. */
+	if ((decoder->status < 0) && (decoder->status != -pte_eos))
+		return 0;
+
+	decoder->status = status;
+
+	/* If we ran out of trace after the current instruction, it has
+	 * already been provided.  We continue where
+	 * we stopped but can't indicate any events in its flags anymore.
+	 */
+	memset(&insn, 0, sizeof(insn));
+
+	if (decoder->resume_proceed) {
+		decoder->resume_proceed = 0;
+
+		/* The new trace may bind events to the current instruction.
+		 * Process them as pt_insn_next_events() would have.
+		 */
+		decoder->event_may_change_ip = 0;
+
+		errcode = process_events_after(decoder, &insn);
+		if (errcode < 0)
+			decoder->resume_proceed = (errcode == -pte_eos);
+		else if (decoder->enabled)
+			errcode = pt_insn_peek(decoder, &insn);
+
+		decoder->event_may_change_ip = 1;
+
+		if (errcode < 0)
+			decoder->status = errcode;
+	} else if (decoder->resume_peek) {
+		decoder->resume_peek = 0;
+
+		errcode = process_events_peek(decoder, &insn);
+		if (errcode < 0) {
+			decoder->resume_peek = (errcode == -pte_eos);
+			decoder->status = errcode;
+		}
+	}
+
+	return 0;
+}
+
+/* Find the block map for @decoder->ip.
+ *
+ * Returns the block map of the section containing @decoder->ip, NULL if
+ * there is none.
+ */
+static const struct pt_block_map *pt_insn_bmap(struct pt_insn_decoder *decoder)
+{
+	const struct pt_mapped_section *msec;
+	const struct pt_image *image;
+	uint64_t ip;
+	int errcode;
+
+	image = decoder->image;
+	ip = decoder->ip;
+
+	if (decoder->run.image == image &&
+	    decoder->run.mgeneration == image->mgeneration &&
+	    decoder->run.asid.cr3 == decoder->asid.cr3 &&
+	    decoder->run.asid.vmcs == decoder->asid.vmcs &&
+	    decoder->run.begin <= ip && ip < decoder->run.end)
+		return decoder->run.bmap;
+
+	errcode = pt_image_find_view(&decoder->view, decoder->image, &msec,
+				     &decoder->asid, ip);
+	if (errcode < 0) {
+		decoder->run.image = NULL;
+		return NULL;
+	}
+
+	decoder->run.image = image;
+	decoder->run.mgeneration = image->mgeneration;
+	decoder->run.asid = decoder->asid;
+	decoder->run.begin = pt_msec_begin(msec);
+	decoder->run.end = pt_msec_end(msec);
+	decoder->run.bmap = pt_section_bmap(msec->section);
+
+	return decoder->run.bmap;
+}
+
+int pt_insn_skip(struct pt_insn_decoder *decoder, uint64_t *ip,
+		 uint32_t *ninsn, uint32_t max)
+{
+	const struct pt_block_map *bmap;
+	uint8_t raw[pt_max_insn_size];
+	int relevant;
+
+	if (!decoder || !ip || !ninsn)
+		return -pte_internal;
+
+	if (!max || pt_insn_needs_events(decoder))
+		return 0;
+
+	bmap = pt_insn_bmap(decoder);
+	if (bmap && bmap->mode == decoder->mode) {
+		uint64_t offset, last;
+		int status;
+
+		offset = decoder->ip - decoder->run.begin;
+		status = pt_bmap_skip(bmap, &offset, &last, ninsn, max);
+		if (status != 0) {
+			if (status < 0)
+				return status;
+
+			*ip = decoder->run.begin + last;
+			decoder->ip = decoder->run.begin + offset;
+
+			return status;
+		}
+	}
+
+	relevant = pt_insn_decode_at(&decoder->ild, raw, decoder, decoder->ip);
+	if (relevant < 0) {
+		decoder->status = relevant;
+		return relevant;
+	}
+
+	if (relevant)
+		return 0;
+
+	/* Irrelevant instructions do not branch and do not consult the trace.
+	 * Without pending events, there is nothing else to do.
+	 */
+	*ip = decoder->ip;
+	*ninsn = 1;
+	decoder->ip += decoder->ild.length;
+
+	return 1;
+}
+
+int pt_insn_follow_tnt(struct pt_insn_decoder *decoder,
+		       struct pt_sblock_cache_entry *sblock)
+{
+	uint8_t raw[pt_max_insn_size];
+	uint64_t ip, ninsn;
+	uint32_t nblocks;
+	uint8_t nused;
+	int changes;
+
+	if (!decoder || !sblock)
+		return -pte_internal;
+
+	ip = sblock->ip;
+	ninsn = 0ull;
+	nblocks = 0;
+	changes = 0;
+
+	for (nused = 0; nused < sblock->ntnt; ++nused) {
+		pti_ild_t ild;
+		uint64_t at;
+		uint32_t bninsn;
+
+		for (at = ip, bninsn = 1; bninsn < UINT32_MAX; ++bninsn) {
+			int relevant;
+
+			relevant = pt_insn_decode_at(&ild, raw, decoder, at);
+			if (relevant < 0)
+				goto out;
+
+			/* See pt_insn_decode_at().  On a cache hit, the view
+			 * may still refer to an earlier fetch, which is on
+			 * the safe side.
+			 */
+			if (decoder->view.callback &&
+			    !decoder->image->readmem.cache.npages)
+				changes = 1;
+
+			if (relevant)
+				break;
+
+			at += ild.length;
+		}
+
+		if (bninsn == UINT32_MAX)
+			break;
+
+		if (!ild.u.s.branch || !ild.u.s.cond || !ild.u.s.branch_direct)
+			break;
+
+		if ((sblock->tnt >> (sblock->ntnt - nused - 1)) & 1ull)
+			ip = ild.direct_target;
+		else
+			ip = at + ild.length;
+
+		ninsn += bninsn;
+		nblocks += 1;
+	}
+
+out:
+	sblock->next_ip = ip;
+	sblock->ninsn = ninsn;
+	sblock->nblocks = nblocks;
+	sblock->nused = nused;
+
+	return changes;
+}
+
+int pt_insn_next(struct pt_insn_decoder *decoder, struct pt_insn *uinsn,
+		 size_t size)
+{
+	struct pt_insn insn, *pinsn;
+	int errcode, status;
+
+	if (!uinsn || !decoder)
+		return -pte_invalid;
+
+	pinsn = size == sizeof(insn) ? uinsn : &insn;
+
+	status = pt_insn_step(decoder, pinsn);
+
+	/* We provide the (incomplete) instruction also in case of errors. */
+	errcode = insn_to_user(uinsn, size, pinsn);
+	if (status < 0)
+		return status;
+
+	if (errcode < 0) {
+		decoder->status = errcode;
+		return errcode;
+	}
+
+	return status;
+}
+
+/* Check whether @insn ends a batch.
+ *
+ * Returns non-zero if it does, zero otherwise.
+ */
+static int pt_insn_ends_batch(const struct pt_insn *insn)
+{
+	if (!insn)
+		return 1;
+
+	return insn->aborted || insn->committed || insn->disabled ||
+		insn->interrupted || insn->stopped;
+}
+
+int pt_insn_next_batch(struct pt_insn_decoder *decoder, struct pt_insn *uinsn,
+		       size_t n, size_t size, size_t *count)
+{
+	struct pt_insn insn;
+	uint8_t *pos;
+	size_t idx;
+	int status;
+
+	if (!decoder || !uinsn || !count || !size)
+		return -pte_invalid;
+
+	*count = 0;
+	status = 0;
+
+	pos = (uint8_t *) uinsn;
+	for (idx = 0; idx < n; ++idx, pos += size) {
+		struct pt_insn *pinsn;
+		int errcode;
+
+		/* Events may change the IP, the execution mode, or set flags
+		 * on the next instruction.  We end the batch and process them
+		 * at the beginning of the next batch.
+		 */
+		if (idx && pt_insn_needs_events(decoder))
+			break;
+
+		pinsn = size == sizeof(insn) ? (struct pt_insn *) pos : &insn;
+
+		errcode = pt_insn_step(decoder, pinsn);
+
+		/* We provide the (incomplete) instruction also in case of
+		 * errors.
+		 */
+		(void) insn_to_user((struct pt_insn *) pos, size, pinsn);
+
+		/* Errors are logged in @decoder.  We report them when we
+		 * can't return any instructions.
+		 */
+		if (errcode < 0) {
+			if (!idx)
+				return errcode;
+
+			break;
+		}
+
+		status = errcode;
+
+		if (pt_insn_ends_batch(pinsn)) {
+			idx += 1;
+			break;
+		}
+	}
+
+	*count = idx;
+
+	return status;
+}
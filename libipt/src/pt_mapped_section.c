@@ -148,3 +148,26 @@ int pt_msec_read_mapped(const struct pt_mapped_section *msec, uint8_t *buffer,
 
 	return status;
 }
+
+int pt_msec_fetch_mapped(const struct pt_mapped_section *msec,
+			 const uint8_t **pbegin, uint16_t size,
+			 const struct pt_asid *asid, uint64_t addr)
+{
+	int errcode;
+
+	if (!msec || !asid)
+		return -pte_internal;
+
+	errcode = pt_msec_matches_asid(msec, asid);
+	if (errcode < 0)
+		return errcode;
+
+	if (!errcode)
+		return -pte_nomap;
+
+	if (addr < msec->vaddr)
+		return -pte_nomap;
+
+	return pt_section_fetch(msec->section, pbegin, size,
+				addr - msec->vaddr);
+}
@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pt_merge_decoder.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+int pt_merge_decoder_init(struct pt_merge_decoder *decoder,
+			  const struct pt_config *config, uint32_t ncpus)
+{
+	uint32_t idx;
+
+	if (!decoder)
+		return -pte_internal;
+
+	if (!config || !ncpus)
+		return -pte_invalid;
+
+	memset(decoder, 0, sizeof(*decoder));
+
+	decoder->cpu = calloc(ncpus, sizeof(*decoder->cpu));
+	decoder->heap = calloc(ncpus, sizeof(*decoder->heap));
+	if (!decoder->cpu || !decoder->heap) {
+		pt_merge_decoder_fini(decoder);
+		return -pte_nomem;
+	}
+
+	decoder->ncpus = ncpus;
+
+	for (idx = 0; idx < ncpus; ++idx) {
+		struct pt_merge_cpu *cpu;
+
+		cpu = &decoder->cpu[idx];
+		cpu->decoder = pt_insn_alloc_decoder(&config[idx]);
+		if (!cpu->decoder) {
+			pt_merge_decoder_fini(decoder);
+			return -pte_nomem;
+		}
+
+		cpu->status = -pte_nosync;
+	}
+
+	return 0;
+}
+
+void pt_merge_decoder_fini(struct pt_merge_decoder *decoder)
+{
+	uint32_t idx;
+
+	if (!decoder)
+		return;
+
+	if (decoder->cpu) {
+		for (idx = 0; idx < decoder->ncpus; ++idx)
+			pt_insn_free_decoder(decoder->cpu[idx].decoder);
+	}
+
+	free(decoder->cpu);
+	free(decoder->heap);
+
+	decoder->cpu = NULL;
+	decoder->heap = NULL;
+	decoder->ncpus = 0;
+	decoder->nheap = 0;
+}
+
+struct pt_merge_decoder *
+pt_merge_alloc_decoder(const struct pt_config *config, uint32_t ncpus)
+{
+	struct pt_merge_decoder *decoder;
+	int errcode;
+
+	decoder = malloc(sizeof(*decoder));
+	if (!decoder)
+		return NULL;
+
+	errcode = pt_merge_decoder_init(decoder, config, ncpus);
+	if (errcode < 0) {
+		free(decoder);
+		return NULL;
+	}
+
+	return decoder;
+}
+
+void pt_merge_free_decoder(struct pt_merge_decoder *decoder)
+{
+	if (!decoder)
+		return;
+
+	pt_merge_decoder_fini(decoder);
+	free(decoder);
+}
+
+int pt_merge_set_image(struct pt_merge_decoder *decoder,
+		       struct pt_image *image)
+{
+	uint32_t idx;
+
+	if (!decoder)
+		return -pte_invalid;
+
+	for (idx = 0; idx < decoder->ncpus; ++idx) {
+		int errcode;
+
+		errcode = pt_insn_set_image(decoder->cpu[idx].decoder, image);
+		if (errcode < 0)
+			return errcode;
+	}
+
+	return 0;
+}
+
+/* Check whether the next instruction of cpu @lhs precedes the one of cpu @rhs.
+ *
+ * Instructions at the same time are ordered by cpu to keep the order stable.
+ *
+ * Returns non-zero if it does, zero otherwise.
+ */
+static int pt_merge_before(const struct pt_merge_decoder *decoder,
+			   uint32_t lhs, uint32_t rhs)
+{
+	uint64_t ltime, rtime;
+
+	ltime = decoder->cpu[lhs].time;
+	rtime = decoder->cpu[rhs].time;
+
+	if (ltime != rtime)
+		return ltime < rtime;
+
+	return lhs < rhs;
+}
+
+/* Restore the heap property for the heap entry at @pos moving it up. */
+static void pt_merge_sift_up(struct pt_merge_decoder *decoder, uint32_t pos)
+{
+	uint32_t *heap, cpu;
+
+	heap = decoder->heap;
+	cpu = heap[pos];
+
+	while (pos) {
+		uint32_t parent;
+
+		parent = (pos - 1) / 2;
+		if (!pt_merge_before(decoder, cpu, heap[parent]))
+			break;
+
+		heap[pos] = heap[parent];
+		pos = parent;
+	}
+
+	heap[pos] = cpu;
+}
+
+/* Restore the heap property for the heap entry at @pos moving it down. */
+static void pt_merge_sift_down(struct pt_merge_decoder *decoder, uint32_t pos)
+{
+	uint32_t *heap, cpu, nheap;
+
+	heap = decoder->heap;
+	nheap = decoder->nheap;
+	cpu = heap[pos];
+
+	for (;;) {
+		uint32_t child;
+
+		child = (pos * 2) + 1;
+		if (nheap <= child)
+			break;
+
+		if ((child + 1 < nheap) &&
+		    pt_merge_before(decoder, heap[child + 1], heap[child]))
+			child += 1;
+
+		if (!pt_merge_before(decoder, heap[child], cpu))
+			break;
+
+		heap[pos] = heap[child];
+		pos = child;
+	}
+
+	heap[pos] = cpu;
+}
+
+/* Fetch the next instruction for @cpu.
+ *
+ * Resynchronizes @cpu's decoder if the previous instruction ended in an error.
+ * Errors are stored in @cpu->status and reported in order with the (possibly
+ * incomplete) instruction.
+ *
+ * Returns a positive integer if @cpu has an instruction pending.
+ * Returns zero if @cpu reached the end of its trace.
+ * Returns -pte_internal if @cpu is NULL.
+ */
+static int pt_merge_fetch(struct pt_merge_cpu *cpu)
+{
+	int status, errcode;
+
+	if (!cpu)
+		return -pte_internal;
+
+	if (cpu->status < 0) {
+		do {
+			status = pt_insn_sync_forward(cpu->decoder);
+			if (status == -pte_eos)
+				return 0;
+		} while (status < 0);
+	}
+
+	status = pt_insn_next(cpu->decoder, &cpu->insn, sizeof(cpu->insn));
+	if (status == -pte_eos)
+		return 0;
+
+	cpu->status = status;
+
+	/* Without TSC, we order instructions by their time relative to the
+	 * last synchronization.
+	 */
+	errcode = pt_insn_time(cpu->decoder, &cpu->time, NULL, NULL);
+	if ((errcode < 0) && (errcode != -pte_no_time))
+		return -pte_internal;
+
+	return 1;
+}
+
+int pt_merge_sync_forward(struct pt_merge_decoder *decoder)
+{
+	uint32_t idx;
+
+	if (!decoder)
+		return -pte_invalid;
+
+	decoder->nheap = 0;
+
+	for (idx = 0; idx < decoder->ncpus; ++idx) {
+		struct pt_merge_cpu *cpu;
+		int status;
+
+		cpu = &decoder->cpu[idx];
+		cpu->status = -pte_nosync;
+
+		status = pt_merge_fetch(cpu);
+		if (status < 0)
+			return status;
+
+		if (!status)
+			continue;
+
+		decoder->heap[decoder->nheap] = idx;
+		pt_merge_sift_up(decoder, decoder->nheap++);
+	}
+
+	if (!decoder->nheap)
+		return -pte_eos;
+
+	return 0;
+}
+
+int pt_merge_next(struct pt_merge_decoder *decoder, struct pt_insn *insn,
+		  size_t size, uint32_t *cpu)
+{
+	struct pt_merge_cpu *mcpu;
+	uint32_t idx;
+	int status, pending;
+
+	if (!decoder || !insn || !cpu)
+		return -pte_invalid;
+
+	if (!decoder->nheap)
+		return -pte_eos;
+
+	idx = decoder->heap[0];
+	mcpu = &decoder->cpu[idx];
+
+	/* Zero out any unknown bytes. */
+	if (sizeof(*insn) < size) {
+		memset((uint8_t *) insn + sizeof(*insn), 0,
+		       size - sizeof(*insn));
+
+		size = sizeof(*insn);
+	}
+
+	memcpy(insn, &mcpu->insn, size);
+
+	*cpu = idx;
+	decoder->time = mcpu->time;
+	status = mcpu->status;
+
+	/* We only keep one instruction per cpu.  Fetch the next and move
+	 * the cpu to its new place in the heap.
+	 */
+	pending = pt_merge_fetch(mcpu);
+	if (pending < 0)
+		return pending;
+
+	if (!pending)
+		decoder->heap[0] = decoder->heap[--decoder->nheap];
+
+	if (decoder->nheap)
+		pt_merge_sift_down(decoder, 0);
+
+	return status;
+}
+
+int pt_merge_time(const struct pt_merge_decoder *decoder, uint64_t *time)
+{
+	if (!decoder || !time)
+		return -pte_invalid;
+
+	*time = decoder->time;
+
+	return 0;
+}
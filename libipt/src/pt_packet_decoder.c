@@ -29,7 +29,6 @@
 #include "pt_packet_decoder.h"
 #include "pt_decoder_function.h"
 #include "pt_packet.h"
-#include "pt_sync.h"
 #include "pt_config.h"
 
 #include <string.h>
@@ -49,7 +48,7 @@ int pt_pkt_decoder_init(struct pt_packet_decoder *decoder,
 	if (errcode < 0)
 		return errcode;
 
-	return 0;
+	return pt_win_init(&decoder->win, &decoder->config);
 }
 
 struct pt_packet_decoder *pt_pkt_alloc_decoder(const struct pt_config *config)
@@ -72,9 +71,10 @@ struct pt_packet_decoder *pt_pkt_alloc_decoder(const struct pt_config *config)
 
 void pt_pkt_decoder_fini(struct pt_packet_decoder *decoder)
 {
-	(void) decoder;
+	if (!decoder)
+		return;
 
-	/* Nothing to do. */
+	pt_win_fini(&decoder->win);
 }
 
 void pt_pkt_free_decoder(struct pt_packet_decoder *decoder)
@@ -85,25 +85,28 @@ void pt_pkt_free_decoder(struct pt_packet_decoder *decoder)
 
 int pt_pkt_sync_forward(struct pt_packet_decoder *decoder)
 {
-	const uint8_t *pos, *sync;
+	const uint8_t *sync;
+	uint64_t offset;
 	int errcode;
 
 	if (!decoder)
 		return -pte_invalid;
 
-	sync = decoder->sync;
-	pos = decoder->pos;
-	if (!pos)
-		pos = decoder->config.begin;
+	offset = 0ull;
+	if (decoder->pos) {
+		offset = pt_win_offset(&decoder->win, &decoder->config,
+				       decoder->pos);
 
-	if (pos == sync)
-		pos += ptps_psb;
+		if (offset == decoder->sync)
+			offset += ptps_psb;
+	}
 
-	errcode = pt_sync_forward(&sync, pos, &decoder->config);
+	errcode = pt_win_sync_forward(&decoder->win, &decoder->config, &sync,
+				      offset);
 	if (errcode < 0)
 		return errcode;
 
-	decoder->sync = sync;
+	decoder->sync = pt_win_offset(&decoder->win, &decoder->config, sync);
 	decoder->pos = sync;
 
 	return 0;
@@ -111,21 +114,23 @@ int pt_pkt_sync_forward(struct pt_packet_decoder *decoder)
 
 int pt_pkt_sync_backward(struct pt_packet_decoder *decoder)
 {
-	const uint8_t *pos, *sync;
+	const uint8_t *sync;
+	uint64_t offset;
 	int errcode;
 
 	if (!decoder)
 		return -pte_invalid;
 
-	pos = decoder->sync;
-	if (!pos)
-		pos = decoder->config.end;
+	offset = decoder->sync;
+	if (!decoder->pos)
+		offset = pt_win_size(&decoder->config);
 
-	errcode = pt_sync_backward(&sync, pos, &decoder->config);
+	errcode = pt_win_sync_backward(&decoder->win, &decoder->config, &sync,
+				       offset);
 	if (errcode < 0)
 		return errcode;
 
-	decoder->sync = sync;
+	decoder->sync = pt_win_offset(&decoder->win, &decoder->config, sync);
 	decoder->pos = sync;
 
 	return 0;
@@ -133,55 +138,55 @@ int pt_pkt_sync_backward(struct pt_packet_decoder *decoder)
 
 int pt_pkt_sync_set(struct pt_packet_decoder *decoder, uint64_t offset)
 {
-	const uint8_t *begin, *end, *pos;
+	const uint8_t *pos;
+	int errcode;
 
 	if (!decoder)
 		return -pte_invalid;
 
-	begin = decoder->config.begin;
-	end = decoder->config.end;
-	pos = begin + offset;
-
-	if (end < pos || pos < begin)
-		return -pte_invalid;
+	errcode = pt_win_map(&decoder->win, &decoder->config, offset, &pos);
+	if (errcode < 0)
+		return errcode;
 
-	decoder->sync = pos;
+	decoder->sync = offset;
 	decoder->pos = pos;
 
 	return 0;
 }
 
+int pt_pkt_extend(struct pt_packet_decoder *decoder, uint8_t *end)
+{
+	if (!decoder)
+		return -pte_invalid;
+
+	return pt_win_extend(&decoder->win, &decoder->config, end);
+}
+
 int pt_pkt_get_offset(struct pt_packet_decoder *decoder, uint64_t *offset)
 {
-	const uint8_t *begin, *pos;
+	const uint8_t *pos;
 
 	if (!decoder || !offset)
 		return -pte_invalid;
 
-	begin = decoder->config.begin;
 	pos = decoder->pos;
 
 	if (!pos)
 		return -pte_nosync;
 
-	*offset = pos - begin;
+	*offset = pt_win_offset(&decoder->win, &decoder->config, pos);
 	return 0;
 }
 
 int pt_pkt_get_sync_offset(struct pt_packet_decoder *decoder, uint64_t *offset)
 {
-	const uint8_t *begin, *sync;
-
 	if (!decoder || !offset)
 		return -pte_invalid;
 
-	begin = decoder->config.begin;
-	sync = decoder->sync;
-
-	if (!sync)
+	if (!decoder->pos)
 		return -pte_nosync;
 
-	*offset = sync - begin;
+	*offset = decoder->sync;
 	return 0;
 }
 
@@ -227,6 +232,10 @@ int pt_pkt_next(struct pt_packet_decoder *decoder, struct pt_packet *packet,
 
 	ppkt = psize == sizeof(pkt) ? packet : &pkt;
 
+	errcode = pt_win_ensure(&decoder->win, &decoder->config, &decoder->pos);
+	if (errcode < 0)
+		return errcode;
+
 	errcode = pt_df_fetch(&dfun, decoder->pos, &decoder->config);
 	if (errcode < 0)
 		return errcode;
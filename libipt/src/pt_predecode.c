@@ -0,0 +1,526 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pt_block_map.h"
+#include "pt_image.h"
+#include "pt_section.h"
+
+#include "pti-ild.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* The block map cache file format.
+ *
+ * All integers are stored in little-endian byte order.  The file name is
+ * stored without a terminating zero.
+ *
+ *   header:  magic[8], version (u32), mode (u32), offset (u64), size (u64),
+ *            fsize (u64), mtime (u64), length (u32), name[length]
+ *
+ * The header is followed by the @insn and @stop bit-vectors, each consisting
+ * of (@size + 63) / 64 u64 words.
+ *
+ * The file is named after a hash of the header fields.  The header itself is
+ * compared on load to detect hash collisions and changed files.
+ */
+static const char pt_bmap_magic[8] = "ptbmap";
+
+enum {
+	pt_bmap_version		= 1,
+
+	/* The size of the fixed part of the header. */
+	pt_bmap_header_size	= 52
+};
+
+/* Return the number of u64 words required for @size bits. */
+static uint64_t pt_bmap_nwords(uint64_t size)
+{
+	return (size + 63ull) >> 6;
+}
+
+static void pt_bmap_set(uint64_t *bits, uint64_t offset)
+{
+	bits[offset >> 6] |= 1ull << (offset & 63ull);
+}
+
+static pti_machine_mode_enum_t pt_bmap_pti_mode(enum pt_exec_mode mode)
+{
+	switch (mode) {
+	case ptem_unknown:
+		return PTI_MODE_LAST;
+
+	case ptem_16bit:
+		return PTI_MODE_16;
+
+	case ptem_32bit:
+		return PTI_MODE_32;
+
+	case ptem_64bit:
+		return PTI_MODE_64;
+	}
+
+	return PTI_MODE_LAST;
+}
+
+int pt_bmap_build(struct pt_block_map *bmap, const uint8_t *code)
+{
+	pti_machine_mode_enum_t mode;
+	uint64_t offset, size;
+
+	if (!bmap || !code)
+		return -pte_internal;
+
+	mode = pt_bmap_pti_mode(bmap->mode);
+	if (PTI_MODE_LAST <= mode)
+		return -pte_bad_insn;
+
+	size = bmap->size;
+	for (offset = 0ull; offset < size;) {
+		pti_ild_t ild;
+		uint64_t left;
+
+		left = size - offset;
+
+		memset(&ild, 0, sizeof(ild));
+		ild.itext = code + offset;
+		ild.max_bytes = left < pt_max_insn_size ?
+			(pti_uint32_t) left : pt_max_insn_size;
+		ild.mode = mode;
+		ild.runtime_address = offset;
+
+		/* The instruction flow decoder fails at this offset.  We end
+		 * the run and try to get back in sync at the next byte.
+		 */
+		if (!pti_instruction_length_decode(&ild)) {
+			pt_bmap_set(bmap->stop, offset);
+			offset += 1ull;
+			continue;
+		}
+
+		pt_bmap_set(bmap->insn, offset);
+		if (pti_instruction_decode(&ild))
+			pt_bmap_set(bmap->stop, offset);
+
+		offset += ild.length;
+	}
+
+	return 0;
+}
+
+/* An encoder writing a cache file into a buffer. */
+struct pt_bmap_encoder {
+	/* The next byte to write. */
+	uint8_t *pos;
+};
+
+static void pt_bmap_put64(struct pt_bmap_encoder *encoder, uint64_t value)
+{
+	int idx;
+
+	for (idx = 0; idx < 8; ++idx, value >>= 8)
+		*encoder->pos++ = (uint8_t) value;
+}
+
+static void pt_bmap_put32(struct pt_bmap_encoder *encoder, uint32_t value)
+{
+	int idx;
+
+	for (idx = 0; idx < 4; ++idx, value >>= 8)
+		*encoder->pos++ = (uint8_t) value;
+}
+
+static uint64_t pt_bmap_get64(const uint8_t **pos)
+{
+	uint64_t value;
+	int idx;
+
+	value = 0ull;
+	for (idx = 7; idx >= 0; --idx)
+		value = (value << 8) | (*pos)[idx];
+
+	*pos += 8;
+
+	return value;
+}
+
+/* Encode the cache file header for @section in @mode.
+ *
+ * On success, provides the size of the header in @hsize.
+ *
+ * Returns a malloc()'ed header on success, NULL if @section is not loaded
+ * from a file or on errors.
+ */
+static uint8_t *pt_bmap_cache_header(const struct pt_section *section,
+				     enum pt_exec_mode mode, size_t *hsize)
+{
+	struct pt_bmap_encoder encoder;
+	const char *filename;
+	uint64_t fsize, mtime;
+	uint8_t *header;
+	size_t length;
+	int errcode;
+
+	filename = pt_section_filename(section);
+	if (!filename)
+		return NULL;
+
+	errcode = pt_section_status_identity(&fsize, &mtime, section->status);
+	if (errcode < 0)
+		return NULL;
+
+	length = strlen(filename);
+
+	header = malloc(pt_bmap_header_size + length);
+	if (!header)
+		return NULL;
+
+	encoder.pos = header;
+	memcpy(encoder.pos, pt_bmap_magic, sizeof(pt_bmap_magic));
+	encoder.pos += sizeof(pt_bmap_magic);
+
+	pt_bmap_put32(&encoder, pt_bmap_version);
+	pt_bmap_put32(&encoder, (uint32_t) mode);
+	pt_bmap_put64(&encoder, section->offset);
+	pt_bmap_put64(&encoder, pt_section_size(section));
+	pt_bmap_put64(&encoder, fsize);
+	pt_bmap_put64(&encoder, mtime);
+	pt_bmap_put32(&encoder, (uint32_t) length);
+
+	memcpy(encoder.pos, filename, length);
+	encoder.pos += length;
+
+	*hsize = (size_t) (encoder.pos - header);
+
+	return header;
+}
+
+/* Compute the name of the cache file for a header in @cachedir.
+ *
+ * Returns a malloc()'ed file name on success, NULL otherwise.
+ */
+static char *pt_bmap_cache_name(const char *cachedir, const uint8_t *header,
+				size_t size)
+{
+	uint64_t hash;
+	size_t idx, length;
+	char *name;
+
+	/* We use FNV-1a. */
+	hash = 0xcbf29ce484222325ull;
+	for (idx = 0; idx < size; ++idx) {
+		hash ^= header[idx];
+		hash *= 0x100000001b3ull;
+	}
+
+	length = strlen(cachedir) + sizeof("/0123456789abcdef.ptbm");
+	name = malloc(length);
+	if (!name)
+		return NULL;
+
+	sprintf(name, "%s/%08x%08x.ptbm", cachedir, (uint32_t) (hash >> 32),
+		(uint32_t) hash);
+
+	return name;
+}
+
+/* Load @bmap from @filename.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_bad_file if @filename does not contain a map for @header.
+ */
+static int pt_bmap_load(struct pt_block_map *bmap, const char *filename,
+			const uint8_t *header, size_t hsize)
+{
+	const uint8_t *data;
+	uint8_t *buffer;
+	uint64_t nwords, idx;
+	size_t size, read;
+	FILE *file;
+	int errcode;
+
+	nwords = pt_bmap_nwords(bmap->size);
+	size = hsize + (size_t) (2ull * nwords * 8ull);
+
+	buffer = malloc(size);
+	if (!buffer)
+		return -pte_nomem;
+
+	errcode = -pte_bad_file;
+	file = fopen(filename, "rb");
+	if (!file)
+		goto out;
+
+	read = fread(buffer, 1, size, file);
+
+	/* The file must not contain anything else. */
+	if (read == size && fgetc(file) != EOF)
+		read = 0;
+
+	fclose(file);
+
+	if (read != size || memcmp(buffer, header, hsize))
+		goto out;
+
+	data = buffer + hsize;
+	for (idx = 0; idx < nwords; ++idx)
+		bmap->insn[idx] = pt_bmap_get64(&data);
+
+	for (idx = 0; idx < nwords; ++idx)
+		bmap->stop[idx] = pt_bmap_get64(&data);
+
+	errcode = 0;
+
+out:
+	free(buffer);
+	return errcode;
+}
+
+/* Store @bmap in @filename.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_bmap_store(const struct pt_block_map *bmap,
+			 const char *filename, const uint8_t *header,
+			 size_t hsize)
+{
+	struct pt_bmap_encoder encoder;
+	uint8_t *buffer;
+	uint64_t nwords, idx;
+	size_t size, written;
+	FILE *file;
+	int errcode;
+
+	nwords = pt_bmap_nwords(bmap->size);
+	size = hsize + (size_t) (2ull * nwords * 8ull);
+
+	buffer = malloc(size);
+	if (!buffer)
+		return -pte_nomem;
+
+	memcpy(buffer, header, hsize);
+
+	encoder.pos = buffer + hsize;
+	for (idx = 0; idx < nwords; ++idx)
+		pt_bmap_put64(&encoder, bmap->insn[idx]);
+
+	for (idx = 0; idx < nwords; ++idx)
+		pt_bmap_put64(&encoder, bmap->stop[idx]);
+
+	errcode = -pte_bad_file;
+	file = fopen(filename, "wb");
+	if (!file)
+		goto out;
+
+	written = fwrite(buffer, 1, size, file);
+	if (fclose(file) || (written != size)) {
+		(void) remove(filename);
+		goto out;
+	}
+
+	errcode = 0;
+
+out:
+	free(buffer);
+	return errcode;
+}
+
+/* Decode @section into @bmap.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_bmap_decode_section(struct pt_block_map *bmap,
+				  struct pt_section *section)
+{
+	uint8_t *code;
+	uint64_t offset;
+	int errcode, status;
+
+	if (!bmap->size)
+		return 0;
+
+	if (SIZE_MAX < bmap->size)
+		return -pte_nomem;
+
+	code = malloc((size_t) bmap->size);
+	if (!code)
+		return -pte_nomem;
+
+	errcode = pt_section_map(section);
+	if (errcode < 0)
+		goto out;
+
+	for (offset = 0ull; offset < bmap->size; offset += status) {
+		uint64_t left;
+
+		left = bmap->size - offset;
+		status = pt_section_read(section, code + offset,
+					 left < UINT16_MAX ?
+					 (uint16_t) left : UINT16_MAX,
+					 offset);
+		if (status <= 0) {
+			errcode = status < 0 ? status : -pte_nomap;
+			break;
+		}
+	}
+
+	status = pt_section_unmap(section);
+	if (errcode >= 0)
+		errcode = status;
+
+	if (errcode >= 0)
+		errcode = pt_bmap_build(bmap, code);
+
+out:
+	free(code);
+	return errcode;
+}
+
+char *pt_bmap_cache_file(const struct pt_section *section,
+			 enum pt_exec_mode mode, const char *cachedir)
+{
+	uint8_t *header;
+	size_t hsize;
+	char *name;
+
+	if (!section || !cachedir)
+		return NULL;
+
+	header = pt_bmap_cache_header(section, mode, &hsize);
+	if (!header)
+		return NULL;
+
+	name = pt_bmap_cache_name(cachedir, header, hsize);
+
+	free(header);
+	return name;
+}
+
+int pt_bmap_section(struct pt_section *section, enum pt_exec_mode mode,
+		    const char *cachedir)
+{
+	struct pt_block_map *bmap;
+	uint8_t *header;
+	char *name;
+	size_t hsize;
+	int errcode;
+
+	if (!section)
+		return -pte_internal;
+
+	if (PTI_MODE_LAST <= pt_bmap_pti_mode(mode))
+		return -pte_bad_insn;
+
+	if (pt_section_bmap(section))
+		return 0;
+
+	bmap = pt_bmap_alloc(pt_section_size(section), mode);
+	if (!bmap)
+		return -pte_nomem;
+
+	header = NULL;
+	name = NULL;
+	hsize = 0;
+
+	if (cachedir) {
+		header = pt_bmap_cache_header(section, mode, &hsize);
+		if (header)
+			name = pt_bmap_cache_name(cachedir, header, hsize);
+	}
+
+	errcode = -pte_bad_file;
+	if (name)
+		errcode = pt_bmap_load(bmap, name, header, hsize);
+
+	if (errcode < 0) {
+		errcode = pt_bmap_decode_section(bmap, section);
+		if (errcode < 0)
+			goto out;
+
+		/* Failing to store the map is not an error. */
+		if (name)
+			(void) pt_bmap_store(bmap, name, header, hsize);
+	}
+
+	errcode = pt_section_attach_bmap(section, bmap);
+	if (errcode < 0)
+		goto out;
+
+	/* Someone else was faster - keep their map. */
+	if (errcode > 0)
+		pt_bmap_free(bmap);
+
+	free(header);
+	free(name);
+	return 0;
+
+out:
+	pt_bmap_free(bmap);
+	free(header);
+	free(name);
+	return errcode;
+}
+
+int pt_image_predecode(struct pt_image *image, enum pt_exec_mode mode,
+		       const char *cachedir)
+{
+	uint32_t bucket;
+
+	if (!image)
+		return -pte_invalid;
+
+	if (PTI_MODE_LAST <= pt_bmap_pti_mode(mode))
+		return -pte_bad_insn;
+
+	for (bucket = 0; bucket < image->nbuckets; ++bucket) {
+		const struct pt_image_space *space;
+
+		space = image->spaces[bucket];
+		for (; space; space = space->next) {
+			uint32_t idx;
+
+			for (idx = 0; idx < space->index->nentries; ++idx) {
+				const struct pt_mapped_section *msec;
+				int errcode;
+
+				msec = &space->index->entries[idx].section;
+
+				errcode = pt_bmap_section(msec->section, mode,
+							  cachedir);
+				if (errcode < 0)
+					return errcode;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,656 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pt_psb_index.h"
+#include "pt_packet_decoder.h"
+#include "pt_window.h"
+#include "pt_last_ip.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* The PSB index file format.
+ *
+ * All integers are stored in little-endian byte order.
+ *
+ *   header:  magic[8], version (u32), nentries (u32), size (u64)
+ *
+ *   entry:   offset (u64), tsc (u64), ip (u64), cr3 (u64), ctc (u32),
+ *            fc (u32), cbr (u32), mode (u32), flags (u32)
+ *
+ * The header is followed by @nentries entries in increasing @offset order.
+ * The @flags contain the entry's has_* bits in the order in which they are
+ * declared.
+ */
+static const char pt_psb_index_magic[8] = "ptpsbidx";
+
+enum {
+	pt_psb_index_version	= 1,
+
+	/* The size of the header and of an entry, respectively. */
+	pt_psb_index_header_size	= 24,
+	pt_psb_index_entry_size		= 52,
+
+	/* The entry flags. */
+	pt_psb_index_tsc	= 1 << 0,
+	pt_psb_index_tma	= 1 << 1,
+	pt_psb_index_cbr	= 1 << 2,
+	pt_psb_index_ip		= 1 << 3,
+	pt_psb_index_cr3	= 1 << 4
+};
+
+void pt_psb_index_init(struct pt_psb_index *index)
+{
+	if (!index)
+		return;
+
+	memset(index, 0, sizeof(*index));
+}
+
+void pt_psb_index_fini(struct pt_psb_index *index)
+{
+	if (!index)
+		return;
+
+	free(index->entries);
+	pt_psb_index_init(index);
+}
+
+struct pt_psb_index *pt_psb_index_alloc(void)
+{
+	struct pt_psb_index *index;
+
+	index = malloc(sizeof(*index));
+	if (index)
+		pt_psb_index_init(index);
+
+	return index;
+}
+
+void pt_psb_index_free(struct pt_psb_index *index)
+{
+	pt_psb_index_fini(index);
+	free(index);
+}
+
+int pt_psb_index_add(struct pt_psb_index *index,
+		     const struct pt_psb_index_entry *entry)
+{
+	uint32_t nentries;
+
+	if (!index || !entry)
+		return -pte_internal;
+
+	nentries = index->nentries;
+	if (nentries &&
+	    entry->offset <= index->entries[nentries - 1].offset)
+		return -pte_internal;
+
+	if (index->capacity <= nentries) {
+		struct pt_psb_index_entry *entries;
+		uint32_t capacity;
+
+		capacity = index->capacity ? (index->capacity * 2) : 0x100;
+		if (capacity <= index->capacity)
+			return -pte_nomem;
+
+		entries = realloc(index->entries,
+				  capacity * sizeof(*entries));
+		if (!entries)
+			return -pte_nomem;
+
+		index->entries = entries;
+		index->capacity = capacity;
+	}
+
+	index->entries[nentries] = *entry;
+	index->nentries = nentries + 1;
+
+	return 0;
+}
+
+/* Update @entry's PSB+ state given @packet.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_psb_index_psb_packet(struct pt_psb_index_entry *entry,
+				   struct pt_last_ip *last_ip,
+				   const struct pt_packet *packet,
+				   const struct pt_config *config)
+{
+	int errcode;
+
+	switch (packet->type) {
+	case ppt_fup:
+		errcode = pt_last_ip_update_ip(last_ip, &packet->payload.ip,
+					       config);
+		if (errcode < 0)
+			return errcode;
+
+		errcode = pt_last_ip_query(&entry->ip, last_ip);
+		entry->has_ip = (errcode >= 0);
+		break;
+
+	case ppt_mode:
+		if (packet->payload.mode.leaf == pt_mol_exec)
+			entry->mode = pt_get_exec_mode(&packet->payload.mode
+						       .bits.exec);
+		break;
+
+	case ppt_pip:
+		entry->cr3 = packet->payload.pip.cr3;
+		entry->has_cr3 = 1;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/* Update the timing information in @state given @packet. */
+static void pt_psb_index_time_packet(struct pt_psb_index_entry *state,
+				     const struct pt_packet *packet)
+{
+	switch (packet->type) {
+	case ppt_tsc:
+		state->tsc = packet->payload.tsc.tsc;
+		state->has_tsc = 1;
+		break;
+
+	case ppt_tma:
+		state->ctc = packet->payload.tma.ctc;
+		state->fc = packet->payload.tma.fc;
+		state->has_tma = 1;
+		break;
+
+	case ppt_cbr:
+		state->cbr = packet->payload.cbr.ratio;
+		state->has_cbr = 1;
+		break;
+
+	default:
+		break;
+	}
+}
+
+/* Index the PSB packets read by @decoder.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_psb_index_scan(struct pt_psb_index *index,
+			     struct pt_packet_decoder *decoder)
+{
+	struct pt_psb_index_entry state, entry;
+	struct pt_last_ip last_ip;
+	int errcode, in_psb;
+
+	memset(&state, 0, sizeof(state));
+	memset(&entry, 0, sizeof(entry));
+	pt_last_ip_init(&last_ip);
+	in_psb = 0;
+
+	errcode = pt_pkt_sync_forward(decoder);
+	while (errcode >= 0) {
+		struct pt_packet packet;
+		uint64_t offset;
+
+		errcode = pt_pkt_get_offset(decoder, &offset);
+		if (errcode < 0)
+			break;
+
+		errcode = pt_pkt_next(decoder, &packet, sizeof(packet));
+		if (errcode < 0) {
+			if (errcode == -pte_eos)
+				break;
+
+			/* Skip the corrupted part of the trace. */
+			in_psb = 0;
+			errcode = pt_pkt_sync_forward(decoder);
+			continue;
+		}
+
+		pt_psb_index_time_packet(&state, &packet);
+
+		switch (packet.type) {
+		case ppt_psb:
+			memset(&entry, 0, sizeof(entry));
+			entry.offset = offset;
+			entry.mode = ptem_unknown;
+
+			pt_last_ip_init(&last_ip);
+			in_psb = 1;
+			break;
+
+		case ppt_psbend:
+			if (!in_psb)
+				break;
+
+			entry.tsc = state.tsc;
+			entry.ctc = state.ctc;
+			entry.fc = state.fc;
+			entry.cbr = state.cbr;
+			entry.has_tsc = state.has_tsc;
+			entry.has_tma = state.has_tma;
+			entry.has_cbr = state.has_cbr;
+
+			errcode = pt_psb_index_add(index, &entry);
+			in_psb = 0;
+			break;
+
+		default:
+			if (!in_psb)
+				break;
+
+			errcode = pt_psb_index_psb_packet(&entry, &last_ip,
+							  &packet,
+							  &decoder->config);
+			if (errcode < 0) {
+				/* Ignore a corrupted PSB+ header. */
+				in_psb = 0;
+				errcode = 0;
+			}
+			break;
+		}
+	}
+
+	return (errcode == -pte_eos) ? 0 : errcode;
+}
+
+int pt_psb_index_build(struct pt_psb_index *index,
+		       const struct pt_config *config)
+{
+	struct pt_packet_decoder decoder;
+	int errcode;
+
+	if (!index || !config)
+		return -pte_invalid;
+
+	errcode = pt_pkt_decoder_init(&decoder, config);
+	if (errcode < 0)
+		return errcode;
+
+	index->nentries = 0;
+	index->size = pt_win_size(config);
+
+	errcode = pt_psb_index_scan(index, &decoder);
+	pt_pkt_decoder_fini(&decoder);
+
+	if (errcode < 0) {
+		index->nentries = 0;
+		return errcode;
+	}
+
+	return (int) index->nentries;
+}
+
+static uint8_t *pt_psb_index_put32(uint8_t *pos, uint32_t value)
+{
+	int idx;
+
+	for (idx = 0; idx < 4; ++idx, value >>= 8)
+		*pos++ = (uint8_t) value;
+
+	return pos;
+}
+
+static uint8_t *pt_psb_index_put64(uint8_t *pos, uint64_t value)
+{
+	int idx;
+
+	for (idx = 0; idx < 8; ++idx, value >>= 8)
+		*pos++ = (uint8_t) value;
+
+	return pos;
+}
+
+static uint32_t pt_psb_index_get32(const uint8_t **pos)
+{
+	uint32_t value;
+	int idx;
+
+	value = 0;
+	for (idx = 3; idx >= 0; --idx)
+		value = (value << 8) | (*pos)[idx];
+
+	*pos += 4;
+
+	return value;
+}
+
+static uint64_t pt_psb_index_get64(const uint8_t **pos)
+{
+	uint64_t value;
+	int idx;
+
+	value = 0ull;
+	for (idx = 7; idx >= 0; --idx)
+		value = (value << 8) | (*pos)[idx];
+
+	*pos += 8;
+
+	return value;
+}
+
+int pt_psb_index_save(const struct pt_psb_index *index, const char *filename)
+{
+	uint8_t *buffer, *pos;
+	size_t size, written;
+	uint32_t idx;
+	FILE *file;
+	int errcode;
+
+	if (!index || !filename)
+		return -pte_invalid;
+
+	size = pt_psb_index_header_size +
+		((size_t) index->nentries * pt_psb_index_entry_size);
+
+	buffer = malloc(size);
+	if (!buffer)
+		return -pte_nomem;
+
+	memcpy(buffer, pt_psb_index_magic, sizeof(pt_psb_index_magic));
+
+	pos = buffer + sizeof(pt_psb_index_magic);
+	pos = pt_psb_index_put32(pos, pt_psb_index_version);
+	pos = pt_psb_index_put32(pos, index->nentries);
+	pos = pt_psb_index_put64(pos, index->size);
+
+	for (idx = 0; idx < index->nentries; ++idx) {
+		const struct pt_psb_index_entry *entry;
+		uint32_t flags;
+
+		entry = &index->entries[idx];
+
+		flags = 0;
+		if (entry->has_tsc)
+			flags |= pt_psb_index_tsc;
+		if (entry->has_tma)
+			flags |= pt_psb_index_tma;
+		if (entry->has_cbr)
+			flags |= pt_psb_index_cbr;
+		if (entry->has_ip)
+			flags |= pt_psb_index_ip;
+		if (entry->has_cr3)
+			flags |= pt_psb_index_cr3;
+
+		pos = pt_psb_index_put64(pos, entry->offset);
+		pos = pt_psb_index_put64(pos, entry->tsc);
+		pos = pt_psb_index_put64(pos, entry->ip);
+		pos = pt_psb_index_put64(pos, entry->cr3);
+		pos = pt_psb_index_put32(pos, entry->ctc);
+		pos = pt_psb_index_put32(pos, entry->fc);
+		pos = pt_psb_index_put32(pos, entry->cbr);
+		pos = pt_psb_index_put32(pos, (uint32_t) entry->mode);
+		pos = pt_psb_index_put32(pos, flags);
+	}
+
+	errcode = -pte_bad_file;
+	file = fopen(filename, "wb");
+	if (!file)
+		goto out;
+
+	written = fwrite(buffer, 1, size, file);
+	if (fclose(file) || (written != size)) {
+		(void) remove(filename);
+		goto out;
+	}
+
+	errcode = 0;
+
+out:
+	free(buffer);
+	return errcode;
+}
+
+/* Decode @nentries entries from @data into @index.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ * Returns -pte_bad_file if the entries are not valid.
+ */
+static int pt_psb_index_decode(struct pt_psb_index *index, const uint8_t *data,
+			       uint32_t nentries)
+{
+	uint32_t idx;
+
+	for (idx = 0; idx < nentries; ++idx) {
+		struct pt_psb_index_entry entry;
+		uint32_t ctc, fc, cbr, mode, flags;
+		int errcode;
+
+		memset(&entry, 0, sizeof(entry));
+
+		entry.offset = pt_psb_index_get64(&data);
+		entry.tsc = pt_psb_index_get64(&data);
+		entry.ip = pt_psb_index_get64(&data);
+		entry.cr3 = pt_psb_index_get64(&data);
+		ctc = pt_psb_index_get32(&data);
+		fc = pt_psb_index_get32(&data);
+		cbr = pt_psb_index_get32(&data);
+		mode = pt_psb_index_get32(&data);
+		flags = pt_psb_index_get32(&data);
+
+		if ((0xffff < ctc) || (0xffff < fc) || (0xff < cbr))
+			return -pte_bad_file;
+
+		switch (mode) {
+		case ptem_unknown:
+		case ptem_16bit:
+		case ptem_32bit:
+		case ptem_64bit:
+			break;
+
+		default:
+			return -pte_bad_file;
+		}
+
+		if (index->size <= entry.offset)
+			return -pte_bad_file;
+
+		entry.ctc = (uint16_t) ctc;
+		entry.fc = (uint16_t) fc;
+		entry.cbr = (uint8_t) cbr;
+		entry.mode = (enum pt_exec_mode) mode;
+		entry.has_tsc = (flags & pt_psb_index_tsc) ? 1 : 0;
+		entry.has_tma = (flags & pt_psb_index_tma) ? 1 : 0;
+		entry.has_cbr = (flags & pt_psb_index_cbr) ? 1 : 0;
+		entry.has_ip = (flags & pt_psb_index_ip) ? 1 : 0;
+		entry.has_cr3 = (flags & pt_psb_index_cr3) ? 1 : 0;
+
+		errcode = pt_psb_index_add(index, &entry);
+		if (errcode == -pte_internal)
+			return -pte_bad_file;
+
+		if (errcode < 0)
+			return errcode;
+	}
+
+	return 0;
+}
+
+int pt_psb_index_load(struct pt_psb_index *index, const char *filename,
+		      const struct pt_config *config)
+{
+	uint8_t header[pt_psb_index_header_size];
+	const uint8_t *pos;
+	uint8_t *buffer;
+	uint32_t version, nentries;
+	uint64_t size;
+	size_t dsize, read;
+	FILE *file;
+	int errcode;
+
+	if (!index || !filename)
+		return -pte_invalid;
+
+	file = fopen(filename, "rb");
+	if (!file)
+		return -pte_bad_file;
+
+	buffer = NULL;
+	errcode = -pte_bad_file;
+
+	read = fread(header, 1, sizeof(header), file);
+	if (read != sizeof(header))
+		goto out;
+
+	if (memcmp(header, pt_psb_index_magic, sizeof(pt_psb_index_magic)))
+		goto out;
+
+	pos = header + sizeof(pt_psb_index_magic);
+	version = pt_psb_index_get32(&pos);
+	nentries = pt_psb_index_get32(&pos);
+	size = pt_psb_index_get64(&pos);
+
+	if (version != pt_psb_index_version)
+		goto out;
+
+	if (config && (size != pt_win_size(config)))
+		goto out;
+
+	/* There can't be more PSBs than fit into the trace. */
+	if ((size / ptps_psb) < nentries)
+		goto out;
+
+	dsize = (size_t) nentries * pt_psb_index_entry_size;
+	if (dsize) {
+		buffer = malloc(dsize);
+		if (!buffer) {
+			errcode = -pte_nomem;
+			goto out;
+		}
+	}
+
+	read = dsize ? fread(buffer, 1, dsize, file) : 0;
+
+	/* The file must not contain anything else. */
+	if (read != dsize || fgetc(file) != EOF)
+		goto out;
+
+	index->nentries = 0;
+	index->size = size;
+
+	errcode = pt_psb_index_decode(index, buffer, nentries);
+	if (errcode < 0) {
+		index->nentries = 0;
+		index->size = 0ull;
+	}
+
+out:
+	fclose(file);
+	free(buffer);
+
+	return (errcode < 0) ? errcode : (int) index->nentries;
+}
+
+int pt_psb_index_get(const struct pt_psb_index *index, uint32_t idx,
+		     struct pt_psb_index_entry *entry)
+{
+	if (!index || !entry)
+		return -pte_invalid;
+
+	if (index->nentries <= idx)
+		return -pte_eos;
+
+	*entry = index->entries[idx];
+
+	return 0;
+}
+
+int pt_psb_index_find_offset(const struct pt_psb_index *index,
+			     uint64_t offset, struct pt_psb_index_entry *entry)
+{
+	uint32_t begin, end;
+
+	if (!index || !entry)
+		return -pte_invalid;
+
+	/* Find the first entry beyond @offset. */
+	begin = 0;
+	end = index->nentries;
+	while (begin < end) {
+		uint32_t mid;
+
+		mid = begin + ((end - begin) / 2);
+		if (offset < index->entries[mid].offset)
+			end = mid;
+		else
+			begin = mid + 1;
+	}
+
+	if (!begin)
+		return -pte_nosync;
+
+	*entry = index->entries[begin - 1];
+
+	return (int) (begin - 1);
+}
+
+int pt_psb_index_find_time(const struct pt_psb_index *index, uint64_t tsc,
+			   struct pt_psb_index_entry *entry)
+{
+	uint32_t begin, end;
+
+	if (!index || !entry)
+		return -pte_invalid;
+
+	/* Find the first entry beyond @tsc.  Entries without a TSC are
+	 * treated as if they had the TSC of the preceding entry or zero.
+	 */
+	begin = 0;
+	end = index->nentries;
+	while (begin < end) {
+		const struct pt_psb_index_entry *mid;
+		uint32_t idx;
+
+		idx = begin + ((end - begin) / 2);
+		mid = &index->entries[idx];
+
+		if (mid->has_tsc && (tsc < mid->tsc))
+			end = idx;
+		else
+			begin = idx + 1;
+	}
+
+	/* Skip entries without a TSC. */
+	while (begin && !index->entries[begin - 1].has_tsc)
+		begin -= 1;
+
+	if (!begin)
+		return -pte_no_time;
+
+	*entry = index->entries[begin - 1];
+
+	return (int) (begin - 1);
+}
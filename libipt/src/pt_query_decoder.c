@@ -27,11 +27,11 @@
  */
 
 #include "pt_query_decoder.h"
-#include "pt_sync.h"
 #include "pt_decoder_function.h"
 #include "pt_packet.h"
 #include "pt_packet_decoder.h"
 #include "pt_config.h"
+#include "pt_checkpoint.h"
 
 #include "intel-pt.h"
 
@@ -59,7 +59,7 @@ int pt_qry_decoder_init(struct pt_query_decoder *decoder,
 	pt_tcal_init(&decoder->tcal);
 	pt_evq_init(&decoder->evq);
 
-	return 0;
+	return pt_win_init(&decoder->win, &decoder->config);
 }
 
 struct pt_query_decoder *pt_qry_alloc_decoder(const struct pt_config *config)
@@ -82,9 +82,10 @@ struct pt_query_decoder *pt_qry_alloc_decoder(const struct pt_config *config)
 
 void pt_qry_decoder_fini(struct pt_query_decoder *decoder)
 {
-	(void) decoder;
+	if (!decoder)
+		return;
 
-	/* Nothing to do. */
+	pt_win_fini(&decoder->win);
 }
 
 void pt_qry_free_decoder(struct pt_query_decoder *decoder)
@@ -147,15 +148,17 @@ static int pt_qry_will_eos(const struct pt_query_decoder *decoder)
 	if (dfun)
 		return 0;
 
-	/* The decoding function may be NULL for two reasons:
+	/* The decoding function may be NULL for three reasons:
 	 *
 	 *   - we ran out of trace
+	 *   - we ran into a packet that is cut off at the end of the trace
 	 *   - we ran into a fetch error such as -pte_bad_opc
 	 *
-	 * Let's fetch again.
+	 * Let's fetch again.  Fetching only looks at the opcode so it
+	 * succeeds in the second case.
 	 */
 	errcode = pt_df_fetch(&dfun, decoder->pos, &decoder->config);
-	return errcode == -pte_eos;
+	return !errcode || (errcode == -pte_eos);
 }
 
 static int pt_qry_status_flags(const struct pt_query_decoder *decoder)
@@ -207,14 +210,30 @@ static int pt_qry_provoke_fetch_error(const struct pt_query_decoder *decoder)
 	return -pte_internal;
 }
 
+/* Fetch the decoder function for the packet at @decoder->pos.
+ *
+ * Moves the trace window if fewer than pt_win_lookahead bytes remain.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_qry_fetch(struct pt_query_decoder *decoder)
+{
+	int errcode;
+
+	errcode = pt_win_ensure(&decoder->win, &decoder->config, &decoder->pos);
+	if (errcode < 0)
+		return errcode;
+
+	return pt_df_fetch(&decoder->next, decoder->pos, &decoder->config);
+}
+
 static int pt_qry_read_ahead(struct pt_query_decoder *decoder)
 {
 	for (;;) {
 		const struct pt_decoder_function *dfun;
 		int errcode;
 
-		errcode = pt_df_fetch(&decoder->next, decoder->pos,
-				      &decoder->config);
+		errcode = pt_qry_fetch(decoder);
 		if (errcode)
 			return errcode;
 
@@ -235,28 +254,41 @@ static int pt_qry_read_ahead(struct pt_query_decoder *decoder)
 		if (pt_qry_will_event(decoder))
 			return 0;
 
-		/* Decode status update packets. */
+		/* Decode status update packets.
+		 *
+		 * A packet that is cut off at the end of the trace ends the
+		 * trace for now.  We fetch it again when the trace buffer is
+		 * extended.
+		 */
 		errcode = dfun->decode(decoder);
-		if (errcode)
+		if (errcode) {
+			if (errcode == -pte_eos)
+				decoder->next = NULL;
+
 			return errcode;
+		}
 	}
 }
 
-static int pt_qry_start(struct pt_query_decoder *decoder, const uint8_t *pos,
-			uint64_t *addr)
+/* Reset @decoder and decode the PSB+ header at @pos.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_qry_start_psb(struct pt_query_decoder *decoder,
+			    const uint8_t *pos)
 {
 	const struct pt_decoder_function *dfun;
-	int status, errcode;
+	int errcode;
 
 	if (!decoder || !pos)
 		return -pte_invalid;
 
 	pt_qry_reset(decoder);
 
-	decoder->sync = pos;
+	decoder->sync = pt_win_offset(&decoder->win, &decoder->config, pos);
 	decoder->pos = pos;
 
-	errcode = pt_df_fetch(&decoder->next, pos, &decoder->config);
+	errcode = pt_qry_fetch(decoder);
 	if (errcode)
 		return errcode;
 
@@ -266,8 +298,29 @@ static int pt_qry_start(struct pt_query_decoder *decoder, const uint8_t *pos,
 	if (dfun != &pt_decode_psb)
 		return -pte_nosync;
 
-	/* Decode the PSB+ header to initialize the state. */
+	/* Decode the PSB+ header to initialize the state.
+	 *
+	 * If the header has been cut off, we're not synchronized.  The PSB
+	 * will be found again by pt_qry_sync_forward() once the trace buffer
+	 * has been extended.
+	 */
 	errcode = dfun->decode(decoder);
+	if (errcode < 0) {
+		if (errcode == -pte_eos)
+			decoder->pos = NULL;
+
+		return errcode;
+	}
+
+	return 0;
+}
+
+static int pt_qry_start(struct pt_query_decoder *decoder, const uint8_t *pos,
+			uint64_t *addr)
+{
+	int status, errcode;
+
+	errcode = pt_qry_start_psb(decoder, pos);
 	if (errcode < 0)
 		return errcode;
 
@@ -306,21 +359,27 @@ static int pt_qry_start(struct pt_query_decoder *decoder, const uint8_t *pos,
 
 int pt_qry_sync_forward(struct pt_query_decoder *decoder, uint64_t *ip)
 {
-	const uint8_t *pos, *sync;
+	const uint8_t *sync;
+	uint64_t offset;
 	int errcode;
 
 	if (!decoder)
 		return -pte_invalid;
 
-	sync = decoder->sync;
-	pos = decoder->pos;
-	if (!pos)
-		pos = decoder->config.begin;
+	offset = decoder->sync;
+	if (decoder->pos) {
+		uint64_t pos;
 
-	if (pos == sync)
-		pos += ptps_psb;
+		pos = pt_win_offset(&decoder->win, &decoder->config,
+				    decoder->pos);
+		if (pos == offset)
+			pos += ptps_psb;
 
-	errcode = pt_sync_forward(&sync, pos, &decoder->config);
+		offset = pos;
+	}
+
+	errcode = pt_win_sync_forward(&decoder->win, &decoder->config, &sync,
+				      offset);
 	if (errcode < 0)
 		return errcode;
 
@@ -329,17 +388,19 @@ int pt_qry_sync_forward(struct pt_query_decoder *decoder, uint64_t *ip)
 
 int pt_qry_sync_backward(struct pt_query_decoder *decoder, uint64_t *ip)
 {
-	const uint8_t *pos, *sync;
+	const uint8_t *sync;
+	uint64_t offset;
 	int errcode;
 
 	if (!decoder)
 		return -pte_invalid;
 
-	pos = decoder->sync;
-	if (!pos)
-		pos = decoder->config.end;
+	offset = decoder->sync;
+	if (!decoder->pos)
+		offset = pt_win_size(&decoder->config);
 
-	errcode = pt_sync_backward(&sync, pos, &decoder->config);
+	errcode = pt_win_sync_backward(&decoder->win, &decoder->config, &sync,
+				       offset);
 	if (errcode < 0)
 		return errcode;
 
@@ -349,52 +410,151 @@ int pt_qry_sync_backward(struct pt_query_decoder *decoder, uint64_t *ip)
 int pt_qry_sync_set(struct pt_query_decoder *decoder, uint64_t *ip,
 		    uint64_t offset)
 {
-	const uint8_t *sync, *pos;
+	const uint8_t *sync;
 	int errcode;
 
 	if (!decoder)
 		return -pte_invalid;
 
-	pos = decoder->config.begin + offset;
+	errcode = pt_win_sync_set(&decoder->win, &decoder->config, &sync,
+				  offset);
+	if (errcode < 0)
+		return errcode;
+
+	return pt_qry_start(decoder, sync, ip);
+}
+
+int pt_qry_sync_time(struct pt_query_decoder *decoder, uint64_t *ip,
+		     uint64_t tsc)
+{
+	const uint8_t *sync;
+	uint64_t begin, end, offset;
+	int errcode, have_sync, have_time;
+
+	if (!decoder)
+		return -pte_invalid;
+
+	begin = 0ull;
+	end = pt_win_size(&decoder->config);
+	offset = 0ull;
+	have_sync = 0;
+	have_time = 0;
+
+	/* Binary search for the last PSB whose PSB+ header gives a time at or
+	 * before @tsc.  We probe the first PSB at or after the middle of the
+	 * remaining range and assume the time to be monotonic.
+	 *
+	 * We search in trace offsets since probing may move the window.
+	 */
+	while (begin < end) {
+		const uint8_t *psb;
+		uint64_t pos, psb_offset, time;
+
+		pos = begin + ((end - begin) / 2);
+
+		errcode = pt_win_sync_forward(&decoder->win, &decoder->config,
+					      &psb, pos);
+		if (errcode < 0) {
+			if (errcode != -pte_eos)
+				return errcode;
+
+			end = pos;
+			continue;
+		}
+
+		psb_offset = pt_win_offset(&decoder->win, &decoder->config,
+					   psb);
+		if (end <= psb_offset) {
+			end = pos;
+			continue;
+		}
+
+		/* A PSB without time is treated like a later one.
+		 *
+		 * We only decode the PSB+ header.  Reading ahead might
+		 * pass adjacent PSB+ headers and report a later time.
+		 */
+		errcode = pt_qry_start_psb(decoder, psb);
+		if (errcode >= 0)
+			errcode = pt_qry_time(decoder, &time, NULL, NULL);
+
+		if (errcode < 0 || tsc < time) {
+			have_time |= (errcode >= 0);
+			end = pos;
+			continue;
+		}
+
+		have_time = 1;
+		have_sync = 1;
+		offset = psb_offset;
+		begin = psb_offset + ptps_psb;
+	}
+
+	if (!have_time)
+		return -pte_no_time;
 
-	errcode = pt_sync_set(&sync, pos, &decoder->config);
+	/* If all PSBs are later, we start at the first one. */
+	if (have_sync)
+		errcode = pt_win_sync_set(&decoder->win, &decoder->config,
+					  &sync, offset);
+	else
+		errcode = pt_win_sync_forward(&decoder->win, &decoder->config,
+					      &sync, offset);
 	if (errcode < 0)
 		return errcode;
 
 	return pt_qry_start(decoder, sync, ip);
 }
 
-int pt_qry_get_offset(struct pt_query_decoder *decoder, uint64_t *offset)
+int pt_qry_extend(struct pt_query_decoder *decoder, uint8_t *end)
 {
-	const uint8_t *begin, *pos;
+	int errcode;
 
-	if (!decoder || !offset)
+	if (!decoder)
 		return -pte_invalid;
 
-	begin = decoder->config.begin;
-	pos = decoder->pos;
+	errcode = pt_win_extend(&decoder->win, &decoder->config, end);
+	if (errcode < 0)
+		return errcode;
+
+	/* There is nothing more to do if we're not synchronized, yet. */
+	if (!decoder->pos)
+		return 0;
+
+	/* If we ran out of trace, we continue reading ahead until the next
+	 * query-relevant packet.  We ignore errors; they will be diagnosed in
+	 * the next query.
+	 */
+	if (!decoder->next) {
+		errcode = pt_qry_fetch(decoder);
+		if (!errcode)
+			(void) pt_qry_read_ahead(decoder);
+	}
+
+	return pt_qry_status_flags(decoder);
+}
+
+int pt_qry_get_offset(struct pt_query_decoder *decoder, uint64_t *offset)
+{
+	if (!decoder || !offset)
+		return -pte_invalid;
 
-	if (!pos)
+	if (!decoder->pos)
 		return -pte_nosync;
 
-	*offset = pos - begin;
+	*offset = pt_win_offset(&decoder->win, &decoder->config, decoder->pos);
 	return 0;
 }
 
 int pt_qry_get_sync_offset(struct pt_query_decoder *decoder, uint64_t *offset)
 {
-	const uint8_t *begin, *sync;
-
 	if (!decoder || !offset)
 		return -pte_invalid;
 
-	begin = decoder->config.begin;
-	sync = decoder->sync;
-
-	if (!sync)
+	if (!decoder->pos)
 		return -pte_nosync;
 
-	*offset = sync - begin;
+	*offset = decoder->sync;
 	return 0;
 }
 
@@ -407,6 +567,121 @@ pt_qry_get_config(const struct pt_query_decoder *decoder)
 	return &decoder->config;
 }
 
+int pt_qry_get_state(const struct pt_query_decoder *decoder,
+		     struct pt_qry_state *state)
+{
+	if (!decoder || !state)
+		return -pte_internal;
+
+	if (!decoder->pos)
+		return -pte_nosync;
+
+	memset(state, 0, sizeof(*state));
+
+	state->offset = pt_win_offset(&decoder->win, &decoder->config,
+				      decoder->pos);
+	state->sync = decoder->sync;
+	state->ip = decoder->ip;
+	state->tnt = decoder->tnt;
+	state->time = decoder->time;
+	state->tcal = decoder->tcal;
+	state->evq = decoder->evq;
+	state->enabled = decoder->enabled;
+	state->consume_packet = decoder->consume_packet;
+	state->has_next = decoder->next ? 1 : 0;
+
+	return 0;
+}
+
+int pt_qry_set_state(struct pt_query_decoder *decoder,
+		     const struct pt_qry_state *state)
+{
+	int errcode;
+
+	if (!decoder || !state)
+		return -pte_internal;
+
+	decoder->pos = NULL;
+	decoder->next = NULL;
+	decoder->event = NULL;
+
+	if (pt_win_size(&decoder->config) < state->sync)
+		return -pte_invalid;
+
+	errcode = pt_win_map(&decoder->win, &decoder->config, state->offset,
+			     &decoder->pos);
+	if (errcode < 0) {
+		decoder->pos = NULL;
+		return errcode;
+	}
+
+	decoder->sync = state->sync;
+	decoder->ip = state->ip;
+	decoder->tnt = state->tnt;
+	decoder->time = state->time;
+	decoder->tcal = state->tcal;
+	decoder->evq = state->evq;
+	decoder->enabled = state->enabled;
+	decoder->consume_packet = state->consume_packet;
+
+	/* If the decoder had fetched the next packet, it will do so again.
+	 * Otherwise, we leave it to the next query to diagnose the end of the
+	 * trace or the fetch error.
+	 */
+	if (state->has_next) {
+		errcode = pt_qry_fetch(decoder);
+		if (errcode < 0) {
+			decoder->pos = NULL;
+			decoder->next = NULL;
+			return errcode;
+		}
+	}
+
+	return pt_qry_status_flags(decoder);
+}
+
+int pt_qry_save(const struct pt_query_decoder *decoder, uint8_t *buffer,
+		size_t size)
+{
+	struct pt_checkpoint ckpt;
+	struct pt_qry_state state;
+	int errcode;
+
+	if (!decoder)
+		return -pte_invalid;
+
+	errcode = pt_qry_get_state(decoder, &state);
+	if (errcode < 0)
+		return errcode;
+
+	pt_ckpt_init_write(&ckpt, buffer, size);
+	pt_ckpt_put_header(&ckpt, pck_query);
+	pt_ckpt_put_qry_state(&ckpt, &state);
+
+	return pt_ckpt_end_write(&ckpt);
+}
+
+int pt_qry_restore(struct pt_query_decoder *decoder, const uint8_t *buffer,
+		   size_t size)
+{
+	struct pt_checkpoint ckpt;
+	struct pt_qry_state state;
+	int errcode;
+
+	if (!decoder || !buffer)
+		return -pte_invalid;
+
+	pt_ckpt_init_read(&ckpt, buffer, size);
+	pt_ckpt_get_header(&ckpt, pck_query);
+	pt_ckpt_get_qry_state(&ckpt, &state);
+
+	errcode = pt_ckpt_end_read(&ckpt);
+	if (errcode < 0)
+		return errcode;
+
+	return pt_qry_set_state(decoder, &state);
+}
+
 static int pt_qry_cache_tnt(struct pt_query_decoder *decoder)
 {
 	for (;;) {
@@ -483,6 +758,28 @@ int pt_qry_cond_branch(struct pt_query_decoder *decoder, int *taken)
 	return pt_qry_status_flags(decoder);
 }
 
+int pt_qry_peek_tnt(const struct pt_query_decoder *decoder, uint64_t *tnt)
+{
+	if (!decoder)
+		return -pte_invalid;
+
+	return pt_tnt_cache_peek(&decoder->tnt, tnt);
+}
+
+int pt_qry_skip_tnt(struct pt_query_decoder *decoder, uint8_t count)
+{
+	int errcode;
+
+	if (!decoder)
+		return -pte_invalid;
+
+	errcode = pt_tnt_cache_skip(&decoder->tnt, count);
+	if (errcode < 0)
+		return errcode;
+
+	return pt_qry_status_flags(decoder);
+}
+
 int pt_qry_indirect_branch(struct pt_query_decoder *decoder, uint64_t *addr)
 {
 	int errcode, flags;
@@ -697,8 +994,7 @@ static int pt_qry_read_psb_header(struct pt_query_decoder *decoder)
 		const struct pt_decoder_function *dfun;
 		int errcode;
 
-		errcode = pt_df_fetch(&decoder->next, decoder->pos,
-				      &decoder->config);
+		errcode = pt_qry_fetch(decoder);
 		if (errcode)
 			return errcode;
 
@@ -721,17 +1017,39 @@ static int pt_qry_read_psb_header(struct pt_query_decoder *decoder)
 
 int pt_qry_decode_psb(struct pt_query_decoder *decoder)
 {
+	struct pt_time time;
+	struct pt_time_cal tcal;
+	uint64_t offset;
 	int size, errcode;
 
 	size = pt_pkt_read_psb(decoder->pos, &decoder->config);
 	if (size < 0)
 		return size;
 
+	/* The PSB+ header may be cut off at the end of the trace buffer.  We
+	 * preserve the state it modifies so we can decode it again once the
+	 * buffer has been extended.
+	 */
+	time = decoder->time;
+	tcal = decoder->tcal;
+	offset = pt_win_offset(&decoder->win, &decoder->config, decoder->pos);
+
 	decoder->pos += size;
 
 	errcode = pt_qry_read_psb_header(decoder);
-	if (errcode < 0)
+	if (errcode < 0) {
+		if (errcode == -pte_eos) {
+			(void) pt_evq_clear(&decoder->evq, evb_psbend);
+
+			decoder->time = time;
+			decoder->tcal = tcal;
+
+			(void) pt_win_map(&decoder->win, &decoder->config,
+					  offset, &decoder->pos);
+		}
+
 		return errcode;
+	}
 
 	/* The next packet following the PSB header will be of type PSBEND.
 	 *
@@ -1066,20 +1384,27 @@ static int scan_for_erratum_bdm70(struct pt_packet_decoder *decoder)
 	}
 }
 
-static int check_erratum_bdm70(const uint8_t *pos,
+static int check_erratum_bdm70(uint64_t offset,
 			       const struct pt_config *config)
 {
 	struct pt_packet_decoder decoder;
+	struct pt_config pconfig;
 	int errcode;
 
-	if (!pos || !config)
+	if (!config)
 		return -pte_internal;
 
-	errcode = pt_pkt_decoder_init(&decoder, config);
+	/* We only scan the rest of the PSB+ header.  There's no need to read
+	 * a big window if the trace is read on demand.
+	 */
+	pconfig = *config;
+	pconfig.source.window = pt_win_bounce_size;
+
+	errcode = pt_pkt_decoder_init(&decoder, &pconfig);
 	if (errcode < 0)
 		return errcode;
 
-	errcode = pt_pkt_sync_set(&decoder, (uint64_t) (pos - config->begin));
+	errcode = pt_pkt_sync_set(&decoder, offset);
 	if (errcode >= 0)
 		errcode = scan_for_erratum_bdm70(&decoder);
 
@@ -1097,8 +1422,12 @@ int pt_qry_header_fup(struct pt_query_decoder *decoder)
 		return size;
 
 	if (decoder->config.errata.bdm70 && !decoder->enabled) {
-		errcode = check_erratum_bdm70(decoder->pos + size,
-					      &decoder->config);
+		uint64_t offset;
+
+		offset = pt_win_offset(&decoder->win, &decoder->config,
+				       decoder->pos + size);
+
+		errcode = check_erratum_bdm70(offset, &decoder->config);
 		if (errcode < 0)
 			return errcode;
 
@@ -1316,8 +1645,7 @@ static int pt_qry_read_ahead_while(struct pt_query_decoder *decoder,
 		const struct pt_decoder_function *dfun;
 		int errcode;
 
-		errcode = pt_df_fetch(&decoder->next, decoder->pos,
-				      &decoder->config);
+		errcode = pt_qry_fetch(decoder);
 		if (errcode < 0)
 			return errcode;
 
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pt_sblock_cache.h"
+#include "pt_image.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+void pt_sblock_cache_init(struct pt_sblock_cache *cache)
+{
+	if (!cache)
+		return;
+
+	memset(cache, 0, sizeof(*cache));
+}
+
+void pt_sblock_cache_fini(struct pt_sblock_cache *cache)
+{
+	if (!cache)
+		return;
+
+	free(cache->entries);
+
+	memset(cache, 0, sizeof(*cache));
+}
+
+void pt_sblock_cache_clear(struct pt_sblock_cache *cache)
+{
+	uint32_t idx;
+
+	if (!cache || !cache->entries)
+		return;
+
+	for (idx = 0; idx < pt_sblock_cache_size; ++idx)
+		cache->entries[idx].valid = 0;
+}
+
+static uint32_t pt_sblock_cache_index(const struct pt_asid *asid, uint64_t ip,
+				      uint64_t tnt, uint8_t ntnt)
+{
+	uint64_t key;
+
+	key = ip ^ (ip >> 12) ^ (asid->cr3 >> 12) ^ ntnt;
+	key ^= tnt ^ (tnt >> 8) ^ (tnt >> 16) ^ (tnt >> 32);
+
+	return (uint32_t) (key & (pt_sblock_cache_size - 1));
+}
+
+const struct pt_sblock_cache_entry *
+pt_sblock_cache_lookup(struct pt_sblock_cache *cache,
+		       const struct pt_image *image,
+		       const struct pt_asid *asid, enum pt_exec_mode mode,
+		       uint64_t ip, uint64_t tnt, uint8_t ntnt)
+{
+	const struct pt_sblock_cache_entry *entry;
+
+	if (!cache || !image || !asid)
+		return NULL;
+
+	if (!cache->entries || (cache->image != image)) {
+		cache->misses += 1;
+		return NULL;
+	}
+
+	entry = &cache->entries[pt_sblock_cache_index(asid, ip, tnt, ntnt)];
+	if (!entry->valid || (entry->ip != ip) ||
+	    (entry->tnt != tnt) || (entry->ntnt != ntnt) ||
+	    (entry->generation != image->mgeneration) ||
+	    (entry->mode != (uint8_t) mode) ||
+	    (entry->asid.cr3 != asid->cr3) ||
+	    (entry->asid.vmcs != asid->vmcs)) {
+		cache->misses += 1;
+		return NULL;
+	}
+
+	cache->hits += 1;
+
+	return entry;
+}
+
+int pt_sblock_cache_add(struct pt_sblock_cache *cache,
+			const struct pt_image *image,
+			const struct pt_sblock_cache_entry *sblock)
+{
+	struct pt_sblock_cache_entry *entry;
+	uint32_t idx;
+
+	if (!cache || !image || !sblock)
+		return -pte_internal;
+
+	if (sblock->ntnt < sblock->nused)
+		return -pte_internal;
+
+	if (!cache->entries) {
+		cache->entries = calloc(pt_sblock_cache_size,
+					sizeof(*cache->entries));
+		if (!cache->entries)
+			return -pte_nomem;
+	}
+
+	/* Entries for a different image are useless. */
+	if (cache->image != image) {
+		pt_sblock_cache_clear(cache);
+		cache->image = image;
+	}
+
+	idx = pt_sblock_cache_index(&sblock->asid, sblock->ip, sblock->tnt,
+				    sblock->ntnt);
+	entry = &cache->entries[idx];
+
+	*entry = *sblock;
+	entry->generation = image->mgeneration;
+	entry->valid = 1;
+
+	return 0;
+}
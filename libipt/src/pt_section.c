@@ -27,6 +27,8 @@
  */
 
 #include "pt_section.h"
+#include "pt_section_registry.h"
+#include "pt_block_map.h"
 
 #include "intel-pt.h"
 
@@ -51,21 +53,21 @@ static char *dupstr(const char *str)
 	return strcpy(dup, str);
 }
 
-struct pt_section *pt_mk_section(const char *filename, uint64_t offset,
-				 uint64_t size)
+/* Create a section for @filename with file status @status.
+ *
+ * The new section takes ownership of @status on success.
+ *
+ * Returns a new section on success, NULL otherwise.
+ */
+static struct pt_section *pt_mk_section_owned(const char *filename,
+					      uint64_t offset, uint64_t size,
+					      void *status, uint64_t fsize)
 {
 	struct pt_section *section;
-	uint64_t fsize;
-	void *status;
-	int errcode;
-
-	errcode = pt_section_mk_status(&status, &fsize, filename);
-	if (errcode < 0)
-		return NULL;
 
 	/* Fail if the requested @offset lies beyond the end of @file. */
 	if (fsize <= offset)
-		goto out_status;
+		return NULL;
 
 	/* Truncate @size so the entire range lies within @file. */
 	fsize -= offset;
@@ -74,7 +76,7 @@ struct pt_section *pt_mk_section(const char *filename, uint64_t offset,
 
 	section = malloc(sizeof(*section));
 	if (!section)
-		goto out_status;
+		return NULL;
 
 	memset(section, 0, sizeof(*section));
 
@@ -85,21 +87,60 @@ struct pt_section *pt_mk_section(const char *filename, uint64_t offset,
 	section->ucount = 1;
 
 #if defined(FEATURE_THREADS)
+	{
+		int errcode;
 
-	errcode = mtx_init(&section->lock, mtx_plain);
-	if (errcode != thrd_success) {
-		free(section->filename);
-		free(section);
-		goto out_status;
+		errcode = mtx_init(&section->lock, mtx_plain);
+		if (errcode != thrd_success) {
+			free(section->filename);
+			free(section);
+			return NULL;
+		}
 	}
-
 #endif /* defined(FEATURE_THREADS) */
 
 	return section;
+}
+
+struct pt_section *pt_mk_section(const char *filename, uint64_t offset,
+				 uint64_t size)
+{
+	struct pt_section *section;
+	uint64_t fsize;
+	void *status;
+	int errcode;
+
+	errcode = pt_section_mk_status(&status, &fsize, filename);
+	if (errcode < 0)
+		return NULL;
+
+	section = pt_mk_section_owned(filename, offset, size, status, fsize);
+	if (!section)
+		free(status);
+
+	return section;
+}
+
+struct pt_section *pt_mk_section_status(const char *filename, uint64_t offset,
+					uint64_t size, const void *status,
+					uint64_t fsize)
+{
+	struct pt_section *section;
+	void *copy;
+	int errcode;
+
+	if (!filename)
+		return NULL;
+
+	errcode = pt_section_dup_status(&copy, status);
+	if (errcode < 0)
+		return NULL;
+
+	section = pt_mk_section_owned(filename, offset, size, copy, fsize);
+	if (!section)
+		free(copy);
 
-out_status:
-	free(status);
-	return NULL;
+	return section;
 }
 
 int pt_section_lock(struct pt_section *section)
@@ -149,6 +190,7 @@ static void pt_section_free(struct pt_section *section)
 
 #endif /* defined(FEATURE_THREADS) */
 
+	pt_bmap_free(section->bmap);
 	free(section->filename);
 	free(section->status);
 	free(section);
@@ -156,7 +198,7 @@ static void pt_section_free(struct pt_section *section)
 
 int pt_section_get(struct pt_section *section)
 {
-	uint16_t ucount;
+	uint32_t ucount;
 	int errcode;
 
 	if (!section)
@@ -179,7 +221,8 @@ int pt_section_get(struct pt_section *section)
 
 int pt_section_put(struct pt_section *section)
 {
-	uint16_t ucount, mcount;
+	uint32_t ucount;
+	uint16_t mcount;
 	int errcode;
 
 	if (!section)
@@ -196,6 +239,12 @@ int pt_section_put(struct pt_section *section)
 		return pt_section_unlock(section);
 	}
 
+	/* Mark the section dead so the section registry won't hand it out
+	 * again while we remove it.
+	 */
+	if (ucount && !mcount)
+		section->ucount = 0;
+
 	errcode = pt_section_unlock(section);
 	if (errcode < 0)
 		return errcode;
@@ -203,6 +252,12 @@ int pt_section_put(struct pt_section *section)
 	if (!ucount || mcount)
 		return -pte_internal;
 
+	if (section->registered) {
+		errcode = pt_section_registry_remove(section);
+		if (errcode < 0)
+			return errcode;
+	}
+
 	pt_section_free(section);
 	return 0;
 }
@@ -223,6 +278,52 @@ uint64_t pt_section_size(const struct pt_section *section)
 	return section->size;
 }
 
+const struct pt_block_map *pt_section_bmap(struct pt_section *section)
+{
+	const struct pt_block_map *bmap;
+	int errcode;
+
+	if (!section)
+		return NULL;
+
+	errcode = pt_section_lock(section);
+	if (errcode < 0)
+		return NULL;
+
+	bmap = section->bmap;
+
+	errcode = pt_section_unlock(section);
+	if (errcode < 0)
+		return NULL;
+
+	return bmap;
+}
+
+int pt_section_attach_bmap(struct pt_section *section,
+			   struct pt_block_map *bmap)
+{
+	int errcode, status;
+
+	if (!section || !bmap)
+		return -pte_internal;
+
+	errcode = pt_section_lock(section);
+	if (errcode < 0)
+		return errcode;
+
+	status = 1;
+	if (!section->bmap) {
+		section->bmap = bmap;
+		status = 0;
+	}
+
+	errcode = pt_section_unlock(section);
+	if (errcode < 0)
+		return errcode;
+
+	return status;
+}
+
 int pt_section_unmap(struct pt_section *section)
 {
 	uint16_t mcount;
@@ -273,3 +374,18 @@ int pt_section_read(const struct pt_section *section, uint8_t *buffer,
 
 	return section->read(section, buffer, size, offset);
 }
+
+int pt_section_fetch(const struct pt_section *section, const uint8_t **pbegin,
+		     uint16_t size, uint64_t offset)
+{
+	if (!section || !pbegin)
+		return -pte_internal;
+
+	if (!section->read)
+		return -pte_nomap;
+
+	if (!section->fetch)
+		return -pte_not_supported;
+
+	return section->fetch(section, pbegin, size, offset);
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "pt_section.h"
+#include "pt_section_buffer.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+struct pt_section *pt_mk_section_buffer(const uint8_t *buffer, uint64_t size,
+					int copy)
+{
+	struct pt_sec_buffer_status *status;
+	struct pt_section *section;
+	size_t ssize;
+
+	if (!buffer || !size)
+		return NULL;
+
+	/* The read and fetch functions compute offsets into @buffer. */
+	if ((uint64_t) (size_t) size != size)
+		return NULL;
+
+	ssize = sizeof(*status);
+	if (copy) {
+		ssize += (size_t) size;
+		if (ssize < size)
+			return NULL;
+	}
+
+	status = malloc(ssize);
+	if (!status)
+		return NULL;
+
+	status->begin = buffer;
+	if (copy) {
+		uint8_t *data;
+
+		data = (uint8_t *) &status[1];
+		memcpy(data, buffer, (size_t) size);
+
+		status->begin = data;
+	}
+
+	section = malloc(sizeof(*section));
+	if (!section)
+		goto out_status;
+
+	memset(section, 0, sizeof(*section));
+
+	section->status = status;
+	section->size = size;
+	section->ucount = 1;
+
+#if defined(FEATURE_THREADS)
+	{
+		int errcode;
+
+		errcode = mtx_init(&section->lock, mtx_plain);
+		if (errcode != thrd_success) {
+			free(section);
+			goto out_status;
+		}
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	return section;
+
+out_status:
+	free(status);
+	return NULL;
+}
+
+int pt_sec_buffer_map(struct pt_section *section)
+{
+	if (!section)
+		return -pte_internal;
+
+	if (section->filename || !section->status || section->mapping)
+		return -pte_internal;
+
+	/* The buffer status doubles as mapping. */
+	section->mapping = section->status;
+	section->unmap = pt_sec_buffer_unmap;
+	section->read = pt_sec_buffer_read;
+	section->fetch = pt_sec_buffer_fetch;
+
+	return 0;
+}
+
+int pt_sec_buffer_unmap(struct pt_section *section)
+{
+	if (!section)
+		return -pte_internal;
+
+	if (!section->mapping || !section->unmap || !section->read)
+		return -pte_internal;
+
+	section->mapping = NULL;
+	section->unmap = NULL;
+	section->read = NULL;
+	section->fetch = NULL;
+
+	return 0;
+}
+
+int pt_sec_buffer_read(const struct pt_section *section, uint8_t *buffer,
+		       uint16_t size, uint64_t offset)
+{
+	const uint8_t *begin;
+	int bytes;
+
+	if (!buffer || !section)
+		return -pte_invalid;
+
+	bytes = pt_sec_buffer_fetch(section, &begin, size, offset);
+	if (bytes < 0)
+		return bytes;
+
+	memcpy(buffer, begin, bytes);
+	return bytes;
+}
+
+int pt_sec_buffer_fetch(const struct pt_section *section,
+			const uint8_t **pbegin, uint16_t size, uint64_t offset)
+{
+	const struct pt_sec_buffer_status *mapping;
+	uint64_t left;
+
+	if (!pbegin || !section)
+		return -pte_internal;
+
+	mapping = section->mapping;
+	if (!mapping)
+		return -pte_internal;
+
+	if (section->size <= offset)
+		return -pte_nomap;
+
+	left = section->size - offset;
+	if (left < size)
+		size = (uint16_t) left;
+
+	*pbegin = mapping->begin + offset;
+	return (int) size;
+}
@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pt_section_cache.h"
+#include "pt_section.h"
+
+#include "intel-pt.h"
+
+#include <string.h>
+
+
+/* The process-wide section cache. */
+static struct pt_section_cache pt_scache = {
+	.limit = pt_section_cache_default_limit
+};
+
+#if defined(FEATURE_THREADS)
+
+static once_flag pt_scache_once = ONCE_FLAG_INIT;
+static int pt_scache_lock_status;
+
+static void pt_scache_init_lock(void)
+{
+	pt_scache_lock_status = mtx_init(&pt_scache.lock, mtx_plain);
+}
+
+#endif /* defined(FEATURE_THREADS) */
+
+static int pt_scache_lock(struct pt_section_cache *scache)
+{
+	if (!scache)
+		return -pte_internal;
+
+#if defined(FEATURE_THREADS)
+	{
+		int errcode;
+
+		call_once(&pt_scache_once, pt_scache_init_lock);
+		if (pt_scache_lock_status != thrd_success)
+			return -pte_bad_lock;
+
+		errcode = mtx_lock(&scache->lock);
+		if (errcode != thrd_success)
+			return -pte_bad_lock;
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	return 0;
+}
+
+static int pt_scache_unlock(struct pt_section_cache *scache)
+{
+	if (!scache)
+		return -pte_internal;
+
+#if defined(FEATURE_THREADS)
+	{
+		int errcode;
+
+		errcode = mtx_unlock(&scache->lock);
+		if (errcode != thrd_success)
+			return -pte_bad_lock;
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	return 0;
+}
+
+/* Unlink @section from @scache's LRU list.  The cache must be locked. */
+static void pt_scache_unlink(struct pt_section_cache *scache,
+			     struct pt_section *section)
+{
+	struct pt_section *prev, *next;
+
+	prev = section->lru_prev;
+	next = section->lru_next;
+
+	if (prev)
+		prev->lru_next = next;
+	else
+		scache->head = next;
+
+	if (next)
+		next->lru_prev = prev;
+	else
+		scache->tail = prev;
+
+	section->lru_prev = NULL;
+	section->lru_next = NULL;
+}
+
+/* Make @section the most recently used one.  The cache must be locked. */
+static void pt_scache_push(struct pt_section_cache *scache,
+			   struct pt_section *section)
+{
+	struct pt_section *head;
+
+	head = scache->head;
+
+	section->lru_prev = NULL;
+	section->lru_next = head;
+
+	if (head)
+		head->lru_prev = section;
+	else
+		scache->tail = section;
+
+	scache->head = section;
+}
+
+/* Evict the least recently used sections until @scache is within its
+ * memory budget.  The cache must be locked.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_scache_prune(struct pt_section_cache *scache)
+{
+	while (scache->limit < scache->size) {
+		struct pt_section *section;
+		int errcode;
+
+		section = scache->tail;
+		if (!section || !scache->nsections)
+			return -pte_internal;
+
+		pt_scache_unlink(scache, section);
+		section->cached = 0;
+
+		scache->size -= pt_section_size(section);
+		scache->nsections -= 1;
+		scache->evictions += 1;
+
+		errcode = pt_section_unmap(section);
+		if (errcode < 0)
+			return errcode;
+
+		errcode = pt_section_put(section);
+		if (errcode < 0)
+			return errcode;
+	}
+
+	return 0;
+}
+
+/* Add @section to @scache.  The cache must be locked and @section must be
+ * mapped.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_scache_add(struct pt_section_cache *scache,
+			 struct pt_section *section)
+{
+	uint64_t size;
+	int errcode;
+
+	size = pt_section_size(section);
+	if (scache->limit < size)
+		return 0;
+
+	errcode = pt_section_get(section);
+	if (errcode < 0)
+		return errcode;
+
+	/* This does not actually map @section again. */
+	errcode = pt_section_map(section);
+	if (errcode < 0) {
+		(void) pt_section_put(section);
+		return errcode;
+	}
+
+	pt_scache_push(scache, section);
+	section->cached = 1;
+
+	scache->size += size;
+	scache->nsections += 1;
+
+	return pt_scache_prune(scache);
+}
+
+int pt_section_cache_map(struct pt_section *section)
+{
+	struct pt_section_cache *scache;
+	int errcode, status;
+
+	if (!section)
+		return -pte_internal;
+
+	/* Memory buffer sections are always in memory.  There's nothing
+	 * to be gained by caching their mappings.
+	 */
+	if (!section->filename)
+		return pt_section_map(section);
+
+	scache = &pt_scache;
+
+	errcode = pt_scache_lock(scache);
+	if (errcode < 0)
+		return errcode;
+
+	if (section->cached) {
+		scache->hits += 1;
+
+		if (scache->head != section) {
+			pt_scache_unlink(scache, section);
+			pt_scache_push(scache, section);
+		}
+
+		/* The cache holds a mapping so this is cheap. */
+		status = pt_section_map(section);
+
+		errcode = pt_scache_unlock(scache);
+		if (errcode < 0)
+			return errcode;
+
+		return status;
+	}
+
+	scache->misses += 1;
+
+	errcode = pt_scache_unlock(scache);
+	if (errcode < 0)
+		return errcode;
+
+	/* Map the section without holding the cache lock. */
+	errcode = pt_section_map(section);
+	if (errcode < 0)
+		return errcode;
+
+	errcode = pt_scache_lock(scache);
+	if (errcode < 0)
+		goto out_unmap;
+
+	/* Someone else may have added @section in the meantime. */
+	if (section->cached) {
+		if (scache->head != section) {
+			pt_scache_unlink(scache, section);
+			pt_scache_push(scache, section);
+		}
+
+		status = 0;
+	} else
+		status = pt_scache_add(scache, section);
+
+	errcode = pt_scache_unlock(scache);
+	if (errcode < 0)
+		goto out_unmap;
+
+	if (status < 0) {
+		errcode = status;
+		goto out_unmap;
+	}
+
+	return 0;
+
+out_unmap:
+	(void) pt_section_unmap(section);
+	return errcode;
+}
+
+int pt_section_cache_set_limit(uint64_t limit)
+{
+	struct pt_section_cache *scache;
+	int errcode, status;
+
+	scache = &pt_scache;
+
+	errcode = pt_scache_lock(scache);
+	if (errcode < 0)
+		return errcode;
+
+	scache->limit = limit;
+
+	status = pt_scache_prune(scache);
+
+	errcode = pt_scache_unlock(scache);
+	if (errcode < 0)
+		return errcode;
+
+	return status;
+}
+
+int pt_section_cache_get_stats(struct pt_section_cache_stats *stats)
+{
+	struct pt_section_cache *scache;
+	int errcode;
+
+	if (!stats)
+		return -pte_invalid;
+
+	scache = &pt_scache;
+
+	errcode = pt_scache_lock(scache);
+	if (errcode < 0)
+		return errcode;
+
+	memset(stats, 0, sizeof(*stats));
+
+	stats->limit = scache->limit;
+	stats->size = scache->size;
+	stats->hits = scache->hits;
+	stats->misses = scache->misses;
+	stats->evictions = scache->evictions;
+	stats->nsections = scache->nsections;
+
+	return pt_scache_unlock(scache);
+}
@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pt_section_registry.h"
+#include "pt_section.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/* The process-wide section registry. */
+static struct pt_section_registry pt_sreg;
+
+#if defined(FEATURE_THREADS)
+
+static once_flag pt_sreg_once = ONCE_FLAG_INIT;
+static int pt_sreg_lock_status;
+
+static void pt_sreg_init_lock(void)
+{
+	pt_sreg_lock_status = mtx_init(&pt_sreg.lock, mtx_plain);
+}
+
+#endif /* defined(FEATURE_THREADS) */
+
+static int pt_sreg_lock(struct pt_section_registry *sreg)
+{
+	if (!sreg)
+		return -pte_internal;
+
+#if defined(FEATURE_THREADS)
+	{
+		int errcode;
+
+		call_once(&pt_sreg_once, pt_sreg_init_lock);
+		if (pt_sreg_lock_status != thrd_success)
+			return -pte_bad_lock;
+
+		errcode = mtx_lock(&sreg->lock);
+		if (errcode != thrd_success)
+			return -pte_bad_lock;
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	return 0;
+}
+
+static int pt_sreg_unlock(struct pt_section_registry *sreg)
+{
+	if (!sreg)
+		return -pte_internal;
+
+#if defined(FEATURE_THREADS)
+	{
+		int errcode;
+
+		errcode = mtx_unlock(&sreg->lock);
+		if (errcode != thrd_success)
+			return -pte_bad_lock;
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	return 0;
+}
+
+/* Hash a section's file name, offset, and size. */
+static uint32_t pt_sreg_hash(const struct pt_section *section)
+{
+	const char *name;
+	uint64_t hash;
+
+	/* This is FNV-1a over the file name mixed with offset and size. */
+	hash = 0xcbf29ce484222325ull;
+	for (name = section->filename; name && *name; ++name) {
+		hash ^= (uint8_t) *name;
+		hash *= 0x100000001b3ull;
+	}
+
+	hash ^= section->offset;
+	hash *= 0x9e3779b97f4a7c15ull;
+	hash ^= section->size;
+	hash *= 0x9e3779b97f4a7c15ull;
+
+	return (uint32_t) (hash >> 32);
+}
+
+/* Check whether two sections describe the same part of the same file.
+ *
+ * Returns a positive number if they do, zero if they don't, and a negative
+ * error code otherwise.
+ */
+static int pt_sreg_match(const struct pt_section *lhs,
+			 const struct pt_section *rhs)
+{
+	if (!lhs || !rhs)
+		return -pte_internal;
+
+	if (lhs->offset != rhs->offset)
+		return 0;
+
+	if (lhs->size != rhs->size)
+		return 0;
+
+	if (!lhs->filename || !rhs->filename)
+		return 0;
+
+	if (strcmp(lhs->filename, rhs->filename) != 0)
+		return 0;
+
+	return pt_section_match_status(lhs->status, rhs->status);
+}
+
+/* Add a user to a section unless it is already dead.
+ *
+ * Returns a positive number if a user was added, zero if @section is dead,
+ * a negative error code otherwise.
+ */
+static int pt_sreg_get_live(struct pt_section *section)
+{
+	uint32_t ucount;
+	int errcode;
+
+	errcode = pt_section_lock(section);
+	if (errcode < 0)
+		return errcode;
+
+	ucount = section->ucount;
+	if (ucount) {
+		ucount += 1;
+		if (ucount)
+			section->ucount = ucount;
+		else
+			errcode = -pte_internal;
+	}
+
+	if (errcode < 0) {
+		(void) pt_section_unlock(section);
+		return errcode;
+	}
+
+	errcode = pt_section_unlock(section);
+	if (errcode < 0)
+		return errcode;
+
+	return ucount ? 1 : 0;
+}
+
+/* Grow the registry's hash table.  The registry must be locked.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_sreg_grow(struct pt_section_registry *sreg)
+{
+	struct pt_section **buckets;
+	uint32_t nbuckets, bucket;
+
+	nbuckets = sreg->nbuckets ? sreg->nbuckets << 1 : 64;
+	if (nbuckets <= sreg->nbuckets)
+		return -pte_nomem;
+
+	buckets = calloc(nbuckets, sizeof(*buckets));
+	if (!buckets)
+		return -pte_nomem;
+
+	for (bucket = 0; bucket < sreg->nbuckets; ++bucket) {
+		struct pt_section *section;
+
+		section = sreg->buckets[bucket];
+		while (section) {
+			struct pt_section *next;
+			uint32_t pos;
+
+			next = section->reg_next;
+			pos = pt_sreg_hash(section) & (nbuckets - 1);
+
+			section->reg_next = buckets[pos];
+			buckets[pos] = section;
+
+			section = next;
+		}
+	}
+
+	free(sreg->buckets);
+	sreg->buckets = buckets;
+	sreg->nbuckets = nbuckets;
+
+	return 0;
+}
+
+/* Find a live section matching @section in @sreg and add a user.
+ *
+ * The registry must be locked.
+ *
+ * Returns a positive number and provides the section in @pfound if one was
+ * found, zero if none was found, a negative error code otherwise.
+ */
+static int pt_sreg_find(struct pt_section_registry *sreg,
+			struct pt_section **pfound,
+			const struct pt_section *section)
+{
+	struct pt_section *entry;
+	uint32_t bucket;
+
+	if (!sreg->nbuckets)
+		return 0;
+
+	bucket = pt_sreg_hash(section) & (sreg->nbuckets - 1);
+	for (entry = sreg->buckets[bucket]; entry; entry = entry->reg_next) {
+		int status;
+
+		status = pt_sreg_match(entry, section);
+		if (status <= 0) {
+			if (status < 0)
+				return status;
+
+			continue;
+		}
+
+		/* A dead section is on its way out; we skip it and
+		 * register @section, instead.
+		 */
+		status = pt_sreg_get_live(entry);
+		if (status <= 0) {
+			if (status < 0)
+				return status;
+
+			continue;
+		}
+
+		*pfound = entry;
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Register @section in @sreg.  The registry must be locked.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_sreg_insert(struct pt_section_registry *sreg,
+			  struct pt_section *section)
+{
+	uint32_t bucket;
+
+	/* We keep the load factor below two. */
+	if ((sreg->nbuckets << 1) <= sreg->nsections) {
+		int errcode;
+
+		errcode = pt_sreg_grow(sreg);
+		if ((errcode < 0) && !sreg->nbuckets)
+			return errcode;
+	}
+
+	bucket = pt_sreg_hash(section) & (sreg->nbuckets - 1);
+
+	section->reg_next = sreg->buckets[bucket];
+	section->registered = 1;
+
+	sreg->buckets[bucket] = section;
+	sreg->nsections += 1;
+
+	return 0;
+}
+
+/* Register @section unless there already is a matching section.
+ *
+ * Returns the registered section with an additional user on success and
+ * frees @section if a matching section had been registered before.
+ * Returns @section if it can't be registered.
+ */
+static struct pt_section *pt_sreg_get(struct pt_section *section)
+{
+	struct pt_section_registry *sreg;
+	struct pt_section *found;
+	int errcode, status;
+
+	sreg = &pt_sreg;
+
+	errcode = pt_sreg_lock(sreg);
+	if (errcode < 0)
+		return section;
+
+	found = NULL;
+	status = pt_sreg_find(sreg, &found, section);
+	if (!status)
+		status = pt_sreg_insert(sreg, section);
+
+	(void) pt_sreg_unlock(sreg);
+
+	/* We use @section, registered or not, unless we found a match. */
+	if (status <= 0)
+		return section;
+
+	(void) pt_section_put(section);
+	return found;
+}
+
+struct pt_section *pt_section_registry_get(const char *filename,
+					   uint64_t offset, uint64_t size)
+{
+	struct pt_section *section;
+
+	/* We create a new section to learn about the file's status and about
+	 * the truncated size.  It will be freed if we find a match.
+	 */
+	section = pt_mk_section(filename, offset, size);
+	if (!section)
+		return NULL;
+
+	return pt_sreg_get(section);
+}
+
+struct pt_section *pt_section_registry_get_status(const char *filename,
+						  uint64_t offset,
+						  uint64_t size,
+						  const void *status,
+						  uint64_t fsize)
+{
+	struct pt_section *section;
+
+	section = pt_mk_section_status(filename, offset, size, status, fsize);
+	if (!section)
+		return NULL;
+
+	return pt_sreg_get(section);
+}
+
+int pt_section_registry_remove(struct pt_section *section)
+{
+	struct pt_section_registry *sreg;
+	struct pt_section **pentry;
+	uint32_t bucket;
+	int errcode;
+
+	if (!section)
+		return -pte_internal;
+
+	sreg = &pt_sreg;
+
+	errcode = pt_sreg_lock(sreg);
+	if (errcode < 0)
+		return errcode;
+
+	errcode = -pte_internal;
+	if (!section->registered || !sreg->nbuckets)
+		goto out_unlock;
+
+	bucket = pt_sreg_hash(section) & (sreg->nbuckets - 1);
+	for (pentry = &sreg->buckets[bucket]; *pentry;
+	     pentry = &(*pentry)->reg_next) {
+		if (*pentry != section)
+			continue;
+
+		*pentry = section->reg_next;
+
+		section->reg_next = NULL;
+		section->registered = 0;
+		sreg->nsections -= 1;
+
+		errcode = 0;
+		break;
+	}
+
+out_unlock:
+	if (errcode < 0) {
+		(void) pt_sreg_unlock(sreg);
+		return errcode;
+	}
+
+	return pt_sreg_unlock(sreg);
+}
@@ -64,6 +64,47 @@ int pt_tnt_cache_query(struct pt_tnt_cache *cache)
 	return taken;
 }
 
+int pt_tnt_cache_peek(const struct pt_tnt_cache *cache, uint64_t *tnt)
+{
+	uint64_t index;
+	int count;
+
+	if (!cache || !tnt)
+		return -pte_invalid;
+
+	index = cache->index;
+	if (!index) {
+		*tnt = 0ull;
+		return 0;
+	}
+
+	/* The mask wraps around to all ones for a full cache. */
+	*tnt = cache->tnt & ((index << 1) - 1ull);
+
+	for (count = 0; index; index >>= 1)
+		count += 1;
+
+	return count;
+}
+
+int pt_tnt_cache_skip(struct pt_tnt_cache *cache, uint8_t count)
+{
+	if (!cache)
+		return -pte_invalid;
+
+	if (!count)
+		return 0;
+
+	if (count > 64 || (cache->index >> (count - 1)) == 0ull)
+		return -pte_bad_query;
+
+	/* Avoid shifting by the full width. */
+	cache->index >>= count - 1;
+	cache->index >>= 1;
+
+	return 0;
+}
+
 int pt_tnt_cache_update_tnt(struct pt_tnt_cache *cache,
 			    const struct pt_packet_tnt *packet,
 			    const struct pt_config *config)
@@ -0,0 +1,528 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pt_window.h"
+#include "pt_sync.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+
+static uint64_t pt_win_seg_size(const struct pt_segment *segment)
+{
+	return (uint64_t) (segment->end - segment->begin);
+}
+
+/* Check whether @config's begin and end describe a window that moves. */
+static int pt_win_is_moving(const struct pt_config *config)
+{
+	return config->source.read || config->segments;
+}
+
+int pt_win_init(struct pt_window *win, struct pt_config *config)
+{
+	const uint8_t *pos;
+	int errcode;
+
+	if (!win || !config)
+		return -pte_internal;
+
+	memset(win, 0, sizeof(*win));
+
+	if (config->source.read) {
+		uint64_t capacity;
+
+		capacity = config->source.window;
+		if (!capacity)
+			capacity = pt_win_source_size;
+
+		/* There is no need to allocate more than the entire trace. */
+		if (config->source.size < capacity)
+			capacity = config->source.size;
+
+		if (capacity < pt_win_bounce_size)
+			capacity = pt_win_bounce_size;
+
+		win->buffer = malloc((size_t) capacity);
+		if (!win->buffer)
+			return -pte_nomem;
+
+		win->capacity = (uint32_t) capacity;
+
+		/* Start with an empty window. */
+		win->base = pt_win_size(config);
+		config->begin = win->buffer;
+		config->end = win->buffer;
+	} else if (!config->segments)
+		return 0;
+
+	errcode = pt_win_map(win, config, 0ull, &pos);
+	if (errcode < 0) {
+		pt_win_fini(win);
+		return errcode;
+	}
+
+	return 0;
+}
+
+void pt_win_fini(struct pt_window *win)
+{
+	if (!win)
+		return;
+
+	free(win->buffer);
+	win->buffer = NULL;
+}
+
+uint64_t pt_win_size(const struct pt_config *config)
+{
+	const struct pt_segment *segment;
+	uint64_t size;
+	uint32_t idx;
+
+	if (!config)
+		return 0ull;
+
+	if (config->source.read)
+		return config->source.size;
+
+	segment = config->segments;
+	if (!segment)
+		return (uint64_t) (config->end - config->begin);
+
+	size = 0ull;
+	for (idx = 0; idx < config->nsegments; ++idx)
+		size += pt_win_seg_size(&segment[idx]);
+
+	return size;
+}
+
+uint64_t pt_win_offset(const struct pt_window *win,
+		       const struct pt_config *config, const uint8_t *pos)
+{
+	if (!win || !config || !pos)
+		return 0ull;
+
+	return win->base + (uint64_t) (pos - config->begin);
+}
+
+/* Copy the trace at @offset into @win's bounce buffer.
+ *
+ * Copies as much of the trace of @size bytes as fits and makes the bounce
+ * buffer @config's window.
+ */
+static void pt_win_bounce(struct pt_window *win, struct pt_config *config,
+			  uint64_t offset, uint64_t size)
+{
+	const struct pt_segment *segment;
+	uint64_t base, end, fill;
+	uint32_t idx;
+
+	end = offset + pt_win_bounce_size;
+	if (size < end)
+		end = size;
+
+	segment = config->segments;
+	base = 0ull;
+	fill = 0ull;
+
+	for (idx = 0; (idx < config->nsegments) && (base < end); ++idx) {
+		uint64_t next, stop;
+
+		next = offset + fill;
+		stop = base + pt_win_seg_size(&segment[idx]);
+
+		if (next < stop) {
+			if (end < stop)
+				stop = end;
+
+			memcpy(&win->bounce[fill],
+			       segment[idx].begin + (next - base),
+			       (size_t) (stop - next));
+
+			fill += stop - next;
+		}
+
+		base += pt_win_seg_size(&segment[idx]);
+	}
+
+	win->base = offset;
+	config->begin = win->bounce;
+	config->end = win->bounce + fill;
+}
+
+/* Read the trace at @first into @win's buffer.
+ *
+ * Reads as much of the trace of @size bytes as fits and makes the buffer
+ * @config's window.
+ *
+ * Returns zero on success, a negative error code otherwise.
+ */
+static int pt_win_fill(struct pt_window *win, struct pt_config *config,
+		       uint64_t first, uint64_t size)
+{
+	uint64_t end, fill;
+
+	end = first + win->capacity;
+	if (size < end)
+		end = size;
+
+	/* The buffer is overwritten - even if we fail. */
+	win->base = first;
+	config->begin = win->buffer;
+	config->end = win->buffer;
+
+	for (fill = 0ull; first + fill < end;) {
+		uint64_t left;
+		int status;
+
+		left = end - (first + fill);
+		if ((uint64_t) INT_MAX < left)
+			left = (uint64_t) INT_MAX;
+
+		status = config->source.read(&win->buffer[fill], (size_t) left,
+					     first + fill,
+					     config->source.context);
+		if (status < 0)
+			return status;
+
+		/* The trace is shorter than announced. */
+		if (!status)
+			return -pte_eos;
+
+		if (left < (uint64_t) status)
+			return -pte_internal;
+
+		fill += (uint64_t) status;
+	}
+
+	config->end = win->buffer + fill;
+
+	return 0;
+}
+
+/* Move the window to @offset for a trace that is read on demand.
+ *
+ * This is pt_win_map() for a read callback.
+ */
+static int pt_win_map_source(struct pt_window *win, struct pt_config *config,
+			     uint64_t offset, uint64_t size,
+			     const uint8_t **pos)
+{
+	uint64_t end;
+	int errcode;
+
+	/* We keep using the current window if we have enough lookahead. */
+	end = win->base + (uint64_t) (config->end - config->begin);
+	if ((win->base <= offset) && (offset <= end) &&
+	    ((offset + pt_win_lookahead <= end) || (size <= end))) {
+		*pos = config->begin + (offset - win->base);
+		return 0;
+	}
+
+	errcode = pt_win_fill(win, config, offset, size);
+	if (errcode < 0)
+		return errcode;
+
+	*pos = config->begin;
+	return 0;
+}
+
+int pt_win_map(struct pt_window *win, struct pt_config *config,
+	       uint64_t offset, const uint8_t **pos)
+{
+	const struct pt_segment *segment;
+	uint64_t base, size;
+	uint32_t idx;
+
+	if (!win || !config || !pos)
+		return -pte_internal;
+
+	size = pt_win_size(config);
+	if (size < offset)
+		return -pte_invalid;
+
+	if (config->source.read)
+		return pt_win_map_source(win, config, offset, size, pos);
+
+	segment = config->segments;
+	if (!segment) {
+		*pos = config->begin + offset;
+		return 0;
+	}
+
+	/* We use the segment containing @offset unless we're too close to its
+	 * end.  We need to go through the bounce buffer in that case.
+	 */
+	base = 0ull;
+	for (idx = 0; idx < config->nsegments; ++idx) {
+		uint64_t end;
+
+		end = base + pt_win_seg_size(&segment[idx]);
+		if (offset < end) {
+			if ((end < offset + pt_win_lookahead) && (end < size))
+				break;
+
+			win->base = base;
+			config->begin = segment[idx].begin;
+			config->end = segment[idx].end;
+
+			*pos = config->begin + (offset - base);
+			return 0;
+		}
+
+		base = end;
+	}
+
+	pt_win_bounce(win, config, offset, size);
+
+	*pos = config->begin;
+	return 0;
+}
+
+/* Move the window to the trace before @offset.
+ *
+ * This is pt_win_map() for searching backwards.  The window contains the
+ * trace before @offset as well as the PSB size after @offset.
+ */
+static int pt_win_map_back(struct pt_window *win, struct pt_config *config,
+			   uint64_t offset, const uint8_t **pos)
+{
+	const struct pt_segment *segment;
+	uint64_t base, size, first, last;
+	uint32_t idx;
+
+	if (!win || !config || !pos)
+		return -pte_internal;
+
+	if (!pt_win_is_moving(config))
+		return pt_win_map(win, config, offset, pos);
+
+	size = pt_win_size(config);
+	if (size < offset)
+		return -pte_invalid;
+
+	first = 0ull;
+	if (pt_win_lookahead < offset)
+		first = offset - pt_win_lookahead;
+
+	last = offset + ptps_psb;
+	if (size < last)
+		last = size;
+
+	if (config->source.read) {
+		uint64_t end;
+
+		end = win->base + (uint64_t) (config->end - config->begin);
+		if ((first < win->base) || (end < last)) {
+			int errcode;
+
+			first = 0ull;
+			if (win->capacity < last)
+				first = last - win->capacity;
+
+			errcode = pt_win_fill(win, config, first, size);
+			if (errcode < 0)
+				return errcode;
+		}
+
+		*pos = config->begin + (offset - win->base);
+		return 0;
+	}
+
+	segment = config->segments;
+
+	base = 0ull;
+	for (idx = 0; idx < config->nsegments; ++idx) {
+		uint64_t end;
+
+		end = base + pt_win_seg_size(&segment[idx]);
+		if ((base <= first) && (last <= end) && (base < end)) {
+			win->base = base;
+			config->begin = segment[idx].begin;
+			config->end = segment[idx].end;
+
+			*pos = config->begin + (offset - base);
+			return 0;
+		}
+
+		base = end;
+	}
+
+	first = 0ull;
+	if (pt_win_bounce_size < last)
+		first = last - pt_win_bounce_size;
+
+	pt_win_bounce(win, config, first, size);
+
+	*pos = config->begin + (offset - first);
+	return 0;
+}
+
+int pt_win_ensure(struct pt_window *win, struct pt_config *config,
+		  const uint8_t **pos)
+{
+	const uint8_t *begin, *end;
+	uint64_t offset;
+
+	if (!win || !config || !pos)
+		return -pte_internal;
+
+	/* There is nothing to do for a single trace buffer. */
+	if (!pt_win_is_moving(config))
+		return 0;
+
+	/* Errors are diagnosed when reading from @pos. */
+	begin = *pos;
+	end = config->end;
+	if (!begin || (begin < config->begin) || (end < begin))
+		return 0;
+
+	if (pt_win_lookahead <= (end - begin))
+		return 0;
+
+	/* There is nothing to do at the end of the trace. */
+	offset = win->base + (uint64_t) (end - config->begin);
+	if (pt_win_size(config) <= offset)
+		return 0;
+
+	offset = pt_win_offset(win, config, begin);
+
+	return pt_win_map(win, config, offset, pos);
+}
+
+int pt_win_sync_forward(struct pt_window *win, struct pt_config *config,
+			const uint8_t **sync, uint64_t offset)
+{
+	const uint8_t *pos;
+	int errcode;
+
+	if (!sync)
+		return -pte_internal;
+
+	errcode = pt_win_map(win, config, offset, &pos);
+	if (errcode < 0)
+		return errcode;
+
+	for (;;) {
+		uint64_t end;
+
+		errcode = pt_sync_forward(sync, pos, config);
+		if (errcode != -pte_eos)
+			return errcode;
+
+		if (!pt_win_is_moving(config))
+			return -pte_eos;
+
+		end = win->base + (uint64_t) (config->end - config->begin);
+		if (pt_win_size(config) <= end)
+			return -pte_eos;
+
+		/* Continue the search in the next window.  We go back a
+		 * little to find a PSB that straddles the current window's
+		 * end.
+		 */
+		if (offset + (ptps_psb - 1) < end)
+			offset = end - (ptps_psb - 1);
+
+		errcode = pt_win_map(win, config, offset, &pos);
+		if (errcode < 0)
+			return errcode;
+	}
+}
+
+int pt_win_sync_backward(struct pt_window *win, struct pt_config *config,
+			 const uint8_t **sync, uint64_t offset)
+{
+	const uint8_t *pos;
+	int errcode;
+
+	if (!sync)
+		return -pte_internal;
+
+	errcode = pt_win_map_back(win, config, offset, &pos);
+	if (errcode < 0)
+		return errcode;
+
+	for (;;) {
+		errcode = pt_sync_backward(sync, pos, config);
+		if (errcode != -pte_eos)
+			return errcode;
+
+		if (!pt_win_is_moving(config) || !win->base)
+			return -pte_eos;
+
+		/* Continue the search in the previous window.  We go forward
+		 * a little to find a PSB that straddles the current window's
+		 * begin.
+		 */
+		if (win->base + ptps_psb < offset)
+			offset = win->base + ptps_psb;
+
+		errcode = pt_win_map_back(win, config, offset, &pos);
+		if (errcode < 0)
+			return errcode;
+	}
+}
+
+int pt_win_sync_set(struct pt_window *win, struct pt_config *config,
+		    const uint8_t **sync, uint64_t offset)
+{
+	const uint8_t *pos;
+	int errcode;
+
+	if (!sync)
+		return -pte_internal;
+
+	errcode = pt_win_map(win, config, offset, &pos);
+	if (errcode < 0)
+		return errcode;
+
+	return pt_sync_set(sync, pos, config);
+}
+
+int pt_win_extend(struct pt_window *win, struct pt_config *config,
+		  uint8_t *end)
+{
+	if (!win || !config)
+		return -pte_internal;
+
+	if (!end || end < config->end)
+		return -pte_invalid;
+
+	/* We only support extending a single trace buffer. */
+	if (pt_win_is_moving(config))
+		return -pte_invalid;
+
+	config->end = end;
+
+	return 0;
+}
@@ -29,6 +29,7 @@
 #include "pt_section.h"
 #include "pt_section_windows.h"
 #include "pt_section_file.h"
+#include "pt_section_buffer.h"
 
 #include "intel-pt.h"
 
@@ -86,6 +87,63 @@ int pt_section_mk_status(void **pstatus, uint64_t *psize, const char *filename)
 	return 0;
 }
 
+int pt_section_match_status(const void *lhs, const void *rhs)
+{
+	const struct pt_sec_windows_status *lstatus, *rstatus;
+
+	lstatus = (const struct pt_sec_windows_status *) lhs;
+	rstatus = (const struct pt_sec_windows_status *) rhs;
+
+	if (!lstatus || !rstatus)
+		return -pte_internal;
+
+	/* Windows does not provide inode numbers.  We rely on the caller
+	 * comparing file names.
+	 */
+	if (lstatus->stat.st_dev != rstatus->stat.st_dev)
+		return 0;
+
+	if (lstatus->stat.st_size != rstatus->stat.st_size)
+		return 0;
+
+	if (lstatus->stat.st_mtime != rstatus->stat.st_mtime)
+		return 0;
+
+	return 1;
+}
+
+int pt_section_dup_status(void **pcopy, const void *status)
+{
+	struct pt_sec_windows_status *copy;
+
+	if (!pcopy || !status)
+		return -pte_internal;
+
+	copy = malloc(sizeof(*copy));
+	if (!copy)
+		return -pte_nomem;
+
+	*copy = *(const struct pt_sec_windows_status *) status;
+	*pcopy = copy;
+
+	return 0;
+}
+
+int pt_section_status_identity(uint64_t *psize, uint64_t *pmtime,
+			       const void *status)
+{
+	const struct pt_sec_windows_status *fstatus;
+
+	fstatus = (const struct pt_sec_windows_status *) status;
+	if (!psize || !pmtime || !fstatus)
+		return -pte_internal;
+
+	*psize = (uint64_t) fstatus->stat.st_size;
+	*pmtime = (uint64_t) fstatus->stat.st_mtime;
+
+	return 0;
+}
+
 static int check_file_status(struct pt_section *section, int fd)
 {
 	struct pt_sec_windows_status *status;
@@ -174,6 +232,7 @@ int pt_sec_windows_map(struct pt_section *section, int fd)
 	section->mapping = mapping;
 	section->unmap = pt_sec_windows_unmap;
 	section->read = pt_sec_windows_read;
+	section->fetch = pt_sec_windows_fetch;
 
 	return 0;
 
@@ -217,10 +276,15 @@ int pt_section_map(struct pt_section *section)
 		goto out_unlock;
 	}
 
+	/* Sections without a file are backed by a memory buffer. */
 	filename = section->filename;
 	if (!filename) {
-		errcode = -pte_internal;
-		goto out_unlock;
+		errcode = pt_sec_buffer_map(section);
+		if (errcode < 0)
+			goto out_unlock;
+
+		section->mcount = 1;
+		return pt_section_unlock(section);
 	}
 
 	fh = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
@@ -308,6 +372,7 @@ int pt_sec_windows_unmap(struct pt_section *section)
 	section->mapping = NULL;
 	section->unmap = NULL;
 	section->read = NULL;
+	section->fetch = NULL;
 
 	UnmapViewOfFile(mapping->begin);
 	CloseHandle(mapping->mh);
@@ -318,15 +383,31 @@ int pt_sec_windows_unmap(struct pt_section *section)
 }
 
 int pt_sec_windows_read(const struct pt_section *section, uint8_t *buffer,
-		      uint16_t size, uint64_t offset)
+			uint16_t size, uint64_t offset)
 {
-	struct pt_sec_windows_mapping *mapping;
-	const uint8_t *begin, *end;
+	const uint8_t *begin;
 	int bytes;
 
 	if (!buffer || !section)
 		return -pte_invalid;
 
+	bytes = pt_sec_windows_fetch(section, &begin, size, offset);
+	if (bytes < 0)
+		return bytes;
+
+	memcpy(buffer, begin, bytes);
+	return bytes;
+}
+
+int pt_sec_windows_fetch(const struct pt_section *section,
+			 const uint8_t **pbegin, uint16_t size, uint64_t offset)
+{
+	struct pt_sec_windows_mapping *mapping;
+	const uint8_t *begin, *end;
+
+	if (!pbegin || !section)
+		return -pte_internal;
+
 	mapping = section->mapping;
 	if (!mapping)
 		return -pte_internal;
@@ -346,8 +427,6 @@ int pt_sec_windows_read(const struct pt_section *section, uint8_t *buffer,
 	if (mapping->end < end)
 		end = mapping->end;
 
-	bytes = (int) (end - begin);
-
-	memcpy(buffer, begin, bytes);
-	return bytes;
+	*pbegin = begin;
+	return (int) (end - begin);
 }
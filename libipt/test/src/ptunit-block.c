@@ -0,0 +1,1961 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "ptunit.h"
+
+#include "pt_block_decoder.h"
+#include "pt_encoder.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/* The code of our test image at bfix_base.
+ *
+ *   0x1000:  nop
+ *   0x1001:  nop
+ *   0x1002:  call 0x100c
+ *   0x1007:  jne 0x1000
+ *   0x1009:  jmp *%rax
+ *   0x100b:  nop
+ *   0x100c:  nop
+ *   0x100d:  ret
+ */
+static const uint8_t bfix_code[] = {
+	0x90, 0x90, 0xe8, 0x05, 0x00, 0x00, 0x00, 0x75, 0xf7, 0xff, 0xe0,
+	0x90, 0x90, 0xc3
+};
+
+/* The code of our loop test image at bfix_base.
+ *
+ *   0x1000:  nop
+ *   0x1001:  nop
+ *   0x1002:  jne 0x1000
+ *   0x1004:  jmp *%rax
+ */
+static const uint8_t bfix_loop[] = {
+	0x90, 0x90, 0x75, 0xfc, 0xff, 0xe0
+};
+
+enum {
+	bfix_base	= 0x1000
+};
+
+/* A test fixture providing a trace as well as a block and an instruction
+ * flow decoder for it.
+ */
+struct block_fixture {
+	/* The trace buffer. */
+	uint8_t buffer[0x2000];
+
+	/* The configuration. */
+	struct pt_config config;
+
+	/* The encoder used for generating the trace. */
+	struct pt_encoder encoder;
+
+	/* A block decoder and an instruction flow decoder for the trace. */
+	struct pt_block_decoder *decoder;
+	struct pt_insn_decoder *insn;
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct block_fixture *);
+	struct ptunit_result (*fini)(struct block_fixture *);
+};
+
+static struct ptunit_result bfix_packet(struct block_fixture *bfix,
+					enum pt_packet_type type,
+					uint64_t payload, uint8_t size)
+{
+	struct pt_packet packet;
+	int errcode;
+
+	memset(&packet, 0, sizeof(packet));
+	packet.type = type;
+
+	switch (type) {
+	case ppt_tnt_8:
+	case ppt_tnt_64:
+		packet.payload.tnt.bit_size = size;
+		packet.payload.tnt.payload = payload;
+		break;
+
+	case ppt_tip:
+	case ppt_tip_pge:
+	case ppt_tip_pgd:
+	case ppt_fup:
+		packet.payload.ip.ipc = pt_ipc_sext_48;
+		packet.payload.ip.ip = payload;
+		break;
+
+	case ppt_tsc:
+		packet.payload.tsc.tsc = payload;
+		break;
+
+	case ppt_mode:
+		packet.payload.mode.leaf = pt_mol_exec;
+		packet.payload.mode.bits.exec = pt_set_exec_mode(ptem_64bit);
+		break;
+
+	default:
+		break;
+	}
+
+	errcode = pt_enc_next(&bfix->encoder, &packet);
+	ptu_int_gt(errcode, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result bfix_encoder(struct block_fixture *bfix)
+{
+	int errcode;
+
+	memset(bfix->buffer, 0, sizeof(bfix->buffer));
+
+	pt_config_init(&bfix->config);
+	bfix->config.begin = bfix->buffer;
+	bfix->config.end = bfix->buffer + sizeof(bfix->buffer);
+
+	errcode = pt_encoder_init(&bfix->encoder, &bfix->config);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
+/* Allocate the decoders for the trace generated so far and @code. */
+static struct ptunit_result bfix_decoders(struct block_fixture *bfix,
+					  const uint8_t *code, size_t size)
+{
+	struct pt_image *image;
+	int errcode;
+
+	bfix->config.end = bfix->encoder.pos;
+
+	bfix->decoder = pt_blk_alloc_decoder(&bfix->config);
+	ptu_ptr(bfix->decoder);
+
+	bfix->insn = pt_insn_alloc_decoder(&bfix->config);
+	ptu_ptr(bfix->insn);
+
+	image = pt_blk_get_image(bfix->decoder);
+	errcode = pt_image_add_buffer(image, code, size, 0, NULL, bfix_base);
+	ptu_int_eq(errcode, 0);
+
+	image = pt_insn_get_image(bfix->insn);
+	errcode = pt_image_add_buffer(image, code, size, 0, NULL, bfix_base);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result bfix_init(struct block_fixture *bfix)
+{
+	ptu_test(bfix_encoder, bfix);
+
+	/* Three iterations of the loop, an interrupt at 0x1001, two more
+	 * iterations with the last one falling through, and a disable.
+	 *
+	 * Then another enable, three iterations, and an indirect jump to
+	 * 0x100b, whose return disables tracing.
+	 */
+	ptu_test(bfix_packet, bfix, ppt_psb, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_mode, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_psbend, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tip_pge, 0x1000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tnt_8, 0x3full, 6);
+	ptu_test(bfix_packet, bfix, ppt_fup, 0x1001ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tip, 0x1000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tnt_8, 0xeull, 4);
+	ptu_test(bfix_packet, bfix, ppt_tip_pgd, 0x2000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_mode, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tip_pge, 0x1000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tnt_8, 0x3full, 6);
+	ptu_test(bfix_packet, bfix, ppt_tnt_8, 0x2ull, 2);
+	ptu_test(bfix_packet, bfix, ppt_tip, 0x100bull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tip_pgd, 0x1000ull, 0);
+
+	ptu_test(bfix_decoders, bfix, bfix_code, sizeof(bfix_code));
+
+	return ptu_passed();
+}
+
+static struct ptunit_result bfix_init_loop(struct block_fixture *bfix)
+{
+	ptu_test(bfix_encoder, bfix);
+
+	/* Two full tnt packets worth of loop iterations, two more with the
+	 * last one falling through, and an indirect jump that disables
+	 * tracing.
+	 */
+	ptu_test(bfix_packet, bfix, ppt_psb, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_mode, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_psbend, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tip_pge, 0x1000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tnt_64, (1ull << 47) - 1ull, 47);
+	ptu_test(bfix_packet, bfix, ppt_tnt_64, (1ull << 47) - 1ull, 47);
+	ptu_test(bfix_packet, bfix, ppt_tnt_8, 0x2ull, 2);
+	ptu_test(bfix_packet, bfix, ppt_tip_pgd, 0x2000ull, 0);
+
+	ptu_test(bfix_decoders, bfix, bfix_loop, sizeof(bfix_loop));
+
+	return ptu_passed();
+}
+
+static struct ptunit_result bfix_init_dense(struct block_fixture *bfix)
+{
+	int idx;
+
+	ptu_test(bfix_encoder, bfix);
+
+	/* Two long runs of loop iterations separated by a PSB, the last one
+	 * falling through, and an indirect jump that disables tracing.
+	 *
+	 * Each run is too dense for decoding it in one go.
+	 */
+	ptu_test(bfix_packet, bfix, ppt_psb, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_mode, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_psbend, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tip_pge, 0x1000ull, 0);
+
+	for (idx = 0; idx < 360; ++idx)
+		ptu_test(bfix_packet, bfix, ppt_tnt_64, (1ull << 47) - 1ull,
+			 47);
+
+	ptu_test(bfix_packet, bfix, ppt_psb, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_mode, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_fup, 0x1000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_psbend, 0ull, 0);
+
+	for (idx = 0; idx < 360; ++idx)
+		ptu_test(bfix_packet, bfix, ppt_tnt_64, (1ull << 47) - 1ull,
+			 47);
+
+	ptu_test(bfix_packet, bfix, ppt_tnt_8, 0x2ull, 2);
+	ptu_test(bfix_packet, bfix, ppt_tip_pgd, 0x2000ull, 0);
+
+	ptu_test(bfix_decoders, bfix, bfix_loop, sizeof(bfix_loop));
+
+	return ptu_passed();
+}
+
+static struct ptunit_result bfix_init_psb(struct block_fixture *bfix)
+{
+	ptu_test(bfix_encoder, bfix);
+
+	/* Three iterations of the loop, followed by a PSB taken inside the
+	 * call, so the first ret after it is only known to the decoder that
+	 * saw the call.  Two more iterations with the last one falling
+	 * through, and an indirect jump that disables tracing.
+	 *
+	 * Then another PSB while tracing is disabled, another enable, three
+	 * iterations, and an indirect jump to 0x100b, whose return disables
+	 * tracing.
+	 */
+	ptu_test(bfix_packet, bfix, ppt_psb, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_mode, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_psbend, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tip_pge, 0x1000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tnt_8, 0x3full, 6);
+	ptu_test(bfix_packet, bfix, ppt_psb, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_mode, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_fup, 0x100cull, 0);
+	ptu_test(bfix_packet, bfix, ppt_psbend, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tnt_8, 0xeull, 4);
+	ptu_test(bfix_packet, bfix, ppt_tip_pgd, 0x2000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_psb, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_mode, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_psbend, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tip_pge, 0x1000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tnt_8, 0x3full, 6);
+	ptu_test(bfix_packet, bfix, ppt_tnt_8, 0x2ull, 2);
+	ptu_test(bfix_packet, bfix, ppt_tip, 0x100bull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tip_pgd, 0x1000ull, 0);
+
+	ptu_test(bfix_decoders, bfix, bfix_code, sizeof(bfix_code));
+
+	return ptu_passed();
+}
+
+static struct ptunit_result bfix_init_time(struct block_fixture *bfix)
+{
+	ptu_test(bfix_encoder, bfix);
+
+	/* Two tnt packets worth of loop iterations, the second after a
+	 * timing update, and a PSB at a later time, followed by the last
+	 * iteration falling through, and an indirect jump that disables
+	 * tracing.
+	 */
+	ptu_test(bfix_packet, bfix, ppt_psb, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tsc, 0x1000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_mode, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_psbend, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tip_pge, 0x1000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tnt_8, 0x3full, 6);
+	ptu_test(bfix_packet, bfix, ppt_tsc, 0x2000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tnt_8, 0x3full, 6);
+	ptu_test(bfix_packet, bfix, ppt_psb, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tsc, 0x3000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_mode, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_fup, 0x1000ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_psbend, 0ull, 0);
+	ptu_test(bfix_packet, bfix, ppt_tnt_8, 0x2ull, 2);
+	ptu_test(bfix_packet, bfix, ppt_tip_pgd, 0x2000ull, 0);
+
+	ptu_test(bfix_decoders, bfix, bfix_loop, sizeof(bfix_loop));
+
+	return ptu_passed();
+}
+
+static struct ptunit_result bfix_fini(struct block_fixture *bfix)
+{
+	pt_insn_free_decoder(bfix->insn);
+	pt_blk_free_decoder(bfix->decoder);
+	pt_encoder_fini(&bfix->encoder);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result null(void)
+{
+	struct pt_block block;
+	uint64_t offset;
+	uint32_t cbr;
+	int errcode;
+
+	ptu_null(pt_blk_alloc_decoder(NULL));
+	pt_blk_free_decoder(NULL);
+
+	errcode = pt_blk_sync_forward(NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_blk_sync_backward(NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_blk_sync_set(NULL, 0ull);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_blk_sync_time(NULL, 0ull);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_blk_get_offset(NULL, &offset);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_blk_get_sync_offset(NULL, &offset);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	ptu_null(pt_blk_get_image(NULL));
+	ptu_null(pt_blk_get_config(NULL));
+
+	errcode = pt_blk_set_image(NULL, NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_blk_time(NULL, &offset, NULL, NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_blk_core_bus_ratio(NULL, &cbr);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_blk_next(NULL, &block, sizeof(block));
+	ptu_int_eq(errcode, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result next_null(struct block_fixture *bfix)
+{
+	int errcode;
+
+	errcode = pt_blk_next(bfix->decoder, NULL, sizeof(struct pt_block));
+	ptu_int_eq(errcode, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result next_nosync(struct block_fixture *bfix)
+{
+	struct pt_block block;
+	struct pt_insn insn;
+	int errcode;
+
+	errcode = pt_blk_next(bfix->decoder, &block, sizeof(block));
+	ptu_int_lt(errcode, 0);
+
+	/* We report the same error as the instruction flow decoder. */
+	ptu_int_eq(errcode, pt_insn_next(bfix->insn, &insn, sizeof(insn)));
+
+	return ptu_passed();
+}
+
+static struct ptunit_result first(struct block_fixture *bfix)
+{
+	struct pt_block block;
+	int status;
+
+	status = pt_blk_sync_forward(bfix->decoder);
+	ptu_int_ge(status, 0);
+
+	status = pt_blk_next(bfix->decoder, &block, sizeof(block));
+	ptu_int_ge(status, 0);
+	ptu_uint_eq(block.ip, 0x1000ull);
+	ptu_uint_eq(block.end_ip, 0x1002ull);
+	ptu_uint_eq(block.ninsn, 3);
+	ptu_int_eq(block.mode, ptem_64bit);
+	ptu_int_eq(block.iclass, ptic_call);
+	ptu_uint_eq(block.enabled, 1);
+	ptu_uint_eq(block.disabled, 0);
+
+	status = pt_blk_next(bfix->decoder, &block, sizeof(block));
+	ptu_int_ge(status, 0);
+	ptu_uint_eq(block.ip, 0x100cull);
+	ptu_uint_eq(block.end_ip, 0x100dull);
+	ptu_uint_eq(block.ninsn, 2);
+	ptu_int_eq(block.iclass, ptic_return);
+	ptu_uint_eq(block.enabled, 0);
+
+	status = pt_blk_next(bfix->decoder, &block, sizeof(block));
+	ptu_int_ge(status, 0);
+	ptu_uint_eq(block.ip, 0x1007ull);
+	ptu_uint_eq(block.ninsn, 1);
+	ptu_int_eq(block.iclass, ptic_cond_jump);
+
+	return ptu_passed();
+}
+
+/* The flags that may only be set for the first instruction in a block. */
+static uint32_t bfix_start_flags(uint32_t enabled, uint32_t resumed,
+				 uint32_t resynced)
+{
+	return enabled | (resumed << 1) | (resynced << 2);
+}
+
+/* The flags that may only be set for the last instruction in a block. */
+static uint32_t bfix_end_flags(uint32_t aborted, uint32_t committed,
+			       uint32_t disabled, uint32_t interrupted,
+			       uint32_t stopped)
+{
+	return aborted | (committed << 1) | (disabled << 2) |
+		(interrupted << 3) | (stopped << 4);
+}
+
+/* Check that the block decoder provides the same instructions as the
+ * instruction flow decoder.
+ */
+static struct ptunit_result same_insn(struct block_fixture *bfix)
+{
+	struct pt_insn insn;
+	uint32_t nblocks, ninsn, end;
+	int bstatus, istatus;
+
+	bstatus = pt_blk_sync_forward(bfix->decoder);
+	istatus = pt_insn_sync_forward(bfix->insn);
+	ptu_int_eq(bstatus, istatus);
+
+	nblocks = 0;
+	ninsn = 0;
+	for (;;) {
+		struct pt_block block;
+		uint64_t ip;
+		uint32_t idx;
+
+		bstatus = pt_blk_next(bfix->decoder, &block, sizeof(block));
+		if (bstatus < 0)
+			break;
+
+		nblocks += 1;
+
+		ip = block.ip;
+		end = 0;
+		for (idx = 0; idx < block.ninsn; ++idx) {
+			uint32_t start;
+
+			istatus = pt_insn_next(bfix->insn, &insn,
+					       sizeof(insn));
+			ptu_int_ge(istatus, 0);
+			ptu_uint_eq(insn.ip, ip);
+			ptu_int_eq(insn.mode, block.mode);
+			ptu_uint_eq(insn.speculative, block.speculative);
+
+			ninsn += 1;
+			ip += insn.size;
+
+			start = bfix_start_flags(insn.enabled, insn.resumed,
+						 insn.resynced);
+			end = bfix_end_flags(insn.aborted, insn.committed,
+					     insn.disabled, insn.interrupted,
+					     insn.stopped);
+
+			if (!idx)
+				ptu_uint_eq(start,
+					    bfix_start_flags(block.enabled,
+							     block.resumed,
+							     block.resynced));
+			else
+				ptu_uint_eq(start, 0);
+
+			if (idx + 1 < block.ninsn) {
+				ptu_int_eq(insn.iclass, ptic_other);
+				ptu_uint_eq(end, 0);
+			}
+		}
+
+		ptu_uint_eq(insn.ip, block.end_ip);
+		ptu_int_eq(insn.iclass, block.iclass);
+		ptu_int_eq(istatus, bstatus);
+		ptu_uint_eq(end, bfix_end_flags(block.aborted, block.committed,
+						block.disabled,
+						block.interrupted,
+						block.stopped));
+	}
+
+	istatus = pt_insn_next(bfix->insn, &insn, sizeof(insn));
+	ptu_int_eq(istatus, bstatus);
+
+	/* Blocks group instructions. */
+	ptu_uint_lt(nblocks, ninsn);
+	ptu_uint_gt(nblocks, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result branch_null(struct block_fixture *bfix)
+{
+	struct pt_branch branch;
+	int errcode;
+
+	errcode = pt_blk_next_branch(NULL, &branch, sizeof(branch));
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_blk_next_branch(bfix->decoder, NULL, sizeof(branch));
+	ptu_int_eq(errcode, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result branch_first(struct block_fixture *bfix)
+{
+	struct pt_branch branch;
+	int status;
+
+	status = pt_blk_sync_forward(bfix->decoder);
+	ptu_int_ge(status, 0);
+
+	status = pt_blk_next_branch(bfix->decoder, &branch, sizeof(branch));
+	ptu_int_ge(status, 0);
+	ptu_uint_eq(branch.start, 0x1000ull);
+	ptu_uint_eq(branch.from, 0x1002ull);
+	ptu_uint_eq(branch.to, 0x100cull);
+	ptu_uint_eq(branch.ninsn, 3);
+	ptu_int_eq(branch.mode, ptem_64bit);
+	ptu_int_eq(branch.iclass, ptic_call);
+	ptu_uint_eq(branch.taken, 1);
+	ptu_uint_eq(branch.enabled, 1);
+
+	status = pt_blk_next_branch(bfix->decoder, &branch, sizeof(branch));
+	ptu_int_ge(status, 0);
+	ptu_uint_eq(branch.start, 0x100cull);
+	ptu_uint_eq(branch.from, 0x100dull);
+	ptu_uint_eq(branch.to, 0x1007ull);
+	ptu_uint_eq(branch.ninsn, 2);
+	ptu_int_eq(branch.iclass, ptic_return);
+	ptu_uint_eq(branch.taken, 1);
+	ptu_uint_eq(branch.enabled, 0);
+
+	status = pt_blk_next_branch(bfix->decoder, &branch, sizeof(branch));
+	ptu_int_ge(status, 0);
+	ptu_uint_eq(branch.start, 0x1007ull);
+	ptu_uint_eq(branch.from, 0x1007ull);
+	ptu_uint_eq(branch.to, 0x1000ull);
+	ptu_uint_eq(branch.ninsn, 1);
+	ptu_int_eq(branch.iclass, ptic_cond_jump);
+	ptu_uint_eq(branch.taken, 1);
+
+	return ptu_passed();
+}
+
+/* Check that branch records describe the same instructions as the
+ * instruction flow decoder.
+ */
+static struct ptunit_result branch_same_insn(struct block_fixture *bfix)
+{
+	struct pt_insn insn;
+	uint32_t nbranches, ntaken, ninsn;
+	uint64_t to;
+	int bstatus, istatus;
+
+	bstatus = pt_blk_sync_forward(bfix->decoder);
+	istatus = pt_insn_sync_forward(bfix->insn);
+	ptu_int_eq(bstatus, istatus);
+
+	nbranches = 0;
+	ntaken = 0;
+	ninsn = 0;
+	to = 0ull;
+	for (;;) {
+		struct pt_branch branch;
+		uint32_t idx, end;
+
+		bstatus = pt_blk_next_branch(bfix->decoder, &branch,
+					     sizeof(branch));
+		if (bstatus < 0)
+			break;
+
+		nbranches += 1;
+		if (branch.taken)
+			ntaken += 1;
+
+		if (to)
+			ptu_uint_eq(branch.start, to);
+
+		end = 0;
+		for (idx = 0; idx < branch.ninsn; ++idx) {
+			istatus = pt_insn_next(bfix->insn, &insn,
+					       sizeof(insn));
+			ptu_int_ge(istatus, 0);
+			ptu_int_eq(insn.mode, branch.mode);
+			ptu_uint_eq(insn.speculative, branch.speculative);
+
+			ninsn += 1;
+
+			if (!idx) {
+				ptu_uint_eq(insn.ip, branch.start);
+				ptu_uint_eq(bfix_start_flags(insn.enabled,
+							     insn.resumed,
+							     insn.resynced),
+					    bfix_start_flags(branch.enabled,
+							     branch.resumed,
+							     branch.resynced));
+			}
+
+			end = bfix_end_flags(insn.aborted, insn.committed,
+					     insn.disabled, insn.interrupted,
+					     insn.stopped);
+
+			if (idx + 1 < branch.ninsn) {
+				ptu_uint_eq(end, 0);
+				ptu_uint_ne(insn.iclass == ptic_other ||
+					    insn.iclass == ptic_cond_jump, 0);
+			}
+		}
+
+		ptu_uint_eq(insn.ip, branch.from);
+		ptu_int_eq(insn.iclass, branch.iclass);
+		ptu_int_eq(istatus, bstatus);
+		ptu_uint_eq(end, bfix_end_flags(branch.aborted,
+						branch.committed,
+						branch.disabled,
+						branch.interrupted,
+						branch.stopped));
+
+		/* The branch target is the start of the next range. */
+		to = branch.taken ? branch.to : 0ull;
+	}
+
+	istatus = pt_insn_next(bfix->insn, &insn, sizeof(insn));
+	ptu_int_eq(istatus, bstatus);
+
+	/* Branch records group instructions across not-taken branches. */
+	ptu_uint_lt(nbranches, ninsn);
+	ptu_uint_gt(ntaken, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result skip_null(struct block_fixture *bfix)
+{
+	uint64_t ninsn, nblocks;
+	int errcode;
+
+	errcode = pt_blk_skip(NULL, &ninsn, &nblocks);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_blk_skip(bfix->decoder, NULL, &nblocks);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_blk_skip(bfix->decoder, &ninsn, NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result skip_nosync(struct block_fixture *bfix)
+{
+	uint64_t ninsn, nblocks;
+	int errcode;
+
+	errcode = pt_blk_skip(bfix->decoder, &ninsn, &nblocks);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(ninsn, 0ull);
+	ptu_uint_eq(nblocks, 0ull);
+
+	return ptu_passed();
+}
+
+/* Check that skipping blocks in between pt_blk_next() calls gives the same
+ * blocks and instructions as pt_blk_next() alone.
+ */
+static struct ptunit_result skip_same_block(struct block_fixture *bfix)
+{
+	struct pt_block_decoder *decoder;
+	struct pt_insn insn;
+	uint64_t nblocks, ninsn, nskipped, nexpected;
+	int bstatus, status;
+
+	/* A second block decoder for reference. */
+	decoder = pt_blk_alloc_decoder(&bfix->config);
+	ptu_ptr(decoder);
+
+	status = pt_image_copy(pt_blk_get_image(decoder),
+			       pt_blk_get_image(bfix->decoder));
+	ptu_int_eq(status, 0);
+
+	bstatus = pt_blk_sync_forward(bfix->decoder);
+	status = pt_blk_sync_forward(decoder);
+	ptu_int_eq(bstatus, status);
+
+	nblocks = 0ull;
+	ninsn = 0ull;
+	nskipped = 0ull;
+	for (;;) {
+		struct pt_block block, expected;
+		uint64_t nsinsn, nsblocks;
+
+		status = pt_blk_skip(bfix->decoder, &nsinsn, &nsblocks);
+		ptu_int_eq(status, 0);
+
+		nblocks += nsblocks;
+		ninsn += nsinsn;
+		nskipped += nsblocks;
+
+		/* Skipped blocks end in a conditional branch and do not
+		 * indicate events.
+		 */
+		for (; nsblocks; --nsblocks) {
+			status = pt_blk_next(decoder, &expected,
+					     sizeof(expected));
+			ptu_int_eq(status, 0);
+			ptu_int_eq(expected.iclass, ptic_cond_jump);
+			ptu_uint_eq(bfix_start_flags(expected.enabled,
+						     expected.resumed,
+						     expected.resynced), 0);
+			ptu_uint_eq(bfix_end_flags(expected.aborted,
+						   expected.committed,
+						   expected.disabled,
+						   expected.interrupted,
+						   expected.stopped), 0);
+
+			ptu_uint_ge(nsinsn, expected.ninsn);
+			nsinsn -= expected.ninsn;
+		}
+		ptu_uint_eq(nsinsn, 0ull);
+
+		bstatus = pt_blk_next(bfix->decoder, &block, sizeof(block));
+		status = pt_blk_next(decoder, &expected, sizeof(expected));
+		ptu_int_eq(bstatus, status);
+		if (bstatus < 0)
+			break;
+
+		ptu_uint_eq(block.ip, expected.ip);
+		ptu_uint_eq(block.end_ip, expected.end_ip);
+		ptu_uint_eq(block.ninsn, expected.ninsn);
+		ptu_int_eq(block.iclass, expected.iclass);
+
+		nblocks += 1;
+		ninsn += block.ninsn;
+	}
+
+	pt_blk_free_decoder(decoder);
+
+	/* We did not lose any instructions. */
+	status = pt_insn_sync_forward(bfix->insn);
+	ptu_int_ge(status, 0);
+
+	for (nexpected = 0ull;; ++nexpected) {
+		status = pt_insn_next(bfix->insn, &insn, sizeof(insn));
+		if (status < 0)
+			break;
+	}
+
+	ptu_int_eq(status, bstatus);
+	ptu_uint_eq(ninsn, nexpected);
+	ptu_uint_lt(nskipped, nblocks);
+
+	return ptu_passed();
+}
+
+/* Check that pt_blk_skip() proceeds over loop iterations. */
+static struct ptunit_result skip_loop(struct block_fixture *bfix)
+{
+	struct pt_block block;
+	uint64_t ninsn, nblocks;
+	int status;
+
+	status = pt_blk_sync_forward(bfix->decoder);
+	ptu_int_ge(status, 0);
+
+	/* The first block fetches the first tnt packet. */
+	status = pt_blk_next(bfix->decoder, &block, sizeof(block));
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(block.ip, 0x1000ull);
+	ptu_uint_eq(block.ninsn, 3);
+	ptu_uint_eq(block.enabled, 1);
+
+	/* All but the last of the remaining 46 iterations can be skipped. */
+	status = pt_blk_skip(bfix->decoder, &ninsn, &nblocks);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(nblocks, 45ull);
+	ptu_uint_eq(ninsn, 135ull);
+	ptu_uint_eq(bfix->decoder->sbcache.hits, 0ull);
+
+	status = pt_blk_skip(bfix->decoder, &ninsn, &nblocks);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(nblocks, 0ull);
+
+	status = pt_blk_next(bfix->decoder, &block, sizeof(block));
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(block.ip, 0x1000ull);
+	ptu_uint_eq(block.ninsn, 3);
+
+	/* We need a new tnt packet. */
+	status = pt_blk_skip(bfix->decoder, &ninsn, &nblocks);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(nblocks, 0ull);
+
+	status = pt_blk_next(bfix->decoder, &block, sizeof(block));
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(block.ip, 0x1000ull);
+
+	/* The second packet repeats the first. */
+	status = pt_blk_skip(bfix->decoder, &ninsn, &nblocks);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(nblocks, 45ull);
+	ptu_uint_eq(ninsn, 135ull);
+	ptu_uint_eq(bfix->decoder->sbcache.hits, 1ull);
+
+	return ptu_passed();
+}
+
+/* Check that pt_blk_sync_time() starts at the first block if all PSBs are
+ * later than the requested time.
+ */
+static struct ptunit_result sync_time_early(struct block_fixture *bfix)
+{
+	struct pt_block block;
+	uint64_t offset, tsc;
+	int status;
+
+	status = pt_blk_sync_time(bfix->decoder, 0x800ull);
+	ptu_int_ge(status, 0);
+
+	status = pt_blk_get_sync_offset(bfix->decoder, &offset);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(offset, 0ull);
+
+	status = pt_blk_time(bfix->decoder, &tsc, NULL, NULL);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(tsc, 0x1000ull);
+
+	status = pt_blk_next(bfix->decoder, &block, sizeof(block));
+	ptu_int_ge(status, 0);
+	ptu_uint_eq(block.ip, 0x1000ull);
+	ptu_uint_eq(block.enabled, 1);
+
+	return ptu_passed();
+}
+
+/* Check that pt_blk_sync_time() proceeds past the time update. */
+static struct ptunit_result sync_time(struct block_fixture *bfix)
+{
+	struct pt_block block;
+	uint64_t offset, tsc;
+	int status;
+
+	status = pt_blk_sync_time(bfix->decoder, 0x1800ull);
+	ptu_int_ge(status, 0);
+
+	status = pt_blk_get_sync_offset(bfix->decoder, &offset);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(offset, 0ull);
+
+	status = pt_blk_time(bfix->decoder, &tsc, NULL, NULL);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(tsc, 0x2000ull);
+
+	status = pt_blk_next(bfix->decoder, &block, sizeof(block));
+	ptu_int_ge(status, 0);
+	ptu_uint_eq(block.enabled, 0);
+
+	return ptu_passed();
+}
+
+/* Check that pt_blk_sync_time() picks the last PSB before the requested
+ * time and runs out of trace trying to reach it.
+ */
+static struct ptunit_result sync_time_late(struct block_fixture *bfix)
+{
+	uint64_t offset;
+	int status;
+
+	status = pt_blk_sync_time(bfix->decoder, 0x3800ull);
+	ptu_int_eq(status, -pte_eos);
+
+	status = pt_blk_get_sync_offset(bfix->decoder, &offset);
+	ptu_int_eq(status, 0);
+	ptu_uint_ne(offset, 0ull);
+
+	return ptu_passed();
+}
+
+/* The instructions collected by bfix_insns(). */
+struct bfix_insns {
+	/* The instruction addresses. */
+	uint64_t ip[512];
+
+	/* The number of instructions. */
+	size_t ninsn;
+};
+
+/* Decode @bfix's trace using @decoder starting with a trace buffer of one
+ * byte and extending it byte by byte when running out of trace.
+ *
+ * If @decoder's trace buffer covers the entire trace, if it is split into
+ * segments, or if it is read on demand, it is never extended.
+ */
+static struct ptunit_result bfix_insns(struct block_fixture *bfix,
+				       struct pt_insn_decoder *decoder,
+				       struct bfix_insns *insns)
+{
+	const struct pt_config *config;
+	uint8_t *end;
+	int status;
+
+	config = pt_insn_get_config(decoder);
+	ptu_ptr(config);
+
+	end = config->end;
+	if (config->segments || config->source.read)
+		end = bfix->config.end;
+
+	insns->ninsn = 0;
+
+	for (;;) {
+		status = pt_insn_sync_forward(decoder);
+		if (status == -pte_eos && end < bfix->config.end) {
+			status = pt_insn_extend(decoder, ++end);
+			ptu_int_eq(status, 0);
+			continue;
+		}
+
+		if (status < 0)
+			break;
+
+		for (;;) {
+			struct pt_insn insn;
+
+			status = pt_insn_next(decoder, &insn, sizeof(insn));
+			if (status == -pte_eos && end < bfix->config.end) {
+				status = pt_insn_extend(decoder, ++end);
+				ptu_int_eq(status, 0);
+				continue;
+			}
+
+			if (status < 0)
+				break;
+
+			ptu_uint_lt(insns->ninsn, 512);
+			insns->ip[insns->ninsn++] = insn.ip;
+		}
+	}
+
+	ptu_int_eq(status, -pte_eos);
+
+	return ptu_passed();
+}
+
+/* Check that decoding trace while it is being collected gives the same
+ * instructions as decoding it all at once.
+ */
+static struct ptunit_result extend(struct block_fixture *bfix)
+{
+	struct pt_insn_decoder *decoder;
+	struct bfix_insns *expected, *insns;
+	struct pt_config config;
+	size_t idx;
+	int status;
+
+	expected = malloc(sizeof(*expected));
+	insns = malloc(sizeof(*insns));
+	ptu_ptr(expected);
+	ptu_ptr(insns);
+
+	config = bfix->config;
+	config.end = config.begin + 1;
+	config.live = 1;
+
+	decoder = pt_insn_alloc_decoder(&config);
+	ptu_ptr(decoder);
+
+	status = pt_insn_set_image(decoder, pt_insn_get_image(bfix->insn));
+	ptu_int_eq(status, 0);
+
+	ptu_test(bfix_insns, bfix, bfix->insn, expected);
+	ptu_test(bfix_insns, bfix, decoder, insns);
+
+	ptu_uint_ne(expected->ninsn, 0);
+	ptu_uint_eq(insns->ninsn, expected->ninsn);
+
+	for (idx = 0; idx < expected->ninsn; ++idx)
+		ptu_uint_eq(insns->ip[idx], expected->ip[idx]);
+
+	pt_insn_free_decoder(decoder);
+	free(insns);
+	free(expected);
+
+	return ptu_passed();
+}
+
+/* Check that pt_blk_extend() continues decoding blocks. */
+static struct ptunit_result extend_block(struct block_fixture *bfix)
+{
+	struct pt_block_decoder *decoder;
+	struct pt_config config;
+	uint64_t ninsn, expected;
+	uint8_t *end;
+	int status;
+
+	expected = 0ull;
+	for (;;) {
+		status = pt_blk_sync_forward(bfix->decoder);
+		if (status < 0)
+			break;
+
+		for (;;) {
+			struct pt_block block;
+
+			status = pt_blk_next(bfix->decoder, &block,
+					     sizeof(block));
+			if (status < 0)
+				break;
+
+			expected += block.ninsn;
+		}
+	}
+
+	config = bfix->config;
+	config.end = config.begin + 1;
+	config.live = 1;
+	end = config.end;
+
+	decoder = pt_blk_alloc_decoder(&config);
+	ptu_ptr(decoder);
+
+	status = pt_blk_set_image(decoder, pt_blk_get_image(bfix->decoder));
+	ptu_int_eq(status, 0);
+
+	ninsn = 0ull;
+	for (;;) {
+		status = pt_blk_sync_forward(decoder);
+		if (status == -pte_eos && end < bfix->config.end) {
+			status = pt_blk_extend(decoder, ++end);
+			ptu_int_eq(status, 0);
+			continue;
+		}
+
+		if (status < 0)
+			break;
+
+		for (;;) {
+			struct pt_block block;
+
+			status = pt_blk_next(decoder, &block, sizeof(block));
+			if (status == -pte_eos && end < bfix->config.end) {
+				status = pt_blk_extend(decoder, ++end);
+				ptu_int_eq(status, 0);
+				continue;
+			}
+
+			if (status < 0)
+				break;
+
+			ninsn += block.ninsn;
+		}
+	}
+
+	ptu_uint_ne(expected, 0ull);
+	ptu_uint_eq(ninsn, expected);
+
+	pt_blk_free_decoder(decoder);
+
+	return ptu_passed();
+}
+
+/* Check that decoding trace split into segments gives the same instructions
+ * as decoding it in one piece for every split.
+ */
+static struct ptunit_result segments(struct block_fixture *bfix)
+{
+	struct bfix_insns *expected, *insns;
+	struct pt_segment segment[3];
+	uint64_t size, split;
+	int status;
+
+	expected = malloc(sizeof(*expected));
+	insns = malloc(sizeof(*insns));
+	ptu_ptr(expected);
+	ptu_ptr(insns);
+
+	ptu_test(bfix_insns, bfix, bfix->insn, expected);
+	ptu_uint_ne(expected->ninsn, 0);
+
+	size = (uint64_t) (bfix->config.end - bfix->config.begin);
+	for (split = 0; split < size; ++split) {
+		struct pt_insn_decoder *decoder;
+		struct pt_config config;
+		size_t idx;
+
+		/* Split off the byte after @split into a tiny segment. */
+		segment[0].begin = bfix->config.begin;
+		segment[0].end = bfix->config.begin + split;
+		segment[1].begin = segment[0].end;
+		segment[1].end = segment[1].begin + 1;
+		segment[2].begin = segment[1].end;
+		segment[2].end = bfix->config.end;
+
+		config = bfix->config;
+		config.segments = segment;
+		config.nsegments = 3;
+
+		decoder = pt_insn_alloc_decoder(&config);
+		ptu_ptr(decoder);
+
+		status = pt_insn_set_image(decoder,
+					   pt_insn_get_image(bfix->insn));
+		ptu_int_eq(status, 0);
+
+		ptu_test(bfix_insns, bfix, decoder, insns);
+		ptu_uint_eq(insns->ninsn, expected->ninsn);
+
+		for (idx = 0; idx < expected->ninsn; ++idx)
+			ptu_uint_eq(insns->ip[idx], expected->ip[idx]);
+
+		pt_insn_free_decoder(decoder);
+	}
+
+	free(insns);
+	free(expected);
+
+	return ptu_passed();
+}
+
+/* Read @bfix's trace on demand. */
+static int bfix_read(uint8_t *buffer, size_t size, uint64_t offset,
+		     void *context)
+{
+	struct block_fixture *bfix;
+	uint64_t tsize;
+
+	bfix = (struct block_fixture *) context;
+	if (!bfix)
+		return -pte_internal;
+
+	tsize = (uint64_t) (bfix->config.end - bfix->config.begin);
+	if (tsize <= offset)
+		return 0;
+
+	if (tsize - offset < size)
+		size = (size_t) (tsize - offset);
+
+	memcpy(buffer, bfix->config.begin + offset, size);
+
+	return (int) size;
+}
+
+/* Check that reading the trace on demand in small windows gives the same
+ * instructions as decoding it in one piece.
+ */
+static struct ptunit_result source(struct block_fixture *bfix)
+{
+	struct pt_insn_decoder *decoder;
+	struct bfix_insns *expected, *insns;
+	struct pt_config config;
+	size_t idx;
+	int status;
+
+	expected = malloc(sizeof(*expected));
+	insns = malloc(sizeof(*insns));
+	ptu_ptr(expected);
+	ptu_ptr(insns);
+
+	config = bfix->config;
+	config.source.read = bfix_read;
+	config.source.context = bfix;
+	config.source.size =
+		(uint64_t) (bfix->config.end - bfix->config.begin);
+	config.source.window = 128;
+
+	decoder = pt_insn_alloc_decoder(&config);
+	ptu_ptr(decoder);
+
+	status = pt_insn_set_image(decoder, pt_insn_get_image(bfix->insn));
+	ptu_int_eq(status, 0);
+
+	ptu_test(bfix_insns, bfix, bfix->insn, expected);
+	ptu_test(bfix_insns, bfix, decoder, insns);
+
+	ptu_uint_ne(expected->ninsn, 0);
+	ptu_uint_eq(insns->ninsn, expected->ninsn);
+
+	for (idx = 0; idx < expected->ninsn; ++idx)
+		ptu_uint_eq(insns->ip[idx], expected->ip[idx]);
+
+	pt_insn_free_decoder(decoder);
+	free(insns);
+	free(expected);
+
+	return ptu_passed();
+}
+
+/* Decode the rest of @bfix's trace using @decoder. */
+static struct ptunit_result bfix_insns_rest(struct pt_insn_decoder *decoder,
+					    struct bfix_insns *insns)
+{
+	int status;
+
+	insns->ninsn = 0;
+
+	for (;;) {
+		for (;;) {
+			struct pt_insn insn;
+
+			status = pt_insn_next(decoder, &insn, sizeof(insn));
+			if (status < 0)
+				break;
+
+			ptu_uint_lt(insns->ninsn, 512);
+			insns->ip[insns->ninsn++] = insn.ip;
+		}
+
+		status = pt_insn_sync_forward(decoder);
+		if (status < 0)
+			break;
+	}
+
+	ptu_int_eq(status, -pte_eos);
+
+	return ptu_passed();
+}
+
+/* Check that restoring a checkpoint taken after each instruction into a new
+ * decoder gives the remaining instructions.
+ */
+static struct ptunit_result checkpoint(struct block_fixture *bfix)
+{
+	struct pt_insn_decoder *decoder, *restored;
+	struct bfix_insns *expected, *insns;
+	uint8_t buffer[1024];
+	size_t ninsn;
+	int status;
+
+	expected = malloc(sizeof(*expected));
+	insns = malloc(sizeof(*insns));
+	ptu_ptr(expected);
+	ptu_ptr(insns);
+
+	ptu_test(bfix_insns, bfix, bfix->insn, expected);
+	ptu_uint_ne(expected->ninsn, 0);
+
+	decoder = pt_insn_alloc_decoder(&bfix->config);
+	ptu_ptr(decoder);
+
+	status = pt_insn_set_image(decoder, pt_insn_get_image(bfix->insn));
+	ptu_int_eq(status, 0);
+
+	restored = pt_insn_alloc_decoder(&bfix->config);
+	ptu_ptr(restored);
+
+	status = pt_insn_set_image(restored, pt_insn_get_image(bfix->insn));
+	ptu_int_eq(status, 0);
+
+	ninsn = 0;
+	for (;;) {
+		status = pt_insn_sync_forward(decoder);
+		if (status < 0)
+			break;
+
+		for (;;) {
+			struct pt_insn insn;
+			size_t idx;
+			int size;
+
+			status = pt_insn_next(decoder, &insn, sizeof(insn));
+			if (status < 0)
+				break;
+
+			ptu_uint_lt(ninsn, expected->ninsn);
+			ptu_uint_eq(insn.ip, expected->ip[ninsn++]);
+
+			size = pt_insn_save(decoder, NULL, 0);
+			ptu_int_gt(size, 0);
+			ptu_uint_le((size_t) size, sizeof(buffer));
+
+			status = pt_insn_save(decoder, buffer, sizeof(buffer));
+			ptu_int_eq(status, size);
+
+			status = pt_insn_restore(restored, buffer,
+						 (size_t) size);
+			ptu_int_eq(status, 0);
+
+			ptu_test(bfix_insns_rest, restored, insns);
+			ptu_uint_eq(insns->ninsn, expected->ninsn - ninsn);
+
+			for (idx = 0; idx < insns->ninsn; ++idx)
+				ptu_uint_eq(insns->ip[idx],
+					    expected->ip[ninsn + idx]);
+		}
+	}
+
+	ptu_int_eq(status, -pte_eos);
+	ptu_uint_eq(ninsn, expected->ninsn);
+
+	pt_insn_free_decoder(restored);
+	pt_insn_free_decoder(decoder);
+	free(insns);
+	free(expected);
+
+	return ptu_passed();
+}
+
+/* Check that restoring a block decoder's checkpoint gives the remaining
+ * blocks.
+ */
+static struct ptunit_result checkpoint_block(struct block_fixture *bfix)
+{
+	struct pt_block_decoder *restored;
+	struct pt_block block;
+	uint8_t buffer[1024];
+	uint64_t ninsn, expected;
+	int status, size;
+
+	status = pt_blk_sync_forward(bfix->decoder);
+	ptu_int_ge(status, 0);
+
+	status = pt_blk_next(bfix->decoder, &block, sizeof(block));
+	ptu_int_ge(status, 0);
+
+	size = pt_blk_save(bfix->decoder, buffer, sizeof(buffer));
+	ptu_int_gt(size, 0);
+
+	expected = 0ull;
+	for (;;) {
+		for (;;) {
+			status = pt_blk_next(bfix->decoder, &block,
+					     sizeof(block));
+			if (status < 0)
+				break;
+
+			expected += block.ninsn;
+		}
+
+		status = pt_blk_sync_forward(bfix->decoder);
+		if (status < 0)
+			break;
+	}
+
+	restored = pt_blk_alloc_decoder(&bfix->config);
+	ptu_ptr(restored);
+
+	status = pt_blk_set_image(restored, pt_blk_get_image(bfix->decoder));
+	ptu_int_eq(status, 0);
+
+	status = pt_blk_restore(restored, buffer, (size_t) size);
+	ptu_int_eq(status, 0);
+
+	ninsn = 0ull;
+	for (;;) {
+		for (;;) {
+			status = pt_blk_next(restored, &block, sizeof(block));
+			if (status < 0)
+				break;
+
+			ninsn += block.ninsn;
+		}
+
+		status = pt_blk_sync_forward(restored);
+		if (status < 0)
+			break;
+	}
+
+	ptu_int_eq(status, -pte_eos);
+	ptu_uint_eq(ninsn, expected);
+
+	pt_blk_free_decoder(restored);
+
+	return ptu_passed();
+}
+
+/* Check that a checkpoint taken right after synchronizing can be restored
+ * and does not depend on anything but the decoder's state.
+ */
+static struct ptunit_result checkpoint_sync(struct block_fixture *bfix)
+{
+	struct pt_insn_decoder *decoder, *restored;
+	uint8_t buffer[1024], dbuffer[1024], rbuffer[1024];
+	int status, size;
+
+	memset(buffer, 0, sizeof(buffer));
+	memset(dbuffer, 0, sizeof(dbuffer));
+	memset(rbuffer, 0, sizeof(rbuffer));
+
+	decoder = pt_insn_alloc_decoder(&bfix->config);
+	ptu_ptr(decoder);
+
+	restored = pt_insn_alloc_decoder(&bfix->config);
+	ptu_ptr(restored);
+
+	status = pt_insn_sync_forward(bfix->insn);
+	ptu_int_ge(status, 0);
+
+	status = pt_insn_sync_forward(decoder);
+	ptu_int_ge(status, 0);
+
+	size = pt_insn_save(bfix->insn, buffer, sizeof(buffer));
+	ptu_int_gt(size, 0);
+
+	status = pt_insn_save(decoder, dbuffer, sizeof(dbuffer));
+	ptu_int_eq(status, size);
+	ptu_int_eq(memcmp(buffer, dbuffer, (size_t) size), 0);
+
+	status = pt_insn_restore(restored, buffer, (size_t) size);
+	ptu_int_eq(status, 0);
+
+	status = pt_insn_save(restored, rbuffer, sizeof(rbuffer));
+	ptu_int_eq(status, size);
+	ptu_int_eq(memcmp(buffer, rbuffer, (size_t) size), 0);
+
+	pt_insn_free_decoder(restored);
+	pt_insn_free_decoder(decoder);
+
+	return ptu_passed();
+}
+
+/* Check that a restored query decoder saves the same checkpoint. */
+static struct ptunit_result checkpoint_query(struct block_fixture *bfix)
+{
+	struct pt_query_decoder *decoder, *restored;
+	uint8_t buffer[1024], rbuffer[1024];
+	uint64_t ip;
+	int status, size;
+
+	decoder = pt_qry_alloc_decoder(&bfix->config);
+	ptu_ptr(decoder);
+
+	restored = pt_qry_alloc_decoder(&bfix->config);
+	ptu_ptr(restored);
+
+	status = pt_qry_save(decoder, buffer, sizeof(buffer));
+	ptu_int_eq(status, -pte_nosync);
+
+	status = pt_qry_sync_forward(decoder, &ip);
+	ptu_int_ge(status, 0);
+
+	size = pt_qry_save(decoder, buffer, sizeof(buffer));
+	ptu_int_gt(size, 0);
+
+	status = pt_qry_restore(restored, buffer, (size_t) size);
+	ptu_int_ge(status, 0);
+
+	status = pt_qry_save(restored, rbuffer, sizeof(rbuffer));
+	ptu_int_eq(status, size);
+	ptu_int_eq(memcmp(buffer, rbuffer, (size_t) size), 0);
+
+	pt_qry_free_decoder(restored);
+	pt_qry_free_decoder(decoder);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result checkpoint_fail(struct block_fixture *bfix)
+{
+	uint8_t buffer[1024];
+	int status, size;
+
+	status = pt_insn_save(NULL, buffer, sizeof(buffer));
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_insn_save(bfix->insn, buffer, sizeof(buffer));
+	ptu_int_eq(status, -pte_nosync);
+
+	status = pt_insn_sync_forward(bfix->insn);
+	ptu_int_ge(status, 0);
+
+	size = pt_insn_save(bfix->insn, buffer, sizeof(buffer));
+	ptu_int_gt(size, 0);
+
+	status = pt_insn_save(bfix->insn, buffer, (size_t) size - 1);
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_insn_restore(NULL, buffer, (size_t) size);
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_insn_restore(bfix->insn, NULL, (size_t) size);
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_insn_restore(bfix->insn, buffer, (size_t) size - 1);
+	ptu_int_eq(status, -pte_bad_file);
+
+	status = pt_blk_restore(bfix->decoder, buffer, (size_t) size);
+	ptu_int_eq(status, 0);
+
+	status = pt_qry_restore(&bfix->insn->query, buffer, (size_t) size);
+	ptu_int_eq(status, -pte_bad_file);
+
+	buffer[0] ^= 0xff;
+
+	status = pt_insn_restore(bfix->insn, buffer, (size_t) size);
+	ptu_int_eq(status, -pte_bad_file);
+
+	return ptu_passed();
+}
+
+/* The blocks collected by bfix_collect(). */
+struct bfix_blocks {
+	/* The blocks and their status. */
+	struct pt_block block[256];
+	int status[256];
+
+	/* The number of blocks. */
+	size_t nblocks;
+};
+
+static int bfix_collect(const struct pt_block *block, int status,
+			void *context)
+{
+	struct bfix_blocks *blocks;
+
+	blocks = (struct bfix_blocks *) context;
+	if (!blocks || !block)
+		return -pte_internal;
+
+	if (256 <= blocks->nblocks)
+		return -pte_nomem;
+
+	blocks->block[blocks->nblocks] = *block;
+	blocks->status[blocks->nblocks] = status;
+	blocks->nblocks += 1;
+
+	return 0;
+}
+
+static struct ptunit_result parallel_null(struct block_fixture *bfix)
+{
+	struct bfix_blocks blocks;
+	struct pt_image *image;
+	int errcode;
+
+	image = pt_blk_get_image(bfix->decoder);
+
+	errcode = pt_blk_decode_parallel(NULL, image, 1, bfix_collect,
+					 &blocks);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_blk_decode_parallel(&bfix->config, NULL, 1, bfix_collect,
+					 &blocks);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_blk_decode_parallel(&bfix->config, image, 1, NULL,
+					 &blocks);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static int bfix_fail(const struct pt_block *block, int status,
+		     void *context)
+{
+	(void) block;
+	(void) status;
+	(void) context;
+
+	return -pte_bad_config;
+}
+
+static struct ptunit_result parallel_fail(struct block_fixture *bfix)
+{
+	struct pt_image *image;
+	int errcode;
+
+	image = pt_blk_get_image(bfix->decoder);
+
+	errcode = pt_blk_decode_parallel(&bfix->config, image, 2, bfix_fail,
+					 NULL);
+	ptu_int_eq(errcode, -pte_bad_config);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result parallel(struct block_fixture *bfix,
+				     uint32_t nthreads)
+{
+	struct bfix_blocks serial, blocks;
+	struct pt_image *image;
+	struct pt_config config;
+	size_t idx;
+	int status;
+
+	memset(&serial, 0, sizeof(serial));
+	memset(&blocks, 0, sizeof(blocks));
+
+	for (;;) {
+		status = pt_blk_sync_forward(bfix->decoder);
+		if (status < 0)
+			break;
+
+		for (;;) {
+			struct pt_block block;
+
+			memset(&block, 0, sizeof(block));
+
+			status = pt_blk_next(bfix->decoder, &block,
+					     sizeof(block));
+			if (status == -pte_eos)
+				break;
+
+			status = bfix_collect(&block, status, &serial);
+			ptu_int_eq(status, 0);
+
+			if (serial.status[serial.nblocks - 1] < 0)
+				break;
+		}
+	}
+	ptu_int_eq(status, -pte_eos);
+	ptu_uint_gt(serial.nblocks, 0);
+
+	image = pt_blk_get_image(bfix->decoder);
+
+	status = pt_blk_decode_parallel(&bfix->config, image, nthreads,
+					bfix_collect, &blocks);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(blocks.nblocks, serial.nblocks);
+
+	for (idx = 0; idx < serial.nblocks; ++idx) {
+		ptu_int_eq(blocks.status[idx], serial.status[idx]);
+		ptu_uint_eq(blocks.block[idx].ip, serial.block[idx].ip);
+		ptu_uint_eq(blocks.block[idx].end_ip,
+			    serial.block[idx].end_ip);
+		ptu_uint_eq(blocks.block[idx].ninsn, serial.block[idx].ninsn);
+		ptu_int_eq(blocks.block[idx].mode, serial.block[idx].mode);
+		ptu_uint_eq(blocks.block[idx].enabled,
+			    serial.block[idx].enabled);
+		ptu_uint_eq(blocks.block[idx].disabled,
+			    serial.block[idx].disabled);
+		ptu_uint_eq(blocks.block[idx].resumed,
+			    serial.block[idx].resumed);
+		ptu_uint_eq(blocks.block[idx].interrupted,
+			    serial.block[idx].interrupted);
+	}
+
+	/* Each chunk reads its part of the trace on demand. */
+	config = bfix->config;
+	config.source.read = bfix_read;
+	config.source.context = bfix;
+	config.source.size =
+		(uint64_t) (bfix->config.end - bfix->config.begin);
+	config.source.window = 128;
+
+	memset(&blocks, 0, sizeof(blocks));
+
+	status = pt_blk_decode_parallel(&config, image, nthreads,
+					bfix_collect, &blocks);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(blocks.nblocks, serial.nblocks);
+
+	for (idx = 0; idx < serial.nblocks; ++idx) {
+		ptu_int_eq(blocks.status[idx], serial.status[idx]);
+		ptu_uint_eq(blocks.block[idx].ip, serial.block[idx].ip);
+		ptu_uint_eq(blocks.block[idx].ninsn, serial.block[idx].ninsn);
+	}
+
+	return ptu_passed();
+}
+
+/* The blocks collected by bfix_collect_dense(). */
+struct bfix_dense {
+	/* The block addresses, sizes, and status. */
+	uint64_t ip[0x9000];
+	uint16_t ninsn[0x9000];
+	int status[0x9000];
+
+	/* The number of blocks. */
+	size_t nblocks;
+};
+
+static int bfix_collect_dense(const struct pt_block *block, int status,
+			      void *context)
+{
+	struct bfix_dense *blocks;
+
+	blocks = (struct bfix_dense *) context;
+	if (!blocks || !block)
+		return -pte_internal;
+
+	if (0x9000 <= blocks->nblocks)
+		return -pte_nomem;
+
+	blocks->ip[blocks->nblocks] = block->ip;
+	blocks->ninsn[blocks->nblocks] = block->ninsn;
+	blocks->status[blocks->nblocks] = status;
+	blocks->nblocks += 1;
+
+	return 0;
+}
+
+/* Check that decoding a trace with more blocks than are kept per chunk in
+ * parallel gives the same blocks as decoding it serially.
+ */
+static struct ptunit_result parallel_dense(struct block_fixture *bfix,
+					   uint32_t nthreads)
+{
+	struct bfix_dense *serial, *blocks;
+	size_t idx;
+	int status;
+
+	serial = malloc(sizeof(*serial));
+	blocks = malloc(sizeof(*blocks));
+	ptu_ptr(serial);
+	ptu_ptr(blocks);
+
+	serial->nblocks = 0;
+	blocks->nblocks = 0;
+
+	status = pt_blk_sync_forward(bfix->decoder);
+	ptu_int_ge(status, 0);
+
+	for (;;) {
+		struct pt_block block;
+
+		status = pt_blk_next(bfix->decoder, &block, sizeof(block));
+		if (status < 0)
+			break;
+
+		status = bfix_collect_dense(&block, status, serial);
+		ptu_int_eq(status, 0);
+	}
+	ptu_int_eq(status, -pte_eos);
+	ptu_uint_gt(serial->nblocks, 0x8000);
+
+	status = pt_blk_decode_parallel(&bfix->config,
+					pt_blk_get_image(bfix->decoder),
+					nthreads, bfix_collect_dense, blocks);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(blocks->nblocks, serial->nblocks);
+
+	for (idx = 0; idx < serial->nblocks; ++idx) {
+		ptu_int_eq(blocks->status[idx], serial->status[idx]);
+		ptu_uint_eq(blocks->ip[idx], serial->ip[idx]);
+		ptu_uint_eq(blocks->ninsn[idx], serial->ninsn[idx]);
+	}
+
+	free(blocks);
+	free(serial);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result remove_asid(struct block_fixture *bfix)
+{
+	struct pt_block block;
+	struct pt_insn insn;
+	struct pt_image *image;
+	uint64_t ninsn, nblocks;
+	int status;
+
+	status = pt_blk_sync_forward(bfix->decoder);
+	ptu_int_ge(status, 0);
+
+	status = pt_insn_sync_forward(bfix->insn);
+	ptu_int_ge(status, 0);
+
+	/* Decode a few iterations so the decoders remember the loop. */
+	status = pt_blk_next(bfix->decoder, &block, sizeof(block));
+	ptu_int_eq(status, 0);
+
+	status = pt_blk_skip(bfix->decoder, &ninsn, &nblocks);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(nblocks, 45ull);
+
+	status = pt_blk_next(bfix->decoder, &block, sizeof(block));
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(block.ip, 0x1000ull);
+
+	for (ninsn = 0; ninsn < 9; ++ninsn) {
+		status = pt_insn_next(bfix->insn, &insn, sizeof(insn));
+		ptu_int_eq(status, 0);
+	}
+
+	image = pt_blk_get_image(bfix->decoder);
+	status = pt_image_remove_by_asid(image, NULL);
+	ptu_int_eq(status, 1);
+
+	image = pt_insn_get_image(bfix->insn);
+	status = pt_image_remove_by_asid(image, NULL);
+	ptu_int_eq(status, 1);
+
+	/* The loop is gone. */
+	status = pt_blk_next(bfix->decoder, &block, sizeof(block));
+	ptu_int_eq(status, -pte_nomap);
+
+	status = pt_insn_next(bfix->insn, &insn, sizeof(insn));
+	ptu_int_eq(status, -pte_nomap);
+
+	return ptu_passed();
+}
+
+/* Run @test after pre-decoding the block decoder's image. */
+static struct ptunit_result
+predecoded(struct block_fixture *bfix,
+	   struct ptunit_result (*test)(struct block_fixture *))
+{
+	struct pt_image *image;
+	int errcode;
+
+	image = pt_blk_get_image(bfix->decoder);
+	errcode = pt_image_predecode(image, ptem_64bit, NULL);
+	ptu_int_eq(errcode, 0);
+
+	ptu_test(test, bfix);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result predecode_null(void)
+{
+	struct pt_image *image;
+	int errcode;
+
+	errcode = pt_image_predecode(NULL, ptem_64bit, NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	image = pt_image_alloc(NULL);
+	ptu_ptr(image);
+
+	errcode = pt_image_predecode(image, ptem_unknown, NULL);
+	ptu_int_eq(errcode, -pte_bad_insn);
+
+	errcode = pt_image_predecode(image, ptem_64bit, NULL);
+	ptu_int_eq(errcode, 0);
+
+	pt_image_free(image);
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct block_fixture bfix;
+	struct ptunit_suite suite;
+
+	bfix.init = bfix_init;
+	bfix.fini = bfix_fini;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run(suite, null);
+	ptu_run_f(suite, next_null, bfix);
+	ptu_run_f(suite, next_nosync, bfix);
+	ptu_run_f(suite, first, bfix);
+	ptu_run_f(suite, same_insn, bfix);
+	ptu_run_f(suite, branch_null, bfix);
+	ptu_run_f(suite, branch_first, bfix);
+	ptu_run_f(suite, branch_same_insn, bfix);
+	ptu_run_fp(suite, predecoded, bfix, same_insn);
+	ptu_run_fp(suite, predecoded, bfix, branch_same_insn);
+	ptu_run(suite, predecode_null);
+	ptu_run_f(suite, skip_null, bfix);
+	ptu_run_f(suite, skip_nosync, bfix);
+	ptu_run_f(suite, skip_same_block, bfix);
+	ptu_run_f(suite, extend, bfix);
+	ptu_run_f(suite, extend_block, bfix);
+	ptu_run_f(suite, segments, bfix);
+	ptu_run_f(suite, source, bfix);
+	ptu_run_f(suite, checkpoint, bfix);
+	ptu_run_f(suite, checkpoint_block, bfix);
+	ptu_run_f(suite, checkpoint_sync, bfix);
+	ptu_run_f(suite, checkpoint_query, bfix);
+	ptu_run_f(suite, checkpoint_fail, bfix);
+
+	bfix.init = bfix_init_loop;
+
+	ptu_run_f(suite, skip_same_block, bfix);
+	ptu_run_f(suite, skip_loop, bfix);
+	ptu_run_f(suite, remove_asid, bfix);
+	ptu_run_fp(suite, predecoded, bfix, remove_asid);
+	ptu_run_fp(suite, predecoded, bfix, skip_same_block);
+	ptu_run_fp(suite, parallel, bfix, 1);
+	ptu_run_f(suite, extend, bfix);
+	ptu_run_f(suite, extend_block, bfix);
+	ptu_run_f(suite, segments, bfix);
+	ptu_run_f(suite, source, bfix);
+	ptu_run_f(suite, checkpoint, bfix);
+	ptu_run_f(suite, checkpoint_block, bfix);
+
+	bfix.init = bfix_init_psb;
+
+	ptu_run_f(suite, parallel_null, bfix);
+	ptu_run_f(suite, parallel_fail, bfix);
+	ptu_run_fp(suite, parallel, bfix, 1);
+	ptu_run_fp(suite, parallel, bfix, 2);
+	ptu_run_fp(suite, parallel, bfix, 4);
+	ptu_run_f(suite, extend, bfix);
+	ptu_run_f(suite, extend_block, bfix);
+	ptu_run_f(suite, segments, bfix);
+	ptu_run_f(suite, source, bfix);
+	ptu_run_f(suite, checkpoint, bfix);
+	ptu_run_f(suite, checkpoint_block, bfix);
+
+	bfix.init = bfix_init_dense;
+
+	ptu_run_fp(suite, parallel_dense, bfix, 1);
+	ptu_run_fp(suite, parallel_dense, bfix, 2);
+	ptu_run_fp(suite, parallel_dense, bfix, 4);
+
+	bfix.init = bfix_init_time;
+
+	ptu_run_f(suite, sync_time_early, bfix);
+	ptu_run_f(suite, sync_time, bfix);
+	ptu_run_f(suite, sync_time_late, bfix);
+	ptu_run_f(suite, extend, bfix);
+	ptu_run_f(suite, extend_block, bfix);
+	ptu_run_f(suite, segments, bfix);
+	ptu_run_f(suite, source, bfix);
+	ptu_run_f(suite, checkpoint, bfix);
+	ptu_run_f(suite, checkpoint_block, bfix);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}
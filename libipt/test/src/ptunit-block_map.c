@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ptunit.h"
+#include "ptunit_mktempname.h"
+
+#include "pt_block_map.h"
+#include "pt_section.h"
+
+#include "pti-ild.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* Our test code.
+ *
+ *   0x0:  nop
+ *   0x1:  mov $0x90909090, %eax
+ *   0x6:  nop
+ *   0x7:  jmp 0x0
+ *   0x9:  nop
+ *   0xa:  ret
+ *   0xb:  nop
+ *   0xc:  mov $..., %eax (truncated)
+ *
+ * The linear decode gets back in sync at 0xd, where it finds a nop.
+ */
+static const uint8_t code[] = {
+	0x90, 0xb8, 0x90, 0x90, 0x90, 0x90, 0x90, 0xeb, 0xf7, 0x90, 0xc3,
+	0x90, 0xb8, 0x90
+};
+
+/* A test fixture providing a map for our test code. */
+struct bmap_fixture {
+	/* The block map. */
+	struct pt_block_map *bmap;
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct bmap_fixture *);
+	struct ptunit_result (*fini)(struct bmap_fixture *);
+};
+
+static struct ptunit_result bfix_init(struct bmap_fixture *bfix)
+{
+	int errcode;
+
+	bfix->bmap = pt_bmap_alloc(sizeof(code), ptem_64bit);
+	ptu_ptr(bfix->bmap);
+
+	errcode = pt_bmap_build(bfix->bmap, code);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result bfix_fini(struct bmap_fixture *bfix)
+{
+	pt_bmap_free(bfix->bmap);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result free_null(void)
+{
+	pt_bmap_free(NULL);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result build_null(void)
+{
+	struct pt_block_map *bmap;
+	int errcode;
+
+	errcode = pt_bmap_build(NULL, code);
+	ptu_int_eq(errcode, -pte_internal);
+
+	bmap = pt_bmap_alloc(sizeof(code), ptem_64bit);
+	ptu_ptr(bmap);
+
+	errcode = pt_bmap_build(bmap, NULL);
+	ptu_int_eq(errcode, -pte_internal);
+
+	pt_bmap_free(bmap);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result build_bad_mode(void)
+{
+	struct pt_block_map *bmap;
+	int errcode;
+
+	bmap = pt_bmap_alloc(sizeof(code), ptem_unknown);
+	ptu_ptr(bmap);
+
+	errcode = pt_bmap_build(bmap, code);
+	ptu_int_eq(errcode, -pte_bad_insn);
+
+	pt_bmap_free(bmap);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result skip_null(struct bmap_fixture *bfix)
+{
+	uint64_t offset, last;
+	uint32_t ninsn;
+	int errcode;
+
+	offset = 0ull;
+	errcode = pt_bmap_skip(NULL, &offset, &last, &ninsn, 8);
+	ptu_int_eq(errcode, -pte_internal);
+
+	errcode = pt_bmap_skip(bfix->bmap, NULL, &last, &ninsn, 8);
+	ptu_int_eq(errcode, -pte_internal);
+
+	errcode = pt_bmap_skip(bfix->bmap, &offset, NULL, &ninsn, 8);
+	ptu_int_eq(errcode, -pte_internal);
+
+	errcode = pt_bmap_skip(bfix->bmap, &offset, &last, NULL, 8);
+	ptu_int_eq(errcode, -pte_internal);
+
+	return ptu_passed();
+}
+
+/* Check walking from @begin to @end over @count instructions. */
+static struct ptunit_result skip(struct bmap_fixture *bfix, uint64_t begin,
+				 uint64_t end, uint64_t expected_last,
+				 uint32_t count)
+{
+	uint64_t offset, last;
+	uint32_t ninsn;
+	int status;
+
+	offset = begin;
+	status = pt_bmap_skip(bfix->bmap, &offset, &last, &ninsn, 8);
+	ptu_int_gt(status, 0);
+	ptu_uint_eq(offset, end);
+	ptu_uint_eq(last, expected_last);
+	ptu_uint_eq(ninsn, count);
+
+	return ptu_passed();
+}
+
+/* Check that @begin can't be walked over with at most @max instructions. */
+static struct ptunit_result skip_none(struct bmap_fixture *bfix,
+				      uint64_t begin, uint32_t max)
+{
+	uint64_t offset, last;
+	uint32_t ninsn;
+	int status;
+
+	offset = begin;
+	status = pt_bmap_skip(bfix->bmap, &offset, &last, &ninsn, max);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(offset, begin);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result skip_long(void)
+{
+	struct pt_block_map *bmap;
+	uint8_t nops[0x123];
+	uint64_t offset, last;
+	uint32_t ninsn;
+	int status;
+
+	memset(nops, 0x90, sizeof(nops));
+	nops[sizeof(nops) - 1] = 0xc3;
+
+	bmap = pt_bmap_alloc(sizeof(nops), ptem_32bit);
+	ptu_ptr(bmap);
+
+	status = pt_bmap_build(bmap, nops);
+	ptu_int_eq(status, 0);
+
+	offset = 0x3ull;
+	status = pt_bmap_skip(bmap, &offset, &last, &ninsn, UINT32_MAX);
+	ptu_int_gt(status, 0);
+	ptu_uint_eq(offset, sizeof(nops) - 1);
+	ptu_uint_eq(last, sizeof(nops) - 2);
+	ptu_uint_eq(ninsn, sizeof(nops) - 4);
+
+	offset = 0x40ull;
+	status = pt_bmap_skip(bmap, &offset, &last, &ninsn, UINT32_MAX);
+	ptu_int_gt(status, 0);
+	ptu_uint_eq(offset, sizeof(nops) - 1);
+	ptu_uint_eq(ninsn, sizeof(nops) - 0x41);
+
+	pt_bmap_free(bmap);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result skip_end(void)
+{
+	struct pt_block_map *bmap;
+	uint8_t nops[0x80];
+	uint64_t offset, last;
+	uint32_t ninsn;
+	int status;
+
+	memset(nops, 0x90, sizeof(nops));
+
+	bmap = pt_bmap_alloc(sizeof(nops), ptem_16bit);
+	ptu_ptr(bmap);
+
+	status = pt_bmap_build(bmap, nops);
+	ptu_int_eq(status, 0);
+
+	/* Without a stop, the run ends at the end of the section. */
+	offset = 0x7full;
+	status = pt_bmap_skip(bmap, &offset, &last, &ninsn, UINT32_MAX);
+	ptu_int_gt(status, 0);
+	ptu_uint_eq(offset, sizeof(nops));
+	ptu_uint_eq(last, sizeof(nops) - 1);
+	ptu_uint_eq(ninsn, 1);
+
+	offset = sizeof(nops);
+	status = pt_bmap_skip(bmap, &offset, &last, &ninsn, UINT32_MAX);
+	ptu_int_eq(status, 0);
+
+	pt_bmap_free(bmap);
+
+	return ptu_passed();
+}
+
+/* A test fixture providing a file section for our test code. */
+struct section_fixture {
+	/* The name of a temporary file holding the test code. */
+	char *name;
+
+	/* The directory in which the temporary file resides. */
+	char *dir;
+
+	/* Two sections for the file. */
+	struct pt_section *section[2];
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct section_fixture *);
+	struct ptunit_result (*fini)(struct section_fixture *);
+};
+
+static struct ptunit_result sfix_init(struct section_fixture *sfix)
+{
+	FILE *file;
+	size_t written;
+	char *sep;
+
+	sfix->name = mktempname();
+	ptu_ptr(sfix->name);
+
+	file = fopen(sfix->name, "wb");
+	ptu_ptr(file);
+
+	written = fwrite(code, 1, sizeof(code), file);
+	ptu_uint_eq(written, sizeof(code));
+
+	fclose(file);
+
+	sfix->dir = malloc(strlen(sfix->name) + 1);
+	ptu_ptr(sfix->dir);
+
+	strcpy(sfix->dir, sfix->name);
+
+	sep = strrchr(sfix->dir, '/');
+	if (!sep)
+		sep = strrchr(sfix->dir, '\\');
+	ptu_ptr(sep);
+
+	*sep = 0;
+
+	sfix->section[0] = pt_mk_section(sfix->name, 0ull, sizeof(code));
+	ptu_ptr(sfix->section[0]);
+
+	sfix->section[1] = pt_mk_section(sfix->name, 0ull, sizeof(code));
+	ptu_ptr(sfix->section[1]);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result sfix_fini(struct section_fixture *sfix)
+{
+	char *cache;
+	int errcode;
+
+	cache = pt_bmap_cache_file(sfix->section[0], ptem_64bit, sfix->dir);
+	if (cache) {
+		(void) remove(cache);
+		free(cache);
+	}
+
+	errcode = pt_section_put(sfix->section[0]);
+	ptu_int_eq(errcode, 0);
+
+	errcode = pt_section_put(sfix->section[1]);
+	ptu_int_eq(errcode, 0);
+
+	(void) remove(sfix->name);
+	free(sfix->name);
+	free(sfix->dir);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result section_null(void)
+{
+	int errcode;
+
+	errcode = pt_bmap_section(NULL, ptem_64bit, NULL);
+	ptu_int_eq(errcode, -pte_internal);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result section_bad_mode(struct section_fixture *sfix)
+{
+	int errcode;
+
+	errcode = pt_bmap_section(sfix->section[0], ptem_unknown, NULL);
+	ptu_int_eq(errcode, -pte_bad_insn);
+	ptu_null(pt_section_bmap(sfix->section[0]));
+
+	return ptu_passed();
+}
+
+static struct ptunit_result section(struct section_fixture *sfix)
+{
+	const struct pt_block_map *bmap;
+	uint64_t offset, last;
+	uint32_t ninsn;
+	int errcode;
+
+	errcode = pt_bmap_section(sfix->section[0], ptem_64bit, NULL);
+	ptu_int_eq(errcode, 0);
+
+	bmap = pt_section_bmap(sfix->section[0]);
+	ptu_ptr(bmap);
+	ptu_uint_eq(bmap->size, sizeof(code));
+	ptu_int_eq(bmap->mode, ptem_64bit);
+
+	offset = 0ull;
+	errcode = pt_bmap_skip(bmap, &offset, &last, &ninsn, 8);
+	ptu_int_gt(errcode, 0);
+	ptu_uint_eq(offset, 0x7ull);
+	ptu_uint_eq(ninsn, 3);
+
+	/* A section is only decoded once. */
+	errcode = pt_bmap_section(sfix->section[0], ptem_32bit, NULL);
+	ptu_int_eq(errcode, 0);
+	ptu_ptr_eq(pt_section_bmap(sfix->section[0]), bmap);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result section_cache(struct section_fixture *sfix)
+{
+	const struct pt_block_map *bmap;
+	uint64_t offset, last;
+	uint32_t ninsn;
+	uint8_t buffer[0x100];
+	size_t size;
+	FILE *file;
+	char *cache;
+	int errcode;
+
+	cache = pt_bmap_cache_file(sfix->section[0], ptem_64bit, sfix->dir);
+	ptu_ptr(cache);
+
+	errcode = pt_bmap_section(sfix->section[0], ptem_64bit, sfix->dir);
+	ptu_int_eq(errcode, 0);
+
+	/* Clear the instruction bit-vector in the cache file.  It consists of
+	 * a single word right after the header.
+	 */
+	file = fopen(cache, "rb");
+	ptu_ptr(file);
+
+	size = fread(buffer, 1, sizeof(buffer), file);
+	fclose(file);
+
+	ptu_uint_gt(size, 16);
+	memset(&buffer[size - 16], 0, 8);
+
+	file = fopen(cache, "wb");
+	ptu_ptr(file);
+
+	ptu_uint_eq(fwrite(buffer, 1, size, file), size);
+	fclose(file);
+
+	free(cache);
+
+	/* The second section is identical to the first.  Its map is read
+	 * from the cache file.
+	 */
+	errcode = pt_bmap_section(sfix->section[1], ptem_64bit, sfix->dir);
+	ptu_int_eq(errcode, 0);
+
+	bmap = pt_section_bmap(sfix->section[1]);
+	ptu_ptr(bmap);
+
+	offset = 0ull;
+	errcode = pt_bmap_skip(bmap, &offset, &last, &ninsn, 8);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result section_cache_mode(struct section_fixture *sfix)
+{
+	const struct pt_block_map *bmap;
+	char *cache;
+	int errcode;
+
+	errcode = pt_bmap_section(sfix->section[0], ptem_64bit, sfix->dir);
+	ptu_int_eq(errcode, 0);
+
+	/* The cache file does not match a different mode. */
+	errcode = pt_bmap_section(sfix->section[1], ptem_32bit, sfix->dir);
+	ptu_int_eq(errcode, 0);
+
+	bmap = pt_section_bmap(sfix->section[1]);
+	ptu_ptr(bmap);
+	ptu_int_eq(bmap->mode, ptem_32bit);
+
+	cache = pt_bmap_cache_file(sfix->section[1], ptem_32bit, sfix->dir);
+	ptu_ptr(cache);
+
+	(void) remove(cache);
+	free(cache);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result section_cache_bad_dir(struct section_fixture *sfix)
+{
+	int errcode;
+
+	/* Failing to write the cache file is not an error. */
+	errcode = pt_bmap_section(sfix->section[0], ptem_64bit,
+				  "/no/such/directory");
+	ptu_int_eq(errcode, 0);
+	ptu_ptr(pt_section_bmap(sfix->section[0]));
+
+	return ptu_passed();
+}
+
+static struct ptunit_result cache_file_null(struct section_fixture *sfix)
+{
+	ptu_null(pt_bmap_cache_file(NULL, ptem_64bit, sfix->dir));
+	ptu_null(pt_bmap_cache_file(sfix->section[0], ptem_64bit, NULL));
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct bmap_fixture bfix;
+	struct section_fixture sfix;
+	struct ptunit_suite suite;
+
+	bfix.init = bfix_init;
+	bfix.fini = bfix_fini;
+
+	sfix.init = sfix_init;
+	sfix.fini = sfix_fini;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run(suite, free_null);
+	ptu_run(suite, build_null);
+	ptu_run(suite, build_bad_mode);
+	ptu_run_f(suite, skip_null, bfix);
+	ptu_run_fp(suite, skip, bfix, 0x0ull, 0x7ull, 0x6ull, 3);
+	ptu_run_fp(suite, skip, bfix, 0x1ull, 0x7ull, 0x6ull, 2);
+	ptu_run_fp(suite, skip, bfix, 0x6ull, 0x7ull, 0x6ull, 1);
+	ptu_run_fp(suite, skip, bfix, 0x9ull, 0xaull, 0x9ull, 1);
+	ptu_run_fp(suite, skip, bfix, 0xbull, 0xcull, 0xbull, 1);
+	ptu_run_fp(suite, skip, bfix, 0xdull, 0xeull, 0xdull, 1);
+	ptu_run_fp(suite, skip_none, bfix, 0x0ull, 2);
+	ptu_run_fp(suite, skip_none, bfix, 0x2ull, 8);
+	ptu_run_fp(suite, skip_none, bfix, 0x7ull, 8);
+	ptu_run_fp(suite, skip_none, bfix, 0xaull, 8);
+	ptu_run_fp(suite, skip_none, bfix, 0xcull, 8);
+	ptu_run_fp(suite, skip_none, bfix, sizeof(code), 8);
+	ptu_run(suite, skip_long);
+	ptu_run(suite, skip_end);
+	ptu_run(suite, section_null);
+	ptu_run_f(suite, section_bad_mode, sfix);
+	ptu_run_f(suite, section, sfix);
+	ptu_run_f(suite, section_cache, sfix);
+	ptu_run_f(suite, section_cache_mode, sfix);
+	ptu_run_f(suite, section_cache_bad_dir, sfix);
+	ptu_run_f(suite, cache_file_null, sfix);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}
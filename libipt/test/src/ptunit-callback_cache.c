@@ -0,0 +1,543 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "ptunit.h"
+
+#include "pt_callback_cache.h"
+
+#include "intel-pt.h"
+
+
+enum {
+	/* The memory provided by our test callback. */
+	ccfix_begin	= 0x1010,
+	ccfix_end	= 0x3000,
+
+	/* The cache configuration. */
+	ccfix_granule	= 0x100,
+	ccfix_npages	= 0x4
+};
+
+/* A test fixture providing a callback cache and a test callback. */
+struct callback_cache_fixture {
+	/* The callback cache. */
+	struct pt_callback_cache cache;
+
+	/* The asids. */
+	struct pt_asid asid[2];
+
+	/* The number of callback invocations. */
+	uint32_t ncalls;
+
+	/* The status of a nested read from the cache inside the callback. */
+	int nested;
+
+	/* Flags telling the callback to read from the cache or to invalidate
+	 * the page it is asked for on its next invocation.
+	 */
+	uint32_t reenter:1;
+	uint32_t invalidate:1;
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct callback_cache_fixture *);
+	struct ptunit_result (*fini)(struct callback_cache_fixture *);
+};
+
+/* The content of the test memory at @addr in @asid. */
+static uint8_t ccfix_byte(const struct pt_asid *asid, uint64_t addr)
+{
+	return (uint8_t) (addr ^ asid->cr3);
+}
+
+/* Our test callback providing memory in [ccfix_begin; ccfix_end[. */
+static int ccfix_callback(uint8_t *buffer, size_t size,
+			  const struct pt_asid *asid, uint64_t ip,
+			  void *context)
+{
+	struct callback_cache_fixture *ccfix;
+	size_t idx;
+
+	ccfix = context;
+	if (!ccfix || !buffer || !asid)
+		return -pte_internal;
+
+	ccfix->ncalls += 1;
+
+	if (ccfix->reenter) {
+		uint8_t nested[0x10];
+
+		ccfix->reenter = 0;
+		ccfix->nested = pt_callback_cache_read(&ccfix->cache,
+						       ccfix_callback, ccfix,
+						       nested, sizeof(nested),
+						       asid, 0x2900ull);
+	}
+
+	if (ccfix->invalidate) {
+		ccfix->invalidate = 0;
+		(void) pt_callback_cache_invalidate(&ccfix->cache, asid, ip,
+						    size);
+	}
+
+	if ((ip < ccfix_begin) || (ccfix_end <= ip))
+		return -pte_nomap;
+
+	if ((ccfix_end - ip) < size)
+		size = (size_t) (ccfix_end - ip);
+
+	for (idx = 0; idx < size; ++idx)
+		buffer[idx] = ccfix_byte(asid, ip + idx);
+
+	return (int) size;
+}
+
+/* Read @size bytes at @addr in @asid and check the result.
+ *
+ * Expects @expected bytes to be read.
+ */
+static struct ptunit_result ccfix_read(struct callback_cache_fixture *ccfix,
+				       const struct pt_asid *asid,
+				       uint64_t addr, uint16_t size,
+				       int expected)
+{
+	uint8_t buffer[0x20];
+	int status, idx;
+
+	ptu_uint_le(size, sizeof(buffer));
+
+	status = pt_callback_cache_read(&ccfix->cache, ccfix_callback, ccfix,
+					buffer, size, asid, addr);
+	ptu_int_eq(status, expected);
+
+	for (idx = 0; idx < status; ++idx)
+		ptu_uint_eq(buffer[idx], ccfix_byte(asid, addr + idx));
+
+	return ptu_passed();
+}
+
+static struct ptunit_result init_null(void)
+{
+	pt_callback_cache_init(NULL);
+	pt_callback_cache_fini(NULL);
+	pt_callback_cache_clear(NULL);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result configure_null(void)
+{
+	int status;
+
+	status = pt_callback_cache_configure(NULL, ccfix_granule, 1);
+	ptu_int_eq(status, -pte_internal);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result
+configure_bad_granule(struct callback_cache_fixture *ccfix)
+{
+	int status;
+
+	status = pt_callback_cache_configure(&ccfix->cache, 0x30, 1);
+	ptu_int_eq(status, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result configure_off(struct callback_cache_fixture *ccfix)
+{
+	int status;
+
+	status = pt_callback_cache_configure(&ccfix->cache, 0, 0);
+	ptu_int_eq(status, 0);
+	ptu_null(ccfix->cache.pages);
+	ptu_uint_eq(ccfix->cache.npages, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_null(struct callback_cache_fixture *ccfix)
+{
+	uint8_t buffer[] = { 0xcc };
+	int status;
+
+	status = pt_callback_cache_read(NULL, ccfix_callback, ccfix, buffer,
+					sizeof(buffer), &ccfix->asid[0],
+					ccfix_begin);
+	ptu_int_eq(status, -pte_internal);
+
+	status = pt_callback_cache_read(&ccfix->cache, NULL, ccfix, buffer,
+					sizeof(buffer), &ccfix->asid[0],
+					ccfix_begin);
+	ptu_int_eq(status, -pte_internal);
+
+	status = pt_callback_cache_read(&ccfix->cache, ccfix_callback, ccfix,
+					NULL, sizeof(buffer), &ccfix->asid[0],
+					ccfix_begin);
+	ptu_int_eq(status, -pte_internal);
+
+	status = pt_callback_cache_read(&ccfix->cache, ccfix_callback, ccfix,
+					buffer, sizeof(buffer), NULL,
+					ccfix_begin);
+	ptu_int_eq(status, -pte_internal);
+	ptu_uint_eq(buffer[0], 0xcc);
+	ptu_uint_eq(ccfix->ncalls, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_disabled(struct callback_cache_fixture *ccfix)
+{
+	ptu_test(configure_off, ccfix);
+
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+
+	ptu_uint_eq(ccfix->ncalls, 2);
+	ptu_uint_eq(ccfix->cache.hits, 0);
+	ptu_uint_eq(ccfix->cache.misses, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_hit(struct callback_cache_fixture *ccfix)
+{
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2010ull, 0x10, 0x10);
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x20f0ull, 0x10, 0x10);
+
+	ptu_uint_eq(ccfix->ncalls, 1);
+	ptu_uint_eq(ccfix->cache.hits, 2);
+	ptu_uint_eq(ccfix->cache.misses, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_cross(struct callback_cache_fixture *ccfix)
+{
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x20f8ull, 0x10, 0x10);
+
+	ptu_uint_eq(ccfix->ncalls, 2);
+	ptu_uint_eq(ccfix->cache.misses, 2);
+
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x20f8ull, 0x10, 0x10);
+
+	ptu_uint_eq(ccfix->ncalls, 2);
+	ptu_uint_eq(ccfix->cache.hits, 2);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_asid(struct callback_cache_fixture *ccfix)
+{
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[1], 0x2000ull, 0x10, 0x10);
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[1], 0x2000ull, 0x10, 0x10);
+
+	ptu_uint_eq(ccfix->ncalls, 2);
+	ptu_uint_eq(ccfix->cache.hits, 2);
+	ptu_uint_eq(ccfix->cache.misses, 2);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_evict(struct callback_cache_fixture *ccfix)
+{
+	uint64_t addr;
+
+	addr = 0x2000ull + (ccfix_granule * ccfix_npages);
+
+	/* Both pages map to the same slot. */
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], addr, 0x10, 0x10);
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+
+	ptu_uint_eq(ccfix->ncalls, 3);
+	ptu_uint_eq(ccfix->cache.misses, 3);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result
+read_partial_page(struct callback_cache_fixture *ccfix)
+{
+	/* The page containing ccfix_begin can't be provided as a whole. */
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], ccfix_begin, 0x10, 0x10);
+
+	ptu_uint_eq(ccfix->ncalls, 2);
+	ptu_uint_eq(ccfix->cache.misses, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_truncated(struct callback_cache_fixture *ccfix)
+{
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], ccfix_end - 0x2, 0x10,
+		 0x2);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_nomap(struct callback_cache_fixture *ccfix)
+{
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], ccfix_end, 0x10,
+		 -pte_nomap);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_reenter(struct callback_cache_fixture *ccfix)
+{
+	ccfix->reenter = 1;
+
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+
+	ptu_int_eq(ccfix->nested, 0x10);
+	ptu_uint_eq(ccfix->ncalls, 2);
+
+	/* Both pages have been cached. */
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2900ull, 0x10, 0x10);
+
+	ptu_uint_eq(ccfix->ncalls, 2);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result
+read_invalidated(struct callback_cache_fixture *ccfix)
+{
+	ccfix->invalidate = 1;
+
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_uint_eq(ccfix->ncalls, 1);
+
+	/* The page had been invalidated while it was read - it's not cached. */
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_uint_eq(ccfix->ncalls, 2);
+
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_uint_eq(ccfix->ncalls, 2);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result stats_null(struct callback_cache_fixture *ccfix)
+{
+	struct pt_callback_cache_stats stats;
+	int status;
+
+	status = pt_callback_cache_get_stats(NULL, &stats);
+	ptu_int_eq(status, -pte_internal);
+
+	status = pt_callback_cache_get_stats(&ccfix->cache, NULL);
+	ptu_int_eq(status, -pte_internal);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result stats(struct callback_cache_fixture *ccfix)
+{
+	struct pt_callback_cache_stats stats;
+	int status;
+
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+
+	status = pt_callback_cache_invalidate(&ccfix->cache, &ccfix->asid[0],
+					      0x2000ull, 0x10ull);
+	ptu_int_eq(status, 1);
+
+	status = pt_callback_cache_get_stats(&ccfix->cache, &stats);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(stats.granule, ccfix_granule);
+	ptu_uint_eq(stats.npages, ccfix_npages);
+	ptu_uint_eq(stats.hits, 1);
+	ptu_uint_eq(stats.misses, 1);
+	ptu_uint_eq(stats.invalidations, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result invalidate(struct callback_cache_fixture *ccfix)
+{
+	int status;
+
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2100ull, 0x10, 0x10);
+
+	status = pt_callback_cache_invalidate(&ccfix->cache, &ccfix->asid[0],
+					      0x2080ull, 0x80ull);
+	ptu_int_eq(status, 1);
+	ptu_uint_eq(ccfix->cache.invalidations, 1);
+
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2100ull, 0x10, 0x10);
+
+	ptu_uint_eq(ccfix->ncalls, 3);
+	ptu_uint_eq(ccfix->cache.hits, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result
+invalidate_other_asid(struct callback_cache_fixture *ccfix)
+{
+	int status;
+
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+
+	status = pt_callback_cache_invalidate(&ccfix->cache, &ccfix->asid[1],
+					      0ull, UINT64_MAX);
+	ptu_int_eq(status, 0);
+
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_uint_eq(ccfix->ncalls, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result invalidate_all(struct callback_cache_fixture *ccfix)
+{
+	struct pt_asid asid;
+	int status;
+
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[1], 0x2200ull, 0x10, 0x10);
+
+	pt_asid_init(&asid);
+
+	status = pt_callback_cache_invalidate(&ccfix->cache, &asid, 0ull,
+					      UINT64_MAX);
+	ptu_int_eq(status, 2);
+
+	status = pt_callback_cache_invalidate(&ccfix->cache, &asid, 0ull,
+					      UINT64_MAX);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result
+invalidate_null(struct callback_cache_fixture *ccfix)
+{
+	int status;
+
+	status = pt_callback_cache_invalidate(NULL, &ccfix->asid[0], 0ull,
+					      UINT64_MAX);
+	ptu_int_eq(status, -pte_internal);
+
+	status = pt_callback_cache_invalidate(&ccfix->cache, NULL, 0ull,
+					      UINT64_MAX);
+	ptu_int_eq(status, -pte_internal);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result clear(struct callback_cache_fixture *ccfix)
+{
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+
+	pt_callback_cache_clear(&ccfix->cache);
+
+	ptu_test(ccfix_read, ccfix, &ccfix->asid[0], 0x2000ull, 0x10, 0x10);
+	ptu_uint_eq(ccfix->ncalls, 2);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result ccfix_init(struct callback_cache_fixture *ccfix)
+{
+	int status;
+
+	ccfix->ncalls = 0;
+	ccfix->nested = 0;
+	ccfix->reenter = 0;
+	ccfix->invalidate = 0;
+
+	pt_asid_init(&ccfix->asid[0]);
+	pt_asid_init(&ccfix->asid[1]);
+
+	ccfix->asid[0].cr3 = 0x4000ull;
+	ccfix->asid[1].cr3 = 0x5000ull;
+
+	pt_callback_cache_init(&ccfix->cache);
+
+	status = pt_callback_cache_configure(&ccfix->cache, ccfix_granule,
+					     ccfix_npages);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result ccfix_fini(struct callback_cache_fixture *ccfix)
+{
+	pt_callback_cache_fini(&ccfix->cache);
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct callback_cache_fixture ccfix;
+	struct ptunit_suite suite;
+
+	ccfix.init = ccfix_init;
+	ccfix.fini = ccfix_fini;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run(suite, init_null);
+	ptu_run(suite, configure_null);
+	ptu_run_f(suite, configure_bad_granule, ccfix);
+	ptu_run_f(suite, configure_off, ccfix);
+
+	ptu_run_f(suite, read_null, ccfix);
+	ptu_run_f(suite, read_disabled, ccfix);
+	ptu_run_f(suite, read_hit, ccfix);
+	ptu_run_f(suite, read_cross, ccfix);
+	ptu_run_f(suite, read_asid, ccfix);
+	ptu_run_f(suite, read_evict, ccfix);
+	ptu_run_f(suite, read_partial_page, ccfix);
+	ptu_run_f(suite, read_truncated, ccfix);
+	ptu_run_f(suite, read_nomap, ccfix);
+	ptu_run_f(suite, read_reenter, ccfix);
+	ptu_run_f(suite, read_invalidated, ccfix);
+	ptu_run_f(suite, stats_null, ccfix);
+	ptu_run_f(suite, stats, ccfix);
+
+	ptu_run_f(suite, invalidate, ccfix);
+	ptu_run_f(suite, invalidate_other_asid, ccfix);
+	ptu_run_f(suite, invalidate_all, ccfix);
+	ptu_run_f(suite, invalidate_null, ccfix);
+	ptu_run_f(suite, clear, ccfix);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}
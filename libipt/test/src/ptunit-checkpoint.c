@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ptunit.h"
+
+#include "pt_checkpoint.h"
+#include "pt_event_queue.h"
+#include "pt_retstack.h"
+#include "pt_tnt_cache.h"
+
+#include "intel-pt.h"
+
+#include <string.h>
+
+
+/* A test fixture providing a checkpoint buffer. */
+struct checkpoint_fixture {
+	/* The checkpoint buffer. */
+	uint8_t buffer[1024];
+
+	/* The checkpoint we're writing and reading. */
+	struct pt_checkpoint ckpt;
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct checkpoint_fixture *);
+	struct ptunit_result (*fini)(struct checkpoint_fixture *);
+};
+
+
+static struct ptunit_result cfix_init(struct checkpoint_fixture *cfix)
+{
+	memset(cfix->buffer, 0xcc, sizeof(cfix->buffer));
+
+	pt_ckpt_init_write(&cfix->ckpt, cfix->buffer, sizeof(cfix->buffer));
+
+	return ptu_passed();
+}
+
+/* Finish writing @cfix's checkpoint and start reading it. */
+static struct ptunit_result cfix_read(struct checkpoint_fixture *cfix)
+{
+	int size;
+
+	size = pt_ckpt_end_write(&cfix->ckpt);
+	ptu_int_gt(size, 0);
+
+	pt_ckpt_init_read(&cfix->ckpt, cfix->buffer, (size_t) size);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result end_null(void)
+{
+	int errcode;
+
+	errcode = pt_ckpt_end_write(NULL);
+	ptu_int_eq(errcode, -pte_internal);
+
+	errcode = pt_ckpt_end_read(NULL);
+	ptu_int_eq(errcode, -pte_internal);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result integers(struct checkpoint_fixture *cfix)
+{
+	int errcode;
+
+	pt_ckpt_put32(&cfix->ckpt, 0x01020304u);
+	pt_ckpt_put64(&cfix->ckpt, 0x05060708090a0b0cull);
+
+	ptu_int_eq(pt_ckpt_end_write(&cfix->ckpt), 12);
+
+	/* Integers are stored in little-endian byte order. */
+	ptu_uint_eq(cfix->buffer[0], 0x04);
+	ptu_uint_eq(cfix->buffer[3], 0x01);
+	ptu_uint_eq(cfix->buffer[4], 0x0c);
+	ptu_uint_eq(cfix->buffer[11], 0x05);
+	ptu_uint_eq(cfix->buffer[12], 0xcc);
+
+	ptu_test(cfix_read, cfix);
+
+	ptu_uint_eq(pt_ckpt_get32(&cfix->ckpt), 0x01020304u);
+	ptu_uint_eq(pt_ckpt_get64(&cfix->ckpt), 0x05060708090a0b0cull);
+
+	errcode = pt_ckpt_end_read(&cfix->ckpt);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result size_only(void)
+{
+	struct pt_checkpoint ckpt;
+
+	pt_ckpt_init_write(&ckpt, NULL, 0);
+	pt_ckpt_put_header(&ckpt, pck_query);
+	pt_ckpt_put64(&ckpt, 0ull);
+
+	ptu_int_eq(pt_ckpt_end_write(&ckpt), 20);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result overflow(struct checkpoint_fixture *cfix)
+{
+	int errcode;
+
+	pt_ckpt_init_write(&cfix->ckpt, cfix->buffer, 6);
+	pt_ckpt_put32(&cfix->ckpt, 0x01020304u);
+	pt_ckpt_put32(&cfix->ckpt, 0x05060708u);
+
+	errcode = pt_ckpt_end_write(&cfix->ckpt);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	/* We must not write beyond the end of the buffer. */
+	ptu_uint_eq(cfix->buffer[4], 0xcc);
+	ptu_uint_eq(cfix->buffer[5], 0xcc);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result truncated(struct checkpoint_fixture *cfix)
+{
+	int errcode;
+
+	pt_ckpt_put64(&cfix->ckpt, 0x05060708090a0b0cull);
+
+	pt_ckpt_init_read(&cfix->ckpt, cfix->buffer, 7);
+	ptu_uint_eq(pt_ckpt_get64(&cfix->ckpt), 0ull);
+
+	errcode = pt_ckpt_end_read(&cfix->ckpt);
+	ptu_int_eq(errcode, -pte_bad_file);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result header(struct checkpoint_fixture *cfix,
+				   enum pt_ckpt_kind put,
+				   enum pt_ckpt_kind get, int expected)
+{
+	int errcode;
+
+	pt_ckpt_put_header(&cfix->ckpt, put);
+
+	ptu_test(cfix_read, cfix);
+
+	pt_ckpt_get_header(&cfix->ckpt, get);
+
+	errcode = pt_ckpt_end_read(&cfix->ckpt);
+	ptu_int_eq(errcode, expected);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result header_version(struct checkpoint_fixture *cfix)
+{
+	int errcode;
+
+	pt_ckpt_put_header(&cfix->ckpt, pck_insn);
+
+	ptu_test(cfix_read, cfix);
+
+	/* The version follows the magic. */
+	cfix->buffer[8] += 1;
+
+	pt_ckpt_get_header(&cfix->ckpt, pck_insn);
+
+	errcode = pt_ckpt_end_read(&cfix->ckpt);
+	ptu_int_eq(errcode, -pte_bad_file);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result tnt_bad_index(struct checkpoint_fixture *cfix)
+{
+	struct pt_tnt_cache tnt;
+	int errcode;
+
+	pt_tnt_cache_init(&tnt);
+	tnt.tnt = 0x5ull;
+	tnt.index = 0x6ull;
+
+	pt_ckpt_put_tnt_cache(&cfix->ckpt, &tnt);
+
+	ptu_test(cfix_read, cfix);
+
+	pt_ckpt_get_tnt_cache(&cfix->ckpt, &tnt);
+
+	errcode = pt_ckpt_end_read(&cfix->ckpt);
+	ptu_int_eq(errcode, -pte_bad_file);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result event(struct checkpoint_fixture *cfix,
+				  enum pt_event_type type)
+{
+	struct pt_event expected, actual;
+	int errcode;
+
+	memset(&expected, 0, sizeof(expected));
+	expected.type = type;
+	expected.ip_suppressed = 1;
+	expected.has_tsc = 1;
+	expected.tsc = 0x1234ull;
+	expected.lost_mtc = 2;
+	expected.lost_cyc = 3;
+
+	switch (type) {
+	case ptev_async_branch:
+		expected.variant.async_branch.from = 0x1000ull;
+		expected.variant.async_branch.to = 0x2000ull;
+		break;
+
+	case ptev_async_paging:
+		expected.variant.async_paging.cr3 = 0x3000ull;
+		expected.variant.async_paging.non_root = 1;
+		expected.variant.async_paging.ip = 0x4000ull;
+		break;
+
+	case ptev_exec_mode:
+		expected.variant.exec_mode.mode = ptem_32bit;
+		expected.variant.exec_mode.ip = 0x5000ull;
+		break;
+
+	case ptev_tsx:
+		expected.variant.tsx.ip = 0x6000ull;
+		expected.variant.tsx.aborted = 1;
+		break;
+
+	case ptev_async_vmcs:
+		expected.variant.async_vmcs.base = 0x7000ull;
+		expected.variant.async_vmcs.ip = 0x8000ull;
+		break;
+
+	default:
+		break;
+	}
+
+	pt_ckpt_put_event(&cfix->ckpt, &expected);
+
+	ptu_test(cfix_read, cfix);
+
+	pt_ckpt_get_event(&cfix->ckpt, &actual);
+
+	errcode = pt_ckpt_end_read(&cfix->ckpt);
+	ptu_int_eq(errcode, 0);
+
+	ptu_int_eq(memcmp(&actual, &expected, sizeof(actual)), 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result event_bad_type(struct checkpoint_fixture *cfix)
+{
+	struct pt_event event;
+	int errcode;
+
+	memset(&event, 0, sizeof(event));
+	event.type = ptev_stop;
+
+	pt_ckpt_put_event(&cfix->ckpt, &event);
+
+	ptu_test(cfix_read, cfix);
+
+	/* The event type comes first. */
+	cfix->buffer[0] = 0xff;
+
+	pt_ckpt_get_event(&cfix->ckpt, &event);
+
+	errcode = pt_ckpt_end_read(&cfix->ckpt);
+	ptu_int_eq(errcode, -pte_bad_file);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result evq(struct checkpoint_fixture *cfix)
+{
+	struct pt_event_queue expected, actual;
+	struct pt_event *ev;
+	int errcode, evb, idx;
+
+	pt_evq_init(&expected);
+
+	/* Wrap the fup queue around. */
+	for (idx = 0; idx < 5; ++idx) {
+		ev = pt_evq_enqueue(&expected, evb_fup);
+		ptu_ptr(ev);
+
+		ev = pt_evq_dequeue(&expected, evb_fup);
+		ptu_ptr(ev);
+	}
+
+	for (evb = 0; evb < evb_max; ++evb) {
+		for (idx = 0; idx <= evb * 2; ++idx) {
+			ev = pt_evq_enqueue(&expected,
+					    (enum pt_event_binding) evb);
+			ptu_ptr(ev);
+
+			ev->type = ptev_overflow;
+			ev->variant.overflow.ip = (uint64_t) ((evb << 8) + idx);
+		}
+	}
+
+	pt_ckpt_put_evq(&cfix->ckpt, &expected);
+
+	ptu_test(cfix_read, cfix);
+
+	pt_ckpt_get_evq(&cfix->ckpt, &actual);
+
+	errcode = pt_ckpt_end_read(&cfix->ckpt);
+	ptu_int_eq(errcode, 0);
+
+	for (evb = 0; evb < evb_max; ++evb) {
+		for (idx = 0; idx <= evb * 2; ++idx) {
+			ev = pt_evq_dequeue(&actual,
+					    (enum pt_event_binding) evb);
+			ptu_ptr(ev);
+			ptu_int_eq(ev->type, ptev_overflow);
+			ptu_uint_eq(ev->variant.overflow.ip,
+				    (uint64_t) ((evb << 8) + idx));
+		}
+
+		ev = pt_evq_dequeue(&actual, (enum pt_event_binding) evb);
+		ptu_null(ev);
+	}
+
+	return ptu_passed();
+}
+
+static struct ptunit_result retstack(struct checkpoint_fixture *cfix)
+{
+	struct pt_retstack expected, actual;
+	uint64_t ip;
+	int errcode, idx;
+
+	pt_retstack_init(&expected);
+
+	/* Overflow the return stack so it wraps around. */
+	for (idx = 0; idx < pt_retstack_size + 10; ++idx) {
+		errcode = pt_retstack_push(&expected, (uint64_t) idx);
+		ptu_int_eq(errcode, 0);
+	}
+
+	pt_ckpt_put_retstack(&cfix->ckpt, &expected);
+
+	ptu_test(cfix_read, cfix);
+
+	pt_ckpt_get_retstack(&cfix->ckpt, &actual);
+
+	errcode = pt_ckpt_end_read(&cfix->ckpt);
+	ptu_int_eq(errcode, 0);
+
+	for (idx = pt_retstack_size + 9; idx >= 10; --idx) {
+		errcode = pt_retstack_pop(&actual, &ip);
+		ptu_int_eq(errcode, 0);
+		ptu_uint_eq(ip, (uint64_t) idx);
+	}
+
+	ptu_int_eq(pt_retstack_is_empty(&actual), 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result retstack_bad_size(struct checkpoint_fixture *cfix)
+{
+	struct pt_retstack retstack;
+	int errcode;
+
+	pt_ckpt_put32(&cfix->ckpt, pt_retstack_size + 1);
+
+	ptu_test(cfix_read, cfix);
+
+	pt_ckpt_get_retstack(&cfix->ckpt, &retstack);
+
+	errcode = pt_ckpt_end_read(&cfix->ckpt);
+	ptu_int_eq(errcode, -pte_bad_file);
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct checkpoint_fixture cfix;
+	struct ptunit_suite suite;
+
+	cfix.init = cfix_init;
+	cfix.fini = NULL;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run(suite, end_null);
+	ptu_run_f(suite, integers, cfix);
+	ptu_run(suite, size_only);
+	ptu_run_f(suite, overflow, cfix);
+	ptu_run_f(suite, truncated, cfix);
+	ptu_run_fp(suite, header, cfix, pck_query, pck_query, 0);
+	ptu_run_fp(suite, header, cfix, pck_insn, pck_insn, 0);
+	ptu_run_fp(suite, header, cfix, pck_query, pck_insn, -pte_bad_file);
+	ptu_run_fp(suite, header, cfix, pck_insn, pck_query, -pte_bad_file);
+	ptu_run_f(suite, header_version, cfix);
+	ptu_run_f(suite, tnt_bad_index, cfix);
+	ptu_run_fp(suite, event, cfix, ptev_enabled);
+	ptu_run_fp(suite, event, cfix, ptev_async_branch);
+	ptu_run_fp(suite, event, cfix, ptev_async_paging);
+	ptu_run_fp(suite, event, cfix, ptev_exec_mode);
+	ptu_run_fp(suite, event, cfix, ptev_tsx);
+	ptu_run_fp(suite, event, cfix, ptev_stop);
+	ptu_run_fp(suite, event, cfix, ptev_async_vmcs);
+	ptu_run_f(suite, event_bad_type, cfix);
+	ptu_run_f(suite, evq, cfix);
+	ptu_run_f(suite, retstack, cfix);
+	ptu_run_f(suite, retstack_bad_size, cfix);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}
@@ -388,8 +388,6 @@ int main(int argc, char **argv)
 {
 	struct ptunit_suite suite;
 
-	pti_ild_init();
-
 	suite = ptunit_mk_suite(argc, argv);
 
 	ptu_run(suite, push);
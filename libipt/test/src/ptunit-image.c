@@ -30,6 +30,7 @@
 
 #include "pt_image.h"
 #include "pt_section.h"
+#include "pt_section_buffer.h"
 #include "pt_mapped_section.h"
 
 #include "intel-pt.h"
@@ -54,6 +55,9 @@ struct ifix_status {
 
 	/* The test mapping to be used. */
 	struct ifix_mapping *mapping;
+
+	/* Do not support direct memory access if non-zero. */
+	int nofetch;
 };
 
 static void pt_init_section(struct pt_section *section, char *filename,
@@ -73,6 +77,7 @@ static void pt_init_section(struct pt_section *section, char *filename,
 
 	status->deleted = 0;
 	status->mapping = mapping;
+	status->nofetch = 0;
 }
 
 const char *pt_section_filename(const struct pt_section *section)
@@ -91,8 +96,8 @@ uint64_t pt_section_size(const struct pt_section *section)
 	return section->size;
 }
 
-struct pt_section *pt_mk_section(const char *file, uint64_t offset,
-				 uint64_t size)
+struct pt_section *pt_section_registry_get(const char *file, uint64_t offset,
+					   uint64_t size)
 {
 	(void) file;
 	(void) offset;
@@ -102,6 +107,17 @@ struct pt_section *pt_mk_section(const char *file, uint64_t offset,
 	return NULL;
 }
 
+struct pt_section *pt_mk_section_buffer(const uint8_t *buffer, uint64_t size,
+					int copy)
+{
+	(void) buffer;
+	(void) size;
+	(void) copy;
+
+	/* This function is not used by our tests. */
+	return NULL;
+}
+
 int pt_section_get(struct pt_section *section)
 {
 	if (!section)
@@ -113,7 +129,7 @@ int pt_section_get(struct pt_section *section)
 
 int pt_section_put(struct pt_section *section)
 {
-	uint16_t ucount;
+	uint32_t ucount;
 
 	if (!section)
 		return -pte_internal;
@@ -189,6 +205,36 @@ static int ifix_read(const struct pt_section *section, uint8_t *buffer,
 	return size;
 }
 
+static int ifix_fetch(const struct pt_section *section, const uint8_t **pbegin,
+		      uint16_t size, uint64_t offset)
+{
+	struct ifix_mapping *mapping;
+	uint64_t begin, end;
+
+	if (!section || !pbegin)
+		return -pte_internal;
+
+	begin = offset;
+	end = begin + size;
+
+	if (end < begin)
+		return -pte_nomap;
+
+	mapping = section->mapping;
+	if (!mapping)
+		return -pte_nomap;
+
+	if (mapping->size <= begin)
+		return -pte_nomap;
+
+	if (mapping->size < end)
+		end = mapping->size;
+
+	*pbegin = &mapping->content[begin];
+
+	return (int) (end - begin);
+}
+
 int pt_section_map(struct pt_section *section)
 {
 	struct ifix_status *status;
@@ -211,6 +257,7 @@ int pt_section_map(struct pt_section *section)
 	section->mapping = status->mapping;
 	section->unmap = ifix_unmap;
 	section->read = ifix_read;
+	section->fetch = status->nofetch ? NULL : ifix_fetch;
 
 	return 0;
 }
@@ -238,6 +285,21 @@ int pt_section_read(const struct pt_section *section, uint8_t *buffer,
 	return section->read(section, buffer, size, offset);
 }
 
+int pt_section_fetch(const struct pt_section *section, const uint8_t **pbegin,
+		     uint16_t size, uint64_t offset)
+{
+	if (!section || !pbegin)
+		return -pte_internal;
+
+	if (!section->read)
+		return -pte_nomap;
+
+	if (!section->fetch)
+		return -pte_not_supported;
+
+	return section->fetch(section, pbegin, size, offset);
+}
+
 /* A test fixture providing an image, test sections, and asids. */
 struct image_fixture {
 	/* The image. */
@@ -300,7 +362,8 @@ static struct ptunit_result init(void)
 
 	pt_image_init(&image, NULL);
 	ptu_null(image.name);
-	ptu_null(image.sections);
+	ptu_null(image.spaces);
+	ptu_uint_eq(image.nspaces, 0);
 	ptu_null((void *) (uintptr_t) image.readmem.callback);
 	ptu_null(image.readmem.context);
 
@@ -313,7 +376,8 @@ static struct ptunit_result init_name(struct image_fixture *ifix)
 
 	pt_image_init(&ifix->image, "image-name");
 	ptu_str_eq(ifix->image.name, "image-name");
-	ptu_null(ifix->image.sections);
+	ptu_null(ifix->image.spaces);
+	ptu_uint_eq(ifix->image.nspaces, 0);
 	ptu_null((void *) (uintptr_t) ifix->image.readmem.callback);
 	ptu_null(ifix->image.readmem.context);
 
@@ -403,6 +467,26 @@ static struct ptunit_result name_null(void)
 	return ptu_passed();
 }
 
+static struct ptunit_result add_buffer_null(struct image_fixture *ifix)
+{
+	uint8_t buffer[] = { 0xcc };
+	int status;
+
+	status = pt_image_add_buffer(NULL, buffer, sizeof(buffer), 0, NULL,
+				     0x1000ull);
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_image_add_buffer(&ifix->image, NULL, sizeof(buffer), 0,
+				     NULL, 0x1000ull);
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_image_add_buffer(&ifix->image, buffer, 0ull, 0, NULL,
+				     0x1000ull);
+	ptu_int_eq(status, -pte_invalid);
+
+	return ptu_passed();
+}
+
 static struct ptunit_result read_empty(struct image_fixture *ifix)
 {
 	struct pt_asid asid;
@@ -481,6 +565,129 @@ static struct ptunit_result adjacent(struct image_fixture *ifix)
 	return ptu_passed();
 }
 
+static struct ptunit_result overlap_wildcard(struct image_fixture *ifix)
+{
+	struct pt_asid asid;
+	int status;
+
+	pt_asid_init(&asid);
+
+	status = pt_image_add(&ifix->image, &ifix->section[0], &ifix->asid[0],
+			      0x1000ull);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_add(&ifix->image, &ifix->section[1], &asid,
+			      0x1008ull);
+	ptu_int_eq(status, -pte_bad_image);
+
+	status = pt_image_add(&ifix->image, &ifix->section[1], &ifix->asid[1],
+			      0x1008ull);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_add(&ifix->image, &ifix->section[2], &asid,
+			      0x1010ull);
+	ptu_int_eq(status, -pte_bad_image);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result adjacent_empty(struct image_fixture *ifix)
+{
+	uint8_t buffer[] = { 0xcc, 0xcc };
+	int status;
+
+	ifix->section[1].size = 0ull;
+
+	status = pt_image_add(&ifix->image, &ifix->section[0], &ifix->asid[0],
+			      0x1000ull);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_add(&ifix->image, &ifix->section[1], &ifix->asid[0],
+			      0x1000ull);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_add(&ifix->image, &ifix->section[2], &ifix->asid[0],
+			      0x1008ull);
+	ptu_int_eq(status, -pte_bad_image);
+
+	status = pt_image_read(&ifix->image, buffer, 1, &ifix->asid[0],
+			       0x1003ull);
+	ptu_int_eq(status, 1);
+	ptu_uint_eq(buffer[0], 0x03);
+	ptu_uint_eq(buffer[1], 0xcc);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_many(void)
+{
+	struct ifix_mapping mapping[0x20];
+	struct ifix_status status[0x20];
+	struct pt_section section[0x20];
+	struct pt_image image;
+	struct pt_asid asid;
+	uint8_t buffer[] = { 0xcc, 0xcc };
+	uint64_t base;
+	int errcode, idx;
+
+	pt_asid_init(&asid);
+	asid.cr3 = 0xa000;
+
+	pt_image_init(&image, NULL);
+
+	/* Add sections back-to-back in scrambled order. */
+	base = 0x10000ull;
+	for (idx = 0; idx < 0x20; ++idx) {
+		int sec;
+
+		sec = (idx * 7) % 0x20;
+
+		pt_init_section(&section[sec], NULL, &status[sec],
+				&mapping[sec]);
+
+		errcode = pt_image_add(&image, &section[sec], &asid,
+				       base + (sec * 0x10));
+		ptu_int_eq(errcode, 0);
+	}
+
+	for (idx = 0; idx < 0x20; ++idx) {
+		errcode = pt_image_read(&image, buffer, 1, &asid,
+					base + (idx * 0x10) + (idx & 0xf));
+		ptu_int_eq(errcode, 1);
+		ptu_uint_eq(buffer[0], idx & 0xf);
+	}
+
+	errcode = pt_image_add(&image, &section[0], &asid, base + 0x108);
+	ptu_int_eq(errcode, -pte_bad_image);
+
+	errcode = pt_image_remove(&image, &section[0x10], &asid,
+				  base + 0x100);
+	ptu_int_eq(errcode, 0);
+	ptu_int_ne(status[0x10].deleted, 0);
+
+	buffer[0] = 0xcc;
+	errcode = pt_image_read(&image, buffer, 1, &asid, base + 0x108);
+	ptu_int_eq(errcode, -pte_nomap);
+	ptu_uint_eq(buffer[0], 0xcc);
+
+	errcode = pt_image_read(&image, buffer, 1, &asid, base + 0xff);
+	ptu_int_eq(errcode, 1);
+	ptu_uint_eq(buffer[0], 0xf);
+
+	errcode = pt_image_read(&image, buffer, 1, &asid, base + 0x110);
+	ptu_int_eq(errcode, 1);
+	ptu_uint_eq(buffer[0], 0x0);
+
+	pt_image_fini(&image);
+
+	for (idx = 0; idx < 0x20; ++idx) {
+		ptu_int_eq(section[idx].ucount, 0);
+		ptu_int_eq(section[idx].mcount, 0);
+	}
+
+	return ptu_passed();
+}
+
 static struct ptunit_result read(struct image_fixture *ifix)
 {
 	uint8_t buffer[] = { 0xcc, 0xcc, 0xcc };
@@ -551,6 +758,333 @@ static struct ptunit_result read_null_asid(struct image_fixture *ifix)
 	return ptu_passed();
 }
 
+static struct ptunit_result read_view(struct image_fixture *ifix)
+{
+	struct pt_image_view view;
+	uint8_t buffer[] = { 0xcc, 0xcc };
+	int status;
+
+	pt_image_view_init(&view);
+
+	status = pt_image_read_view(&view, &ifix->image, buffer, 1,
+				    &ifix->asid[2], 0x1001ull);
+	ptu_int_eq(status, -pte_nomap);
+	ptu_uint_eq(buffer[0], 0xcc);
+
+	status = pt_image_read_view(&view, &ifix->image, buffer, 1,
+				    &ifix->asid[0], 0x1001ull);
+	ptu_int_eq(status, 1);
+	ptu_uint_eq(buffer[0], 0x01);
+
+	status = pt_image_add(&ifix->image, &ifix->section[2], &ifix->asid[2],
+			      0x1000ull);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_read_view(&view, &ifix->image, buffer, 1,
+				    &ifix->asid[2], 0x1002ull);
+	ptu_int_eq(status, 1);
+	ptu_uint_eq(buffer[0], 0x02);
+	ptu_uint_eq(buffer[1], 0xcc);
+
+	pt_image_view_fini(&view);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_view_null(struct image_fixture *ifix)
+{
+	struct pt_image_view view;
+	uint8_t buffer[] = { 0xcc, 0xcc };
+	int status;
+
+	pt_image_view_init(&view);
+
+	status = pt_image_read_view(NULL, &ifix->image, buffer, 1,
+				    &ifix->asid[0], 0x1001ull);
+	ptu_int_eq(status, -pte_internal);
+
+	status = pt_image_read_view(&view, NULL, buffer, 1, &ifix->asid[0],
+				    0x1001ull);
+	ptu_int_eq(status, -pte_internal);
+
+	status = pt_image_read_view(&view, &ifix->image, buffer, 1, NULL,
+				    0x1001ull);
+	ptu_int_eq(status, -pte_internal);
+	ptu_uint_eq(buffer[0], 0xcc);
+
+	pt_image_view_fini(&view);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result fetch_view(struct image_fixture *ifix)
+{
+	struct pt_image_view view;
+	uint8_t buffer[] = { 0xcc, 0xcc };
+	const uint8_t *begin;
+	int status;
+
+	pt_image_view_init(&view);
+
+	status = pt_image_fetch_view(&view, &ifix->image, &begin, buffer, 2,
+				     &ifix->asid[0], 0x1001ull);
+	ptu_int_eq(status, 2);
+	ptu_ptr_eq(begin, &ifix->mapping[0].content[1]);
+	ptu_uint_eq(begin[0], 0x01);
+	ptu_uint_eq(begin[1], 0x02);
+	ptu_uint_eq(buffer[0], 0xcc);
+
+	status = pt_image_fetch_view(&view, &ifix->image, &begin, buffer, 2,
+				     &ifix->asid[1], 0x200full);
+	ptu_int_eq(status, 1);
+	ptu_ptr_eq(begin, &ifix->mapping[1].content[0xf]);
+	ptu_uint_eq(begin[0], 0x0f);
+	ptu_uint_eq(buffer[0], 0xcc);
+
+	status = pt_image_fetch_view(&view, &ifix->image, &begin, buffer, 2,
+				     &ifix->asid[1], 0x2010ull);
+	ptu_int_eq(status, -pte_nomap);
+
+	pt_image_view_fini(&view);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result fetch_view_hold(struct image_fixture *ifix)
+{
+	struct pt_image_view view;
+	const uint8_t *begin;
+	uint8_t buffer[] = { 0xcc, 0xcc };
+	int status;
+
+	pt_image_view_init(&view);
+
+	status = pt_image_fetch_view(&view, &ifix->image, &begin, buffer, 2,
+				     &ifix->asid[0], 0x1001ull);
+	ptu_int_eq(status, 2);
+	ptu_ptr_eq(begin, &ifix->mapping[0].content[1]);
+	ptu_ptr_eq(view.section, &ifix->section[0]);
+	ptu_uint_eq(ifix->section[0].mcount, 1);
+	ptu_uint_eq(ifix->section[0].ucount, 2);
+
+	status = pt_image_fetch_view(&view, &ifix->image, &begin, buffer, 2,
+				     &ifix->asid[1], 0x2001ull);
+	ptu_int_eq(status, 2);
+	ptu_ptr_eq(begin, &ifix->mapping[1].content[1]);
+	ptu_ptr_eq(view.section, &ifix->section[1]);
+	ptu_uint_eq(ifix->section[0].mcount, 0);
+	ptu_uint_eq(ifix->section[0].ucount, 1);
+	ptu_uint_eq(ifix->section[1].mcount, 1);
+
+	pt_image_view_fini(&view);
+	ptu_null(view.section);
+	ptu_uint_eq(ifix->section[1].mcount, 0);
+	ptu_uint_eq(ifix->section[1].ucount, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_cached(struct image_fixture *ifix)
+{
+	struct pt_section_cache_stats stats;
+	uint8_t buffer[] = { 0xcc, 0xcc };
+	int status;
+
+	status = pt_section_cache_set_limit(0x20ull);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_read(&ifix->image, buffer, 1, &ifix->asid[0],
+			       0x1001ull);
+	ptu_int_eq(status, 1);
+	ptu_uint_eq(buffer[0], 0x01);
+	ptu_uint_eq(ifix->section[0].mcount, 1);
+	ptu_uint_eq(ifix->section[0].ucount, 2);
+
+	status = pt_image_read(&ifix->image, buffer, 1, &ifix->asid[1],
+			       0x2002ull);
+	ptu_int_eq(status, 1);
+	ptu_uint_eq(buffer[0], 0x02);
+	ptu_uint_eq(ifix->section[1].mcount, 1);
+
+	status = pt_image_read(&ifix->image, buffer, 1, &ifix->asid[0],
+			       0x1003ull);
+	ptu_int_eq(status, 1);
+	ptu_uint_eq(buffer[0], 0x03);
+
+	status = pt_section_cache_get_stats(&stats);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(stats.nsections, 2);
+	ptu_uint_eq(stats.size, 0x20ull);
+
+	/* Section 1 is the least recently used one. */
+	status = pt_section_cache_set_limit(0x10ull);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(ifix->section[0].mcount, 1);
+	ptu_uint_eq(ifix->section[1].mcount, 0);
+	ptu_uint_eq(ifix->section[1].ucount, 1);
+
+	status = pt_section_cache_set_limit(0ull);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(ifix->section[0].mcount, 0);
+	ptu_uint_eq(ifix->section[0].ucount, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result fetch_view_nofetch(struct image_fixture *ifix)
+{
+	struct pt_image_view view;
+	uint8_t buffer[] = { 0xcc, 0xcc, 0xcc };
+	const uint8_t *begin;
+	int status;
+
+	pt_image_view_init(&view);
+	ifix->status[0].nofetch = 1;
+
+	status = pt_image_fetch_view(&view, &ifix->image, &begin, buffer, 2,
+				     &ifix->asid[0], 0x1001ull);
+	ptu_int_eq(status, 2);
+	ptu_ptr_eq(begin, buffer);
+	ptu_uint_eq(buffer[0], 0x01);
+	ptu_uint_eq(buffer[1], 0x02);
+	ptu_uint_eq(buffer[2], 0xcc);
+
+	/* The view keeps the section mapped; we read from its mapping. */
+	buffer[0] = 0xcc;
+	begin = NULL;
+
+	status = pt_image_fetch_view(&view, &ifix->image, &begin, buffer, 1,
+				     &ifix->asid[0], 0x1003ull);
+	ptu_int_eq(status, 1);
+	ptu_ptr_eq(begin, buffer);
+	ptu_uint_eq(buffer[0], 0x03);
+
+	pt_image_view_fini(&view);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result fetch_view_callback(struct image_fixture *ifix)
+{
+	uint8_t memory[] = { 0xdd, 0x01, 0x02, 0xdd };
+	uint8_t buffer[] = { 0xcc, 0xcc, 0xcc };
+	struct pt_image_view view;
+	const uint8_t *begin;
+	int status;
+
+	pt_image_view_init(&view);
+
+	status = pt_image_set_callback(&ifix->image, image_readmem_callback,
+				       memory);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_fetch_view(&view, &ifix->image, &begin, buffer, 2,
+				     &ifix->asid[0], 0x3001ull);
+	ptu_int_eq(status, 2);
+	ptu_ptr_eq(begin, buffer);
+	ptu_uint_eq(buffer[0], 0x01);
+	ptu_uint_eq(buffer[1], 0x02);
+	ptu_uint_eq(buffer[2], 0xcc);
+
+	pt_image_view_fini(&view);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result fetch_view_null(struct image_fixture *ifix)
+{
+	struct pt_image_view view;
+	uint8_t buffer[] = { 0xcc, 0xcc };
+	const uint8_t *begin;
+	int status;
+
+	pt_image_view_init(&view);
+
+	status = pt_image_fetch_view(&view, &ifix->image, NULL, buffer, 1,
+				     &ifix->asid[0], 0x1001ull);
+	ptu_int_eq(status, -pte_internal);
+
+	status = pt_image_fetch_view(&view, &ifix->image, &begin, NULL, 1,
+				     &ifix->asid[0], 0x1001ull);
+	ptu_int_eq(status, -pte_internal);
+
+	status = pt_image_fetch_view(NULL, &ifix->image, &begin, buffer, 1,
+				     &ifix->asid[0], 0x1001ull);
+	ptu_int_eq(status, -pte_internal);
+
+	pt_image_view_fini(&view);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result many_asids(struct image_fixture *ifix)
+{
+	struct pt_image_view view;
+	struct pt_asid asid, any;
+	uint8_t buffer[] = { 0xcc, 0xcc };
+	uint64_t cr3;
+	int status;
+
+	pt_image_view_init(&view);
+	pt_asid_init(&asid);
+	pt_asid_init(&any);
+
+	for (cr3 = 1; cr3 <= 0x40; ++cr3) {
+		asid.cr3 = cr3 << 12;
+
+		status = pt_image_add(&ifix->image, &ifix->section[0], &asid,
+				      cr3 << 8);
+		ptu_int_eq(status, 0);
+	}
+
+	status = pt_image_add(&ifix->image, &ifix->section[1], &any,
+			      0x100000ull);
+	ptu_int_eq(status, 0);
+
+	for (cr3 = 1; cr3 <= 0x40; ++cr3) {
+		asid.cr3 = cr3 << 12;
+
+		status = pt_image_read_view(&view, &ifix->image, buffer, 1,
+					    &asid, (cr3 << 8) + 3);
+		ptu_int_eq(status, 1);
+		ptu_uint_eq(buffer[0], 0x03);
+
+		status = pt_image_read_view(&view, &ifix->image, buffer, 1,
+					    &asid, ((cr3 + 1) << 8) + 3);
+		ptu_int_eq(status, -pte_nomap);
+
+		status = pt_image_read_view(&view, &ifix->image, buffer, 1,
+					    &asid, 0x100004ull);
+		ptu_int_eq(status, 1);
+		ptu_uint_eq(buffer[0], 0x04);
+	}
+
+	status = pt_image_read(&ifix->image, buffer, 1, &any, 0x2005ull);
+	ptu_int_eq(status, 1);
+	ptu_uint_eq(buffer[0], 0x05);
+
+	/* Release the section held by @view so it can be deleted. */
+	pt_image_view_fini(&view);
+
+	/* This also removes the section that was added for any cr3. */
+	asid.cr3 = 0x20000ull;
+	status = pt_image_remove_by_asid(&ifix->image, &asid);
+	ptu_int_eq(status, 2);
+	ptu_int_ne(ifix->status[1].deleted, 0);
+
+	status = pt_image_read_view(&view, &ifix->image, buffer, 1, &asid,
+				    0x2003ull);
+	ptu_int_eq(status, -pte_nomap);
+
+	status = pt_image_remove_by_asid(&ifix->image, &any);
+	ptu_int_eq(status, 0x3f);
+	ptu_int_ne(ifix->status[0].deleted, 0);
+
+	pt_image_view_fini(&view);
+
+	return ptu_passed();
+}
+
 static struct ptunit_result read_callback(struct image_fixture *ifix)
 {
 	uint8_t memory[] = { 0xdd, 0x01, 0x02, 0xdd };
@@ -571,6 +1105,84 @@ static struct ptunit_result read_callback(struct image_fixture *ifix)
 	return ptu_passed();
 }
 
+static struct ptunit_result read_callback_cached(struct image_fixture *ifix)
+{
+	struct pt_callback_cache_stats stats;
+	uint8_t memory[0x10], buffer[] = { 0xcc, 0xcc, 0xcc };
+	uint8_t idx;
+	int status;
+
+	for (idx = 0; idx < sizeof(memory); ++idx)
+		memory[idx] = idx;
+
+	status = pt_image_set_callback(&ifix->image, image_readmem_callback,
+				       memory);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_set_callback_cache(&ifix->image, sizeof(memory), 2);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_read(&ifix->image, buffer, 2, &ifix->asid[0],
+			       0x3001ull);
+	ptu_int_eq(status, 2);
+	ptu_uint_eq(buffer[0], 0x01);
+	ptu_uint_eq(buffer[1], 0x02);
+	ptu_uint_eq(buffer[2], 0xcc);
+
+	/* The cached page is not affected by changes to @memory. */
+	memory[0x3] = 0xdd;
+
+	status = pt_image_read(&ifix->image, buffer, 2, &ifix->asid[0],
+			       0x3003ull);
+	ptu_int_eq(status, 2);
+	ptu_uint_eq(buffer[0], 0x03);
+	ptu_uint_eq(buffer[1], 0x04);
+
+	status = pt_image_invalidate_callback_cache(&ifix->image, NULL,
+						    0x3003ull, 1ull);
+	ptu_int_eq(status, 1);
+
+	status = pt_image_read(&ifix->image, buffer, 2, &ifix->asid[0],
+			       0x3003ull);
+	ptu_int_eq(status, 2);
+	ptu_uint_eq(buffer[0], 0xdd);
+	ptu_uint_eq(buffer[1], 0x04);
+
+	status = pt_image_get_callback_cache_stats(&ifix->image, &stats);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(stats.granule, sizeof(memory));
+	ptu_uint_eq(stats.npages, 2);
+	ptu_uint_eq(stats.hits, 1);
+	ptu_uint_eq(stats.misses, 2);
+	ptu_uint_eq(stats.invalidations, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result callback_cache_null(struct image_fixture *ifix)
+{
+	struct pt_callback_cache_stats stats;
+	int status;
+
+	status = pt_image_set_callback_cache(NULL, 0x1000, 1);
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_image_set_callback_cache(&ifix->image, 0x1001, 1);
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_image_invalidate_callback_cache(NULL, NULL, 0ull,
+						    UINT64_MAX);
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_image_get_callback_cache_stats(NULL, &stats);
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_image_get_callback_cache_stats(&ifix->image, NULL);
+	ptu_int_eq(status, -pte_invalid);
+
+	return ptu_passed();
+}
+
 static struct ptunit_result read_nomem(struct image_fixture *ifix)
 {
 	uint8_t buffer[] = { 0xcc, 0xcc };
@@ -971,6 +1583,151 @@ static struct ptunit_result copy_self(struct image_fixture *ifix)
 	return ptu_passed();
 }
 
+/* Find the index of the address space for @asid in @image. */
+static const struct pt_image_index *
+ifix_find_index(const struct pt_image *image, const struct pt_asid *asid)
+{
+	uint32_t bucket;
+
+	for (bucket = 0; bucket < image->nbuckets; ++bucket) {
+		const struct pt_image_space *space;
+
+		space = image->spaces[bucket];
+		for (; space; space = space->next) {
+			if ((space->asid.cr3 == asid->cr3) &&
+			    (space->asid.vmcs == asid->vmcs))
+				return space->index;
+		}
+	}
+
+	return NULL;
+}
+
+static struct ptunit_result copy_shared(struct image_fixture *ifix)
+{
+	const struct pt_image_index *index;
+	int status;
+
+	status = pt_image_copy(&ifix->copy, &ifix->image);
+	ptu_int_eq(status, 0);
+
+	index = ifix_find_index(&ifix->copy, &ifix->asid[1]);
+	ptu_ptr(index);
+	ptu_ptr_eq(index, ifix_find_index(&ifix->image, &ifix->asid[1]));
+	ptu_uint_eq(index->ucount, 2);
+	ptu_uint_eq(ifix->section[1].ucount, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result copy_cow_add(struct image_fixture *ifix)
+{
+	const struct pt_image_index *index;
+	uint8_t buffer[] = { 0xcc, 0xcc, 0xcc };
+	int status;
+
+	status = pt_image_copy(&ifix->copy, &ifix->image);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_add(&ifix->copy, &ifix->section[2], &ifix->asid[1],
+			      0x3000ull);
+	ptu_int_eq(status, 0);
+
+	index = ifix_find_index(&ifix->copy, &ifix->asid[1]);
+	ptu_ptr(index);
+	ptu_ptr_ne(index, ifix_find_index(&ifix->image, &ifix->asid[1]));
+	ptu_uint_eq(index->ucount, 1);
+	ptu_uint_eq(index->nentries, 2);
+	ptu_uint_eq(ifix->section[1].ucount, 2);
+
+	status = pt_image_read(&ifix->copy, buffer, 2, &ifix->asid[1],
+			       0x3003ull);
+	ptu_int_eq(status, 2);
+	ptu_uint_eq(buffer[0], 0x03);
+	ptu_uint_eq(buffer[1], 0x04);
+
+	status = pt_image_read(&ifix->image, buffer, 2, &ifix->asid[1],
+			       0x3003ull);
+	ptu_int_eq(status, -pte_nomap);
+
+	status = pt_image_read(&ifix->copy, buffer, 2, &ifix->asid[1],
+			       0x2003ull);
+	ptu_int_eq(status, 2);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result copy_cow_remove(struct image_fixture *ifix)
+{
+	uint8_t buffer[] = { 0xcc, 0xcc, 0xcc };
+	int status;
+
+	status = pt_image_copy(&ifix->copy, &ifix->image);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_remove(&ifix->copy, &ifix->section[1],
+				 &ifix->asid[1], 0x2000ull);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_read(&ifix->copy, buffer, 2, &ifix->asid[1],
+			       0x2003ull);
+	ptu_int_eq(status, -pte_nomap);
+
+	status = pt_image_read(&ifix->image, buffer, 2, &ifix->asid[1],
+			       0x2003ull);
+	ptu_int_eq(status, 2);
+	ptu_uint_eq(buffer[0], 0x03);
+	ptu_uint_eq(buffer[1], 0x04);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result
+copy_remove_by_asid(struct image_fixture *ifix)
+{
+	uint8_t buffer[] = { 0xcc, 0xcc, 0xcc };
+	int status;
+
+	status = pt_image_copy(&ifix->copy, &ifix->image);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_remove_by_asid(&ifix->copy, &ifix->asid[1]);
+	ptu_int_eq(status, 1);
+
+	status = pt_image_read(&ifix->copy, buffer, 2, &ifix->asid[1],
+			       0x2003ull);
+	ptu_int_eq(status, -pte_nomap);
+
+	status = pt_image_read(&ifix->image, buffer, 2, &ifix->asid[1],
+			       0x2003ull);
+	ptu_int_eq(status, 2);
+	ptu_uint_eq(ifix->section[1].ucount, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result copy_fini_src(struct image_fixture *ifix)
+{
+	uint8_t buffer[] = { 0xcc, 0xcc, 0xcc };
+	int status;
+
+	status = pt_image_copy(&ifix->copy, &ifix->image);
+	ptu_int_eq(status, 0);
+
+	pt_image_fini(&ifix->image);
+	pt_image_init(&ifix->image, NULL);
+
+	ptu_uint_eq(ifix->section[1].ucount, 1);
+
+	status = pt_image_read(&ifix->copy, buffer, 2, &ifix->asid[1],
+			       0x2003ull);
+	ptu_int_eq(status, 2);
+	ptu_uint_eq(buffer[0], 0x03);
+	ptu_uint_eq(buffer[1], 0x04);
+
+	return ptu_passed();
+}
+
 struct ptunit_result ifix_init(struct image_fixture *ifix)
 {
 	pt_image_init(&ifix->image, NULL);
@@ -1040,6 +1797,11 @@ int main(int argc, char **argv)
 	struct image_fixture dfix, ifix, rfix;
 	struct ptunit_suite suite;
 
+	/* Our test sections do not outlive a single test.  Do not let the
+	 * section cache hold on to them unless a test asks for it.
+	 */
+	(void) pt_section_cache_set_limit(0ull);
+
 	/* Dfix provides image destruction. */
 	dfix.init = NULL;
 	dfix.fini = dfix_fini;
@@ -1066,15 +1828,31 @@ int main(int argc, char **argv)
 	ptu_run(suite, name_none);
 	ptu_run(suite, name_null);
 
+	ptu_run_f(suite, add_buffer_null, ifix);
+
 	ptu_run_f(suite, read_empty, ifix);
 	ptu_run_f(suite, overlap, ifix);
 	ptu_run_f(suite, adjacent, ifix);
+	ptu_run_f(suite, overlap_wildcard, ifix);
+	ptu_run_f(suite, adjacent_empty, ifix);
+	ptu_run(suite, read_many);
 
 	ptu_run_f(suite, read, rfix);
 	ptu_run_f(suite, read_asid, ifix);
 	ptu_run_f(suite, read_bad_asid, rfix);
 	ptu_run_f(suite, read_null_asid, rfix);
+	ptu_run_f(suite, read_view, rfix);
+	ptu_run_f(suite, read_view_null, rfix);
+	ptu_run_f(suite, fetch_view, rfix);
+	ptu_run_f(suite, fetch_view_hold, rfix);
+	ptu_run_f(suite, fetch_view_nofetch, rfix);
+	ptu_run_f(suite, fetch_view_callback, rfix);
+	ptu_run_f(suite, fetch_view_null, rfix);
+	ptu_run_f(suite, many_asids, ifix);
+	ptu_run_f(suite, read_cached, rfix);
 	ptu_run_f(suite, read_callback, rfix);
+	ptu_run_f(suite, read_callback_cached, rfix);
+	ptu_run_f(suite, callback_cache_null, rfix);
 	ptu_run_f(suite, read_nomem, rfix);
 	ptu_run_f(suite, read_truncated, rfix);
 
@@ -1091,6 +1869,11 @@ int main(int argc, char **argv)
 	ptu_run_f(suite, copy, rfix);
 	ptu_run_f(suite, copy_duplicate, rfix);
 	ptu_run_f(suite, copy_self, rfix);
+	ptu_run_f(suite, copy_shared, rfix);
+	ptu_run_f(suite, copy_cow_add, rfix);
+	ptu_run_f(suite, copy_cow_remove, rfix);
+	ptu_run_f(suite, copy_remove_by_asid, rfix);
+	ptu_run_f(suite, copy_fini_src, rfix);
 
 	ptunit_report(&suite);
 	return suite.nr_fails;
@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "ptunit.h"
+#include "ptunit_mktempname.h"
+
+#include "pt_image.h"
+#include "pt_asid.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+
+/* A test fixture providing a temporary file, a manifest name, and images. */
+struct image_manifest_fixture {
+	/* The name of a temporary file providing the section content. */
+	char *name;
+
+	/* The name of a temporary manifest file. */
+	char *manifest;
+
+	/* Two address space identifiers. */
+	struct pt_asid asid[2];
+
+	/* The image to save and the image to load into, respectively. */
+	struct pt_image saved, loaded;
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct image_manifest_fixture *);
+	struct ptunit_result (*fini)(struct image_manifest_fixture *);
+};
+
+/* Write @size bytes of @content to @name. */
+static struct ptunit_result mfix_write(const char *name, const uint8_t *content,
+				       size_t size)
+{
+	size_t written;
+	FILE *file;
+
+	file = fopen(name, "wb");
+	ptu_ptr(file);
+
+	written = fwrite(content, 1, size, file);
+	fclose(file);
+	ptu_uint_eq(written, size);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result mfix_init(struct image_manifest_fixture *mfix)
+{
+	uint8_t content[] = { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17 };
+	int errcode;
+
+	mfix->name = mktempname();
+	ptu_ptr(mfix->name);
+
+	mfix->manifest = mktempname();
+	ptu_ptr(mfix->manifest);
+
+	ptu_test(mfix_write, mfix->name, content, sizeof(content));
+
+	pt_asid_init(&mfix->asid[0]);
+	mfix->asid[0].cr3 = 0xa000;
+
+	pt_asid_init(&mfix->asid[1]);
+	mfix->asid[1].cr3 = 0xb000;
+
+	pt_image_init(&mfix->saved, NULL);
+	pt_image_init(&mfix->loaded, NULL);
+
+	errcode = pt_image_add_file(&mfix->saved, mfix->name, 0x2ull, 0x4ull,
+				    &mfix->asid[0], 0x1000ull);
+	ptu_int_eq(errcode, 0);
+
+	errcode = pt_image_add_file(&mfix->saved, mfix->name, 0x0ull, 0x8ull,
+				    &mfix->asid[1], 0x2000ull);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result mfix_fini(struct image_manifest_fixture *mfix)
+{
+	pt_image_fini(&mfix->loaded);
+	pt_image_fini(&mfix->saved);
+
+	if (mfix->manifest) {
+		remove(mfix->manifest);
+		free(mfix->manifest);
+		mfix->manifest = NULL;
+	}
+
+	if (mfix->name) {
+		remove(mfix->name);
+		free(mfix->name);
+		mfix->name = NULL;
+	}
+
+	return ptu_passed();
+}
+
+static struct ptunit_result save_null(struct image_manifest_fixture *mfix)
+{
+	int status;
+
+	status = pt_image_save(NULL, mfix->manifest);
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_image_save(&mfix->saved, NULL);
+	ptu_int_eq(status, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result load_null(struct image_manifest_fixture *mfix)
+{
+	int status;
+
+	status = pt_image_load(NULL, mfix->manifest);
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_image_load(&mfix->loaded, NULL);
+	ptu_int_eq(status, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result load_nofile(struct image_manifest_fixture *mfix)
+{
+	int status;
+
+	status = pt_image_load(&mfix->loaded, mfix->manifest);
+	ptu_int_eq(status, -pte_bad_file);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result load_bad_magic(struct image_manifest_fixture *mfix)
+{
+	uint8_t content[] = { 'p', 't', 'i', 'm', 'a', 'g', 'x', 0 };
+	int status;
+
+	ptu_test(mfix_write, mfix->manifest, content, sizeof(content));
+
+	status = pt_image_load(&mfix->loaded, mfix->manifest);
+	ptu_int_eq(status, -pte_bad_file);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result load_truncated(struct image_manifest_fixture *mfix)
+{
+	uint8_t content[0x100];
+	size_t size;
+	FILE *file;
+	int status;
+
+	status = pt_image_save(&mfix->saved, mfix->manifest);
+	ptu_int_eq(status, 0);
+
+	file = fopen(mfix->manifest, "rb");
+	ptu_ptr(file);
+
+	size = fread(content, 1, sizeof(content), file);
+	fclose(file);
+	ptu_uint_gt(size, 1);
+	ptu_uint_lt(size, sizeof(content));
+
+	ptu_test(mfix_write, mfix->manifest, content, size - 1);
+
+	status = pt_image_load(&mfix->loaded, mfix->manifest);
+	ptu_int_eq(status, -pte_bad_file);
+	ptu_uint_eq(mfix->loaded.nspaces, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result save_load(struct image_manifest_fixture *mfix)
+{
+	uint8_t buffer[] = { 0xcc, 0xcc, 0xcc, 0xcc };
+	int status;
+
+	status = pt_image_save(&mfix->saved, mfix->manifest);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_load(&mfix->loaded, mfix->manifest);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(mfix->loaded.nspaces, 2);
+
+	status = pt_image_read(&mfix->loaded, buffer, 2, &mfix->asid[0],
+			       0x1002ull);
+	ptu_int_eq(status, 2);
+	ptu_uint_eq(buffer[0], 0x14);
+	ptu_uint_eq(buffer[1], 0x15);
+	ptu_uint_eq(buffer[2], 0xcc);
+
+	status = pt_image_read(&mfix->loaded, buffer, 4, &mfix->asid[0],
+			       0x1004ull);
+	ptu_int_eq(status, -pte_nomap);
+
+	status = pt_image_read(&mfix->loaded, buffer, 4, &mfix->asid[1],
+			       0x2006ull);
+	ptu_int_eq(status, 2);
+	ptu_uint_eq(buffer[0], 0x16);
+	ptu_uint_eq(buffer[1], 0x17);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result load_overlap(struct image_manifest_fixture *mfix)
+{
+	int status;
+
+	status = pt_image_save(&mfix->saved, mfix->manifest);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_load(&mfix->loaded, mfix->manifest);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_load(&mfix->loaded, mfix->manifest);
+	ptu_int_eq(status, 2);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result load_changed(struct image_manifest_fixture *mfix)
+{
+	uint8_t content[] = { 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
+			      0x28 };
+	int status;
+
+	status = pt_image_save(&mfix->saved, mfix->manifest);
+	ptu_int_eq(status, 0);
+
+	ptu_test(mfix_write, mfix->name, content, sizeof(content));
+
+	status = pt_image_load(&mfix->loaded, mfix->manifest);
+	ptu_int_eq(status, -pte_bad_image);
+	ptu_uint_eq(mfix->loaded.nspaces, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result load_removed(struct image_manifest_fixture *mfix)
+{
+	int status;
+
+	status = pt_image_save(&mfix->saved, mfix->manifest);
+	ptu_int_eq(status, 0);
+
+	remove(mfix->name);
+
+	status = pt_image_load(&mfix->loaded, mfix->manifest);
+	ptu_int_eq(status, -pte_bad_image);
+	ptu_uint_eq(mfix->loaded.nspaces, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result save_buffer(struct image_manifest_fixture *mfix)
+{
+	uint8_t buffer[] = { 0xcc, 0xcc };
+	int status;
+
+	status = pt_image_add_buffer(&mfix->saved, buffer, sizeof(buffer), 1,
+				     &mfix->asid[0], 0x3000ull);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_save(&mfix->saved, mfix->manifest);
+	ptu_int_eq(status, 1);
+
+	status = pt_image_load(&mfix->loaded, mfix->manifest);
+	ptu_int_eq(status, 0);
+
+	status = pt_image_read(&mfix->loaded, buffer, 1, &mfix->asid[0],
+			       0x3000ull);
+	ptu_int_eq(status, -pte_nomap);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result save_empty(struct image_manifest_fixture *mfix)
+{
+	struct pt_image image;
+	int status;
+
+	pt_image_init(&image, NULL);
+
+	status = pt_image_save(&image, mfix->manifest);
+	ptu_int_eq(status, 0);
+
+	pt_image_fini(&image);
+
+	status = pt_image_load(&mfix->loaded, mfix->manifest);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(mfix->loaded.nspaces, 0);
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct image_manifest_fixture mfix;
+	struct ptunit_suite suite;
+
+	mfix.init = mfix_init;
+	mfix.fini = mfix_fini;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run_f(suite, save_null, mfix);
+	ptu_run_f(suite, load_null, mfix);
+	ptu_run_f(suite, load_nofile, mfix);
+	ptu_run_f(suite, load_bad_magic, mfix);
+	ptu_run_f(suite, load_truncated, mfix);
+	ptu_run_f(suite, save_load, mfix);
+	ptu_run_f(suite, load_overlap, mfix);
+	ptu_run_f(suite, load_changed, mfix);
+	ptu_run_f(suite, load_removed, mfix);
+	ptu_run_f(suite, save_buffer, mfix);
+	ptu_run_f(suite, save_empty, mfix);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}
@@ -0,0 +1,508 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "ptunit_threads.h"
+
+#include "pt_insn_decoder.h"
+#include "pt_encoder.h"
+
+#include "intel-pt.h"
+
+#include <string.h>
+
+
+/* The code of our test image at ifix_base.
+ *
+ *   0x1000:  nop
+ *   0x1001:  nop
+ *   0x1002:  call 0x100c
+ *   0x1007:  jne 0x1000
+ *   0x1009:  jmp *%rax
+ *   0x100b:  nop
+ *   0x100c:  nop
+ *   0x100d:  ret
+ */
+static const uint8_t ifix_code[] = {
+	0x90, 0x90, 0xe8, 0x05, 0x00, 0x00, 0x00, 0x75, 0xf7, 0xff, 0xe0,
+	0x90, 0x90, 0xc3
+};
+
+enum {
+	ifix_base	= 0x1000,
+
+	/* The number of additional threads and the number of decoders that
+	 * each thread runs in turn in the stress test.
+	 */
+	ifix_nthreads	= 8,
+	ifix_ndecoders	= 50
+};
+
+/* A test fixture providing a trace and two instruction flow decoders for it. */
+struct insn_fixture {
+	/* The trace buffer. */
+	uint8_t buffer[1024];
+
+	/* The configuration. */
+	struct pt_config config;
+
+	/* The encoder used for generating the trace. */
+	struct pt_encoder encoder;
+
+	/* Two instruction flow decoders for the trace. */
+	struct pt_insn_decoder *decoder, *insn;
+
+	/* An image shared by decoders in different threads. */
+	struct pt_image *image;
+
+	/* The expected number of instructions, the sum of their IPs, and the
+	 * final status when decoding the trace using @image.
+	 */
+	uint64_t ninsn, ipsum;
+	int status;
+
+	/* The test fixture threading support. */
+	struct ptunit_thrd_fixture thrd;
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct insn_fixture *);
+	struct ptunit_result (*fini)(struct insn_fixture *);
+};
+
+static struct ptunit_result ifix_packet(struct insn_fixture *ifix,
+					enum pt_packet_type type,
+					uint64_t payload, uint8_t size)
+{
+	struct pt_packet packet;
+	int errcode;
+
+	memset(&packet, 0, sizeof(packet));
+	packet.type = type;
+
+	switch (type) {
+	case ppt_tnt_8:
+		packet.payload.tnt.bit_size = size;
+		packet.payload.tnt.payload = payload;
+		break;
+
+	case ppt_tip:
+	case ppt_tip_pge:
+	case ppt_tip_pgd:
+	case ppt_fup:
+		packet.payload.ip.ipc = pt_ipc_sext_48;
+		packet.payload.ip.ip = payload;
+		break;
+
+	case ppt_mode:
+		packet.payload.mode.leaf = pt_mol_exec;
+		packet.payload.mode.bits.exec = pt_set_exec_mode(ptem_64bit);
+		break;
+
+	default:
+		break;
+	}
+
+	errcode = pt_enc_next(&ifix->encoder, &packet);
+	ptu_int_gt(errcode, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result ifix_init(struct insn_fixture *ifix)
+{
+	struct pt_image *image;
+	int errcode;
+
+	memset(ifix->buffer, 0, sizeof(ifix->buffer));
+
+	pt_config_init(&ifix->config);
+	ifix->config.begin = ifix->buffer;
+	ifix->config.end = ifix->buffer + sizeof(ifix->buffer);
+
+	errcode = pt_encoder_init(&ifix->encoder, &ifix->config);
+	ptu_int_eq(errcode, 0);
+
+	/* Three iterations of the loop, an interrupt at 0x1001, two more
+	 * iterations with the last one falling through, and a disable.
+	 *
+	 * Then another enable, three iterations, and an indirect jump to
+	 * 0x100b, whose return disables tracing.
+	 */
+	ptu_test(ifix_packet, ifix, ppt_psb, 0ull, 0);
+	ptu_test(ifix_packet, ifix, ppt_mode, 0ull, 0);
+	ptu_test(ifix_packet, ifix, ppt_psbend, 0ull, 0);
+	ptu_test(ifix_packet, ifix, ppt_tip_pge, 0x1000ull, 0);
+	ptu_test(ifix_packet, ifix, ppt_tnt_8, 0x3full, 6);
+	ptu_test(ifix_packet, ifix, ppt_fup, 0x1001ull, 0);
+	ptu_test(ifix_packet, ifix, ppt_tip, 0x1000ull, 0);
+	ptu_test(ifix_packet, ifix, ppt_tnt_8, 0xeull, 4);
+	ptu_test(ifix_packet, ifix, ppt_tip_pgd, 0x2000ull, 0);
+	ptu_test(ifix_packet, ifix, ppt_mode, 0ull, 0);
+	ptu_test(ifix_packet, ifix, ppt_tip_pge, 0x1000ull, 0);
+	ptu_test(ifix_packet, ifix, ppt_tnt_8, 0x3full, 6);
+	ptu_test(ifix_packet, ifix, ppt_tnt_8, 0x2ull, 2);
+	ptu_test(ifix_packet, ifix, ppt_tip, 0x100bull, 0);
+	ptu_test(ifix_packet, ifix, ppt_tip_pgd, 0x1000ull, 0);
+
+	ifix->config.end = ifix->encoder.pos;
+
+	ifix->image = NULL;
+
+	ptu_test(ptunit_thrd_init, &ifix->thrd);
+
+	ifix->decoder = pt_insn_alloc_decoder(&ifix->config);
+	ptu_ptr(ifix->decoder);
+
+	ifix->insn = pt_insn_alloc_decoder(&ifix->config);
+	ptu_ptr(ifix->insn);
+
+	image = pt_insn_get_image(ifix->decoder);
+	errcode = pt_image_add_buffer(image, ifix_code, sizeof(ifix_code), 0,
+				      NULL, ifix_base);
+	ptu_int_eq(errcode, 0);
+
+	image = pt_insn_get_image(ifix->insn);
+	errcode = pt_image_add_buffer(image, ifix_code, sizeof(ifix_code), 0,
+				      NULL, ifix_base);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result ifix_fini(struct insn_fixture *ifix)
+{
+	int thrd;
+
+	ptu_test(ptunit_thrd_fini, &ifix->thrd);
+
+	for (thrd = 0; thrd < ifix->thrd.nthreads; ++thrd)
+		ptu_int_eq(ifix->thrd.result[thrd], 0);
+
+	pt_image_free(ifix->image);
+	pt_insn_free_decoder(ifix->insn);
+	pt_insn_free_decoder(ifix->decoder);
+	pt_encoder_fini(&ifix->encoder);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result batch_null(struct insn_fixture *ifix)
+{
+	struct pt_insn insn[2];
+	size_t count;
+	int errcode;
+
+	errcode = pt_insn_next_batch(NULL, insn, 2, sizeof(*insn), &count);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_insn_next_batch(ifix->decoder, NULL, 2, sizeof(*insn),
+				     &count);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_insn_next_batch(ifix->decoder, insn, 2, 0, &count);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_insn_next_batch(ifix->decoder, insn, 2, sizeof(*insn),
+				     NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result batch_nosync(struct insn_fixture *ifix)
+{
+	struct pt_insn insn[2];
+	size_t count;
+	int errcode;
+
+	count = 1;
+	errcode = pt_insn_next_batch(ifix->decoder, insn, 2, sizeof(*insn),
+				     &count);
+	ptu_int_lt(errcode, 0);
+	ptu_uint_eq(count, 0);
+
+	/* We report the same error as pt_insn_next(). */
+	ptu_int_eq(errcode, pt_insn_next(ifix->insn, insn, sizeof(*insn)));
+
+	return ptu_passed();
+}
+
+static struct ptunit_result batch_empty(struct insn_fixture *ifix)
+{
+	struct pt_insn insn[2];
+	size_t count;
+	int status;
+
+	status = pt_insn_sync_forward(ifix->decoder);
+	ptu_int_ge(status, 0);
+
+	count = 1;
+	status = pt_insn_next_batch(ifix->decoder, insn, 0, sizeof(*insn),
+				    &count);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(count, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result batch_first(struct insn_fixture *ifix)
+{
+	struct pt_insn insn[8];
+	size_t count;
+	int status;
+
+	status = pt_insn_sync_forward(ifix->decoder);
+	ptu_int_ge(status, 0);
+
+	status = pt_insn_next_batch(ifix->decoder, insn, 4, sizeof(*insn),
+				    &count);
+	ptu_int_ge(status, 0);
+	ptu_uint_eq(count, 4);
+	ptu_uint_eq(insn[0].ip, 0x1000ull);
+	ptu_uint_eq(insn[0].enabled, 1);
+	ptu_uint_eq(insn[1].ip, 0x1001ull);
+	ptu_uint_eq(insn[2].ip, 0x1002ull);
+	ptu_int_eq(insn[2].iclass, ptic_call);
+	ptu_uint_eq(insn[3].ip, 0x100cull);
+	ptu_uint_eq(insn[3].enabled, 0);
+
+	return ptu_passed();
+}
+
+/* Check that batches provide the same instructions as pt_insn_next() for
+ * a batch size of @n.
+ */
+static struct ptunit_result batch_same(struct insn_fixture *ifix, size_t n)
+{
+	struct pt_insn insn[16], expected;
+	size_t count, total, idx;
+	int status, estatus;
+
+	ptu_uint_le(n, sizeof(insn) / sizeof(*insn));
+
+	status = pt_insn_sync_forward(ifix->decoder);
+	estatus = pt_insn_sync_forward(ifix->insn);
+	ptu_int_eq(status, estatus);
+
+	total = 0;
+	for (;;) {
+		status = pt_insn_next_batch(ifix->decoder, insn, n,
+					    sizeof(*insn), &count);
+		if (status < 0)
+			break;
+
+		ptu_uint_gt(count, 0);
+		ptu_uint_le(count, n);
+
+		for (idx = 0; idx < count; ++idx) {
+			estatus = pt_insn_next(ifix->insn, &expected,
+					       sizeof(expected));
+			ptu_int_ge(estatus, 0);
+			ptu_uint_eq(insn[idx].ip, expected.ip);
+			ptu_uint_eq(insn[idx].size, expected.size);
+			ptu_int_eq(insn[idx].iclass, expected.iclass);
+			ptu_int_eq(insn[idx].mode, expected.mode);
+			ptu_uint_eq(insn[idx].enabled, expected.enabled);
+			ptu_uint_eq(insn[idx].resumed, expected.resumed);
+			ptu_uint_eq(insn[idx].resynced, expected.resynced);
+			ptu_uint_eq(insn[idx].disabled, expected.disabled);
+			ptu_uint_eq(insn[idx].interrupted,
+				    expected.interrupted);
+
+			if (idx) {
+				ptu_uint_eq(insn[idx].enabled, 0);
+				ptu_uint_eq(insn[idx].resumed, 0);
+				ptu_uint_eq(insn[idx].resynced, 0);
+			}
+
+			if (idx + 1 < count) {
+				ptu_uint_eq(insn[idx].disabled, 0);
+				ptu_uint_eq(insn[idx].interrupted, 0);
+			}
+		}
+
+		ptu_int_eq(status, estatus);
+		total += count;
+	}
+
+	estatus = pt_insn_next(ifix->insn, &expected, sizeof(expected));
+	ptu_int_eq(status, estatus);
+	ptu_uint_gt(total, 0);
+
+	return ptu_passed();
+}
+
+static int ifix_read_code(uint8_t *buffer, size_t size,
+			  const struct pt_asid *asid, uint64_t ip,
+			  void *context)
+{
+	(void) asid;
+	(void) context;
+
+	if (ip < ifix_base || (ifix_base + sizeof(ifix_code)) <= ip)
+		return -pte_nomap;
+
+	ip -= ifix_base;
+	if ((sizeof(ifix_code) - ip) < size)
+		size = sizeof(ifix_code) - ip;
+
+	memcpy(buffer, &ifix_code[ip], size);
+
+	return (int) size;
+}
+
+/* Decode the trace using a new decoder for @ifix->image.
+ *
+ * Provides the number of instructions in @ninsn and the sum of their IPs in
+ * @ipsum.
+ *
+ * Returns the final decoder status.
+ */
+static int ifix_decode(struct insn_fixture *ifix, uint64_t *ninsn,
+		       uint64_t *ipsum)
+{
+	struct pt_insn_decoder *decoder;
+	int status;
+
+	decoder = pt_insn_alloc_decoder(&ifix->config);
+	if (!decoder)
+		return -pte_nomem;
+
+	status = pt_insn_set_image(decoder, ifix->image);
+	if (status >= 0)
+		status = pt_insn_sync_forward(decoder);
+
+	*ninsn = 0ull;
+	*ipsum = 0ull;
+	while (status >= 0) {
+		struct pt_insn insn;
+
+		status = pt_insn_next(decoder, &insn, sizeof(insn));
+		if (status < 0)
+			break;
+
+		*ninsn += 1;
+		*ipsum += insn.ip;
+	}
+
+	pt_insn_free_decoder(decoder);
+
+	return status;
+}
+
+static int ifix_worker(void *arg)
+{
+	struct insn_fixture *ifix;
+	int decoder;
+
+	ifix = arg;
+	if (!ifix)
+		return -pte_internal;
+
+	for (decoder = 0; decoder < ifix_ndecoders; ++decoder) {
+		uint64_t ninsn, ipsum;
+		int status;
+
+		status = ifix_decode(ifix, &ninsn, &ipsum);
+		if (status != ifix->status)
+			return (status < 0) ? status : -pte_internal;
+
+		if (ninsn != ifix->ninsn || ipsum != ifix->ipsum)
+			return -pte_internal;
+	}
+
+	return 0;
+}
+
+/* Run many decoders in different threads on one image.
+ *
+ * If @cached is non-zero, the image's memory is provided by a read memory
+ * callback through the callback cache.
+ */
+static struct ptunit_result stress(struct insn_fixture *ifix, int cached)
+{
+	int errcode;
+
+	ifix->image = pt_image_alloc("stress");
+	ptu_ptr(ifix->image);
+
+	if (cached) {
+		errcode = pt_image_set_callback(ifix->image, ifix_read_code,
+						NULL);
+		ptu_int_eq(errcode, 0);
+
+		errcode = pt_image_set_callback_cache(ifix->image, 0x4, 2);
+		ptu_int_eq(errcode, 0);
+	} else {
+		errcode = pt_image_add_buffer(ifix->image, ifix_code,
+					      sizeof(ifix_code), 0, NULL,
+					      ifix_base);
+		ptu_int_eq(errcode, 0);
+	}
+
+	ifix->status = ifix_decode(ifix, &ifix->ninsn, &ifix->ipsum);
+	ptu_int_eq(ifix->status, -pte_eos);
+	ptu_uint_gt(ifix->ninsn, 0ull);
+
+#if defined(FEATURE_THREADS)
+	{
+		int thrd;
+
+		for (thrd = 0; thrd < ifix_nthreads; ++thrd)
+			ptu_test(ptunit_thrd_create, &ifix->thrd, ifix_worker,
+				 ifix);
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	errcode = ifix_worker(ifix);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct insn_fixture ifix;
+	struct ptunit_suite suite;
+
+	ifix.init = ifix_init;
+	ifix.fini = ifix_fini;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run_f(suite, batch_null, ifix);
+	ptu_run_f(suite, batch_nosync, ifix);
+	ptu_run_f(suite, batch_empty, ifix);
+	ptu_run_f(suite, batch_first, ifix);
+	ptu_run_fp(suite, batch_same, ifix, 1);
+	ptu_run_fp(suite, batch_same, ifix, 3);
+	ptu_run_fp(suite, batch_same, ifix, 16);
+	ptu_run_fp(suite, stress, ifix, 0);
+	ptu_run_fp(suite, stress, ifix, 1);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}
@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "ptunit.h"
+
+#include "pt_insn_cache.h"
+#include "pt_image.h"
+
+#include "intel-pt.h"
+
+#include <string.h>
+
+
+/* A test fixture providing an instruction cache and a decoded instruction. */
+struct insn_cache_fixture {
+	/* The instruction cache. */
+	struct pt_insn_cache cache;
+
+	/* Two images. */
+	struct pt_image image[2];
+
+	/* Two asids. */
+	struct pt_asid asid[2];
+
+	/* A decoded instruction. */
+	pti_ild_t ild;
+
+	/* The instruction's bytes. */
+	uint8_t raw[2];
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct insn_cache_fixture *);
+	struct ptunit_result (*fini)(struct insn_cache_fixture *);
+};
+
+static struct ptunit_result icfix_init(struct insn_cache_fixture *icfix)
+{
+	pt_insn_cache_init(&icfix->cache);
+
+	memset(icfix->image, 0, sizeof(icfix->image));
+
+	pt_asid_init(&icfix->asid[0]);
+	icfix->asid[0].cr3 = 0x4000;
+
+	pt_asid_init(&icfix->asid[1]);
+	icfix->asid[1].cr3 = 0x8000;
+
+	/* A near jump to itself. */
+	icfix->raw[0] = 0xeb;
+	icfix->raw[1] = 0xfe;
+
+	memset(&icfix->ild, 0, sizeof(icfix->ild));
+	icfix->ild.itext = icfix->raw;
+	icfix->ild.max_bytes = sizeof(icfix->raw);
+	icfix->ild.mode = PTI_MODE_64;
+	icfix->ild.runtime_address = 0x1000ull;
+	icfix->ild.length = sizeof(icfix->raw);
+	icfix->ild.direct_target = 0x1000ull;
+	icfix->ild.u.s.branch = 1;
+	icfix->ild.u.s.branch_direct = 1;
+
+	return ptu_passed();
+}
+
+static struct ptunit_result icfix_fini(struct insn_cache_fixture *icfix)
+{
+	pt_insn_cache_fini(&icfix->cache);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result init_null(void)
+{
+	pt_insn_cache_init(NULL);
+	pt_insn_cache_fini(NULL);
+	pt_insn_cache_clear(NULL);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result add_null(struct insn_cache_fixture *icfix)
+{
+	int errcode;
+
+	errcode = pt_insn_cache_add(NULL, &icfix->image[0], &icfix->asid[0],
+				    ptem_64bit, &icfix->ild, 1);
+	ptu_int_eq(errcode, -pte_internal);
+
+	errcode = pt_insn_cache_add(&icfix->cache, NULL, &icfix->asid[0],
+				    ptem_64bit, &icfix->ild, 1);
+	ptu_int_eq(errcode, -pte_internal);
+
+	errcode = pt_insn_cache_add(&icfix->cache, &icfix->image[0], NULL,
+				    ptem_64bit, &icfix->ild, 1);
+	ptu_int_eq(errcode, -pte_internal);
+
+	errcode = pt_insn_cache_add(&icfix->cache, &icfix->image[0],
+				    &icfix->asid[0], ptem_64bit, NULL, 1);
+	ptu_int_eq(errcode, -pte_internal);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result add_bad_length(struct insn_cache_fixture *icfix)
+{
+	int errcode;
+
+	icfix->ild.length = pt_max_insn_size + 1;
+
+	errcode = pt_insn_cache_add(&icfix->cache, &icfix->image[0],
+				    &icfix->asid[0], ptem_64bit, &icfix->ild,
+				    1);
+	ptu_int_eq(errcode, -pte_internal);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result lookup_null(struct insn_cache_fixture *icfix)
+{
+	const struct pt_insn_cache_entry *entry;
+
+	entry = pt_insn_cache_lookup(NULL, &icfix->image[0], &icfix->asid[0],
+				     ptem_64bit, 0x1000ull);
+	ptu_null(entry);
+
+	entry = pt_insn_cache_lookup(&icfix->cache, NULL, &icfix->asid[0],
+				     ptem_64bit, 0x1000ull);
+	ptu_null(entry);
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[0], NULL,
+				     ptem_64bit, 0x1000ull);
+	ptu_null(entry);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result lookup_empty(struct insn_cache_fixture *icfix)
+{
+	const struct pt_insn_cache_entry *entry;
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[0],
+				     &icfix->asid[0], ptem_64bit, 0x1000ull);
+	ptu_null(entry);
+	ptu_uint_eq(icfix->cache.misses, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result add_lookup(struct insn_cache_fixture *icfix)
+{
+	const struct pt_insn_cache_entry *entry;
+	int errcode;
+
+	errcode = pt_insn_cache_add(&icfix->cache, &icfix->image[0],
+				    &icfix->asid[0], ptem_64bit, &icfix->ild,
+				    1);
+	ptu_int_eq(errcode, 0);
+
+	/* The entry keeps its own copy of the instruction bytes. */
+	icfix->raw[0] = 0xcc;
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[0],
+				     &icfix->asid[0], ptem_64bit, 0x1000ull);
+	ptu_ptr(entry);
+	ptu_uint_eq(entry->ild.length, 2);
+	ptu_uint_eq(entry->ild.runtime_address, 0x1000ull);
+	ptu_uint_eq(entry->ild.direct_target, 0x1000ull);
+	ptu_uint_eq(entry->ild.u.s.branch, 1);
+	ptu_uint_eq(entry->ild.u.s.branch_direct, 1);
+	ptu_null(entry->ild.itext);
+	ptu_uint_eq(entry->relevant, 1);
+	ptu_uint_eq(entry->raw[0], 0xeb);
+	ptu_uint_eq(entry->raw[1], 0xfe);
+	ptu_uint_eq(icfix->cache.hits, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result lookup_miss(struct insn_cache_fixture *icfix)
+{
+	const struct pt_insn_cache_entry *entry;
+	int errcode;
+
+	errcode = pt_insn_cache_add(&icfix->cache, &icfix->image[0],
+				    &icfix->asid[0], ptem_64bit, &icfix->ild,
+				    0);
+	ptu_int_eq(errcode, 0);
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[0],
+				     &icfix->asid[0], ptem_64bit, 0x1002ull);
+	ptu_null(entry);
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[0],
+				     &icfix->asid[1], ptem_64bit, 0x1000ull);
+	ptu_null(entry);
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[0],
+				     &icfix->asid[0], ptem_32bit, 0x1000ull);
+	ptu_null(entry);
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[1],
+				     &icfix->asid[0], ptem_64bit, 0x1000ull);
+	ptu_null(entry);
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[0],
+				     &icfix->asid[0], ptem_64bit, 0x1000ull);
+	ptu_ptr(entry);
+	ptu_uint_eq(entry->relevant, 0);
+
+	ptu_uint_eq(icfix->cache.hits, 1);
+	ptu_uint_eq(icfix->cache.misses, 4);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result generation(struct insn_cache_fixture *icfix)
+{
+	const struct pt_insn_cache_entry *entry;
+	int errcode;
+
+	errcode = pt_insn_cache_add(&icfix->cache, &icfix->image[0],
+				    &icfix->asid[0], ptem_64bit, &icfix->ild,
+				    1);
+	ptu_int_eq(errcode, 0);
+
+	icfix->image[0].mgeneration += 1;
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[0],
+				     &icfix->asid[0], ptem_64bit, 0x1000ull);
+	ptu_null(entry);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result other_image(struct insn_cache_fixture *icfix)
+{
+	const struct pt_insn_cache_entry *entry;
+	int errcode;
+
+	errcode = pt_insn_cache_add(&icfix->cache, &icfix->image[0],
+				    &icfix->asid[0], ptem_64bit, &icfix->ild,
+				    1);
+	ptu_int_eq(errcode, 0);
+
+	icfix->ild.runtime_address = 0x2000ull;
+
+	errcode = pt_insn_cache_add(&icfix->cache, &icfix->image[1],
+				    &icfix->asid[0], ptem_64bit, &icfix->ild,
+				    1);
+	ptu_int_eq(errcode, 0);
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[1],
+				     &icfix->asid[0], ptem_64bit, 0x2000ull);
+	ptu_ptr(entry);
+
+	/* Adding an instruction for another image discards all entries. */
+	icfix->cache.image = &icfix->image[0];
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[0],
+				     &icfix->asid[0], ptem_64bit, 0x1000ull);
+	ptu_null(entry);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result evict(struct insn_cache_fixture *icfix)
+{
+	const struct pt_insn_cache_entry *entry;
+	int errcode;
+
+	errcode = pt_insn_cache_add(&icfix->cache, &icfix->image[0],
+				    &icfix->asid[0], ptem_64bit, &icfix->ild,
+				    1);
+	ptu_int_eq(errcode, 0);
+
+	/* An address that maps to the same entry. */
+	icfix->ild.runtime_address = 0x1000ull + pt_insn_cache_size;
+
+	errcode = pt_insn_cache_add(&icfix->cache, &icfix->image[0],
+				    &icfix->asid[0], ptem_64bit, &icfix->ild,
+				    1);
+	ptu_int_eq(errcode, 0);
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[0],
+				     &icfix->asid[0], ptem_64bit, 0x1000ull);
+	ptu_null(entry);
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[0],
+				     &icfix->asid[0], ptem_64bit,
+				     icfix->ild.runtime_address);
+	ptu_ptr(entry);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result clear(struct insn_cache_fixture *icfix)
+{
+	const struct pt_insn_cache_entry *entry;
+	int errcode;
+
+	errcode = pt_insn_cache_add(&icfix->cache, &icfix->image[0],
+				    &icfix->asid[0], ptem_64bit, &icfix->ild,
+				    1);
+	ptu_int_eq(errcode, 0);
+
+	pt_insn_cache_clear(&icfix->cache);
+
+	entry = pt_insn_cache_lookup(&icfix->cache, &icfix->image[0],
+				     &icfix->asid[0], ptem_64bit, 0x1000ull);
+	ptu_null(entry);
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct insn_cache_fixture icfix;
+	struct ptunit_suite suite;
+
+	icfix.init = icfix_init;
+	icfix.fini = icfix_fini;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run(suite, init_null);
+	ptu_run_f(suite, add_null, icfix);
+	ptu_run_f(suite, add_bad_length, icfix);
+	ptu_run_f(suite, lookup_null, icfix);
+	ptu_run_f(suite, lookup_empty, icfix);
+	ptu_run_f(suite, add_lookup, icfix);
+	ptu_run_f(suite, lookup_miss, icfix);
+	ptu_run_f(suite, generation, icfix);
+	ptu_run_f(suite, other_image, icfix);
+	ptu_run_f(suite, evict, icfix);
+	ptu_run_f(suite, clear, icfix);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}
@@ -104,6 +104,31 @@ int pt_section_read(const struct pt_section *section, uint8_t *buffer,
 	return size;
 }
 
+int pt_section_fetch(const struct pt_section *section, const uint8_t **pbegin,
+		     uint16_t size, uint64_t offset)
+{
+	struct sfix_mapping *mapping;
+	uint64_t end;
+
+	if (!section || !pbegin)
+		return -pte_internal;
+
+	mapping = section->mapping;
+	if (!mapping)
+		return -pte_nomap;
+
+	if (mapping->size <= offset)
+		return -pte_nomap;
+
+	end = offset + size;
+	if (mapping->size < end)
+		end = mapping->size;
+
+	*pbegin = &mapping->content[offset];
+
+	return (int) (end - offset);
+}
+
 /* A test fixture providing a test sections. */
 struct section_fixture {
 	/* The test mapping. */
@@ -307,6 +332,60 @@ static struct ptunit_result read_nomem_asid(struct section_fixture *sfix)
 	return ptu_passed();
 }
 
+static struct ptunit_result fetch(struct section_fixture *sfix)
+{
+	const uint8_t *begin;
+	int status;
+
+	status = pt_section_map(&sfix->section);
+	ptu_int_eq(status, 0);
+
+	status = pt_msec_fetch_mapped(&sfix->msec, &begin, 2, &sfix->asid,
+				      sfix->vaddr + 3);
+	ptu_int_eq(status, 2);
+	ptu_ptr_eq(begin, &sfix->mapping.content[3]);
+
+	status = pt_msec_fetch_mapped(&sfix->msec, &begin, 2, &sfix->asid,
+				      sfix->vaddr + sfix->section.size - 1);
+	ptu_int_eq(status, 1);
+	ptu_ptr_eq(begin, &sfix->mapping.content[sfix->mapping.size - 1]);
+
+	status = pt_section_unmap(&sfix->section);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result fetch_nomem(struct section_fixture *sfix)
+{
+	const uint8_t *begin;
+	struct pt_asid asid;
+	int status;
+
+	pt_asid_init(&asid);
+	asid.cr3 = 0xcece00ull;
+
+	status = pt_section_map(&sfix->section);
+	ptu_int_eq(status, 0);
+
+	status = pt_msec_fetch_mapped(&sfix->msec, &begin, 2, &sfix->asid,
+				      sfix->vaddr - 1);
+	ptu_int_eq(status, -pte_nomap);
+
+	status = pt_msec_fetch_mapped(&sfix->msec, &begin, 2, &asid,
+				      sfix->vaddr);
+	ptu_int_eq(status, -pte_nomap);
+
+	status = pt_msec_fetch_mapped(NULL, &begin, 2, &sfix->asid,
+				      sfix->vaddr);
+	ptu_int_eq(status, -pte_internal);
+
+	status = pt_section_unmap(&sfix->section);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
 static struct ptunit_result sfix_init(struct section_fixture *sfix)
 {
 	uint8_t i;
@@ -363,6 +442,8 @@ int main(int argc, char **argv)
 	ptu_run_f(suite, read_truncated, sfix);
 	ptu_run_f(suite, read_nomem_vaddr, sfix);
 	ptu_run_f(suite, read_nomem_asid, sfix);
+	ptu_run_f(suite, fetch, sfix);
+	ptu_run_f(suite, fetch_nomem, sfix);
 
 	ptunit_report(&suite);
 	return suite.nr_fails;
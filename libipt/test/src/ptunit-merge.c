@@ -0,0 +1,488 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ptunit.h"
+
+#include "pt_merge_decoder.h"
+#include "pt_encoder.h"
+
+#include "intel-pt.h"
+
+#include <string.h>
+
+
+/* The code of our test image at mfix_base.
+ *
+ *   0x1000:  nop
+ *   0x1001:  nop
+ *   0x1002:  jne 0x1000
+ *   0x1004:  jmp *%rax
+ */
+static const uint8_t mfix_code[] = {
+	0x90, 0x90, 0x75, 0xfc, 0xff, 0xe0
+};
+
+enum {
+	mfix_base	= 0x1000,
+	mfix_ncpus	= 3
+};
+
+/* A test fixture providing per-cpu traces and a merge decoder for them. */
+struct merge_fixture {
+	/* The trace buffers. */
+	uint8_t buffer[mfix_ncpus][1024];
+
+	/* The configurations and encoders for the above buffers. */
+	struct pt_config config[mfix_ncpus];
+	struct pt_encoder encoder[mfix_ncpus];
+
+	/* The image containing mfix_code. */
+	struct pt_image *image;
+
+	/* The merge decoder. */
+	struct pt_merge_decoder *decoder;
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct merge_fixture *);
+	struct ptunit_result (*fini)(struct merge_fixture *);
+};
+
+static struct ptunit_result mfix_packet(struct merge_fixture *mfix,
+					uint32_t cpu, enum pt_packet_type type,
+					uint64_t payload, uint8_t size)
+{
+	struct pt_packet packet;
+	int errcode;
+
+	memset(&packet, 0, sizeof(packet));
+	packet.type = type;
+
+	switch (type) {
+	case ppt_tnt_8:
+		packet.payload.tnt.bit_size = size;
+		packet.payload.tnt.payload = payload;
+		break;
+
+	case ppt_tip_pge:
+	case ppt_tip_pgd:
+		packet.payload.ip.ipc = pt_ipc_sext_48;
+		packet.payload.ip.ip = payload;
+		break;
+
+	case ppt_tsc:
+		packet.payload.tsc.tsc = payload;
+		break;
+
+	case ppt_mode:
+		packet.payload.mode.leaf = pt_mol_exec;
+		packet.payload.mode.bits.exec = pt_set_exec_mode(ptem_64bit);
+		break;
+
+	default:
+		break;
+	}
+
+	errcode = pt_enc_next(&mfix->encoder[cpu], &packet);
+	ptu_int_gt(errcode, 0);
+
+	return ptu_passed();
+}
+
+/* Encode a trace for @cpu starting at @tsc with @ntnt loop iterations before
+ * and after a timing update at @tsc + 0x1000.  The last iteration falls
+ * through into an indirect jump that disables tracing.
+ *
+ * Tracing is enabled at @ip.
+ */
+static struct ptunit_result mfix_trace(struct merge_fixture *mfix,
+				       uint32_t cpu, uint64_t tsc,
+				       uint64_t ip, uint8_t ntnt)
+{
+	uint64_t tnt;
+
+	tnt = (1ull << ntnt) - 1ull;
+
+	ptu_test(mfix_packet, mfix, cpu, ppt_psb, 0ull, 0);
+	ptu_test(mfix_packet, mfix, cpu, ppt_tsc, tsc, 0);
+	ptu_test(mfix_packet, mfix, cpu, ppt_mode, 0ull, 0);
+	ptu_test(mfix_packet, mfix, cpu, ppt_psbend, 0ull, 0);
+	ptu_test(mfix_packet, mfix, cpu, ppt_tip_pge, ip, 0);
+	ptu_test(mfix_packet, mfix, cpu, ppt_tnt_8, tnt, ntnt);
+	ptu_test(mfix_packet, mfix, cpu, ppt_tsc, tsc + 0x1000ull, 0);
+	ptu_test(mfix_packet, mfix, cpu, ppt_tnt_8, tnt << 1, ntnt + 1);
+	ptu_test(mfix_packet, mfix, cpu, ppt_tip_pgd, 0x2000ull, 0);
+
+	return ptu_passed();
+}
+
+/* Allocate the merge decoder for the traces generated so far. */
+static struct ptunit_result mfix_decoder(struct merge_fixture *mfix)
+{
+	uint32_t cpu;
+	int errcode;
+
+	for (cpu = 0; cpu < mfix_ncpus; ++cpu)
+		mfix->config[cpu].end = mfix->encoder[cpu].pos;
+
+	mfix->decoder = pt_merge_alloc_decoder(mfix->config, mfix_ncpus);
+	ptu_ptr(mfix->decoder);
+
+	errcode = pt_merge_set_image(mfix->decoder, mfix->image);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result mfix_init_encoders(struct merge_fixture *mfix)
+{
+	uint32_t cpu;
+	int errcode;
+
+	memset(mfix->buffer, 0, sizeof(mfix->buffer));
+
+	for (cpu = 0; cpu < mfix_ncpus; ++cpu) {
+		struct pt_config *config;
+
+		config = &mfix->config[cpu];
+
+		pt_config_init(config);
+		config->begin = mfix->buffer[cpu];
+		config->end = mfix->buffer[cpu] + sizeof(mfix->buffer[cpu]);
+
+		errcode = pt_encoder_init(&mfix->encoder[cpu], config);
+		ptu_int_eq(errcode, 0);
+	}
+
+	mfix->image = pt_image_alloc(NULL);
+	ptu_ptr(mfix->image);
+
+	errcode = pt_image_add_buffer(mfix->image, mfix_code,
+				      sizeof(mfix_code), 0, NULL, mfix_base);
+	ptu_int_eq(errcode, 0);
+
+	mfix->decoder = NULL;
+
+	return ptu_passed();
+}
+
+static struct ptunit_result mfix_init(struct merge_fixture *mfix)
+{
+	ptu_test(mfix_init_encoders, mfix);
+
+	ptu_test(mfix_trace, mfix, 0, 0x1000ull, mfix_base, 2);
+	ptu_test(mfix_trace, mfix, 1, 0x1800ull, mfix_base, 3);
+	ptu_test(mfix_trace, mfix, 2, 0x1000ull, mfix_base, 4);
+
+	ptu_test(mfix_decoder, mfix);
+
+	return ptu_passed();
+}
+
+/* Tracing on cpu 1 is enabled at an address that is not in the image. */
+static struct ptunit_result mfix_init_nomap(struct merge_fixture *mfix)
+{
+	ptu_test(mfix_init_encoders, mfix);
+
+	ptu_test(mfix_trace, mfix, 0, 0x1000ull, mfix_base, 2);
+	ptu_test(mfix_trace, mfix, 1, 0x800ull, 0x3000ull, 3);
+
+	ptu_test(mfix_decoder, mfix);
+
+	return ptu_passed();
+}
+
+/* Cpu 0 has no trace, cpu 2 has a trace without TSC. */
+static struct ptunit_result mfix_init_sparse(struct merge_fixture *mfix)
+{
+	ptu_test(mfix_init_encoders, mfix);
+
+	ptu_test(mfix_trace, mfix, 1, 0x1000ull, mfix_base, 2);
+
+	ptu_test(mfix_packet, mfix, 2, ppt_psb, 0ull, 0);
+	ptu_test(mfix_packet, mfix, 2, ppt_mode, 0ull, 0);
+	ptu_test(mfix_packet, mfix, 2, ppt_psbend, 0ull, 0);
+	ptu_test(mfix_packet, mfix, 2, ppt_tip_pge, mfix_base, 0);
+	ptu_test(mfix_packet, mfix, 2, ppt_tnt_8, 0x2ull, 2);
+	ptu_test(mfix_packet, mfix, 2, ppt_tip_pgd, 0x2000ull, 0);
+
+	ptu_test(mfix_decoder, mfix);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result mfix_fini(struct merge_fixture *mfix)
+{
+	uint32_t cpu;
+
+	pt_merge_free_decoder(mfix->decoder);
+	pt_image_free(mfix->image);
+
+	for (cpu = 0; cpu < mfix_ncpus; ++cpu)
+		pt_encoder_fini(&mfix->encoder[cpu]);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result null(void)
+{
+	struct pt_config config;
+	struct pt_merge_decoder decoder;
+	struct pt_insn insn;
+	uint64_t time;
+	uint32_t cpu;
+	int errcode;
+
+	pt_config_init(&config);
+
+	ptu_null(pt_merge_alloc_decoder(NULL, 1));
+	ptu_null(pt_merge_alloc_decoder(&config, 0));
+	pt_merge_free_decoder(NULL);
+
+	errcode = pt_merge_decoder_init(NULL, &config, 1);
+	ptu_int_eq(errcode, -pte_internal);
+
+	errcode = pt_merge_sync_forward(NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_merge_set_image(NULL, NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_merge_next(NULL, &insn, sizeof(insn), &cpu);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_merge_next(&decoder, NULL, sizeof(insn), &cpu);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_merge_next(&decoder, &insn, sizeof(insn), NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_merge_time(NULL, &time);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_merge_time(&decoder, NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result next_nosync(struct merge_fixture *mfix)
+{
+	struct pt_insn insn;
+	uint32_t cpu;
+	int errcode;
+
+	errcode = pt_merge_next(mfix->decoder, &insn, sizeof(insn), &cpu);
+	ptu_int_eq(errcode, -pte_eos);
+
+	return ptu_passed();
+}
+
+/* Check that instructions are provided in time order and that each cpu's
+ * instructions are provided in the order of a separate instruction flow
+ * decoder.
+ */
+static struct ptunit_result merge(struct merge_fixture *mfix)
+{
+	struct pt_insn_decoder *insn_decoder[mfix_ncpus];
+	uint64_t last_time, ninsn[mfix_ncpus];
+	uint32_t cpu, last_cpu, nswitches;
+	int status;
+
+	for (cpu = 0; cpu < mfix_ncpus; ++cpu) {
+		insn_decoder[cpu] = pt_insn_alloc_decoder(&mfix->config[cpu]);
+		ptu_ptr(insn_decoder[cpu]);
+
+		status = pt_insn_set_image(insn_decoder[cpu], mfix->image);
+		ptu_int_eq(status, 0);
+
+		status = pt_insn_sync_forward(insn_decoder[cpu]);
+		ptu_int_ge(status, 0);
+
+		ninsn[cpu] = 0ull;
+	}
+
+	status = pt_merge_sync_forward(mfix->decoder);
+	ptu_int_eq(status, 0);
+
+	last_time = 0ull;
+	last_cpu = mfix_ncpus;
+	nswitches = 0;
+	for (;;) {
+		struct pt_insn insn, expected;
+		uint64_t time;
+		int errcode;
+
+		status = pt_merge_next(mfix->decoder, &insn, sizeof(insn),
+				       &cpu);
+		if (status < 0)
+			break;
+
+		ptu_uint_lt(cpu, mfix_ncpus);
+
+		errcode = pt_merge_time(mfix->decoder, &time);
+		ptu_int_eq(errcode, 0);
+		ptu_uint_ge(time, last_time);
+
+		/* Instructions at the same time are ordered by cpu. */
+		if ((time == last_time) && (cpu != last_cpu))
+			ptu_uint_gt(cpu, last_cpu);
+
+		errcode = pt_insn_next(insn_decoder[cpu], &expected,
+				       sizeof(expected));
+		ptu_int_eq(errcode, status);
+		ptu_uint_eq(insn.ip, expected.ip);
+		ptu_uint_eq(insn.enabled, expected.enabled);
+		ptu_uint_eq(insn.disabled, expected.disabled);
+
+		if (cpu != last_cpu)
+			nswitches += 1;
+
+		last_time = time;
+		last_cpu = cpu;
+		ninsn[cpu] += 1;
+	}
+
+	ptu_int_eq(status, -pte_eos);
+
+	for (cpu = 0; cpu < mfix_ncpus; ++cpu) {
+		struct pt_insn insn;
+
+		status = pt_insn_next(insn_decoder[cpu], &insn, sizeof(insn));
+		ptu_int_eq(status, -pte_eos);
+		ptu_uint_ne(ninsn[cpu], 0ull);
+
+		pt_insn_free_decoder(insn_decoder[cpu]);
+	}
+
+	/* The cpus' runs interleave. */
+	ptu_uint_gt(nswitches, mfix_ncpus);
+
+	return ptu_passed();
+}
+
+/* Check that errors are reported for the cpu that encountered them without
+ * affecting other cpus.
+ */
+static struct ptunit_result merge_nomap(struct merge_fixture *mfix)
+{
+	struct pt_insn insn;
+	uint64_t ninsn;
+	uint32_t cpu;
+	int status;
+
+	status = pt_merge_sync_forward(mfix->decoder);
+	ptu_int_eq(status, 0);
+
+	/* Cpu 1 comes first. */
+	status = pt_merge_next(mfix->decoder, &insn, sizeof(insn), &cpu);
+	ptu_int_eq(status, -pte_nomap);
+	ptu_uint_eq(cpu, 1);
+
+	/* Cpu 1 can't be resynchronized; we continue with cpu 0. */
+	for (ninsn = 0ull;; ++ninsn) {
+		status = pt_merge_next(mfix->decoder, &insn, sizeof(insn),
+				       &cpu);
+		if (status < 0)
+			break;
+
+		ptu_uint_eq(cpu, 0);
+	}
+
+	ptu_int_eq(status, -pte_eos);
+	ptu_uint_eq(ninsn, 16ull);
+
+	return ptu_passed();
+}
+
+/* Check that cpus without trace are ignored and that cpus without TSC are
+ * ordered relative to their synchronization.
+ */
+static struct ptunit_result merge_sparse(struct merge_fixture *mfix)
+{
+	struct pt_insn insn;
+	uint64_t time;
+	uint32_t cpu;
+	int status;
+
+	status = pt_merge_sync_forward(mfix->decoder);
+	ptu_int_eq(status, 0);
+
+	status = pt_merge_next(mfix->decoder, &insn, sizeof(insn), &cpu);
+	ptu_int_ge(status, 0);
+	ptu_uint_eq(cpu, 2);
+	ptu_uint_eq(insn.ip, mfix_base);
+	ptu_uint_eq(insn.enabled, 1);
+
+	status = pt_merge_time(mfix->decoder, &time);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(time, 0ull);
+
+	do {
+		status = pt_merge_next(mfix->decoder, &insn, sizeof(insn),
+				       &cpu);
+	} while ((status >= 0) && (cpu == 2));
+
+	ptu_int_ge(status, 0);
+	ptu_uint_eq(cpu, 1);
+	ptu_uint_eq(insn.enabled, 1);
+
+	do {
+		status = pt_merge_next(mfix->decoder, &insn, sizeof(insn),
+				       &cpu);
+	} while ((status >= 0) && (cpu == 1));
+
+	ptu_int_eq(status, -pte_eos);
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct merge_fixture mfix;
+	struct ptunit_suite suite;
+
+	mfix.init = mfix_init;
+	mfix.fini = mfix_fini;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run(suite, null);
+	ptu_run_f(suite, next_nosync, mfix);
+	ptu_run_f(suite, merge, mfix);
+
+	mfix.init = mfix_init_nomap;
+
+	ptu_run_f(suite, merge_nomap, mfix);
+
+	mfix.init = mfix_init_sparse;
+
+	ptu_run_f(suite, merge_sparse, mfix);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}
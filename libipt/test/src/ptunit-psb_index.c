@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ptunit.h"
+#include "ptunit_mktempname.h"
+
+#include "pt_psb_index.h"
+#include "pt_encoder.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* A test fixture providing a trace with a few PSBs and an index for it. */
+struct psb_index_fixture {
+	/* The trace buffer. */
+	uint8_t buffer[1024];
+
+	/* The trace configuration. */
+	struct pt_config config;
+
+	/* The offsets of the complete PSB+ headers in the trace. */
+	uint64_t offset[3];
+
+	/* The index to test. */
+	struct pt_psb_index index;
+
+	/* The name of a temporary index file. */
+	char *name;
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct psb_index_fixture *);
+	struct ptunit_result (*fini)(struct psb_index_fixture *);
+};
+
+static struct ptunit_result pfix_init(struct psb_index_fixture *pfix)
+{
+	struct pt_encoder encoder;
+	int errcode;
+
+	memset(pfix->buffer, 0, sizeof(pfix->buffer));
+
+	pt_config_init(&pfix->config);
+	pfix->config.begin = pfix->buffer;
+	pfix->config.end = pfix->buffer + sizeof(pfix->buffer);
+
+	errcode = pt_encoder_init(&encoder, &pfix->config);
+	ptu_int_eq(errcode, 0);
+
+	/* Some garbage that is skipped. */
+	pt_encode_tnt_8(&encoder, 0x2, 2);
+	pt_encode_tsc(&encoder, 0x100ull);
+
+	/* A PSB while tracing is enabled. */
+	errcode = pt_enc_get_offset(&encoder, &pfix->offset[0]);
+	ptu_int_eq(errcode, 0);
+
+	pt_encode_psb(&encoder);
+	pt_encode_tsc(&encoder, 0x1000ull);
+	pt_encode_cbr(&encoder, 0x2);
+	pt_encode_mode_exec(&encoder, ptem_64bit);
+	pt_encode_pip(&encoder, 0xa000ull, 0);
+	pt_encode_fup(&encoder, 0x1000ull, pt_ipc_sext_48);
+	pt_encode_psbend(&encoder);
+	pt_encode_tnt_8(&encoder, 0x2, 2);
+	pt_encode_tip(&encoder, 0x2000ull, pt_ipc_update_16);
+	pt_encode_tsc(&encoder, 0x2000ull);
+	pt_encode_tip_pgd(&encoder, 0ull, pt_ipc_suppressed);
+
+	/* A PSB while tracing is disabled. */
+	errcode = pt_enc_get_offset(&encoder, &pfix->offset[1]);
+	ptu_int_eq(errcode, 0);
+
+	pt_encode_psb(&encoder);
+	pt_encode_tma(&encoder, 0x1, 0x2);
+	pt_encode_mode_exec(&encoder, ptem_32bit);
+	pt_encode_psbend(&encoder);
+	pt_encode_tsc(&encoder, 0x3000ull);
+
+	/* A PSB without timing or mode information. */
+	errcode = pt_enc_get_offset(&encoder, &pfix->offset[2]);
+	ptu_int_eq(errcode, 0);
+
+	pt_encode_psb(&encoder);
+	pt_encode_psbend(&encoder);
+	pt_encode_tip_pge(&encoder, 0x3000ull, pt_ipc_sext_48);
+
+	/* An incomplete PSB+ header at the end of the trace. */
+	pt_encode_psb(&encoder);
+	pt_encode_tsc(&encoder, 0x4000ull);
+
+	pfix->config.end = encoder.pos;
+	pt_encoder_fini(&encoder);
+
+	pt_psb_index_init(&pfix->index);
+	pfix->name = mktempname();
+	ptu_ptr(pfix->name);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result pfix_fini(struct psb_index_fixture *pfix)
+{
+	pt_psb_index_fini(&pfix->index);
+
+	if (pfix->name) {
+		(void) remove(pfix->name);
+		free(pfix->name);
+	}
+
+	return ptu_passed();
+}
+
+static struct ptunit_result null(void)
+{
+	struct pt_psb_index_entry entry;
+	struct pt_psb_index index;
+	struct pt_config config;
+	int errcode;
+
+	pt_config_init(&config);
+	pt_psb_index_init(&index);
+
+	errcode = pt_psb_index_build(NULL, &config);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_psb_index_build(&index, NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_psb_index_save(NULL, "name");
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_psb_index_save(&index, NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_psb_index_load(NULL, "name", NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_psb_index_load(&index, NULL, NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_psb_index_get(NULL, 0, &entry);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_psb_index_get(&index, 0, NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_psb_index_find_offset(NULL, 0ull, &entry);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_psb_index_find_offset(&index, 0ull, NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_psb_index_find_time(NULL, 0ull, &entry);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_psb_index_find_time(&index, 0ull, NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	pt_psb_index_free(NULL);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result empty(void)
+{
+	struct pt_psb_index_entry entry;
+	struct pt_psb_index index;
+	struct pt_config config;
+	uint8_t buffer[] = { 0, 0, 0, 0 };
+	int errcode;
+
+	pt_config_init(&config);
+	config.begin = buffer;
+	config.end = buffer + sizeof(buffer);
+
+	pt_psb_index_init(&index);
+
+	errcode = pt_psb_index_build(&index, &config);
+	ptu_int_eq(errcode, 0);
+
+	errcode = pt_psb_index_get(&index, 0, &entry);
+	ptu_int_eq(errcode, -pte_eos);
+
+	errcode = pt_psb_index_find_offset(&index, 0ull, &entry);
+	ptu_int_eq(errcode, -pte_nosync);
+
+	errcode = pt_psb_index_find_time(&index, 0ull, &entry);
+	ptu_int_eq(errcode, -pte_no_time);
+
+	pt_psb_index_fini(&index);
+
+	return ptu_passed();
+}
+
+/* Check that @index contains the PSBs of @pfix's trace. */
+static struct ptunit_result check(struct psb_index_fixture *pfix,
+				  const struct pt_psb_index *index)
+{
+	struct pt_psb_index_entry entry;
+	int errcode;
+
+	errcode = pt_psb_index_get(index, 0, &entry);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(entry.offset, pfix->offset[0]);
+	ptu_uint_eq(entry.has_tsc, 1);
+	ptu_uint_eq(entry.tsc, 0x1000ull);
+	ptu_uint_eq(entry.has_cbr, 1);
+	ptu_uint_eq(entry.cbr, 0x2);
+	ptu_uint_eq(entry.has_tma, 0);
+	ptu_int_eq(entry.mode, ptem_64bit);
+	ptu_uint_eq(entry.has_cr3, 1);
+	ptu_uint_eq(entry.cr3, 0xa000ull);
+	ptu_uint_eq(entry.has_ip, 1);
+	ptu_uint_eq(entry.ip, 0x1000ull);
+
+	errcode = pt_psb_index_get(index, 1, &entry);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(entry.offset, pfix->offset[1]);
+	ptu_uint_eq(entry.has_tsc, 1);
+	ptu_uint_eq(entry.tsc, 0x2000ull);
+	ptu_uint_eq(entry.has_cbr, 1);
+	ptu_uint_eq(entry.cbr, 0x2);
+	ptu_uint_eq(entry.has_tma, 1);
+	ptu_uint_eq(entry.ctc, 0x1);
+	ptu_uint_eq(entry.fc, 0x2);
+	ptu_int_eq(entry.mode, ptem_32bit);
+	ptu_uint_eq(entry.has_cr3, 0);
+	ptu_uint_eq(entry.has_ip, 0);
+
+	errcode = pt_psb_index_get(index, 2, &entry);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(entry.offset, pfix->offset[2]);
+	ptu_uint_eq(entry.tsc, 0x3000ull);
+	ptu_int_eq(entry.mode, ptem_unknown);
+	ptu_uint_eq(entry.has_ip, 0);
+
+	errcode = pt_psb_index_get(index, 3, &entry);
+	ptu_int_eq(errcode, -pte_eos);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result build(struct psb_index_fixture *pfix)
+{
+	int errcode;
+
+	errcode = pt_psb_index_build(&pfix->index, &pfix->config);
+	ptu_int_eq(errcode, 3);
+
+	ptu_test(check, pfix, &pfix->index);
+
+	/* Building again replaces the previous content. */
+	errcode = pt_psb_index_build(&pfix->index, &pfix->config);
+	ptu_int_eq(errcode, 3);
+
+	ptu_test(check, pfix, &pfix->index);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result find_offset(struct psb_index_fixture *pfix)
+{
+	struct pt_psb_index_entry entry;
+	int errcode;
+
+	errcode = pt_psb_index_build(&pfix->index, &pfix->config);
+	ptu_int_eq(errcode, 3);
+
+	errcode = pt_psb_index_find_offset(&pfix->index, 0ull, &entry);
+	ptu_int_eq(errcode, -pte_nosync);
+
+	errcode = pt_psb_index_find_offset(&pfix->index, pfix->offset[0],
+					   &entry);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(entry.offset, pfix->offset[0]);
+
+	errcode = pt_psb_index_find_offset(&pfix->index, pfix->offset[1] - 1,
+					   &entry);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(entry.offset, pfix->offset[0]);
+
+	errcode = pt_psb_index_find_offset(&pfix->index, pfix->offset[1],
+					   &entry);
+	ptu_int_eq(errcode, 1);
+	ptu_uint_eq(entry.offset, pfix->offset[1]);
+
+	errcode = pt_psb_index_find_offset(&pfix->index, UINT64_MAX, &entry);
+	ptu_int_eq(errcode, 2);
+	ptu_uint_eq(entry.offset, pfix->offset[2]);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result find_time(struct psb_index_fixture *pfix)
+{
+	struct pt_psb_index_entry entry;
+	int errcode;
+
+	errcode = pt_psb_index_build(&pfix->index, &pfix->config);
+	ptu_int_eq(errcode, 3);
+
+	errcode = pt_psb_index_find_time(&pfix->index, 0xfffull, &entry);
+	ptu_int_eq(errcode, -pte_no_time);
+
+	errcode = pt_psb_index_find_time(&pfix->index, 0x1000ull, &entry);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(entry.offset, pfix->offset[0]);
+
+	errcode = pt_psb_index_find_time(&pfix->index, 0x2fffull, &entry);
+	ptu_int_eq(errcode, 1);
+	ptu_uint_eq(entry.offset, pfix->offset[1]);
+
+	errcode = pt_psb_index_find_time(&pfix->index, 0x5000ull, &entry);
+	ptu_int_eq(errcode, 2);
+	ptu_uint_eq(entry.offset, pfix->offset[2]);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result save_load(struct psb_index_fixture *pfix)
+{
+	struct pt_psb_index *loaded;
+	int errcode;
+
+	errcode = pt_psb_index_build(&pfix->index, &pfix->config);
+	ptu_int_eq(errcode, 3);
+
+	errcode = pt_psb_index_save(&pfix->index, pfix->name);
+	ptu_int_eq(errcode, 0);
+
+	loaded = pt_psb_index_alloc();
+	ptu_ptr(loaded);
+
+	errcode = pt_psb_index_load(loaded, pfix->name, &pfix->config);
+	ptu_int_eq(errcode, 3);
+
+	ptu_test(check, pfix, loaded);
+
+	pt_psb_index_free(loaded);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result load_bad_size(struct psb_index_fixture *pfix)
+{
+	struct pt_config config;
+	int errcode;
+
+	errcode = pt_psb_index_build(&pfix->index, &pfix->config);
+	ptu_int_eq(errcode, 3);
+
+	errcode = pt_psb_index_save(&pfix->index, pfix->name);
+	ptu_int_eq(errcode, 0);
+
+	config = pfix->config;
+	config.end -= 1;
+
+	errcode = pt_psb_index_load(&pfix->index, pfix->name, &config);
+	ptu_int_eq(errcode, -pte_bad_file);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result load_bad_file(struct psb_index_fixture *pfix)
+{
+	uint8_t content[] = { 'p', 't', 'p', 's', 'b', 'i', 'd', 'x' };
+	size_t written;
+	FILE *file;
+	int errcode;
+
+	errcode = pt_psb_index_load(&pfix->index, pfix->name, NULL);
+	ptu_int_eq(errcode, -pte_bad_file);
+
+	file = fopen(pfix->name, "wb");
+	ptu_ptr(file);
+
+	written = fwrite(content, 1, sizeof(content), file);
+	fclose(file);
+	ptu_uint_eq(written, sizeof(content));
+
+	errcode = pt_psb_index_load(&pfix->index, pfix->name, NULL);
+	ptu_int_eq(errcode, -pte_bad_file);
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct psb_index_fixture pfix;
+	struct ptunit_suite suite;
+
+	pfix.init = pfix_init;
+	pfix.fini = pfix_fini;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run(suite, null);
+	ptu_run(suite, empty);
+	ptu_run_f(suite, build, pfix);
+	ptu_run_f(suite, find_offset, pfix);
+	ptu_run_f(suite, find_time, pfix);
+	ptu_run_f(suite, save_load, pfix);
+	ptu_run_f(suite, load_bad_size, pfix);
+	ptu_run_f(suite, load_bad_file, pfix);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}
@@ -1838,6 +1838,221 @@ static struct ptunit_result time(struct ptu_decoder_fixture *dfix)
 	return ptu_passed();
 }
 
+static struct ptunit_result sync_time_null(struct ptu_decoder_fixture *dfix)
+{
+	uint64_t ip;
+	int errcode;
+
+	(void) dfix;
+
+	errcode = pt_qry_sync_time(NULL, &ip, 0ull);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result sync_time_no_time(struct ptu_decoder_fixture *dfix)
+{
+	struct pt_query_decoder *decoder = &dfix->decoder;
+	struct pt_encoder *encoder = &dfix->encoder;
+	uint64_t ip;
+	int errcode;
+
+	pt_encode_psb(encoder);
+	pt_encode_fup(encoder, 0x1000ull, pt_ipc_sext_48);
+	pt_encode_psbend(encoder);
+
+	errcode = pt_qry_sync_time(decoder, &ip, 0x1000ull);
+	ptu_int_eq(errcode, -pte_no_time);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result sync_time_empty(struct ptu_decoder_fixture *dfix)
+{
+	struct pt_query_decoder *decoder = &dfix->decoder;
+	uint64_t ip;
+	int errcode;
+
+	errcode = pt_qry_sync_time(decoder, &ip, 0x1000ull);
+	ptu_int_eq(errcode, -pte_no_time);
+
+	return ptu_passed();
+}
+
+/* Encode three PSB+ headers at times 0x1000, 0x2000, and 0x3000 with the
+ * respective IP, each followed by a TNT, and store their offsets in @offset.
+ */
+static struct ptunit_result sync_time_encode(struct ptu_decoder_fixture *dfix,
+					     uint64_t offset[3])
+{
+	struct pt_encoder *encoder = &dfix->encoder;
+	int idx;
+
+	for (idx = 0; idx < 3; ++idx) {
+		uint64_t tsc;
+		int pad;
+
+		tsc = 0x1000ull * (idx + 1);
+
+		offset[idx] = (uint64_t) (encoder->pos - dfix->config.begin);
+
+		pt_encode_psb(encoder);
+		pt_encode_tsc(encoder, tsc);
+		pt_encode_fup(encoder, tsc, pt_ipc_sext_48);
+		pt_encode_psbend(encoder);
+		pt_encode_tnt_8(encoder, 0, 1);
+
+		for (pad = 0; pad < 64; ++pad)
+			pt_encode_pad(encoder);
+	}
+
+	return ptu_passed();
+}
+
+static struct ptunit_result sync_time(struct ptu_decoder_fixture *dfix,
+				      uint64_t tsc, int psb)
+{
+	struct pt_query_decoder *decoder = &dfix->decoder;
+	uint64_t offset[3], sync, ip, time;
+	int errcode;
+
+	ptu_check(sync_time_encode, dfix, offset);
+
+	errcode = pt_qry_sync_time(decoder, &ip, tsc);
+	ptu_int_ge(errcode, 0);
+
+	errcode = pt_qry_get_sync_offset(decoder, &sync);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(sync, offset[psb]);
+	ptu_uint_eq(ip, 0x1000ull * (psb + 1));
+
+	errcode = pt_qry_time(decoder, &time, NULL, NULL);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(time, 0x1000ull * (psb + 1));
+
+	return ptu_passed();
+}
+
+static struct ptunit_result extend_null(struct ptu_decoder_fixture *dfix)
+{
+	struct pt_query_decoder *decoder = &dfix->decoder;
+	int errcode;
+
+	errcode = pt_qry_extend(NULL, dfix->config.end);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_qry_extend(decoder, NULL);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	errcode = pt_qry_extend(decoder, dfix->config.end - 1);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	return ptu_passed();
+}
+
+/* Check that a PSB+ header that is cut off is decoded again after extending
+ * the trace buffer.
+ */
+static struct ptunit_result extend_psb(struct ptu_decoder_fixture *dfix)
+{
+	struct pt_query_decoder *decoder = &dfix->decoder;
+	struct pt_encoder *encoder = &dfix->encoder;
+	uint64_t addr, offset, tsc;
+	uint8_t *end;
+	int errcode;
+
+	pt_encode_psb(encoder);
+	pt_encode_tsc(encoder, 0x1000ull);
+	pt_encode_fup(encoder, 0x1000ull, pt_ipc_sext_48);
+	end = encoder->pos;
+	pt_encode_psbend(encoder);
+
+	decoder->config.end = end - 1;
+
+	errcode = pt_qry_sync_forward(decoder, &addr);
+	ptu_int_eq(errcode, -pte_eos);
+
+	errcode = pt_qry_get_sync_offset(decoder, &offset);
+	ptu_int_eq(errcode, -pte_nosync);
+
+	errcode = pt_qry_extend(decoder, end);
+	ptu_int_eq(errcode, 0);
+
+	errcode = pt_qry_sync_forward(decoder, &addr);
+	ptu_int_eq(errcode, -pte_eos);
+
+	errcode = pt_qry_extend(decoder, encoder->pos);
+	ptu_int_eq(errcode, 0);
+
+	errcode = pt_qry_sync_forward(decoder, &addr);
+	ptu_int_ge(errcode, 0);
+	ptu_uint_eq(addr, 0x1000ull);
+
+	errcode = pt_qry_get_sync_offset(decoder, &offset);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(offset, 0ull);
+
+	errcode = pt_qry_time(decoder, &tsc, NULL, NULL);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(tsc, 0x1000ull);
+
+	return ptu_passed();
+}
+
+/* Check that queries that run out of trace can be repeated after extending
+ * the trace buffer.
+ */
+static struct ptunit_result extend_query(struct ptu_decoder_fixture *dfix)
+{
+	struct pt_query_decoder *decoder = &dfix->decoder;
+	struct pt_encoder *encoder = &dfix->encoder;
+	uint64_t addr, tsc;
+	uint8_t *tnt, *tip;
+	int errcode, taken;
+
+	pt_encode_psb(encoder);
+	pt_encode_fup(encoder, 0x1000ull, pt_ipc_sext_48);
+	pt_encode_psbend(encoder);
+	tnt = encoder->pos;
+	pt_encode_tnt_8(encoder, 0x1ull, 1);
+	pt_encode_tsc(encoder, 0x2000ull);
+	tip = encoder->pos;
+	pt_encode_tip(encoder, 0x3000ull, pt_ipc_sext_48);
+
+	decoder->config.end = tnt;
+
+	errcode = pt_qry_sync_forward(decoder, &addr);
+	ptu_int_ge(errcode, 0);
+	ptu_uint_eq(addr, 0x1000ull);
+
+	errcode = pt_qry_cond_branch(decoder, &taken);
+	ptu_int_eq(errcode, -pte_eos);
+
+	errcode = pt_qry_extend(decoder, tip + 1);
+	ptu_int_eq(errcode, 0);
+
+	errcode = pt_qry_cond_branch(decoder, &taken);
+	ptu_int_eq(errcode, 0);
+	ptu_int_eq(taken, 1);
+
+	errcode = pt_qry_indirect_branch(decoder, &addr);
+	ptu_int_eq(errcode, -pte_eos);
+
+	errcode = pt_qry_time(decoder, &tsc, NULL, NULL);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(tsc, 0x2000ull);
+
+	errcode = pt_qry_extend(decoder, encoder->pos);
+	ptu_int_eq(errcode, 0);
+
+	errcode = pt_qry_indirect_branch(decoder, &addr);
+	ptu_int_eq(errcode, pts_eos);
+	ptu_uint_eq(addr, 0x3000ull);
+
+	return ptu_passed();
+}
+
 static struct ptunit_result cbr_null(struct ptu_decoder_fixture *dfix)
 {
 	struct pt_query_decoder *decoder = &dfix->decoder;
@@ -1928,8 +2143,13 @@ ptu_dfix_header_sync(struct ptu_decoder_fixture *dfix)
 {
 	struct pt_query_decoder *decoder = &dfix->decoder;
 
-	/* Synchronize the decoder at the beginning of the buffer. */
+	/* Synchronize the decoder at the beginning of the buffer.
+	 *
+	 * We have not seen a PSB, yet, so the sync offset must not match the
+	 * decoder's position.
+	 */
 	decoder->pos = decoder->config.begin;
+	decoder->sync = sizeof(dfix->buffer);
 
 	return ptu_passed();
 }
@@ -2531,6 +2751,21 @@ int main(int argc, char **argv)
 	ptu_run_f(suite, time_initial, dfix_empty);
 	ptu_run_f(suite, time, dfix_empty);
 
+	ptu_run_f(suite, sync_time_null, dfix_raw);
+	ptu_run_f(suite, sync_time_no_time, dfix_raw);
+	ptu_run_f(suite, sync_time_empty, dfix_raw);
+	ptu_run_fp(suite, sync_time, dfix_raw, 0x0ull, 0);
+	ptu_run_fp(suite, sync_time, dfix_raw, 0x1000ull, 0);
+	ptu_run_fp(suite, sync_time, dfix_raw, 0x1fffull, 0);
+	ptu_run_fp(suite, sync_time, dfix_raw, 0x2000ull, 1);
+	ptu_run_fp(suite, sync_time, dfix_raw, 0x2800ull, 1);
+	ptu_run_fp(suite, sync_time, dfix_raw, 0x3000ull, 2);
+	ptu_run_fp(suite, sync_time, dfix_raw, 0x10000ull, 2);
+
+	ptu_run_f(suite, extend_null, dfix_raw);
+	ptu_run_f(suite, extend_psb, dfix_raw);
+	ptu_run_f(suite, extend_query, dfix_raw);
+
 	ptu_run_f(suite, cbr_null, dfix_empty);
 	ptu_run_f(suite, cbr_initial, dfix_empty);
 	ptu_run_f(suite, cbr, dfix_empty);
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ptunit.h"
+
+#include "pt_sblock_cache.h"
+#include "pt_image.h"
+
+#include "intel-pt.h"
+
+#include <string.h>
+
+
+/* A test fixture providing a superblock cache and a superblock. */
+struct sblock_cache_fixture {
+	/* The superblock cache. */
+	struct pt_sblock_cache cache;
+
+	/* Two images. */
+	struct pt_image image[2];
+
+	/* Two asids. */
+	struct pt_asid asid[2];
+
+	/* A superblock. */
+	struct pt_sblock_cache_entry sblock;
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct sblock_cache_fixture *);
+	struct ptunit_result (*fini)(struct sblock_cache_fixture *);
+};
+
+static struct ptunit_result sbfix_init(struct sblock_cache_fixture *sbfix)
+{
+	pt_sblock_cache_init(&sbfix->cache);
+
+	memset(sbfix->image, 0, sizeof(sbfix->image));
+
+	pt_asid_init(&sbfix->asid[0]);
+	sbfix->asid[0].cr3 = 0x4000;
+
+	pt_asid_init(&sbfix->asid[1]);
+	sbfix->asid[1].cr3 = 0x8000;
+
+	/* Three times around a loop of four instructions at 0x1000 and then
+	 * out of the loop.
+	 */
+	memset(&sbfix->sblock, 0, sizeof(sbfix->sblock));
+	sbfix->sblock.asid = sbfix->asid[0];
+	sbfix->sblock.ip = 0x1000ull;
+	sbfix->sblock.tnt = 0xeull;
+	sbfix->sblock.ntnt = 4;
+	sbfix->sblock.nused = 4;
+	sbfix->sblock.next_ip = 0x1010ull;
+	sbfix->sblock.ninsn = 16ull;
+	sbfix->sblock.nblocks = 4;
+	sbfix->sblock.mode = (uint8_t) ptem_64bit;
+
+	return ptu_passed();
+}
+
+static struct ptunit_result sbfix_fini(struct sblock_cache_fixture *sbfix)
+{
+	pt_sblock_cache_fini(&sbfix->cache);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result init_null(void)
+{
+	pt_sblock_cache_init(NULL);
+	pt_sblock_cache_fini(NULL);
+	pt_sblock_cache_clear(NULL);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result add_null(struct sblock_cache_fixture *sbfix)
+{
+	int errcode;
+
+	errcode = pt_sblock_cache_add(NULL, &sbfix->image[0], &sbfix->sblock);
+	ptu_int_eq(errcode, -pte_internal);
+
+	errcode = pt_sblock_cache_add(&sbfix->cache, NULL, &sbfix->sblock);
+	ptu_int_eq(errcode, -pte_internal);
+
+	errcode = pt_sblock_cache_add(&sbfix->cache, &sbfix->image[0], NULL);
+	ptu_int_eq(errcode, -pte_internal);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result add_bad_nused(struct sblock_cache_fixture *sbfix)
+{
+	int errcode;
+
+	sbfix->sblock.nused = sbfix->sblock.ntnt + 1;
+
+	errcode = pt_sblock_cache_add(&sbfix->cache, &sbfix->image[0],
+				      &sbfix->sblock);
+	ptu_int_eq(errcode, -pte_internal);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result lookup_null(struct sblock_cache_fixture *sbfix)
+{
+	const struct pt_sblock_cache_entry *entry;
+
+	entry = pt_sblock_cache_lookup(NULL, &sbfix->image[0],
+				       &sbfix->asid[0], ptem_64bit, 0x1000ull,
+				       0xeull, 4);
+	ptu_null(entry);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, NULL, &sbfix->asid[0],
+				       ptem_64bit, 0x1000ull, 0xeull, 4);
+	ptu_null(entry);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0], NULL,
+				       ptem_64bit, 0x1000ull, 0xeull, 4);
+	ptu_null(entry);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result lookup_empty(struct sblock_cache_fixture *sbfix)
+{
+	const struct pt_sblock_cache_entry *entry;
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0],
+				       &sbfix->asid[0], ptem_64bit, 0x1000ull,
+				       0xeull, 4);
+	ptu_null(entry);
+	ptu_uint_eq(sbfix->cache.misses, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result add_lookup(struct sblock_cache_fixture *sbfix)
+{
+	const struct pt_sblock_cache_entry *entry;
+	int errcode;
+
+	errcode = pt_sblock_cache_add(&sbfix->cache, &sbfix->image[0],
+				      &sbfix->sblock);
+	ptu_int_eq(errcode, 0);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0],
+				       &sbfix->asid[0], ptem_64bit, 0x1000ull,
+				       0xeull, 4);
+	ptu_ptr(entry);
+	ptu_uint_eq(entry->next_ip, 0x1010ull);
+	ptu_uint_eq(entry->ninsn, 16ull);
+	ptu_uint_eq(entry->nblocks, 4);
+	ptu_uint_eq(entry->nused, 4);
+	ptu_uint_eq(sbfix->cache.hits, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result lookup_miss(struct sblock_cache_fixture *sbfix)
+{
+	const struct pt_sblock_cache_entry *entry;
+	int errcode;
+
+	errcode = pt_sblock_cache_add(&sbfix->cache, &sbfix->image[0],
+				      &sbfix->sblock);
+	ptu_int_eq(errcode, 0);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0],
+				       &sbfix->asid[0], ptem_64bit, 0x1004ull,
+				       0xeull, 4);
+	ptu_null(entry);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0],
+				       &sbfix->asid[0], ptem_64bit, 0x1000ull,
+				       0xfull, 4);
+	ptu_null(entry);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0],
+				       &sbfix->asid[0], ptem_64bit, 0x1000ull,
+				       0xeull, 5);
+	ptu_null(entry);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0],
+				       &sbfix->asid[1], ptem_64bit, 0x1000ull,
+				       0xeull, 4);
+	ptu_null(entry);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0],
+				       &sbfix->asid[0], ptem_32bit, 0x1000ull,
+				       0xeull, 4);
+	ptu_null(entry);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[1],
+				       &sbfix->asid[0], ptem_64bit, 0x1000ull,
+				       0xeull, 4);
+	ptu_null(entry);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0],
+				       &sbfix->asid[0], ptem_64bit, 0x1000ull,
+				       0xeull, 4);
+	ptu_ptr(entry);
+
+	ptu_uint_eq(sbfix->cache.hits, 1);
+	ptu_uint_eq(sbfix->cache.misses, 6);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result generation(struct sblock_cache_fixture *sbfix)
+{
+	const struct pt_sblock_cache_entry *entry;
+	int errcode;
+
+	errcode = pt_sblock_cache_add(&sbfix->cache, &sbfix->image[0],
+				      &sbfix->sblock);
+	ptu_int_eq(errcode, 0);
+
+	sbfix->image[0].mgeneration += 1;
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0],
+				       &sbfix->asid[0], ptem_64bit, 0x1000ull,
+				       0xeull, 4);
+	ptu_null(entry);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result other_image(struct sblock_cache_fixture *sbfix)
+{
+	const struct pt_sblock_cache_entry *entry;
+	int errcode;
+
+	errcode = pt_sblock_cache_add(&sbfix->cache, &sbfix->image[0],
+				      &sbfix->sblock);
+	ptu_int_eq(errcode, 0);
+
+	sbfix->sblock.ip = 0x2000ull;
+
+	errcode = pt_sblock_cache_add(&sbfix->cache, &sbfix->image[1],
+				      &sbfix->sblock);
+	ptu_int_eq(errcode, 0);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[1],
+				       &sbfix->asid[0], ptem_64bit, 0x2000ull,
+				       0xeull, 4);
+	ptu_ptr(entry);
+
+	/* Adding a superblock for another image discards all entries. */
+	sbfix->cache.image = &sbfix->image[0];
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0],
+				       &sbfix->asid[0], ptem_64bit, 0x1000ull,
+				       0xeull, 4);
+	ptu_null(entry);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result evict(struct sblock_cache_fixture *sbfix)
+{
+	const struct pt_sblock_cache_entry *entry;
+	int errcode;
+
+	errcode = pt_sblock_cache_add(&sbfix->cache, &sbfix->image[0],
+				      &sbfix->sblock);
+	ptu_int_eq(errcode, 0);
+
+	/* An address that maps to the same entry. */
+	sbfix->sblock.ip = 0x1000ull + pt_sblock_cache_size;
+
+	errcode = pt_sblock_cache_add(&sbfix->cache, &sbfix->image[0],
+				      &sbfix->sblock);
+	ptu_int_eq(errcode, 0);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0],
+				       &sbfix->asid[0], ptem_64bit, 0x1000ull,
+				       0xeull, 4);
+	ptu_null(entry);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0],
+				       &sbfix->asid[0], ptem_64bit,
+				       sbfix->sblock.ip, 0xeull, 4);
+	ptu_ptr(entry);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result clear(struct sblock_cache_fixture *sbfix)
+{
+	const struct pt_sblock_cache_entry *entry;
+	int errcode;
+
+	errcode = pt_sblock_cache_add(&sbfix->cache, &sbfix->image[0],
+				      &sbfix->sblock);
+	ptu_int_eq(errcode, 0);
+
+	pt_sblock_cache_clear(&sbfix->cache);
+
+	entry = pt_sblock_cache_lookup(&sbfix->cache, &sbfix->image[0],
+				       &sbfix->asid[0], ptem_64bit, 0x1000ull,
+				       0xeull, 4);
+	ptu_null(entry);
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct sblock_cache_fixture sbfix;
+	struct ptunit_suite suite;
+
+	sbfix.init = sbfix_init;
+	sbfix.fini = sbfix_fini;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run(suite, init_null);
+	ptu_run_f(suite, add_null, sbfix);
+	ptu_run_f(suite, add_bad_nused, sbfix);
+	ptu_run_f(suite, lookup_null, sbfix);
+	ptu_run_f(suite, lookup_empty, sbfix);
+	ptu_run_f(suite, add_lookup, sbfix);
+	ptu_run_f(suite, lookup_miss, sbfix);
+	ptu_run_f(suite, generation, sbfix);
+	ptu_run_f(suite, other_image, sbfix);
+	ptu_run_f(suite, evict, sbfix);
+	ptu_run_f(suite, clear, sbfix);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}
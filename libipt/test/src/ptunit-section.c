@@ -30,6 +30,7 @@
 #include "ptunit_mktempname.h"
 
 #include "pt_section.h"
+#include "pt_section_registry.h"
 
 #include "intel-pt.h"
 
@@ -208,7 +209,7 @@ static struct ptunit_result get_overflow(struct section_fixture *sfix)
 	sfix->section = pt_mk_section(sfix->name, 0x1ull, 0x3ull);
 	ptu_ptr(sfix->section);
 
-	sfix->section->ucount = UINT16_MAX;
+	sfix->section->ucount = UINT32_MAX;
 
 	errcode = pt_section_get(sfix->section);
 	ptu_int_eq(errcode, -pte_internal);
@@ -602,6 +603,246 @@ out_put:
 	return errcode;
 }
 
+static struct ptunit_result fetch(struct section_fixture *sfix)
+{
+	uint8_t bytes[] = { 0xcc, 0x2, 0x4, 0x6 };
+	const uint8_t *begin;
+	int status;
+
+	sfix_write(sfix, bytes);
+
+	sfix->section = pt_mk_section(sfix->name, 0x1ull, 0x3ull);
+	ptu_ptr(sfix->section);
+
+	status = pt_section_map(sfix->section);
+	ptu_int_eq(status, 0);
+
+	status = pt_section_fetch(sfix->section, &begin, 4, 0x1ull);
+	if (status != -pte_not_supported) {
+		ptu_int_eq(status, 2);
+		ptu_uint_eq(begin[0], bytes[2]);
+		ptu_uint_eq(begin[1], bytes[3]);
+
+		status = pt_section_fetch(sfix->section, &begin, 1, 0x3ull);
+		ptu_int_eq(status, -pte_nomap);
+	}
+
+	status = pt_section_unmap(sfix->section);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result fetch_nomap(struct section_fixture *sfix)
+{
+	uint8_t bytes[] = { 0xcc, 0x2, 0x4, 0x6 };
+	const uint8_t *begin;
+	int status;
+
+	sfix_write(sfix, bytes);
+
+	sfix->section = pt_mk_section(sfix->name, 0x1ull, 0x3ull);
+	ptu_ptr(sfix->section);
+
+	status = pt_section_fetch(sfix->section, &begin, 1, 0x0ull);
+	ptu_int_eq(status, -pte_nomap);
+
+	status = pt_section_fetch(sfix->section, NULL, 1, 0x0ull);
+	ptu_int_eq(status, -pte_internal);
+
+	status = pt_section_fetch(NULL, &begin, 1, 0x0ull);
+	ptu_int_eq(status, -pte_internal);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result registry_get(struct section_fixture *sfix)
+{
+	uint8_t bytes[] = { 0xcc, 0x2, 0x4, 0x6 };
+	struct pt_section *section;
+	int errcode;
+
+	sfix_write(sfix, bytes);
+
+	sfix->section = pt_section_registry_get(sfix->name, 0x1ull, 0x3ull);
+	ptu_ptr(sfix->section);
+	ptu_uint_eq(sfix->section->ucount, 1);
+	ptu_uint_eq(sfix->section->registered, 1);
+
+	section = pt_section_registry_get(sfix->name, 0x1ull, 0x3ull);
+	ptu_ptr_eq(section, sfix->section);
+	ptu_uint_eq(sfix->section->ucount, 2);
+
+	errcode = pt_section_put(section);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(sfix->section->ucount, 1);
+
+	/* Requests are compared after truncation. */
+	section = pt_section_registry_get(sfix->name, 0x1ull, UINT64_MAX);
+	ptu_ptr_eq(section, sfix->section);
+
+	errcode = pt_section_put(section);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result registry_get_other(struct section_fixture *sfix)
+{
+	uint8_t bytes[] = { 0xcc, 0x2, 0x4, 0x6 };
+	struct pt_section *section;
+	int errcode;
+
+	sfix_write(sfix, bytes);
+
+	sfix->section = pt_section_registry_get(sfix->name, 0x1ull, 0x3ull);
+	ptu_ptr(sfix->section);
+
+	section = pt_section_registry_get(sfix->name, 0x0ull, 0x3ull);
+	ptu_ptr(section);
+	ptu_ptr_ne(section, sfix->section);
+
+	errcode = pt_section_put(section);
+	ptu_int_eq(errcode, 0);
+
+	section = pt_section_registry_get(sfix->name, 0x1ull, 0x2ull);
+	ptu_ptr(section);
+	ptu_ptr_ne(section, sfix->section);
+
+	errcode = pt_section_put(section);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result registry_get_changed(struct section_fixture *sfix)
+{
+	uint8_t bytes[] = { 0xcc, 0x2, 0x4, 0x6 };
+	struct pt_section *section;
+	int errcode;
+
+	sfix_write(sfix, bytes);
+
+	sfix->section = pt_section_registry_get(sfix->name, 0x1ull, 0x2ull);
+	ptu_ptr(sfix->section);
+
+	/* The file changed; we must not share the section. */
+	sfix_write(sfix, bytes);
+
+	section = pt_section_registry_get(sfix->name, 0x1ull, 0x2ull);
+	ptu_ptr(section);
+	ptu_ptr_ne(section, sfix->section);
+
+	errcode = pt_section_put(section);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result registry_put(struct section_fixture *sfix)
+{
+	uint8_t bytes[] = { 0xcc, 0x2, 0x4, 0x6 };
+	struct pt_section *section;
+	int errcode;
+
+	sfix_write(sfix, bytes);
+
+	section = pt_section_registry_get(sfix->name, 0x1ull, 0x3ull);
+	ptu_ptr(section);
+
+	errcode = pt_section_put(section);
+	ptu_int_eq(errcode, 0);
+
+	/* The section removed itself from the registry. */
+	sfix->section = pt_section_registry_get(sfix->name, 0x1ull, 0x3ull);
+	ptu_ptr(sfix->section);
+	ptu_uint_eq(sfix->section->ucount, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result registry_get_bad_file(void)
+{
+	struct pt_section *section;
+
+	section = pt_section_registry_get("", 0x0ull, 0x1ull);
+	ptu_null(section);
+
+	return ptu_passed();
+}
+
+static int registry_worker(void *arg)
+{
+	struct section_fixture *sfix;
+	struct pt_section *section;
+	int it, errcode;
+
+	sfix = arg;
+	if (!sfix)
+		return -pte_internal;
+
+	for (it = 0; it < num_work; ++it) {
+		uint8_t buffer[] = { 0xcc, 0xcc, 0xcc };
+		int read;
+
+		section = pt_section_registry_get(sfix->name, 0x1ull, 0x3ull);
+		if (!section)
+			return -pte_nomem;
+
+		errcode = pt_section_map(section);
+		if (errcode < 0)
+			goto out_put;
+
+		read = pt_section_read(section, buffer, 2, 0x0ull);
+		if (read < 0)
+			goto out_unmap;
+
+		errcode = -pte_invalid;
+		if ((read != 2) || (buffer[0] != 0x2) || (buffer[1] != 0x4))
+			goto out_unmap;
+
+		errcode = pt_section_unmap(section);
+		if (errcode < 0)
+			goto out_put;
+
+		errcode = pt_section_put(section);
+		if (errcode < 0)
+			return errcode;
+	}
+
+	return 0;
+
+out_unmap:
+	(void) pt_section_unmap(section);
+
+out_put:
+	(void) pt_section_put(section);
+	return errcode;
+}
+
+static struct ptunit_result registry_stress(struct section_fixture *sfix)
+{
+	uint8_t bytes[] = { 0xcc, 0x2, 0x4, 0x6 };
+	int errcode;
+
+	sfix_write(sfix, bytes);
+
+#if defined(FEATURE_THREADS)
+	{
+		int thrd;
+
+		for (thrd = 0; thrd < num_threads; ++thrd)
+			ptu_test(ptunit_thrd_create, &sfix->thrd,
+				 registry_worker, sfix);
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	errcode = registry_worker(sfix);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
 static struct ptunit_result stress(struct section_fixture *sfix)
 {
 	uint8_t bytes[] = { 0xcc, 0x2, 0x4, 0x6 };
@@ -708,8 +949,17 @@ int main(int argc, char **argv)
 	ptu_run_f(suite, read_overflow, sfix);
 	ptu_run_f(suite, read_nomap, sfix);
 	ptu_run_f(suite, read_unmap_map, sfix);
+	ptu_run_f(suite, fetch, sfix);
+	ptu_run_f(suite, fetch_nomap, sfix);
 	ptu_run_f(suite, stress, sfix);
 
+	ptu_run(suite, registry_get_bad_file);
+	ptu_run_f(suite, registry_get, sfix);
+	ptu_run_f(suite, registry_get_other, sfix);
+	ptu_run_f(suite, registry_get_changed, sfix);
+	ptu_run_f(suite, registry_put, sfix);
+	ptu_run_f(suite, registry_stress, sfix);
+
 	ptunit_report(&suite);
 	return suite.nr_fails;
 }
@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "ptunit.h"
+
+#include "pt_section.h"
+#include "pt_section_buffer.h"
+
+#include "intel-pt.h"
+
+
+/* A test fixture providing a memory buffer section. */
+struct section_buffer_fixture {
+	/* The section's memory. */
+	uint8_t buffer[8];
+
+	/* The section. */
+	struct pt_section *section;
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct section_buffer_fixture *);
+	struct ptunit_result (*fini)(struct section_buffer_fixture *);
+};
+
+static struct ptunit_result create_null(void)
+{
+	uint8_t buffer[] = { 0xcc };
+	struct pt_section *section;
+
+	section = pt_mk_section_buffer(NULL, 1ull, 0);
+	ptu_null(section);
+
+	section = pt_mk_section_buffer(buffer, 0ull, 0);
+	ptu_null(section);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result create(struct section_buffer_fixture *bfix)
+{
+	const char *name;
+	uint64_t size;
+
+	name = pt_section_filename(bfix->section);
+	ptu_null(name);
+
+	size = pt_section_size(bfix->section);
+	ptu_uint_eq(size, sizeof(bfix->buffer));
+
+	return ptu_passed();
+}
+
+static struct ptunit_result map_null(void)
+{
+	int status;
+
+	status = pt_sec_buffer_map(NULL);
+	ptu_int_eq(status, -pte_internal);
+
+	status = pt_sec_buffer_unmap(NULL);
+	ptu_int_eq(status, -pte_internal);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result map_unmap(struct section_buffer_fixture *bfix)
+{
+	int status;
+
+	status = pt_section_map(bfix->section);
+	ptu_int_eq(status, 0);
+
+	status = pt_section_map(bfix->section);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(bfix->section->mcount, 2);
+
+	status = pt_section_unmap(bfix->section);
+	ptu_int_eq(status, 0);
+	ptu_ptr(bfix->section->mapping);
+
+	status = pt_section_unmap(bfix->section);
+	ptu_int_eq(status, 0);
+	ptu_null(bfix->section->mapping);
+
+	status = pt_section_unmap(bfix->section);
+	ptu_int_eq(status, -pte_nomap);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_nomap(struct section_buffer_fixture *bfix)
+{
+	uint8_t buffer[] = { 0xcc };
+	int status;
+
+	status = pt_section_read(bfix->section, buffer, 1, 0ull);
+	ptu_int_eq(status, -pte_nomap);
+	ptu_uint_eq(buffer[0], 0xcc);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read(struct section_buffer_fixture *bfix)
+{
+	uint8_t buffer[] = { 0xcc, 0xcc, 0xcc, 0xcc };
+	int status;
+
+	status = pt_section_map(bfix->section);
+	ptu_int_eq(status, 0);
+
+	status = pt_section_read(bfix->section, buffer, 3, 0x2ull);
+	ptu_int_eq(status, 3);
+	ptu_uint_eq(buffer[0], bfix->buffer[2]);
+	ptu_uint_eq(buffer[1], bfix->buffer[3]);
+	ptu_uint_eq(buffer[2], bfix->buffer[4]);
+	ptu_uint_eq(buffer[3], 0xcc);
+
+	status = pt_section_unmap(bfix->section);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_truncated(struct section_buffer_fixture *bfix)
+{
+	uint8_t buffer[] = { 0xcc, 0xcc, 0xcc, 0xcc };
+	int status;
+
+	status = pt_section_map(bfix->section);
+	ptu_int_eq(status, 0);
+
+	status = pt_section_read(bfix->section, buffer, sizeof(buffer), 0x6ull);
+	ptu_int_eq(status, 2);
+	ptu_uint_eq(buffer[0], bfix->buffer[6]);
+	ptu_uint_eq(buffer[1], bfix->buffer[7]);
+	ptu_uint_eq(buffer[2], 0xcc);
+
+	status = pt_section_unmap(bfix->section);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_nomem(struct section_buffer_fixture *bfix)
+{
+	uint8_t buffer[] = { 0xcc };
+	int status;
+
+	status = pt_section_map(bfix->section);
+	ptu_int_eq(status, 0);
+
+	status = pt_section_read(bfix->section, buffer, 1,
+				 sizeof(bfix->buffer));
+	ptu_int_eq(status, -pte_nomap);
+
+	status = pt_section_read(bfix->section, buffer, 1, UINT64_MAX);
+	ptu_int_eq(status, -pte_nomap);
+	ptu_uint_eq(buffer[0], 0xcc);
+
+	status = pt_section_unmap(bfix->section);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result fetch(struct section_buffer_fixture *bfix)
+{
+	const uint8_t *begin;
+	int status;
+
+	status = pt_section_map(bfix->section);
+	ptu_int_eq(status, 0);
+
+	status = pt_section_fetch(bfix->section, &begin, 0x10, 0x3ull);
+	ptu_int_eq(status, 5);
+	ptu_ptr_eq(begin, &bfix->buffer[3]);
+
+	status = pt_section_unmap(bfix->section);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result copy(struct section_buffer_fixture *bfix)
+{
+	struct pt_section *section;
+	const uint8_t *begin;
+	uint8_t buffer[] = { 0xcc };
+	int status;
+
+	section = pt_mk_section_buffer(bfix->buffer, sizeof(bfix->buffer), 1);
+	ptu_ptr(section);
+
+	/* Changes to the original buffer do not affect the copy. */
+	bfix->buffer[1] = 0xf1;
+
+	status = pt_section_map(section);
+	ptu_int_eq(status, 0);
+
+	status = pt_section_read(section, buffer, 1, 0x1ull);
+	ptu_int_eq(status, 1);
+	ptu_uint_eq(buffer[0], 0x01);
+
+	status = pt_section_fetch(section, &begin, 1, 0x1ull);
+	ptu_int_eq(status, 1);
+	ptu_ptr_ne(begin, &bfix->buffer[1]);
+
+	status = pt_section_unmap(section);
+	ptu_int_eq(status, 0);
+
+	status = pt_section_put(section);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result nocopy(struct section_buffer_fixture *bfix)
+{
+	uint8_t buffer[] = { 0xcc };
+	int status;
+
+	/* Changes to the original buffer are visible in the section. */
+	bfix->buffer[1] = 0xf1;
+
+	status = pt_section_map(bfix->section);
+	ptu_int_eq(status, 0);
+
+	status = pt_section_read(bfix->section, buffer, 1, 0x1ull);
+	ptu_int_eq(status, 1);
+	ptu_uint_eq(buffer[0], 0xf1);
+
+	status = pt_section_unmap(bfix->section);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result bfix_init(struct section_buffer_fixture *bfix)
+{
+	uint8_t idx;
+
+	for (idx = 0; idx < sizeof(bfix->buffer); ++idx)
+		bfix->buffer[idx] = idx;
+
+	bfix->section = pt_mk_section_buffer(bfix->buffer,
+					     sizeof(bfix->buffer), 0);
+	ptu_ptr(bfix->section);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result bfix_fini(struct section_buffer_fixture *bfix)
+{
+	int status;
+
+	ptu_uint_eq(bfix->section->mcount, 0);
+
+	status = pt_section_put(bfix->section);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct section_buffer_fixture bfix;
+	struct ptunit_suite suite;
+
+	bfix.init = bfix_init;
+	bfix.fini = bfix_fini;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run(suite, create_null);
+	ptu_run(suite, map_null);
+
+	ptu_run_f(suite, create, bfix);
+	ptu_run_f(suite, map_unmap, bfix);
+	ptu_run_f(suite, read_nomap, bfix);
+	ptu_run_f(suite, read, bfix);
+	ptu_run_f(suite, read_truncated, bfix);
+	ptu_run_f(suite, read_nomem, bfix);
+	ptu_run_f(suite, fetch, bfix);
+	ptu_run_f(suite, copy, bfix);
+	ptu_run_f(suite, nocopy, bfix);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}
@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ptunit.h"
+
+#include "pt_section_cache.h"
+#include "pt_section.h"
+
+#include "intel-pt.h"
+
+#include <string.h>
+
+
+uint64_t pt_section_size(const struct pt_section *section)
+{
+	if (!section)
+		return 0ull;
+
+	return section->size;
+}
+
+int pt_section_get(struct pt_section *section)
+{
+	if (!section)
+		return -pte_internal;
+
+	section->ucount += 1;
+	return 0;
+}
+
+int pt_section_put(struct pt_section *section)
+{
+	if (!section)
+		return -pte_internal;
+
+	if (!section->ucount)
+		return -pte_internal;
+
+	section->ucount -= 1;
+	return 0;
+}
+
+int pt_section_map(struct pt_section *section)
+{
+	if (!section)
+		return -pte_internal;
+
+	section->mcount += 1;
+	return 0;
+}
+
+int pt_section_unmap(struct pt_section *section)
+{
+	if (!section)
+		return -pte_internal;
+
+	if (!section->mcount)
+		return -pte_internal;
+
+	section->mcount -= 1;
+	return 0;
+}
+
+/* The filename of our test sections. */
+static char cfix_filename[] = "file";
+
+/* A test fixture providing test sections. */
+struct section_cache_fixture {
+	/* The test sections. */
+	struct pt_section section[3];
+
+	/* The section cache statistics at the beginning of the test. */
+	struct pt_section_cache_stats stats;
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct section_cache_fixture *);
+	struct ptunit_result (*fini)(struct section_cache_fixture *);
+};
+
+/* Map and unmap @section using the section cache. */
+static struct ptunit_result cfix_use(struct pt_section *section)
+{
+	int status;
+
+	status = pt_section_cache_map(section);
+	ptu_int_eq(status, 0);
+
+	status = pt_section_unmap(section);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result map_null(void)
+{
+	int status;
+
+	status = pt_section_cache_map(NULL);
+	ptu_int_eq(status, -pte_internal);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result stats_null(void)
+{
+	int status;
+
+	status = pt_section_cache_get_stats(NULL);
+	ptu_int_eq(status, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result map(struct section_cache_fixture *cfix)
+{
+	struct pt_section_cache_stats stats;
+	int status;
+
+	status = pt_section_cache_map(&cfix->section[0]);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(cfix->section[0].mcount, 2);
+	ptu_uint_eq(cfix->section[0].ucount, 2);
+	ptu_uint_eq(cfix->section[0].cached, 1);
+
+	status = pt_section_unmap(&cfix->section[0]);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(cfix->section[0].mcount, 1);
+
+	status = pt_section_cache_get_stats(&stats);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(stats.limit, 0x20ull);
+	ptu_uint_eq(stats.size, 0x10ull);
+	ptu_uint_eq(stats.nsections, 1);
+	ptu_uint_eq(stats.misses, cfix->stats.misses + 1);
+	ptu_uint_eq(stats.hits, cfix->stats.hits);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result map_buffer(struct section_cache_fixture *cfix)
+{
+	struct pt_section_cache_stats stats;
+	int status;
+
+	/* Memory buffer sections have no filename and bypass the cache. */
+	cfix->section[0].filename = NULL;
+
+	status = pt_section_cache_map(&cfix->section[0]);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(cfix->section[0].mcount, 1);
+	ptu_uint_eq(cfix->section[0].ucount, 1);
+	ptu_uint_eq(cfix->section[0].cached, 0);
+
+	status = pt_section_unmap(&cfix->section[0]);
+	ptu_int_eq(status, 0);
+
+	status = pt_section_cache_get_stats(&stats);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(stats.nsections, 0);
+	ptu_uint_eq(stats.misses, cfix->stats.misses);
+	ptu_uint_eq(stats.hits, cfix->stats.hits);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result map_hit(struct section_cache_fixture *cfix)
+{
+	struct pt_section_cache_stats stats;
+	int status;
+
+	ptu_test(cfix_use, &cfix->section[0]);
+	ptu_test(cfix_use, &cfix->section[0]);
+
+	status = pt_section_cache_get_stats(&stats);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(stats.nsections, 1);
+	ptu_uint_eq(stats.misses, cfix->stats.misses + 1);
+	ptu_uint_eq(stats.hits, cfix->stats.hits + 1);
+	ptu_uint_eq(cfix->section[0].mcount, 1);
+	ptu_uint_eq(cfix->section[0].ucount, 2);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result map_lru(struct section_cache_fixture *cfix)
+{
+	struct pt_section_cache_stats stats;
+	int status;
+
+	ptu_test(cfix_use, &cfix->section[0]);
+	ptu_test(cfix_use, &cfix->section[1]);
+	ptu_test(cfix_use, &cfix->section[0]);
+	ptu_test(cfix_use, &cfix->section[2]);
+
+	ptu_uint_eq(cfix->section[0].mcount, 1);
+	ptu_uint_eq(cfix->section[1].mcount, 0);
+	ptu_uint_eq(cfix->section[1].ucount, 1);
+	ptu_uint_eq(cfix->section[1].cached, 0);
+	ptu_uint_eq(cfix->section[2].mcount, 1);
+
+	status = pt_section_cache_get_stats(&stats);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(stats.size, 0x20ull);
+	ptu_uint_eq(stats.nsections, 2);
+	ptu_uint_eq(stats.evictions, cfix->stats.evictions + 1);
+
+	/* Section 0 is now the least recently used one. */
+	ptu_test(cfix_use, &cfix->section[1]);
+
+	ptu_uint_eq(cfix->section[0].mcount, 0);
+	ptu_uint_eq(cfix->section[1].mcount, 1);
+	ptu_uint_eq(cfix->section[2].mcount, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result map_too_big(struct section_cache_fixture *cfix)
+{
+	struct pt_section_cache_stats stats;
+	int status;
+
+	cfix->section[0].size = 0x21ull;
+
+	status = pt_section_cache_map(&cfix->section[0]);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(cfix->section[0].mcount, 1);
+	ptu_uint_eq(cfix->section[0].ucount, 1);
+	ptu_uint_eq(cfix->section[0].cached, 0);
+
+	status = pt_section_unmap(&cfix->section[0]);
+	ptu_int_eq(status, 0);
+
+	status = pt_section_cache_get_stats(&stats);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(stats.size, 0ull);
+	ptu_uint_eq(stats.nsections, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result set_limit(struct section_cache_fixture *cfix)
+{
+	struct pt_section_cache_stats stats;
+	int status;
+
+	ptu_test(cfix_use, &cfix->section[0]);
+	ptu_test(cfix_use, &cfix->section[1]);
+
+	status = pt_section_cache_set_limit(0x10ull);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(cfix->section[0].mcount, 0);
+	ptu_uint_eq(cfix->section[1].mcount, 1);
+
+	status = pt_section_cache_set_limit(0ull);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(cfix->section[1].mcount, 0);
+	ptu_uint_eq(cfix->section[1].ucount, 1);
+
+	status = pt_section_cache_get_stats(&stats);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(stats.limit, 0ull);
+	ptu_uint_eq(stats.size, 0ull);
+	ptu_uint_eq(stats.nsections, 0);
+
+	/* Nothing gets cached anymore. */
+	status = pt_section_cache_map(&cfix->section[2]);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(cfix->section[2].mcount, 1);
+	ptu_uint_eq(cfix->section[2].cached, 0);
+
+	status = pt_section_unmap(&cfix->section[2]);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result cfix_init(struct section_cache_fixture *cfix)
+{
+	int idx, status;
+
+	memset(cfix->section, 0, sizeof(cfix->section));
+
+	for (idx = 0; idx < 3; ++idx) {
+		cfix->section[idx].filename = cfix_filename;
+		cfix->section[idx].size = 0x10ull;
+		cfix->section[idx].ucount = 1;
+	}
+
+	status = pt_section_cache_set_limit(0x20ull);
+	ptu_int_eq(status, 0);
+
+	status = pt_section_cache_get_stats(&cfix->stats);
+	ptu_int_eq(status, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result cfix_fini(struct section_cache_fixture *cfix)
+{
+	int idx, status;
+
+	status = pt_section_cache_set_limit(0ull);
+	ptu_int_eq(status, 0);
+
+	for (idx = 0; idx < 3; ++idx) {
+		ptu_uint_eq(cfix->section[idx].ucount, 1);
+		ptu_uint_eq(cfix->section[idx].mcount, 0);
+		ptu_uint_eq(cfix->section[idx].cached, 0);
+	}
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct section_cache_fixture cfix;
+	struct ptunit_suite suite;
+
+	cfix.init = cfix_init;
+	cfix.fini = cfix_fini;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run(suite, map_null);
+	ptu_run(suite, stats_null);
+
+	ptu_run_f(suite, map, cfix);
+	ptu_run_f(suite, map_buffer, cfix);
+	ptu_run_f(suite, map_hit, cfix);
+	ptu_run_f(suite, map_lru, cfix);
+	ptu_run_f(suite, map_too_big, cfix);
+	ptu_run_f(suite, set_limit, cfix);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}
@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ptunit_threads.h"
+#include "ptunit_mktempname.h"
+
+#include "pt_section.h"
+#include "pt_section_pread.h"
+
+#include "intel-pt.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+enum {
+#if defined(FEATURE_THREADS)
+
+	num_threads	= 4,
+
+#endif /* defined(FEATURE_THREADS) */
+
+	num_work	= 0x1000,
+
+	/* The size of our test file - a bit more than three pages. */
+	file_size	= 3 * pt_sec_pread_page_size + 0x10,
+
+	/* The offset of our test section in the test file. */
+	sec_offset	= 0x10
+};
+
+/* A test fixture providing a temporary file and a pread-mapped section. */
+struct section_fixture {
+	/* Threading support. */
+	struct ptunit_thrd_fixture thrd;
+
+	/* A temporary file name. */
+	char *name;
+
+	/* The section. */
+	struct pt_section *section;
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct section_fixture *);
+	struct ptunit_result (*fini)(struct section_fixture *);
+};
+
+/* The content of our test file at @offset. */
+static uint8_t sfix_byte(uint64_t offset)
+{
+	return (uint8_t) ((offset * 7) ^ (offset >> 8));
+}
+
+/* Check that @buffer contains @size bytes of our test section at @offset.
+ *
+ * Returns zero if it does, -pte_invalid otherwise.
+ */
+static int sfix_check(const uint8_t *buffer, uint64_t size, uint64_t offset)
+{
+	uint64_t idx;
+
+	for (idx = 0; idx < size; ++idx) {
+		if (buffer[idx] != sfix_byte(sec_offset + offset + idx))
+			return -pte_invalid;
+	}
+
+	return 0;
+}
+
+static struct ptunit_result read_one(struct section_fixture *sfix)
+{
+	uint8_t buffer[] = { 0xcc, 0xcc, 0xcc, 0xcc };
+	int status;
+
+	status = pt_section_read(sfix->section, buffer, 3, 0x1ull);
+	ptu_int_eq(status, 3);
+	ptu_int_eq(sfix_check(buffer, 3, 0x1ull), 0);
+	ptu_uint_eq(buffer[3], 0xcc);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_cross_page(struct section_fixture *sfix)
+{
+	uint8_t buffer[0x10];
+	uint64_t offset;
+	int status;
+
+	offset = pt_sec_pread_page_size - sec_offset - 0x8;
+
+	status = pt_section_read(sfix->section, buffer, sizeof(buffer),
+				 offset);
+	ptu_int_eq(status, sizeof(buffer));
+	ptu_int_eq(sfix_check(buffer, sizeof(buffer), offset), 0);
+
+	/* Read it again from the cache. */
+	status = pt_section_read(sfix->section, buffer, sizeof(buffer),
+				 offset);
+	ptu_int_eq(status, sizeof(buffer));
+	ptu_int_eq(sfix_check(buffer, sizeof(buffer), offset), 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_truncated(struct section_fixture *sfix)
+{
+	uint8_t buffer[] = { 0xcc, 0xcc, 0xcc, 0xcc };
+	uint64_t offset;
+	int status;
+
+	offset = sfix->section->size - 2;
+
+	status = pt_section_read(sfix->section, buffer, sizeof(buffer),
+				 offset);
+	ptu_int_eq(status, 2);
+	ptu_int_eq(sfix_check(buffer, 2, offset), 0);
+	ptu_uint_eq(buffer[2], 0xcc);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_nomem(struct section_fixture *sfix)
+{
+	uint8_t buffer[] = { 0xcc };
+	int status;
+
+	status = pt_section_read(sfix->section, buffer, 1,
+				 sfix->section->size);
+	ptu_int_eq(status, -pte_nomap);
+	ptu_uint_eq(buffer[0], 0xcc);
+
+	status = pt_section_read(sfix->section, buffer, 1, UINT64_MAX);
+	ptu_int_eq(status, -pte_nomap);
+	ptu_uint_eq(buffer[0], 0xcc);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_null(struct section_fixture *sfix)
+{
+	uint8_t buffer[] = { 0xcc };
+	int status;
+
+	status = pt_sec_pread_read(sfix->section, NULL, 1, 0ull);
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_sec_pread_read(NULL, buffer, 1, 0ull);
+	ptu_int_eq(status, -pte_invalid);
+	ptu_uint_eq(buffer[0], 0xcc);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result read_all(struct section_fixture *sfix)
+{
+	uint8_t buffer[0xf];
+	uint64_t offset;
+
+	for (offset = 0; offset < sfix->section->size; offset += 0xb) {
+		int status;
+
+		status = pt_section_read(sfix->section, buffer, sizeof(buffer),
+					 offset);
+		ptu_int_gt(status, 0);
+		ptu_int_eq(sfix_check(buffer, (uint64_t) status, offset), 0);
+	}
+
+	return ptu_passed();
+}
+
+static struct ptunit_result map_bad_size(void)
+{
+	struct pt_section section;
+	int fd, errcode;
+
+	memset(&section, 0, sizeof(section));
+	section.offset = 0x1000ull;
+	section.size = 0x1000ull;
+
+	fd = open("/dev/null", O_RDONLY);
+	ptu_int_ne(fd, -1);
+
+	errcode = pt_sec_pread_map(&section, fd);
+	ptu_int_eq(errcode, -pte_bad_image);
+	ptu_null(section.mapping);
+
+	close(fd);
+
+	return ptu_passed();
+}
+
+static int worker(void *arg)
+{
+	struct section_fixture *sfix;
+	uint64_t offset;
+	int it;
+
+	sfix = arg;
+	if (!sfix)
+		return -pte_internal;
+
+	offset = 0;
+	for (it = 0; it < num_work; ++it) {
+		uint8_t buffer[0xf];
+		int status;
+
+		offset = (offset + 0x3f5) % sfix->section->size;
+
+		status = pt_section_read(sfix->section, buffer, sizeof(buffer),
+					 offset);
+		if (status <= 0)
+			return status ? status : -pte_nomap;
+
+		status = sfix_check(buffer, (uint64_t) status, offset);
+		if (status < 0)
+			return status;
+	}
+
+	return 0;
+}
+
+static struct ptunit_result stress(struct section_fixture *sfix)
+{
+	int errcode;
+
+#if defined(FEATURE_THREADS)
+	{
+		int thrd;
+
+		for (thrd = 0; thrd < num_threads; ++thrd)
+			ptu_test(ptunit_thrd_create, &sfix->thrd, worker, sfix);
+	}
+#endif /* defined(FEATURE_THREADS) */
+
+	errcode = worker(sfix);
+	ptu_int_eq(errcode, 0);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result sfix_init(struct section_fixture *sfix)
+{
+	uint8_t content[file_size];
+	uint64_t offset;
+	size_t written;
+	FILE *file;
+	int fd, errcode;
+
+	sfix->section = NULL;
+
+	sfix->name = mktempname();
+	ptu_ptr(sfix->name);
+
+	for (offset = 0; offset < sizeof(content); ++offset)
+		content[offset] = sfix_byte(offset);
+
+	file = fopen(sfix->name, "wb");
+	ptu_ptr(file);
+
+	written = fwrite(content, 1, sizeof(content), file);
+	fclose(file);
+	ptu_uint_eq(written, sizeof(content));
+
+	sfix->section = pt_mk_section(sfix->name, sec_offset, UINT64_MAX);
+	ptu_ptr(sfix->section);
+
+	fd = open(sfix->name, O_RDONLY);
+	ptu_int_ne(fd, -1);
+
+	/* We bypass pt_section_map() to use the pread backend even though
+	 * mmap would work.
+	 */
+	errcode = pt_sec_pread_map(sfix->section, fd);
+	ptu_int_eq(errcode, 0);
+
+	sfix->section->mcount = 1;
+
+	ptu_test(ptunit_thrd_init, &sfix->thrd);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result sfix_fini(struct section_fixture *sfix)
+{
+	int thrd, errcode;
+
+	ptu_test(ptunit_thrd_fini, &sfix->thrd);
+
+	for (thrd = 0; thrd < sfix->thrd.nthreads; ++thrd)
+		ptu_int_eq(sfix->thrd.result[thrd], 0);
+
+	if (sfix->section) {
+		errcode = pt_section_unmap(sfix->section);
+		ptu_int_eq(errcode, 0);
+
+		errcode = pt_section_put(sfix->section);
+		ptu_int_eq(errcode, 0);
+
+		sfix->section = NULL;
+	}
+
+	if (sfix->name) {
+		remove(sfix->name);
+		free(sfix->name);
+		sfix->name = NULL;
+	}
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct section_fixture sfix;
+	struct ptunit_suite suite;
+
+	sfix.init = sfix_init;
+	sfix.fini = sfix_fini;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run(suite, map_bad_size);
+
+	ptu_run_f(suite, read_one, sfix);
+	ptu_run_f(suite, read_cross_page, sfix);
+	ptu_run_f(suite, read_truncated, sfix);
+	ptu_run_f(suite, read_nomem, sfix);
+	ptu_run_f(suite, read_null, sfix);
+	ptu_run_f(suite, read_all, sfix);
+	ptu_run_f(suite, stress, sfix);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}
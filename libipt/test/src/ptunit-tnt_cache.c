@@ -158,6 +158,143 @@ static struct ptunit_result query_null(void)
 	return ptu_passed();
 }
 
+static struct ptunit_result peek(void)
+{
+	struct pt_tnt_cache tnt_cache;
+	uint64_t tnt;
+	int status;
+
+	tnt_cache.tnt = 0xf5ull;
+	tnt_cache.index = 1ull << 3;
+
+	status = pt_tnt_cache_peek(&tnt_cache, &tnt);
+	ptu_int_eq(status, 4);
+	ptu_uint_eq(tnt, 0x5ull);
+	ptu_uint_eq(tnt_cache.index, 1ull << 3);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result peek_full(void)
+{
+	struct pt_tnt_cache tnt_cache;
+	uint64_t tnt;
+	int status;
+
+	tnt_cache.tnt = ~0ull;
+	tnt_cache.index = 1ull << 63;
+
+	status = pt_tnt_cache_peek(&tnt_cache, &tnt);
+	ptu_int_eq(status, 64);
+	ptu_uint_eq(tnt, ~0ull);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result peek_empty(void)
+{
+	struct pt_tnt_cache tnt_cache;
+	uint64_t tnt;
+	int status;
+
+	tnt_cache.tnt = 0xffull;
+	tnt_cache.index = 0ull;
+
+	status = pt_tnt_cache_peek(&tnt_cache, &tnt);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(tnt, 0ull);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result peek_null(void)
+{
+	struct pt_tnt_cache tnt_cache;
+	uint64_t tnt;
+	int status;
+
+	status = pt_tnt_cache_peek(NULL, &tnt);
+	ptu_int_eq(status, -pte_invalid);
+
+	status = pt_tnt_cache_peek(&tnt_cache, NULL);
+	ptu_int_eq(status, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result skip(void)
+{
+	struct pt_tnt_cache tnt_cache;
+	int status;
+
+	tnt_cache.tnt = 0x5ull;
+	tnt_cache.index = 1ull << 3;
+
+	status = pt_tnt_cache_skip(&tnt_cache, 3);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(tnt_cache.index, 1ull);
+
+	status = pt_tnt_cache_query(&tnt_cache);
+	ptu_int_eq(status, 1);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result skip_all(void)
+{
+	struct pt_tnt_cache tnt_cache;
+	int status;
+
+	tnt_cache.tnt = 0ull;
+	tnt_cache.index = 1ull << 63;
+
+	status = pt_tnt_cache_skip(&tnt_cache, 64);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(tnt_cache.index, 0ull);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result skip_none(void)
+{
+	struct pt_tnt_cache tnt_cache;
+	int status;
+
+	tnt_cache.tnt = 0ull;
+	tnt_cache.index = 0ull;
+
+	status = pt_tnt_cache_skip(&tnt_cache, 0);
+	ptu_int_eq(status, 0);
+	ptu_uint_eq(tnt_cache.index, 0ull);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result skip_too_many(void)
+{
+	struct pt_tnt_cache tnt_cache;
+	int status;
+
+	tnt_cache.tnt = 0ull;
+	tnt_cache.index = 1ull << 2;
+
+	status = pt_tnt_cache_skip(&tnt_cache, 4);
+	ptu_int_eq(status, -pte_bad_query);
+	ptu_uint_eq(tnt_cache.index, 1ull << 2);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result skip_null(void)
+{
+	int status;
+
+	status = pt_tnt_cache_skip(NULL, 1);
+	ptu_int_eq(status, -pte_invalid);
+
+	return ptu_passed();
+}
+
 static struct ptunit_result update_tnt(void)
 {
 	struct pt_tnt_cache tnt_cache;
@@ -237,6 +374,15 @@ int main(int argc, char **argv)
 	ptu_run(suite, query_not_taken);
 	ptu_run(suite, query_empty);
 	ptu_run(suite, query_null);
+	ptu_run(suite, peek);
+	ptu_run(suite, peek_full);
+	ptu_run(suite, peek_empty);
+	ptu_run(suite, peek_null);
+	ptu_run(suite, skip);
+	ptu_run(suite, skip_all);
+	ptu_run(suite, skip_none);
+	ptu_run(suite, skip_too_many);
+	ptu_run(suite, skip_null);
 	ptu_run(suite, update_tnt);
 	ptu_run(suite, update_tnt_not_empty);
 	ptu_run(suite, update_tnt_null_tnt);
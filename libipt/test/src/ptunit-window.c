@@ -0,0 +1,680 @@
+/*
+ * Copyright (c) 2013-2015, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ptunit.h"
+
+#include "pt_window.h"
+#include "pt_encoder.h"
+
+#include "intel-pt.h"
+
+#include <string.h>
+
+
+enum {
+	/* The maximal number of packets we expect in the test trace. */
+	wfix_max_packets = 128,
+
+	/* The number of PSBs in the test trace. */
+	wfix_npsb = 4
+};
+
+/* A test fixture providing a trace that we split into segments. */
+struct window_fixture {
+	/* The trace buffer. */
+	uint8_t buffer[1024];
+
+	/* The contiguous trace configuration. */
+	struct pt_config config;
+
+	/* The segments into which we split the trace. */
+	struct pt_segment segment[4];
+
+	/* The segmented trace configuration. */
+	struct pt_config sconfig;
+
+	/* The packets in the contiguous trace and their offsets. */
+	struct pt_packet packet[wfix_max_packets];
+	uint64_t offset[wfix_max_packets];
+	int npackets;
+
+	/* The offsets of the PSBs in the trace. */
+	uint64_t psb[wfix_npsb];
+
+	/* The maximal number of bytes wfix_read() provides per call. */
+	size_t chunk;
+
+	/* The offset at which wfix_read() fails. */
+	uint64_t fail;
+
+	/* The maximal number of bytes requested from wfix_read(). */
+	size_t max_read;
+
+	/* The test fixture initialization and finalization functions. */
+	struct ptunit_result (*init)(struct window_fixture *);
+	struct ptunit_result (*fini)(struct window_fixture *);
+};
+
+static struct ptunit_result wfix_init(struct window_fixture *wfix)
+{
+	struct pt_packet_decoder *decoder;
+	struct pt_encoder encoder;
+	int errcode, idx;
+
+	memset(wfix->buffer, 0, sizeof(wfix->buffer));
+
+	pt_config_init(&wfix->config);
+	wfix->config.begin = wfix->buffer;
+	wfix->config.end = wfix->buffer + sizeof(wfix->buffer);
+
+	errcode = pt_encoder_init(&encoder, &wfix->config);
+	ptu_int_eq(errcode, 0);
+
+	/* Some garbage that is skipped. */
+	pt_encode_tnt_8(&encoder, 0x2, 2);
+	pt_encode_pad(&encoder);
+
+	for (idx = 0; idx < wfix_npsb; ++idx) {
+		errcode = pt_enc_get_offset(&encoder, &wfix->psb[idx]);
+		ptu_int_eq(errcode, 0);
+
+		pt_encode_psb(&encoder);
+		pt_encode_tsc(&encoder, 0x1000ull * (idx + 1));
+		pt_encode_cbr(&encoder, 0x2);
+		pt_encode_mode_exec(&encoder, ptem_64bit);
+		pt_encode_pip(&encoder, 0xa000ull, 0);
+		pt_encode_fup(&encoder, 0x1000ull, pt_ipc_sext_48);
+		pt_encode_psbend(&encoder);
+		pt_encode_tnt_8(&encoder, 0x2, 2);
+		pt_encode_tnt_64(&encoder, 0xa5a5ull, 16);
+		pt_encode_tip(&encoder, 0x2000ull, pt_ipc_update_16);
+		pt_encode_mtc(&encoder, 0x4);
+		pt_encode_tip(&encoder, 0x3000ull, pt_ipc_sext_48);
+		pt_encode_pad(&encoder);
+	}
+
+	wfix->config.end = encoder.pos;
+	pt_encoder_fini(&encoder);
+
+	wfix->sconfig = wfix->config;
+	wfix->sconfig.begin = NULL;
+	wfix->sconfig.end = NULL;
+	wfix->sconfig.segments = wfix->segment;
+	wfix->sconfig.nsegments = 0;
+
+	/* Decode the contiguous trace for reference. */
+	decoder = pt_pkt_alloc_decoder(&wfix->config);
+	ptu_ptr(decoder);
+
+	errcode = pt_pkt_sync_forward(decoder);
+	ptu_int_eq(errcode, 0);
+
+	for (idx = 0; idx < wfix_max_packets; ++idx) {
+		struct pt_packet *packet;
+
+		errcode = pt_pkt_get_offset(decoder, &wfix->offset[idx]);
+		ptu_int_eq(errcode, 0);
+
+		packet = &wfix->packet[idx];
+		memset(packet, 0, sizeof(*packet));
+
+		errcode = pt_pkt_next(decoder, packet, sizeof(*packet));
+		if (errcode < 0)
+			break;
+	}
+	pt_pkt_free_decoder(decoder);
+
+	ptu_int_eq(errcode, -pte_eos);
+	wfix->npackets = idx;
+
+	wfix->chunk = 0;
+	wfix->fail = UINT64_MAX;
+	wfix->max_read = 0;
+
+	return ptu_passed();
+}
+
+/* Read the test trace on demand. */
+static int wfix_read(uint8_t *buffer, size_t size, uint64_t offset,
+		     void *context)
+{
+	struct window_fixture *wfix;
+	uint64_t tsize;
+
+	wfix = (struct window_fixture *) context;
+	if (!wfix)
+		return -pte_internal;
+
+	if (wfix->max_read < size)
+		wfix->max_read = size;
+
+	if (wfix->fail <= offset)
+		return -pte_nomap;
+
+	tsize = (uint64_t) (wfix->config.end - wfix->config.begin);
+	if (tsize <= offset)
+		return 0;
+
+	if (tsize - offset < size)
+		size = (size_t) (tsize - offset);
+
+	if (wfix->chunk && (wfix->chunk < size))
+		size = wfix->chunk;
+
+	memcpy(buffer, wfix->config.begin + offset, size);
+
+	return (int) size;
+}
+
+/* Read the test trace on demand in windows of @window bytes. */
+static struct ptunit_result wfix_source(struct window_fixture *wfix,
+					uint32_t window)
+{
+	wfix->sconfig.segments = NULL;
+	wfix->sconfig.nsegments = 0;
+	wfix->sconfig.source.read = wfix_read;
+	wfix->sconfig.source.context = wfix;
+	wfix->sconfig.source.size =
+		(uint64_t) (wfix->config.end - wfix->config.begin);
+	wfix->sconfig.source.window = window;
+
+	return ptu_passed();
+}
+
+/* Split the test trace into @nsegments segments at the @split offsets. */
+static struct ptunit_result wfix_split(struct window_fixture *wfix,
+				       const uint64_t *split,
+				       uint32_t nsegments)
+{
+	uint8_t *begin, *end;
+	uint32_t idx;
+
+	ptu_uint_le(nsegments, sizeof(wfix->segment) / sizeof(*wfix->segment));
+
+	begin = wfix->config.begin;
+	end = wfix->config.end;
+
+	for (idx = 0; idx < nsegments; ++idx) {
+		wfix->segment[idx].begin = begin;
+
+		if ((idx + 1) < nsegments) {
+			ptu_ptr_le(begin, wfix->config.begin + split[idx]);
+			ptu_ptr_le(wfix->config.begin + split[idx], end);
+
+			begin = wfix->config.begin + split[idx];
+		} else
+			begin = end;
+
+		wfix->segment[idx].end = begin;
+	}
+
+	wfix->sconfig.nsegments = nsegments;
+
+	return ptu_passed();
+}
+
+/* Check that the segmented trace gives the same packets. */
+static struct ptunit_result check_packets(struct window_fixture *wfix)
+{
+	struct pt_packet_decoder *decoder;
+	int errcode, idx;
+
+	decoder = pt_pkt_alloc_decoder(&wfix->sconfig);
+	ptu_ptr(decoder);
+
+	errcode = pt_pkt_sync_forward(decoder);
+	ptu_int_eq(errcode, 0);
+
+	for (idx = 0; idx < wfix->npackets; ++idx) {
+		struct pt_packet packet;
+		uint64_t offset;
+
+		errcode = pt_pkt_get_offset(decoder, &offset);
+		ptu_int_eq(errcode, 0);
+		ptu_uint_eq(offset, wfix->offset[idx]);
+
+		memset(&packet, 0, sizeof(packet));
+
+		errcode = pt_pkt_next(decoder, &packet, sizeof(packet));
+		ptu_int_eq(errcode, wfix->packet[idx].size);
+		ptu_int_eq(memcmp(&packet, &wfix->packet[idx], sizeof(packet)),
+			   0);
+	}
+
+	errcode = pt_pkt_next(decoder, &wfix->packet[0], 0);
+	ptu_int_eq(errcode, -pte_eos);
+
+	pt_pkt_free_decoder(decoder);
+
+	return ptu_passed();
+}
+
+/* Check that we find all PSBs in the segmented trace in both directions. */
+static struct ptunit_result check_sync(struct window_fixture *wfix)
+{
+	struct pt_packet_decoder *decoder;
+	uint64_t offset;
+	int errcode, idx;
+
+	decoder = pt_pkt_alloc_decoder(&wfix->sconfig);
+	ptu_ptr(decoder);
+
+	for (idx = 0; idx < wfix_npsb; ++idx) {
+		errcode = pt_pkt_sync_forward(decoder);
+		ptu_int_eq(errcode, 0);
+
+		errcode = pt_pkt_get_sync_offset(decoder, &offset);
+		ptu_int_eq(errcode, 0);
+		ptu_uint_eq(offset, wfix->psb[idx]);
+	}
+
+	errcode = pt_pkt_sync_forward(decoder);
+	ptu_int_eq(errcode, -pte_eos);
+
+	/* We're still synchronized onto the last PSB. */
+	for (idx = wfix_npsb - 2; 0 <= idx; --idx) {
+		errcode = pt_pkt_sync_backward(decoder);
+		ptu_int_eq(errcode, 0);
+
+		errcode = pt_pkt_get_sync_offset(decoder, &offset);
+		ptu_int_eq(errcode, 0);
+		ptu_uint_eq(offset, wfix->psb[idx]);
+	}
+
+	errcode = pt_pkt_sync_backward(decoder);
+	ptu_int_eq(errcode, -pte_eos);
+
+	pt_pkt_free_decoder(decoder);
+
+	/* An unsynchronized decoder searches backwards from the end. */
+	decoder = pt_pkt_alloc_decoder(&wfix->sconfig);
+	ptu_ptr(decoder);
+
+	for (idx = wfix_npsb - 1; 0 <= idx; --idx) {
+		errcode = pt_pkt_sync_backward(decoder);
+		ptu_int_eq(errcode, 0);
+
+		errcode = pt_pkt_get_sync_offset(decoder, &offset);
+		ptu_int_eq(errcode, 0);
+		ptu_uint_eq(offset, wfix->psb[idx]);
+	}
+
+	for (idx = 0; idx < wfix_npsb; ++idx) {
+		errcode = pt_pkt_sync_set(decoder, wfix->psb[idx]);
+		ptu_int_eq(errcode, 0);
+
+		errcode = pt_pkt_get_offset(decoder, &offset);
+		ptu_int_eq(errcode, 0);
+		ptu_uint_eq(offset, wfix->psb[idx]);
+	}
+
+	pt_pkt_free_decoder(decoder);
+
+	return ptu_passed();
+}
+
+/* Check that a query decoder finds all PSBs and their time. */
+static struct ptunit_result check_query(struct window_fixture *wfix)
+{
+	struct pt_query_decoder *decoder;
+	uint64_t offset, ip;
+	int errcode, idx;
+
+	decoder = pt_qry_alloc_decoder(&wfix->sconfig);
+	ptu_ptr(decoder);
+
+	for (idx = 0; idx < wfix_npsb; ++idx) {
+		uint64_t tsc;
+
+		errcode = pt_qry_sync_forward(decoder, &ip);
+		ptu_int_ge(errcode, 0);
+		ptu_uint_eq(ip, 0x1000ull);
+
+		errcode = pt_qry_get_sync_offset(decoder, &offset);
+		ptu_int_eq(errcode, 0);
+		ptu_uint_eq(offset, wfix->psb[idx]);
+
+		errcode = pt_qry_time(decoder, &tsc, NULL, NULL);
+		ptu_int_eq(errcode, 0);
+		ptu_uint_eq(tsc, 0x1000ull * (idx + 1));
+	}
+
+	errcode = pt_qry_sync_time(decoder, &ip, 0x2fffull);
+	ptu_int_ge(errcode, 0);
+
+	errcode = pt_qry_get_sync_offset(decoder, &offset);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(offset, wfix->psb[1]);
+
+	pt_qry_free_decoder(decoder);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result trace_size(struct window_fixture *wfix)
+{
+	uint64_t split[] = { 0x10, 0x10, 0x20 };
+
+	ptu_uint_eq(pt_win_size(&wfix->config),
+		    (uint64_t) (wfix->config.end - wfix->config.begin));
+
+	ptu_test(wfix_split, wfix, split, 4);
+	ptu_uint_eq(pt_win_size(&wfix->sconfig),
+		    (uint64_t) (wfix->config.end - wfix->config.begin));
+
+	return ptu_passed();
+}
+
+static struct ptunit_result map(struct window_fixture *wfix)
+{
+	struct pt_window win;
+	const uint8_t *pos;
+	uint64_t split[] = { 0x40, 0x50 }, size;
+	int errcode;
+
+	ptu_test(wfix_split, wfix, split, 3);
+
+	size = pt_win_size(&wfix->sconfig);
+
+	errcode = pt_win_init(&win, &wfix->sconfig);
+	ptu_int_eq(errcode, 0);
+	ptu_ptr_eq(wfix->sconfig.begin, wfix->segment[0].begin);
+	ptu_ptr_eq(wfix->sconfig.end, wfix->segment[0].end);
+
+	/* We use the segment as long as we have enough lookahead. */
+	errcode = pt_win_map(&win, &wfix->sconfig, 0x0, &pos);
+	ptu_int_eq(errcode, 0);
+	ptu_ptr_eq(pos, wfix->segment[0].begin);
+	ptu_uint_eq(pt_win_offset(&win, &wfix->sconfig, pos), 0x0);
+
+	/* We go through the bounce buffer close to the segment's end. */
+	errcode = pt_win_map(&win, &wfix->sconfig, 0x3f, &pos);
+	ptu_int_eq(errcode, 0);
+	ptu_ptr_eq(pos, win.bounce);
+	ptu_uint_eq(pt_win_offset(&win, &wfix->sconfig, pos), 0x3f);
+	ptu_uint_eq(*pos, wfix->config.begin[0x3f]);
+	ptu_uint_eq(pos[0x20], wfix->config.begin[0x5f]);
+	ptu_uint_eq((uint64_t) (wfix->sconfig.end - pos),
+		    (uint64_t) pt_win_bounce_size);
+
+	/* We use the last segment up to its end. */
+	errcode = pt_win_map(&win, &wfix->sconfig, size - 1, &pos);
+	ptu_int_eq(errcode, 0);
+	ptu_ptr_eq(pos, wfix->segment[2].end - 1);
+
+	errcode = pt_win_map(&win, &wfix->sconfig, size, &pos);
+	ptu_int_eq(errcode, 0);
+	ptu_uint_eq(pt_win_offset(&win, &wfix->sconfig, pos), size);
+
+	errcode = pt_win_map(&win, &wfix->sconfig, size + 1, &pos);
+	ptu_int_eq(errcode, -pte_invalid);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result ensure(struct window_fixture *wfix)
+{
+	struct pt_window win;
+	const uint8_t *pos;
+	uint64_t split[] = { 0x80 };
+	int errcode;
+
+	ptu_test(wfix_split, wfix, split, 2);
+
+	errcode = pt_win_init(&win, &wfix->sconfig);
+	ptu_int_eq(errcode, 0);
+
+	pos = wfix->segment[0].begin + 0x40;
+
+	errcode = pt_win_ensure(&win, &wfix->sconfig, &pos);
+	ptu_int_eq(errcode, 0);
+	ptu_ptr_eq(pos, wfix->segment[0].begin + 0x40);
+
+	pos += 1;
+
+	errcode = pt_win_ensure(&win, &wfix->sconfig, &pos);
+	ptu_int_eq(errcode, 0);
+	ptu_ptr_eq(pos, win.bounce);
+	ptu_uint_eq(pt_win_offset(&win, &wfix->sconfig, pos), 0x41);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result source(struct window_fixture *wfix)
+{
+	uint32_t window;
+
+	for (window = pt_win_bounce_size; window <= 512; window += 13) {
+		ptu_test(wfix_source, wfix, window);
+		ptu_test(check_packets, wfix);
+		ptu_test(check_sync, wfix);
+		ptu_test(check_query, wfix);
+
+		/* We never read more than a window. */
+		ptu_uint_le(wfix->max_read, window);
+	}
+
+	return ptu_passed();
+}
+
+static struct ptunit_result source_default(struct window_fixture *wfix)
+{
+	ptu_test(wfix_source, wfix, 0);
+	ptu_test(check_packets, wfix);
+	ptu_test(check_sync, wfix);
+	ptu_test(check_query, wfix);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result source_short(struct window_fixture *wfix)
+{
+	wfix->chunk = 7;
+
+	ptu_test(wfix_source, wfix, 200);
+	ptu_test(check_packets, wfix);
+	ptu_test(check_sync, wfix);
+	ptu_test(check_query, wfix);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result source_fail(struct window_fixture *wfix)
+{
+	struct pt_packet_decoder *decoder;
+	struct pt_packet packet;
+	int errcode;
+
+	ptu_test(wfix_source, wfix, pt_win_bounce_size);
+
+	/* We fail to read the first window. */
+	wfix->fail = 0ull;
+
+	decoder = pt_pkt_alloc_decoder(&wfix->sconfig);
+	ptu_null(decoder);
+
+	/* We fail to move the window. */
+	wfix->fail = wfix->psb[1];
+
+	decoder = pt_pkt_alloc_decoder(&wfix->sconfig);
+	ptu_ptr(decoder);
+
+	errcode = pt_pkt_sync_forward(decoder);
+	ptu_int_eq(errcode, 0);
+
+	do {
+		errcode = pt_pkt_next(decoder, &packet, sizeof(packet));
+	} while (errcode >= 0);
+
+	ptu_int_eq(errcode, -pte_nomap);
+
+	pt_pkt_free_decoder(decoder);
+
+	/* The trace is shorter than announced. */
+	wfix->fail = UINT64_MAX;
+	wfix->sconfig.source.size += 1;
+
+	decoder = pt_pkt_alloc_decoder(&wfix->sconfig);
+	ptu_ptr(decoder);
+
+	errcode = pt_pkt_sync_forward(decoder);
+	ptu_int_eq(errcode, 0);
+
+	do {
+		errcode = pt_pkt_next(decoder, &packet, sizeof(packet));
+	} while (errcode >= 0);
+
+	ptu_int_eq(errcode, -pte_eos);
+
+	pt_pkt_free_decoder(decoder);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result source_bad_config(struct window_fixture *wfix)
+{
+	struct pt_packet_decoder *decoder;
+	struct pt_encoder *encoder;
+	int errcode;
+
+	ptu_test(wfix_source, wfix, pt_win_bounce_size - 1);
+
+	/* The window is too small. */
+	decoder = pt_pkt_alloc_decoder(&wfix->sconfig);
+	ptu_null(decoder);
+
+	wfix->sconfig.source.window = pt_win_bounce_size;
+
+	/* We can't encode into a read callback. */
+	encoder = pt_alloc_encoder(&wfix->sconfig);
+	ptu_null(encoder);
+
+	/* We can't extend a trace that is read on demand. */
+	decoder = pt_pkt_alloc_decoder(&wfix->sconfig);
+	ptu_ptr(decoder);
+
+	errcode = pt_pkt_extend(decoder, wfix->buffer + sizeof(wfix->buffer));
+	ptu_int_eq(errcode, -pte_invalid);
+
+	pt_pkt_free_decoder(decoder);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result bad_config(struct window_fixture *wfix)
+{
+	struct pt_packet_decoder *decoder;
+	struct pt_encoder *encoder;
+	uint64_t split[] = { 0x80 };
+	int errcode;
+
+	ptu_test(wfix_split, wfix, split, 2);
+
+	/* We can't encode into segments. */
+	encoder = pt_alloc_encoder(&wfix->sconfig);
+	ptu_null(encoder);
+
+	/* We can't extend a segmented trace. */
+	decoder = pt_pkt_alloc_decoder(&wfix->sconfig);
+	ptu_ptr(decoder);
+
+	errcode = pt_pkt_extend(decoder, wfix->buffer + sizeof(wfix->buffer));
+	ptu_int_eq(errcode, -pte_invalid);
+
+	pt_pkt_free_decoder(decoder);
+
+	/* Each segment needs a buffer. */
+	wfix->segment[1].begin = NULL;
+
+	decoder = pt_pkt_alloc_decoder(&wfix->sconfig);
+	ptu_null(decoder);
+
+	return ptu_passed();
+}
+
+static struct ptunit_result split_2(struct window_fixture *wfix)
+{
+	uint64_t split[1], size;
+
+	size = pt_win_size(&wfix->config);
+
+	for (split[0] = 0; split[0] <= size; ++split[0]) {
+		ptu_test(wfix_split, wfix, split, 2);
+		ptu_test(check_packets, wfix);
+		ptu_test(check_sync, wfix);
+		ptu_test(check_query, wfix);
+	}
+
+	return ptu_passed();
+}
+
+static struct ptunit_result split_4(struct window_fixture *wfix)
+{
+	uint64_t split[3], size;
+
+	size = pt_win_size(&wfix->config);
+
+	/* Split into tiny and empty segments. */
+	for (split[0] = 0; split[0] + 8 <= size; ++split[0]) {
+		split[1] = split[0] + 3;
+		split[2] = split[1] + (split[0] % 6);
+
+		ptu_test(wfix_split, wfix, split, 4);
+		ptu_test(check_packets, wfix);
+		ptu_test(check_sync, wfix);
+		ptu_test(check_query, wfix);
+	}
+
+	return ptu_passed();
+}
+
+int main(int argc, char **argv)
+{
+	struct window_fixture wfix;
+	struct ptunit_suite suite;
+
+	wfix.init = wfix_init;
+	wfix.fini = NULL;
+
+	suite = ptunit_mk_suite(argc, argv);
+
+	ptu_run_f(suite, trace_size, wfix);
+	ptu_run_f(suite, map, wfix);
+	ptu_run_f(suite, ensure, wfix);
+	ptu_run_f(suite, bad_config, wfix);
+	ptu_run_f(suite, split_2, wfix);
+	ptu_run_f(suite, split_4, wfix);
+	ptu_run_f(suite, source, wfix);
+	ptu_run_f(suite, source_default, wfix);
+	ptu_run_f(suite, source_short, wfix);
+	ptu_run_f(suite, source_fail, wfix);
+	ptu_run_f(suite, source_bad_config, wfix);
+
+	ptunit_report(&suite);
+	return suite.nr_fails;
+}